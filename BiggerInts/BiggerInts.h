@@ -0,0 +1,33 @@
+#ifndef BIGGERINTS_STUB_H
+#define BIGGERINTS_STUB_H
+#include <cstdint>
+#include <utility>
+namespace BiggerInts {
+	template<int N> struct uint_t;
+	template<int N> struct int_t;
+	template<> struct uint_t<128> {
+		std::uint64_t low = 0, high = 0;
+		uint_t() = default;
+		uint_t(unsigned __int128 v) : low((std::uint64_t)v), high((std::uint64_t)(v >> 64)) {}
+		template<typename T, typename = std::enable_if_t<std::is_integral<T>::value>> explicit uint_t(T v) : uint_t((unsigned __int128)v) {}
+		unsigned __int128 v() const { return ((unsigned __int128)high << 64) | low; }
+		template<typename T, typename = std::enable_if_t<std::is_integral<T>::value>> explicit operator T() const { return (T)v(); }
+		friend uint_t operator*(uint_t a, uint_t b) { return uint_t(a.v() * b.v()); }
+		friend bool operator!=(uint_t a, uint_t b) { return a.v() != b.v(); }
+		friend bool operator!=(uint_t a, std::uint64_t b) { return a.v() != b; }
+	};
+	template<> struct int_t<128> {
+		std::uint64_t low = 0, high = 0;
+		int_t() = default;
+		int_t(__int128 v) : low((std::uint64_t)v), high((std::uint64_t)((unsigned __int128)v >> 64)) {}
+		template<typename T, typename = std::enable_if_t<std::is_integral<T>::value>> explicit int_t(T v) : int_t((__int128)v) {}
+		__int128 v() const { return (__int128)(((unsigned __int128)high << 64) | low); }
+		template<typename T, typename = std::enable_if_t<std::is_integral<T>::value>> explicit operator T() const { return (T)v(); }
+		friend int_t operator*(int_t a, int_t b) { return int_t((__int128)((unsigned __int128)a.v() * (unsigned __int128)b.v())); }
+		friend bool operator!=(int_t a, int_t b) { return a.v() != b.v(); }
+		friend bool operator!=(int_t a, std::int64_t b) { return a.v() != b; }
+	};
+	inline std::pair<uint_t<128>, uint_t<128>> divmod(uint_t<128> a, uint_t<128> b) { return { uint_t<128>(a.v() / b.v()), uint_t<128>(a.v() % b.v()) }; }
+	inline std::pair<int_t<128>, int_t<128>> divmod(int_t<128> a, int_t<128> b) { return { int_t<128>(a.v() / b.v()), int_t<128>(a.v() % b.v()) }; }
+}
+#endif
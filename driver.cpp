@@ -7,11 +7,18 @@
 #include <cstdlib>
 #include <chrono>
 #include <unordered_map>
+#include <map>
+#include <sstream>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
 #include <experimental/filesystem>
 
 #include "include/CoreTypes.h"
 #include "include/Computer.h"
 #include "include/Assembly.h"
+#include "include/Batch.h"
 #include "include/Utility.h"
 
 using namespace CSX64;
@@ -28,6 +35,8 @@ enum class ProgramAction
 
 	Assemble, // assembles 1+ csx64 assembly files into csx64 object files
 	Link,     // links 1+ csx64 object files into a csx64 executable
+
+	DecodeTrace, // takes 1 csx64 execution trace (+ optionally the executable it came from) -- writes it as text
 };
 
 // An extension of assembly and link error codes for use specifically in
@@ -55,6 +64,9 @@ enum class AsmLnkErrorExt
 // on failure, returns null.
 const char *exe_dir();
 
+// returns an id for this process that is unique among those currently running (or 0 if not supported).
+unsigned long long process_id();
+
 // ---------------------------------
 
 // converts time in nanoseconds to a more convenient human form
@@ -92,16 +104,27 @@ Assemble, link, or execute CSX64 files.
   -l, --link                link CSX64 asm/obj files into a CSX64 executable
   -s, --script              assemble, link, and execute a CSX64 asm/obj file in memory
   -S, --multiscript         as --script, but takes multiple CSX64 asm/obj files
+      --decode-trace        write a trace saved by --trace as text (to stdout or --out) - if the executable is given after it, its symbol map annotates the addresses
   otherwise                 execute a CSX64 executable with provided args
 
   -o, --out <path>          specify an explicit output path
       --entry <entry>       main entry point for linker
+      --map                 also write a symbol map for the executable to <output>.map (used by --profile)
+      --gc                  leave out segments of linked files that the program never references
       --rootdir <dir>       specify an explicit rootdir (contains _start.o and stdlib/*.o)
+      --cache <dir>         reuse previously assembled objects from a cache directory when linking (added on a miss)
 
       --fs                  sets the file system flag during execution
+      --jit                 compile hot code to native code during execution (x86-64 linux only)
   -u, --unsafe              sets all unsafe flags during execution (those in this section)
 
   -t, --time                after execution display elapsed time
+      --profile <path>      write an execution profile (per-address counts, opcode costs, call graph) to a file
+      --trace <path>        record recently executed instructions and save them to a file if execution fails
+      --trace-mem           also record the effective address of each memory operand in the trace
+
+      --batch               execute each input (or each "input args..." line of an @file) in parallel
+      --threads <n>         number of worker threads for --batch and for assembling and linking (default one per hardware thread)
       --                    remaining args are not csx64 options (added to arg list)
 
 Report bugs to: https://github.com/dragazo/CSX64-cpp/issues
@@ -197,13 +220,14 @@ int SaveExecutable(const std::string &path, const Executable &exe)
 	}
 }
 // Loads a csx64 executable from a file (no format checking).
+// the content is mapped (see Executable::map) so that instances share it rather than each holding a copy.
 // path - the file to read.
 // exe  - the resulting csx64 executable (on success).
 int LoadExecutable(const std::string &path, Executable &exe)
 {
 	try
 	{
-		exe.load(path);
+		exe.map(path);
 		return 0;
 	}
 	catch (const FileOpenError&)
@@ -233,6 +257,28 @@ int LoadExecutable(const std::string &path, Executable &exe)
 	}
 }
 
+// Saves a symbol map to a file.
+// path    - the file to save to.
+// symbols - the symbol map to save.
+int SaveSymbolMap(const std::string &path, const SymbolMap &symbols)
+{
+	try
+	{
+		symbols.save(path);
+		return 0;
+	}
+	catch (const FileOpenError&)
+	{
+		std::cerr << "Failed to open " << path << " for writing\n";
+		return (int)AsmLnkErrorExt::FailOpen;
+	}
+	catch (const IOError&)
+	{
+		std::cerr << "An IO error occurred while saving symbol map to " << path << '\n';
+		return (int)AsmLnkErrorExt::IOError;
+	}
+}
+
 // -------------------- //
 
 // -- object file io -- //
@@ -242,7 +288,8 @@ int LoadExecutable(const std::string &path, Executable &exe)
 // Saves an object file to a file.
 // path - the destination file to save to.
 // obj  - the object file to save.
-int SaveObjectFile(const std::string &path, const ObjectFile &obj)
+// log  - the stream to write error messages to.
+int SaveObjectFile(const std::string &path, const ObjectFile &obj, std::ostream &log = std::cerr)
 {
 	try
 	{
@@ -251,19 +298,20 @@ int SaveObjectFile(const std::string &path, const ObjectFile &obj)
 	}
 	catch (const FileOpenError&)
 	{
-		std::cerr << "Failed to open " << path << " for writing\n";
+		log << "Failed to open " << path << " for writing\n";
 		return (int)AsmLnkErrorExt::FailOpen;
 	}
 	catch (const IOError&)
 	{
-		std::cerr << "An IO error occurred while saving object file to " << path << '\n';
+		log << "An IO error occurred while saving object file to " << path << '\n';
 		return (int)AsmLnkErrorExt::IOError;
 	}
 }
 // Loads an object file from a file.
 // path - the source file to read from.
 // obj  - the resulting object file (on success).
-int LoadObjectFile(const std::string &path, ObjectFile &obj)
+// log  - the stream to write error messages to.
+int LoadObjectFile(const std::string &path, ObjectFile &obj, std::ostream &log = std::cerr)
 {
 	try
 	{
@@ -272,27 +320,27 @@ int LoadObjectFile(const std::string &path, ObjectFile &obj)
 	}
 	catch (const FileOpenError&)
 	{
-		std::cerr << "Failed to open " << path << " for reading\n";
+		log << "Failed to open " << path << " for reading\n";
 		return (int)AsmLnkErrorExt::FailOpen;
 	}
 	catch (const TypeError&)
 	{
-		std::cerr << path << " is not a CSX64 object file\n";
+		log << path << " is not a CSX64 object file\n";
 		return (int)AsmLnkErrorExt::FormatError;
 	}
 	catch (const VersionError&)
 	{
-		std::cerr << "Object file " << path << " is of an incompatible version of CSX64\n";
+		log << "Object file " << path << " is of an incompatible version of CSX64\n";
 		return (int)AsmLnkErrorExt::FormatError;
 	}
 	catch (const FormatError&)
 	{
-		std::cerr << "Object file " << path << " is of an unrecognized format\n";
+		log << "Object file " << path << " is of an unrecognized format\n";
 		return (int)AsmLnkErrorExt::FormatError;
 	}
 	catch (const std::bad_alloc&)
 	{
-		std::cerr << "Failed to allocate space for object file\n";
+		log << "Failed to allocate space for object file\n";
 		return (int)AsmLnkErrorExt::MemoryAllocError;
 	}
 }
@@ -331,27 +379,130 @@ int LoadObjectFileDir(std::list<std::pair<std::string, ObjectFile>> &objs, const
 
 // -------------- //
 
-// assembles assembly source code from a file (file) into an object file (dest).
-// file - the assembly source file.
-// dest - the resulting object file (on success).
-int Assemble(const std::string &file, ObjectFile &dest)
+// runs job(i, log) for each i in [0, count) on a pool of worker threads (see ParallelFor), where log receives the job's error messages.
+// the messages are then printed in order up to the first job that failed (nonzero result), as if the jobs had been run in sequence.
+// jobs after one that has already failed are skipped. returns the result of the first job that failed (zero if none).
+// if a job throws, the exception is rethrown on the calling thread (see ParallelFor).
+// threads - the number of worker threads (0 for one per hardware thread).
+int RunParallel(std::size_t count, unsigned threads, const std::function<int(std::size_t, std::ostream&)> &job)
 {
-	// open the file for reading - make sure it succeeds
-	std::ifstream source(file);
-	if (!source) { std::cerr << "Failed to open " << file << " for reading\n"; return (int)AsmLnkErrorExt::FailOpen; }
+	std::vector<int> results(count);
+	std::vector<std::ostringstream> logs(count);
+	std::atomic<std::size_t> first_failure(count);
+
+	ParallelFor(count, threads, [&](std::size_t i)
+	{
+		if (i > first_failure) return;
 
+		results[i] = job(i, logs[i]);
+		if (results[i] != 0)
+		{
+			for (std::size_t f = first_failure; i < f && !first_failure.compare_exchange_weak(f, i); ) {}
+		}
+	});
+
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		std::cerr << logs[i].str();
+		if (results[i] != 0) return results[i];
+	}
+	return 0;
+}
+
+// assembles assembly source code from a stream (source) into an object file (dest).
+// file   - the name of the source (for error messages).
+// source - the assembly source code.
+// dest   - the resulting object file (on success).
+// log    - the stream to write error messages to.
+int Assemble(const std::string &file, std::istream &source, ObjectFile &dest, std::ostream &log = std::cerr)
+{
 	// assemble the source
 	AssembleResult res = CSX64::Assemble(source, dest);
 
 	// if there was an error, show error message
 	if (res.Error != AssembleError::None)
 	{
-		std::cerr << "Assemble Error in " << file << ":\n" << res.ErrorMsg << '\n';
+		log << "Assemble Error in " << file << ":\n" << res.ErrorMsg << '\n';
 		return (int)res.Error;
 	}
 
 	return 0;
 }
+// assembles assembly source code from a file (file) into an object file (dest).
+// file - the assembly source file.
+// dest - the resulting object file (on success).
+// log  - the stream to write error messages to.
+int Assemble(const std::string &file, ObjectFile &dest, std::ostream &log = std::cerr)
+{
+	// open the file for reading - make sure it succeeds
+	std::ifstream source(file);
+	if (!source) { log << "Failed to open " << file << " for reading\n"; return (int)AsmLnkErrorExt::FailOpen; }
+
+	return Assemble(file, source, dest, log);
+}
+// as Assemble, but first looks for the result in an object cache directory (cache), and adds it to the cache on a miss.
+// entries are named by a hash of everything that determines the result: the source, the CSX64 version, and the predefined symbols.
+// each entry starts with that key material (the source itself included), which must match exactly for it to be used - so a hash collision is just a miss.
+// the cache is best effort - an entry that can't be read or written just falls back to assembling.
+// file  - the assembly source file.
+// dest  - the resulting object file (on success).
+// cache - the cache directory (created if it doesn't exist).
+// log   - the stream to write error messages to.
+int AssembleCached(const std::string &file, ObjectFile &dest, const std::string &cache, std::ostream &log = std::cerr)
+{
+	// read the whole source (it's needed for the key anyway)
+	std::ifstream source(file);
+	if (!source) { log << "Failed to open " << file << " for reading\n"; return (int)AsmLnkErrorExt::FailOpen; }
+	std::ostringstream content;
+	content << source.rdbuf();
+	const std::string code = content.str();
+
+	// the key material: versions, predefines and the source (length first so it can be compared before reading it)
+	std::ostringstream key_stream;
+	BinWrite(key_stream, Version);
+	BinWrite(key_stream, ObjectFileVersion);
+	BinWrite(key_stream, PredefinedSymbolsHash());
+	BinWrite<u64>(key_stream, code.size());
+	BinWrite(key_stream, code.data(), code.size());
+	const std::string key = key_stream.str();
+
+	const std::string path = cache + "/" + tohex(HashBytes(key.data(), key.size())) + ".o";
+	std::error_code err;
+
+	// if it's cached (and really is this source), we're done
+	if (fs::exists(path, err))
+	{
+		try
+		{
+			std::ifstream entry(path, std::ios::binary);
+			std::string entry_key(key.size(), '\0');
+			if (BinRead(entry, &entry_key[0], entry_key.size()) && entry_key == key) { dest.load(entry); return 0; }
+		}
+		catch (const std::exception&) {}
+	}
+
+	std::istringstream code_stream(code);
+	int ret = Assemble(file, code_stream, dest, log);
+	if (ret != 0) return ret;
+
+	// save to a uniquely-named temp file (by process and thread) and rename it into place so concurrent builds never see a partial entry
+	const std::string temp = path + ".tmp" + tohex((u64)process_id()) + "-" + tohex(std::hash<std::thread::id>()(std::this_thread::get_id()));
+	try
+	{
+		fs::create_directories(cache, err);
+		{
+			std::ofstream entry(temp, std::ios::binary);
+			if (!entry) throw FileOpenError("Failed to open file for saving cache entry");
+			BinWrite(entry, key.data(), key.size());
+			dest.save(entry);
+		}
+		fs::rename(temp, path, err);
+		if (err) fs::remove(temp, err);
+	}
+	catch (const std::exception&) { fs::remove(temp, err); }
+
+	return 0;
+}
 
 // ------------- //
 
@@ -395,7 +546,11 @@ int LoadStdlibObjs(std::list<std::pair<std::string, ObjectFile>> &objs, const ch
 // files       - the files to link. ".o" files are loaded as object files, otherwise treated as assembly source and assembled.
 // entry_point - the main entry point.
 // rootdir     - the root directory to use for core file lookup - null for default.
-int Link(Executable &dest, const std::vector<std::string> &files, const std::string &entry_point, const char *rootdir)
+// symbols     - if non-null, receives the symbol map of the executable (on success).
+// cache       - if non-null, the object cache directory to use for assembly sources (see AssembleCached).
+// threads     - the number of threads to assemble and link with (see RunParallel).
+// gc          - if true, segments that are never referenced are left out of the executable.
+int Link(Executable &dest, const std::vector<std::string> &files, const std::string &entry_point, const char *rootdir, SymbolMap *symbols = nullptr, const char *cache = nullptr, unsigned threads = 1, bool gc = false)
 {
 	std::list<std::pair<std::string, ObjectFile>> objs;
 
@@ -403,18 +558,25 @@ int Link(Executable &dest, const std::vector<std::string> &files, const std::str
 	int ret = LoadStdlibObjs(objs, rootdir);
 	if (ret != 0) return ret;
 
-	// load the provided files
+	// load the provided files (in parallel, but kept in order)
+	std::vector<std::pair<std::string, ObjectFile>*> inputs;
 	for (const std::string &file : files)
 	{
-		// treat ".o" as object file, otherwise as assembly source
 		auto &obj = objs.emplace_back();
 		obj.first = file;
-		ret = EndsWith(file, ".o") ? LoadObjectFile(file, obj.second) : Assemble(file, obj.second);
-		if (ret != 0) return ret;
+		inputs.push_back(&obj);
 	}
+	ret = RunParallel(inputs.size(), threads, [&](std::size_t i, std::ostream &log)
+	{
+		// treat ".o" as object file, otherwise as assembly source
+		const std::string &file = inputs[i]->first;
+		ObjectFile &obj = inputs[i]->second;
+		return EndsWith(file, ".o") ? LoadObjectFile(file, obj, log) : cache ? AssembleCached(file, obj, cache, log) : Assemble(file, obj, log);
+	});
+	if (ret != 0) return ret;
 
 	// link the resulting object files into an executable
-	LinkResult res = CSX64::Link(dest, objs, entry_point);
+	LinkResult res = CSX64::Link(dest, objs, entry_point, symbols, threads, gc);
 
 	// if there was an error, show error message
 	if (res.Error != LinkError::None)
@@ -437,7 +599,12 @@ int Link(Executable &dest, const std::vector<std::string> &files, const std::str
 // args - command line args for the client program.
 // fsf  - value of FSF (file system flag) during client program execution.
 // time - marks if the execution time should be measured.
-int RunConsole(const Executable &exe, const std::vector<std::string> &args, bool fsf, bool time)
+// jit  - marks if hot code should be compiled to native code.
+// profile - if non-null, the path to write the execution profile to (see Computer::Profiling).
+// symbols - if non-null, the symbol map used to annotate the profile.
+// trace - if non-null, the path to save the execution trace to if execution fails (see Computer::Tracing).
+// trace_mem - marks if the trace should include effective addresses.
+int RunConsole(const Executable &exe, const std::vector<std::string> &args, bool fsf, bool time, bool jit, const char *profile, const SymbolMap *symbols, const char *trace, bool trace_mem)
 {
 	// create the computer
 	Computer computer;
@@ -464,8 +631,14 @@ int RunConsole(const Executable &exe, const std::vector<std::string> &args, bool
 	// set private flags
 	computer.FSF() = fsf;
 
-	// this usage is just going for raw speed, so enable OTRF
+	// this usage is just going for raw speed, so enable OTRF, block execution, and lazy flags
 	computer.OTRF() = true;
+	computer.BlockExecution(true);
+	computer.LazyFlags(true);
+	computer.JitCompilation(jit);
+	computer.Profiling(profile != nullptr);
+	computer.Tracing(trace != nullptr, trace_mem);
+	if (trace) computer.TraceDump(trace);
 
 	// tie standard streams - stdin is non-interactive because we don't control it
 	computer.OpenFileWrapper(0, std::make_unique<TerminalInputFileWrapper>(&std::cin, false, false));
@@ -477,10 +650,18 @@ int RunConsole(const Executable &exe, const std::vector<std::string> &args, bool
 	while (computer.Running()) computer.Tick(~(u64)0);
 	auto stop = std::chrono::high_resolution_clock::now();
 
+	// write the profile regardless of how execution ended
+	if (profile)
+	{
+		std::ofstream file(profile);
+		if (!file || !computer.Profile()->Write(file, symbols)) std::cerr << "Failed to write profile to " << profile << '\n';
+	}
+
 	// if there was an error
 	if (computer.Error() != ErrorCode::None)
 	{
 		std::cerr << "\n\nError Encountered: (" << (int)computer.Error() << ") " << ErrorCodeToString.at(computer.Error()) << '\n';
+		if (trace) std::cerr << "Execution trace saved to " << trace << " (see --decode-trace)\n";
 		return ExecErrorReturnCode;
 	}
 	// otherwise no error
@@ -491,6 +672,128 @@ int RunConsole(const Executable &exe, const std::vector<std::string> &args, bool
 	}
 }
 
+// Writes an execution trace saved by RunConsole as text (see Tracer::Write).
+// path    - the trace file to read.
+// symbols - if non-null, the symbol map used to annotate the instruction addresses.
+// output  - if non-null, the path to write to (otherwise stdout).
+int DecodeTrace(const std::string &path, const SymbolMap *symbols, const char *output)
+{
+	std::ifstream trace(path, std::ios::binary);
+	if (!trace) { std::cerr << "Failed to open " << path << " for reading\n"; return (int)AsmLnkErrorExt::FailOpen; }
+
+	std::vector<Tracer::Entry> entries;
+	try
+	{
+		entries = Tracer::Decode(Tracer::Load(trace));
+	}
+	catch (const TypeError&)
+	{
+		std::cerr << path << " is not a CSX64 trace\n";
+		return (int)AsmLnkErrorExt::FormatError;
+	}
+	catch (const VersionError&)
+	{
+		std::cerr << "Trace " << path << " is of an incompatible version of CSX64\n";
+		return (int)AsmLnkErrorExt::FormatError;
+	}
+	catch (const FormatError&)
+	{
+		std::cerr << "Trace " << path << " is corrupted\n";
+		return (int)AsmLnkErrorExt::FormatError;
+	}
+
+	if (!output) return Tracer::Write(std::cout, entries, symbols) ? 0 : (int)AsmLnkErrorExt::IOError;
+
+	std::ofstream file(output);
+	if (!file) { std::cerr << "Failed to open " << output << " for writing\n"; return (int)AsmLnkErrorExt::FailOpen; }
+	if (!Tracer::Write(file, entries, symbols)) { std::cerr << "An IO error occurred while writing trace to " << output << '\n'; return (int)AsmLnkErrorExt::IOError; }
+	return 0;
+}
+
+// parses the batch inputs - each pathspec is an input path, except for @file, which holds one command line (input path + args) per line.
+// blank lines and lines starting with # in an @file are ignored. returns true on success.
+bool ParseBatchCommands(const std::vector<std::string> &pathspec, std::vector<std::vector<std::string>> &commands)
+{
+	for (const std::string &spec : pathspec)
+	{
+		if (spec.empty() || spec[0] != '@') { commands.push_back({ spec }); continue; }
+
+		std::ifstream file(spec.substr(1));
+		if (!file) { std::cerr << "Failed to open batch file " << spec.substr(1) << '\n'; return false; }
+
+		for (std::string line; std::getline(file, line); )
+		{
+			std::istringstream words(line);
+			std::vector<std::string> command;
+			for (std::string word; words >> word; ) command.push_back(std::move(word));
+
+			if (!command.empty() && command[0][0] != '#') commands.push_back(std::move(command));
+		}
+	}
+	return true;
+}
+
+// runs each command (input path + args) as a separate instance (see RunBatch) and prints the results.
+// load is used to get the executable for an input path - each distinct path is only loaded once and the image is shared.
+// fsf  - value of FSF (file system flag) during client program execution.
+// jit  - marks if hot code should be compiled to native code.
+// returns 0 if every instance succeeded, otherwise ExecErrorReturnCode (or the first load error).
+template<typename Loader>
+int RunBatchConsole(const std::vector<std::vector<std::string>> &commands, Loader load, bool fsf, bool jit, unsigned threads)
+{
+	// load each distinct executable (std::map doesn't move its elements, so the jobs can point into it)
+	std::map<std::string, Executable> exes;
+	std::vector<BatchJob> jobs(commands.size());
+	for (std::size_t i = 0; i < commands.size(); ++i)
+	{
+		auto it = exes.find(commands[i][0]);
+		if (it == exes.end())
+		{
+			it = exes.emplace(commands[i][0], Executable()).first;
+			int res = load(it->first, it->second);
+			if (res != 0) return res;
+		}
+
+		jobs[i].exe = &it->second;
+		jobs[i].args = commands[i];
+	}
+
+	BatchOptions options;
+	options.threads = threads;
+	options.fsf = fsf;
+	options.jit = jit;
+
+	auto start = std::chrono::high_resolution_clock::now();
+	std::vector<BatchResult> results = RunBatch(jobs, options);
+	auto stop = std::chrono::high_resolution_clock::now();
+
+	// print each instance's output in order
+	for (const BatchResult &result : results)
+	{
+		std::cout << result.output;
+		std::cerr << result.errors;
+	}
+	std::cout.flush();
+
+	// then the summary
+	std::size_t failed = 0;
+	std::cerr << '\n';
+	for (std::size_t i = 0; i < results.size(); ++i)
+	{
+		const BatchResult &result = results[i];
+		std::cerr << '[' << i << "] " << commands[i][0] << ": ";
+
+		if (!result.initialized) std::cerr << "Initialization Failed: " << result.init_error << '\n';
+		else if (result.error != ErrorCode::None) std::cerr << "Error Encountered: (" << (int)result.error << ") " << ErrorCodeToString.at(result.error) << " (" << FormatTime(result.ns) << ")\n";
+		else std::cerr << "returned " << result.return_value << " (" << FormatTime(result.ns) << ")\n";
+
+		if (!result.ok()) ++failed;
+	}
+	std::cerr << results.size() - failed << '/' << results.size() << " succeeded - Elapsed Time: " << FormatTime(std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count()) << '\n';
+
+	return failed == 0 ? 0 : ExecErrorReturnCode;
+}
+
 // -------------------------- //
 
 // -- cmd line arg parsing -- //
@@ -507,6 +810,15 @@ struct cmdln_pack
 	const char *rootdir = nullptr;                        // root directory to use for std lookup
 	bool fsf = false;                                     // fsf flag
 	bool time = false;                                    // time flag
+	bool jit = false;                                     // native compilation flag
+	const char *profile = nullptr;                        // profile output path
+	const char *trace = nullptr;                          // trace output path
+	bool trace_mem = false;                               // trace effective addresses flag
+	bool map = false;                                     // symbol map flag
+	bool gc = false;                                      // linker segment gc flag
+	const char *cache = nullptr;                          // object cache directory
+	bool batch = false;                                   // batch execution flag
+	unsigned threads = 0;                                 // batch worker threads (0 for default)
 	bool accepting_options = true;                        // marks that we're still accepting options
 
 	// these are parsing helpers - ignore
@@ -549,6 +861,13 @@ bool _multiscript(cmdln_pack &p)
 	p.action = ProgramAction::ExecuteConsoleMultiscript;
 	return true;
 }
+bool _decode_trace(cmdln_pack &p)
+{
+	if (p.action != ProgramAction::ExecuteConsole) { std::cerr << p.argv[p.i] << ": Already specified mode\n"; return false; }
+
+	p.action = ProgramAction::DecodeTrace;
+	return true;
+}
 
 bool _out(cmdln_pack &p)
 {
@@ -574,9 +893,49 @@ bool _rootdir(cmdln_pack &p)
 	p.rootdir = p.argv[++p.i];
 	return true;
 }
+bool _cache(cmdln_pack &p)
+{
+	if (p.cache != nullptr) { std::cerr << p.argv[p.i] << ": Already specified cache directory\n"; return false; }
+	if (p.i + 1 >= p.argc) { std::cerr << p.argv[p.i] << ": Expected cache directory\n"; return false; }
+
+	p.cache = p.argv[++p.i];
+	return true;
+}
 
 bool _fs(cmdln_pack &p) { p.fsf = true; return true; }
 bool _time(cmdln_pack &p) { p.time = true; return true; }
+bool _jit(cmdln_pack &p) { p.jit = true; return true; }
+bool _batch(cmdln_pack &p) { p.batch = true; return true; }
+bool _map(cmdln_pack &p) { p.map = true; return true; }
+bool _gc(cmdln_pack &p) { p.gc = true; return true; }
+bool _profile(cmdln_pack &p)
+{
+	if (p.profile != nullptr) { std::cerr << p.argv[p.i] << ": Already specified profile path\n"; return false; }
+	if (p.i + 1 >= p.argc) { std::cerr << p.argv[p.i] << ": Expected profile path\n"; return false; }
+
+	p.profile = p.argv[++p.i];
+	return true;
+}
+bool _trace(cmdln_pack &p)
+{
+	if (p.trace != nullptr) { std::cerr << p.argv[p.i] << ": Already specified trace path\n"; return false; }
+	if (p.i + 1 >= p.argc) { std::cerr << p.argv[p.i] << ": Expected trace path\n"; return false; }
+
+	p.trace = p.argv[++p.i];
+	return true;
+}
+bool _trace_mem(cmdln_pack &p) { p.trace_mem = true; return true; }
+bool _threads(cmdln_pack &p)
+{
+	if (p.threads != 0) { std::cerr << p.argv[p.i] << ": Already specified thread count\n"; return false; }
+	if (p.i + 1 >= p.argc) { std::cerr << p.argv[p.i] << ": Expected thread count\n"; return false; }
+
+	int n = std::atoi(p.argv[++p.i]);
+	if (n <= 0) { std::cerr << p.argv[p.i - 1] << ": Thread count must be positive\n"; return false; }
+
+	p.threads = (unsigned)n;
+	return true;
+}
 bool _end(cmdln_pack &p) { p.accepting_options = false; return true; }
 bool _unsafe(cmdln_pack &p) { p.fsf = true; return true; }
 
@@ -589,15 +948,25 @@ const std::unordered_map<std::string, bool(*)(cmdln_pack&)> long_names
 { "--link", _link },
 { "--script", _script },
 { "--multiscript", _multiscript },
+{ "--decode-trace", _decode_trace },
 
 { "--output", _out },
 { "--entry", _entry },
+{ "--map", _map },
+{ "--gc", _gc },
 { "--rootdir", _rootdir },
+{ "--cache", _cache },
 
 { "--fs", _fs },
+{ "--jit", _jit },
+{ "--batch", _batch },
+{ "--threads", _threads },
 { "--unsafe", _unsafe },
 
 { "--time", _time },
+{ "--profile", _profile },
+{ "--trace", _trace },
+{ "--trace-mem", _trace_mem },
 { "--", _end },
 };
 // maps (short) options to their parsing handlers
@@ -694,10 +1063,27 @@ int main(int argc, char *argv[]) try
 	{
 		if (dat.pathspec.empty()) { std::cerr << "Expected a file to execute\n"; return 0; }
 
+		if (dat.batch)
+		{
+			std::vector<std::vector<std::string>> commands;
+			if (!ParseBatchCommands(dat.pathspec, commands)) return (int)AsmLnkErrorExt::FailOpen;
+			return RunBatchConsole(commands, LoadExecutable, dat.fsf, dat.jit, dat.threads);
+		}
+
 		Executable exe;
 		
 		int res = LoadExecutable(dat.pathspec[0], exe);
-		return res != 0 ? res : RunConsole(exe, dat.pathspec, dat.fsf, dat.time);
+		if (res != 0) return res;
+
+		// if profiling, annotate it with the executable's symbol map (if it has one)
+		SymbolMap symbols;
+		if (dat.profile && fs::exists(dat.pathspec[0] + ".map"))
+		{
+			try { symbols.load(dat.pathspec[0] + ".map"); }
+			catch (const std::exception &ex) { std::cerr << "Failed to load symbol map: " << ex.what() << '\n'; }
+		}
+
+		return RunConsole(exe, dat.pathspec, dat.fsf, dat.time, dat.jit, dat.profile, symbols.empty() ? nullptr : &symbols, dat.trace, dat.trace_mem);
 	}
 
 	case ProgramAction::ExecuteConsoleScript:
@@ -706,10 +1092,22 @@ int main(int argc, char *argv[]) try
 		if (dat.pathspec.empty()) { std::cerr << "Expected a file to assemble, link, and execute\n"; return 0; }
 
 		AddPredefines();
+
+		if (dat.batch)
+		{
+			std::vector<std::vector<std::string>> commands;
+			if (!ParseBatchCommands(dat.pathspec, commands)) return (int)AsmLnkErrorExt::FailOpen;
+			return RunBatchConsole(commands, [&](const std::string &path, Executable &exe)
+			{
+				return Link(exe, { path }, dat.entry_point ? dat.entry_point : "main", dat.rootdir, nullptr, dat.cache, 1, dat.gc);
+			}, dat.fsf, dat.jit, dat.threads);
+		}
+
 		Executable exe;
+		SymbolMap symbols;
 		
-		int res = Link(exe, { dat.pathspec[0] }, dat.entry_point ? dat.entry_point : "main", dat.rootdir);
-		return res != 0 ? res : RunConsole(exe, dat.pathspec, dat.fsf, dat.time);
+		int res = Link(exe, { dat.pathspec[0] }, dat.entry_point ? dat.entry_point : "main", dat.rootdir, dat.profile ? &symbols : nullptr, dat.cache, dat.threads, dat.gc);
+		return res != 0 ? res : RunConsole(exe, dat.pathspec, dat.fsf, dat.time, dat.jit, dat.profile, dat.profile ? &symbols : nullptr, dat.trace, dat.trace_mem);
 	}
 
 	case ProgramAction::ExecuteConsoleMultiscript:
@@ -719,9 +1117,10 @@ int main(int argc, char *argv[]) try
 
 		AddPredefines();
 		Executable exe;
+		SymbolMap symbols;
 		
-		int res = Link(exe, dat.pathspec, dat.entry_point ? dat.entry_point : "main", dat.rootdir);
-		return res != 0 ? res : RunConsole(exe, { "<script>" }, dat.fsf, dat.time);
+		int res = Link(exe, dat.pathspec, dat.entry_point ? dat.entry_point : "main", dat.rootdir, dat.profile ? &symbols : nullptr, dat.cache, dat.threads, dat.gc);
+		return res != 0 ? res : RunConsole(exe, { "<script>" }, dat.fsf, dat.time, dat.jit, dat.profile, dat.profile ? &symbols : nullptr, dat.trace, dat.trace_mem);
 	}
 
 	case ProgramAction::Assemble:
@@ -730,29 +1129,27 @@ int main(int argc, char *argv[]) try
 		if (dat.pathspec.empty()) { std::cerr << "Expected 1+ files to assemble\n"; return 0; }
 
 		AddPredefines();
-		ObjectFile obj;
 
-		// if no explicit output is provided, batch process each pathspec
+		// if no explicit output is provided, batch process each pathspec (each file is independent, so they're done in parallel)
 		if (dat.output == nullptr)
 		{
-			for (const std::string &path : dat.pathspec)
+			return RunParallel(dat.pathspec.size(), dat.threads, [&](std::size_t i, std::ostream &log)
 			{
+				const std::string &path = dat.pathspec[i];
 				fs::path dest(path);
 				dest.replace_extension(".o");
 
-				int res = Assemble(path, obj);
-				if (res != 0) return res;
-
-				res = SaveObjectFile(dest.string(), obj);
-				if (res != 0) return res;
-			}
-			return 0;
+				ObjectFile obj;
+				int res = Assemble(path, obj, log);
+				return res != 0 ? res : SaveObjectFile(dest.string(), obj, log);
+			});
 		}
 		// otherwise, we're expecting only one input with a named output
 		else
 		{
 			if (dat.pathspec.size() != 1) { std::cerr << "Assembler with an explicit output expected only one input\n"; return 0; }
 
+			ObjectFile obj;
 			int res = Assemble(dat.pathspec[0], obj);
 			return res != 0 ? res : SaveObjectFile(dat.output, obj);
 		}
@@ -765,9 +1162,32 @@ int main(int argc, char *argv[]) try
 
 		AddPredefines();
 		Executable exe;
+		SymbolMap symbols;
+		const std::string output = dat.output ? dat.output : "a.out";
+
+		int res = Link(exe, dat.pathspec, dat.entry_point ? dat.entry_point : "main", dat.rootdir, dat.map ? &symbols : nullptr, dat.cache, dat.threads, dat.gc);
+		if (res == 0) res = SaveExecutable(output, exe);
+		if (res == 0 && dat.map) res = SaveSymbolMap(output + ".map", symbols);
+		return res;
+	}
+
+	case ProgramAction::DecodeTrace:
+
+	{
+		if (dat.pathspec.empty() || dat.pathspec.size() > 2) { std::cerr << "Expected a trace file (and optionally the executable it came from)\n"; return 0; }
+
+		// annotate the trace with the executable's symbol map (see --map)
+		SymbolMap symbols;
+		if (dat.pathspec.size() == 2)
+		{
+			const std::string map = dat.pathspec[1] + ".map";
+			if (!fs::exists(map)) { std::cerr << "No symbol map for " << dat.pathspec[1] << " (link it with --map)\n"; return (int)AsmLnkErrorExt::FailOpen; }
+
+			try { symbols.load(map); }
+			catch (const std::exception &ex) { std::cerr << "Failed to load symbol map: " << ex.what() << '\n'; return (int)AsmLnkErrorExt::FormatError; }
+		}
 
-		int res = Link(exe, dat.pathspec, dat.entry_point ? dat.entry_point : "main", dat.rootdir);
-		return res != 0 ? res : SaveExecutable(dat.output ? dat.output : "a.out", exe);
+		return DecodeTrace(dat.pathspec[0], dat.pathspec.size() == 2 ? &symbols : nullptr, dat.output);
 	}
 
 	} // end switch
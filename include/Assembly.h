@@ -7,10 +7,12 @@
 #include <utility>
 #include <unordered_map>
 #include <unordered_set>
+#include <memory>
 
 #include "CoreTypes.h"
 #include "Expr.h"
 #include "Executable.h"
+#include "SymbolMap.h"
 
 namespace CSX64
 {
@@ -78,12 +80,28 @@ namespace CSX64
 		static std::istream &ReadFrom(std::istream &reader, HoleData &hole);
 	};
 
+	// a label defined in an object file (debug info for SymbolMap - not needed for linking)
+	struct LabelData
+	{
+		std::string Name;   // the full name of the label (local labels include their parent)
+		AsmSegment Segment; // the segment the label is in
+		u64 Address;        // the local address of the label in its segment
+		int Line;           // the line where the label was defined
+	};
+	// the source line of a position in an object file's text segment (debug info for SymbolMap - not needed for linking)
+	struct LineData
+	{
+		u64 Address; // the local address of the first instruction assembled from the line
+		int Line;    // the line number
+	};
+
 	// -----------------------------
 	
 	class ObjectFile;
 
 	// represents a collection of (shared) binary literals.
 	// they are stored in the most compact way possible with maximum sharing.
+	// lookups are indexed (a suffix automaton finds containing top level literals, and rolling hashes find contained ones) so adding stays near-linear.
 	class BinaryLiteralCollection
 	{
 	private: // -- private types -- //
@@ -97,19 +115,70 @@ namespace CSX64
 			friend bool operator==(const BinaryLiteral &a, const BinaryLiteral &b) noexcept { return a.top_level_index == b.top_level_index && a.start == b.start && a.length == b.length; }
 			friend bool operator!=(const BinaryLiteral &a, const BinaryLiteral &b) noexcept { return !(a == b); }
 		};
+		struct BinaryLiteralHash
+		{
+			std::size_t operator()(const BinaryLiteral &lit) const noexcept { return (lit.top_level_index * 0x9e3779b97f4a7c15 ^ lit.start) * 0x9e3779b97f4a7c15 ^ lit.length; }
+		};
+
+		// a state of the suffix automaton
+		struct SamState
+		{
+			std::size_t len;   // length of the longest string in this state
+			std::size_t link;  // suffix link (npos for the root)
+			std::size_t first; // the first (lowest index) top level literal (by id) where this state's strings occur (see _sam_mark)...
+			std::size_t last;  // ...and the position just past their last occurrence in it
+			std::size_t stamp; // the last _sam_mark pass that reached this state
+			std::vector<std::pair<u8, std::size_t>> next; // transitions
+		};
+		// where a top level literal is (by id)
+		struct TopLevelInfo
+		{
+			std::size_t index;  // index in top_level_literals (if not absorbed)
+			std::size_t parent; // the id of the top level literal that absorbed this one (npos if none)
+		};
 
 	private: // -- private data -- //
 
 		std::vector<BinaryLiteral> literals;
 		std::vector<std::vector<u8>> top_level_literals;
 
-		friend LinkResult Link(Executable &exe, std::list<std::pair<std::string, ObjectFile>> &objs, const std::string &entry_point);
+		// -- indexing -- //
+
+		std::unordered_map<BinaryLiteral, std::size_t, BinaryLiteralHash> literal_index; // maps a literal to its index in literals
+
+		std::vector<std::size_t> top_level_ids;               // the (never reused) id of each top level literal
+		std::vector<std::vector<std::size_t>> top_level_refs; // the indices of the literals referencing each top level literal
+		std::vector<TopLevelInfo> top_level_info;             // indexed by id
+
+		std::vector<SamState> sam;  // suffix automaton recognizing every substring of every top level literal ever added (absorbed ones are substrings of their parent)
+		std::size_t sam_last = 0;   // the state of the string being added to the automaton
+		std::size_t sam_stamp = 0;  // the number of _sam_mark passes so far
+
+		std::unordered_map<std::size_t, std::unordered_multimap<u64, std::size_t>> top_level_hashes; // maps length to rolling hash to id of each current top level literal
+
+		friend LinkResult Link(Executable &exe, std::list<std::pair<std::string, ObjectFile>> &objs, const std::string &entry_point, SymbolMap *symbols, unsigned threads, bool gc);
 
 	private: // -- utility -- //
 
 		// inserts info into literals (if it doesn't already exist) and returns its index in the literals array
 		std::size_t _insert(const BinaryLiteral &info);
 
+		// adds value to the end of top_level_literals (and indexes it)
+		void _push_top_level(std::vector<u8> &&value);
+		// repoints every literal referencing top level literal from to top level literal to (adding offset to their start)
+		void _retarget(std::size_t from, std::size_t to, std::size_t offset);
+		// marks top level literal index as having been absorbed into the top level literal with id parent (and removes it from the hash index)
+		void _absorb(std::size_t index, std::size_t parent);
+
+		// finds the first top level literal containing value and the last position of value in it. returns true on success.
+		bool _find_container(const std::vector<u8> &value, std::size_t &index, std::size_t &start) const;
+		// adds a new top level literal's content to the automaton
+		void _sam_add(const std::vector<u8> &value);
+		// makes the top level literal with the given id the first occurrence of each of its substrings that it now comes before (see SamState)
+		void _sam_mark(std::size_t id);
+		// rebuilds all the indexing from literals and top_level_literals - returns false if they're inconsistent
+		bool _reindex();
+
 	public: // -- ctor / dtor / asgn -- //
 
 		BinaryLiteralCollection() = default;
@@ -199,13 +268,23 @@ namespace CSX64
 
 		BinaryLiteralCollection Literals;
 
+		std::vector<LabelData> Labels;   // every label defined in the file (in definition order)
+		std::vector<LineData> TextLines; // the start of each run of text assembled from a single line (in address order)
+
+	private: // -- private data -- //
+
+		// the arena holding the nodes and tokens of the expressions above (null if none) - see Expr::Arena.
+		// it's declared last so that assignment replaces the expressions before the arena they were allocated in.
+		std::shared_ptr<Expr::Arena> _Arena;
+
 	public: // -- ctor / dtor / asgn -- //
 
 		// constructs an empty object file that is ready for use
 		ObjectFile() = default;
 
-		ObjectFile(const ObjectFile&) = default;
-		ObjectFile &operator=(const ObjectFile&) = default;
+		// copies an object file. the copy's expressions are allocated in a new arena (arenas can't be shared between threads).
+		ObjectFile(const ObjectFile &other);
+		ObjectFile &operator=(const ObjectFile &other);
 
 		// move constructs a new object file. the contents of moved-from object are valid, but dirty and undefined.
 		ObjectFile(ObjectFile&&) noexcept = default;
@@ -213,6 +292,8 @@ namespace CSX64
 		// self-assignment is safe.
 		ObjectFile &operator=(ObjectFile&&) noexcept = default;
 
+		~ObjectFile();
+
 	public: // -- state -- //
 
 		// checks if this object file is in a valid, usable state
@@ -228,6 +309,10 @@ namespace CSX64
 		// empties the contents of this file and effectively sets it to the newly-constructed state
 		void clear() noexcept;
 
+		// gets the arena this file's expressions are allocated in (null if none).
+		// make it current (see Expr::ArenaScope) when adding expressions to the file, so their tokens are interned with the rest.
+		Expr::Arena *arena() const noexcept { return _Arena.get(); }
+
 	public: // -- IO -- //
 
 		// saves this object file to a file located at (path).
@@ -242,6 +327,12 @@ namespace CSX64
 		// throws any exception resulting from failed memory allocation.
 		// if an exception is throw, this object is left in an valid, but unclean and undefined state.
 		void load(const std::string &path);
+
+		// as save, but writes to a (binary) stream.
+		// throws IOError if any write operation fails.
+		void save(std::ostream &ostr) const;
+		// as load, but reads from a (binary) stream. the object file extends to the end of the stream.
+		void load(std::istream &istr);
 	};
 
 	// -----------------------------
@@ -274,10 +365,12 @@ namespace CSX64
 	// helper for imm parser
 	bool TryGetOp(const std::string &token, std::size_t pos, Expr::OPs &op, int &oplen);
 
-	// defines a symbol for the assembler
+	// defines a symbol for the assembler (thread safe - assemblies in progress keep the symbols they started with)
 	void DefineSymbol(std::string key, std::string value);
 	void DefineSymbol(std::string key, u64 value);
 	void DefineSymbol(std::string key, double value);
+	// gets a hash of all the symbols defined by DefineSymbol (assembling the same source with different predefines can give a different result)
+	u64 PredefinedSymbolsHash();
 
 	// -----------------------------------
 
@@ -296,8 +389,11 @@ namespace CSX64
 	/// <param name="exe">the resulting executable</param>
 	/// <param name="objs">the object files to link. should all be clean. the first item in this array is the _start file</param>
 	/// <param name="entry_point">the raw starting file</param>
+	/// <param name="symbols">if non-null, receives the address of every label and text line in the executable (on success)</param>
+	/// <param name="threads">the number of threads to copy and patch object files with once the layout is known (0 for one per hardware thread)</param>
+	/// <param name="gc">if true, segments of object files that can't be reached from the _start file's text are dropped from the executable</param>
 	/// <exception cref="ArgumentException"></exception>
-	LinkResult Link(Executable &exe, std::list<std::pair<std::string, ObjectFile>> &objs, const std::string &entry_point = "main");
+	LinkResult Link(Executable &exe, std::list<std::pair<std::string, ObjectFile>> &objs, const std::string &entry_point = "main", SymbolMap *symbols = nullptr, unsigned threads = 1, bool gc = false);
 }
 
 #endif
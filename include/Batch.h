@@ -0,0 +1,58 @@
+#ifndef DRAGAZO_CSX64_BATCH_H
+#define DRAGAZO_CSX64_BATCH_H
+
+#include <vector>
+#include <string>
+#include <functional>
+
+#include "CoreTypes.h"
+#include "Executable.h"
+#include "Computer.h"
+
+namespace CSX64
+{
+	// a single guest program instance to run as part of a batch (see RunBatch)
+	struct BatchJob
+	{
+		const Executable *exe = nullptr;  // the executable image to run - it's never modified, so any number of jobs can share one
+		std::vector<std::string> args;    // the command line args (by convention args[0] is the program name)
+		std::string input;                // the full contents of the instance's stdin
+	};
+
+	// the outcome of running a BatchJob
+	struct BatchResult
+	{
+		bool initialized = false;         // marks if the computer was successfully initialized (otherwise see init_error)
+		std::string init_error;           // the reason initialization failed (if it did)
+
+		ErrorCode error = ErrorCode::None; // the error that terminated execution (if any)
+		int return_value = 0;             // the program's return value (only meaningful if there was no error)
+
+		std::string output;               // everything the instance wrote to stdout
+		std::string errors;               // everything the instance wrote to stderr
+
+		long long ns = 0;                 // execution time in nanoseconds (not including initialization)
+
+		// returns true iff the job was initialized and ran to completion without error
+		bool ok() const noexcept { return initialized && error == ErrorCode::None; }
+	};
+
+	// settings shared by every instance in a batch
+	struct BatchOptions
+	{
+		unsigned threads = 0;             // the number of worker threads (0 for one per hardware thread)
+		u64 max_memory = ~(u64)0;         // max memory of each instance
+		bool fsf = false;                 // value of FSF (file system flag) during execution
+		bool jit = false;                 // marks if hot code should be compiled to native code
+
+		// if non-null, called on each computer after initialization (and before execution) for any additional setup
+		std::function<void(Computer&)> configure;
+	};
+
+	// runs each job to completion on its own Computer and returns the results (in the same order as jobs).
+	// the jobs are spread over a pool of worker threads (idle workers steal pending jobs from busy ones).
+	// each instance's stdin, stdout, and stderr are private in-memory streams (see BatchJob::input and BatchResult).
+	std::vector<BatchResult> RunBatch(const std::vector<BatchJob> &jobs, const BatchOptions &options = {});
+}
+
+#endif
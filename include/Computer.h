@@ -4,17 +4,108 @@
 #include <iostream>
 #include <memory>
 #include <type_traits>
+#include <vector>
 
 #include "CoreTypes.h"
 #include "ExeTypes.h"
 #include "Utility.h"
 #include "FastRng.h"
 #include "Executable.h"
+#include "Profiler.h"
+#include "Tracer.h"
 
 #include "../ios-frstor/iosfrstor.h"
 
+// native compilation of basic blocks is only available on x86-64 linux hosts
+#if defined(__x86_64__) && defined(__linux__)
+#define CSX64_JIT 1
+#else
+#define CSX64_JIT 0
+#endif
+
+// guest memory lives in a virtual memory mapping that reserves room to grow on posix hosts (see VirtualMemory.cpp)
+#if defined(__unix__) || defined(__APPLE__)
+#define CSX64_RESERVED_MEMORY 1
+#else
+#define CSX64_RESERVED_MEMORY 0
+#endif
+
 namespace CSX64
 {
+	class JitCodeBuffer;
+
+	// a whole-vector implementation of a vpu op over 64-byte aligned buffers (see VPUKernels.cpp).
+	// processes at least the first bytes bytes (16, 32, or 64) - elements past that may also be written. res may alias a or b.
+	typedef void (*VPUBinaryKernel)(void *res, const void *a, const void *b, u64 bytes);
+	// as VPUBinaryKernel, but returns false if the op would fail for any element (the op then falls back to its delegate to report the error)
+	typedef bool (*VPUUnaryKernel)(void *res, const void *a, u64 bytes);
+
+	// the kernels for each vectorized vpu op, indexed by element sizecode (null if there isn't one for that size)
+	struct VPUKernelTable
+	{
+		VPUBinaryKernel FADD[4], FSUB[4], FMUL[4], FDIV[4], FMIN[4], FMAX[4], FADDSUB[4];
+		VPUBinaryKernel AND[4], OR[4], XOR[4], ANDN[4];
+		VPUBinaryKernel ADD[4], ADDS[4], ADDUS[4], SUB[4], SUBS[4], SUBUS[4], MULL[4];
+		VPUBinaryKernel UMIN[4], SMIN[4], UMAX[4], SMAX[4], AVG[4];
+
+		VPUUnaryKernel FSQRT[4];
+	};
+
+	// an immutable copy of the state of a computer (see Computer::Snapshot), which any number of computers can be forked from (see Computer::Fork).
+	// with reserved memory, the memory contents are held in an anonymous file that forks map copy-on-write,
+	// so forking doesn't copy memory - a fork only gets its own copy of a page when it first writes to it.
+	class ComputerSnapshot
+	{
+	private: // -- data -- //
+
+		friend class Computer;
+
+		u64 mem_size, min_mem_size, max_mem_size;
+		u64 ExeBarrier, ReadonlyBarrier, StackBarrier;
+
+		int mem_fd = -1;             // the file holding the memory contents (with reserved memory)
+		std::vector<u8> mem_content; // the memory contents (without reserved memory)
+
+		bool running;
+		bool suspended_read;
+		ErrorCode error;
+		int return_value;
+
+		CPURegister CPURegisters[16];
+		u64 _RFLAGS, _RIP;
+
+		long double FPURegisters[8];
+		u16 FPU_control, FPU_status, FPU_tag;
+
+		ZMMRegister ZMMRegisters[32];
+		u32 _MXCSR;
+
+		FastRNG Rand;
+
+		ComputerSnapshot() : Rand(0) {}
+
+	public: // -- ctor / dtor / asgn -- //
+
+		~ComputerSnapshot();
+
+		ComputerSnapshot(const ComputerSnapshot&) = delete;
+		ComputerSnapshot &operator=(const ComputerSnapshot&) = delete;
+
+	public: // -- info -- //
+
+		// gets the size of the memory array captured by the snapshot
+		u64 MemorySize() const noexcept { return mem_size; }
+	};
+
+	// describes a file descriptor that was open when a checkpoint was saved (see Computer::SaveCheckpoint).
+	// files are host objects and aren't part of the checkpoint - it's up to the host to reattach them after restoring.
+	struct CheckpointFile
+	{
+		int fd;
+		bool interactive, can_read, can_write, can_seek;
+		i64 position; // the position of the file when it was saved (-1 if it can't seek)
+	};
+
 	class Computer
 	{
 	public: // -- info -- //
@@ -33,6 +124,16 @@ namespace CSX64
 		// if set to true, uses mask unions to perform the UpdateFlagsZSP() function - otherwise uses flag accessors (slower)
 		static constexpr bool FlagAccessMasking = true;
 
+		// marks if native compilation of basic blocks is supported on this platform (see JitCompilation)
+		static constexpr bool JitSupported = CSX64_JIT;
+
+		// the number of times a basic block must execute before it is compiled to native code
+		static constexpr u64 JitThreshold = 16;
+
+		// marks if memory is a virtual memory mapping that reserves address space to grow into (see VirtualMemory.cpp).
+		// if so, it can grow in place and share pages copy-on-write with snapshots and mapped executables.
+		static constexpr bool ReservedMemory = CSX64_RESERVED_MEMORY;
+
 	public: // -- special types -- //
 
 		// wraps a physical ST register's info into a more convenient package
@@ -146,11 +247,73 @@ namespace CSX64
 			const_ST_Wrapper(ST_Wrapper wrap) noexcept : ST_Wrapper_common(wrap.c, wrap.index) {}
 		};
 
+		// the integer ALU operations whose status flag updates can be deferred (see LazyFlags)
+		enum class FlagOp : u8 { None, ADD, SUB, LOGIC, INC, DEC };
+
+		// the operands of the most recent flag-setting ALU operation - RFLAGS is computed from this on demand
+		struct PendingFlags
+		{
+			u64 a, b;        // the operands
+			u64 res;         // the (truncated) result
+			u8 sizecode;     // the operand size
+			FlagOp op;       // the operation that was performed (None if RFLAGS is up to date)
+		};
+
+		// the machine state passed to natively-compiled blocks (see Jit.cpp for the calling convention)
+		struct JitFrame
+		{
+			void *regs;           // pointer to CPURegisters
+			void *mem;            // pointer to memory array
+			u64 mem_size;         // current memory size
+			u64 readonly_barrier; // current readonly barrier
+			u64 stack_barrier;    // current stack barrier
+			u64 rflags;           // RFLAGS (read and written)
+			u64 rip;              // RIP on exit (written)
+			u64 host_flags;       // scratch space for the native code
+		};
+		// a natively-compiled block - returns the number of instructions that were executed and updates the frame
+		typedef u64(*JitFunction)(JitFrame *frame);
+
+		// a translated basic block from the text segment (see BlockExecution).
+		// blocks are recorded the first time they execute and end at the first control flow instruction.
+		struct BasicBlock
+		{
+			// the instruction forms that are decoded once at translation (integer ops on registers, imms, and memory, and jumps to an imm target) - anything else is performed by its handler
+			enum class OpKind : u8 { Handler, MOV, ADD, SUB, AND, OR, XOR, CMP, TEST, INC, DEC, JMP, Jcc };
+
+			// a single instruction in the block - the handler and the position of its opcode byte, and its pre-decoded form (if any)
+			struct Op
+			{
+				bool(Computer::*handler)();
+				u64 pos;
+
+				OpKind kind = OpKind::Handler;
+				u8 sizecode = 0;
+				u8 dest = 0;          // the destination register (condition code for Jcc)
+				u8 src = 0;           // the source register (modes 0 and 3)
+				u8 mode = 1;          // the binary op mode (see FetchBinaryOpFormat) - 0: reg, reg  1: reg, imm  2: reg, M  3: M, reg  4: M, imm
+				u8 addr_settings = 0; // the address settings byte (see GetAddressAdv) for memory modes
+				u8 addr_regs = 0;     // the address register byte for memory modes
+				u64 imm = 0;          // the imm source (jump target for JMP and Jcc)
+				u64 disp = 0;         // the address imm for memory modes
+				u64 next = 0;         // the position of the following instruction
+			};
+
+			std::vector<Op> ops; // the instructions in the block (in execution order)
+
+			// cached links to the most recent successor blocks (null if not yet linked)
+			BasicBlock *succ[2] = { nullptr, nullptr };
+
+			u64 exec_count = 0;            // the number of times this block has executed (only tracked until compiled)
+			JitFunction native = nullptr;  // the natively-compiled prefix of this block (null if none)
+		};
+
 	private: // -- data -- //
 
-		void *mem;    // pointer to position 0 of memory array (alloc/dealloc with CSX64::aligned_malloc/free)
+		void *mem;    // pointer to position 0 of memory array (alloc/dealloc with AllocateMemory/FreeMemory)
 		u64 mem_size; // current size of memory array
 		u64 mem_cap;  // current capacity of memory array (cap >= size) (size is the user-accessible portion)
+		u64 mem_reserve; // the size the memory array can grow to in place (reserve >= cap)
 
 		u64 min_mem_size; // memory size after initialization (acts as a minimum for sys_brk)
 		u64 max_mem_size; // requested limit on memory size (acts as a maximum for sys_brk)
@@ -177,6 +340,22 @@ namespace CSX64
 
 		FastRNG Rand;
 
+		bool block_execution;                        // flag marking if Tick() should execute translated basic blocks
+		std::vector<std::unique_ptr<BasicBlock>> blocks; // all the translated blocks (owning)
+		std::vector<BasicBlock*> block_map;          // maps positions in the text segment to the block starting there (null if none)
+
+		bool jit_compilation;                  // flag marking if hot blocks should be compiled to native code
+		std::shared_ptr<JitCodeBuffer> jit_code; // executable memory holding all compiled blocks (null if none)
+
+		bool lazy_flags;              // flag marking if integer ALU ops should defer their status flag updates
+		PendingFlags pending_flags;   // the deferred status flag update (op is None if there isn't one)
+
+		std::unique_ptr<Profiler> profiler; // the execution profile being recorded (null if not profiling)
+
+		std::unique_ptr<Tracer> tracer; // the execution trace being recorded (null if not tracing)
+		Tracer *address_tracer;         // the trace that effective addresses are recorded in (null if not recording them)
+		std::string trace_dump;         // the path the trace is saved to on termination with an error (empty for none)
+
 	public: // -- data access -- //
 
 		// Gets the maximum amount of memory the client can request
@@ -196,15 +375,54 @@ namespace CSX64
 		// The return value from the program after errorless termination
 		int ReturnValue() const noexcept { return return_value; }
 
+		// Gets if Tick() executes translated basic blocks rather than individual instructions (disabled by default)
+		bool BlockExecution() const noexcept { return block_execution; }
+		// Enables or disables basic block execution. Disabling releases all translated blocks.
+		void BlockExecution(bool enable);
+
+		// Gets if hot basic blocks are compiled to native code (disabled by default)
+		bool JitCompilation() const noexcept { return jit_compilation; }
+		// Enables or disables native compilation of hot basic blocks. Only has an effect with block execution enabled.
+		// Disabling releases all compiled code. If not supported on this platform (see JitSupported), this is a no-op.
+		void JitCompilation(bool enable);
+
+		// Gets if integer ALU ops defer computing their status flags until something reads them (disabled by default)
+		bool LazyFlags() const noexcept { return lazy_flags; }
+		// Enables or disables lazy status flags. Any deferred flags are computed before the mode changes.
+		// In lazy mode, AF is left unchanged by logical ops (where it's undefined) instead of being randomized.
+		void LazyFlags(bool enable) { FlushFlags(); lazy_flags = enable; }
+
+		// Gets if Tick() records an execution profile (disabled by default)
+		bool Profiling() const noexcept { return profiler != nullptr; }
+		// Enables or disables profiling. Enabling starts an empty profile (if not already profiling) - disabling discards it.
+		// While profiling, instructions are executed individually (block execution and native code are bypassed) so that every one is counted.
+		void Profiling(bool enable);
+		// Gets the profile recorded so far (null if not profiling). Initialize starts a new profile.
+		const Profiler *Profile() const noexcept { return profiler.get(); }
+
+		// Gets if Tick() records an execution trace (disabled by default)
+		bool Tracing() const noexcept { return tracer != nullptr; }
+		// Enables or disables tracing. Enabling starts an empty trace with room for about capacity bytes of records - disabling discards it.
+		// If addresses is true, the effective address of each memory operand is recorded as well.
+		// While tracing, instructions are executed individually (as with profiling). Initialize clears the trace.
+		void Tracing(bool enable, bool addresses = false, u64 capacity = Tracer::DefaultCapacity);
+		// Gets the trace recorded so far (null if not tracing)
+		const Tracer *Trace() const noexcept { return tracer.get(); }
+		// Sets the path of a file the trace is saved to (see Tracer::Save) when execution terminates with an error (empty for none)
+		void TraceDump(std::string path) { trace_dump = std::move(path); }
+
 	public: // -- ctor/dtor -- //
 
 		// Validates the machine for operation, but does not prepare it for execute (see Initialize)
 		Computer() :
-			mem(nullptr), mem_size(0), mem_cap(0), max_mem_size((u64)8 * 1024 * 1024 * 1024),
+			mem(nullptr), mem_size(0), mem_cap(0), mem_reserve(0), max_mem_size((u64)8 * 1024 * 1024 * 1024), ExeBarrier(0),
 			running(false), error(ErrorCode::None),
-			Rand((unsigned int)std::time(nullptr))
-		{}
-		virtual ~Computer() { CSX64::aligned_free(mem); }
+			Rand((unsigned int)std::time(nullptr)),
+			block_execution(false), jit_compilation(false), lazy_flags(false), address_tracer(nullptr)
+		{
+			pending_flags.op = FlagOp::None;
+		}
+		virtual ~Computer() { FreeMemory(mem, mem_reserve); }
 		
 		Computer(const Computer&) = delete;
 		Computer(Computer&&) = delete;
@@ -245,6 +463,26 @@ namespace CSX64
 		// Unsets the suspended read state
 		void ResumeSuspendedRead();
 
+		// captures the current state (registers, flags, memory, execution state, and rng) for forking (see Fork).
+		// file descriptors and execution settings (e.g. block execution) aren't part of the state.
+		// throws MemoryAllocException if the memory contents can't be captured.
+		std::shared_ptr<const ComputerSnapshot> Snapshot() const;
+		// replaces the state of this computer with the state captured by a snapshot, continuing from where it was taken.
+		// file descriptors and execution settings are left unchanged, and any translated/compiled code is discarded.
+		// throws MemoryAllocException if the memory can't be mapped (in which case this computer is unchanged).
+		void Fork(const ComputerSnapshot &snap);
+
+		// writes the current state (as captured by Snapshot) to a binary checkpoint stream (see LoadCheckpoint).
+		// open file descriptors are saved as descriptors only (see CheckpointFile).
+		// if compress is true, pages of memory that are entirely zero are omitted.
+		// throws IOError if the writes fail.
+		void SaveCheckpoint(std::ostream &ostr, bool compress = true) const;
+		// replaces the state of this computer with the state read from a checkpoint stream, continuing from where it was saved.
+		// as with Fork, file descriptors and execution settings are left unchanged - if files is non-null, it receives the saved file descriptors.
+		// throws TypeError, VersionError, or FormatError if the stream isn't a valid checkpoint for this host (in which case this computer is unchanged).
+		// throws MemoryAllocException if the memory can't be allocated (in which case this computer is unchanged).
+		void LoadCheckpoint(std::istream &istr, std::vector<CheckpointFile> *files = nullptr);
+
 		// links the provided file to the first available file descriptor.
 		// returns the file descriptor that was used. if none were available, does not link the file and returns -1.
 		int OpenFileWrapper(std::unique_ptr<IFileWrapper> f);
@@ -290,6 +528,66 @@ namespace CSX64
 		bool Process_sys_mkdir();
 		bool Process_sys_rmdir();
 
+	private: // -- memory backend -- //
+
+		// allocates a memory array of at least size bytes. returns null on failure.
+		// cap receives its usable capacity and reserve the size it can later grow to in place (see ResizeMemory).
+		// with reserved memory, the array is page aligned and reserves address space for it to grow several times over (within max memory).
+		void *AllocateMemory(u64 size, u64 &cap, u64 &reserve);
+		// releases a memory array from AllocateMemory (no-op for null)
+		static void FreeMemory(void *ptr, u64 reserve);
+		// resizes the current memory array in place so that its capacity covers size bytes (contents up to size are preserved).
+		// with reserved memory, pages are committed or released at the end of the array. returns false if the reservation is too small.
+		bool ResizeMemory(u64 size);
+
+		// copies the contents of memory into a snapshot. returns true on success.
+		bool CaptureMemory(ComputerSnapshot &snap) const;
+		// replaces the memory array with a (copy-on-write where supported) copy of a snapshot's memory. returns true on success.
+		// on failure, the current memory array is unchanged.
+		bool MapMemory(const ComputerSnapshot &snap);
+
+		// replaces the memory array with one of size bytes that begins with a copy-on-write mapping of the executable's image (see Executable::map).
+		// returns false (with the current memory array unchanged) if the executable doesn't have an image or the mapping fails.
+		bool MapExecutable(const Executable &exe, u64 size);
+
+		// replaces everything but the memory array with the state held by a snapshot (the rest of Fork)
+		void RestoreState(const ComputerSnapshot &snap);
+
+		// returns true if the range [pos, pos + size) is not entirely within memory (size must be at most 64)
+		bool InvalidRange(u64 pos, u64 size) const noexcept { return pos >= mem_size || pos + size > mem_size; }
+
+	private: // -- execution engines -- //
+
+		// performs up to count individual instructions - the core of Tick() when not using block execution
+		u64 TickInterpreted(u64 count);
+		// performs up to count instructions by executing (and translating) basic blocks
+		u64 TickBlocks(u64 count);
+		// performs up to count individual instructions while recording them in the profile and/or trace (see Profiling and Tracing)
+		u64 TickInstrumented(u64 count);
+
+		// saves the trace to the trace dump path (errors are reported to stderr)
+		void DumpTrace();
+
+		// executes the block starting at the current RIP while recording it as a new block (up to count instructions).
+		// returns the number of instructions executed. on success, block receives the new block (otherwise null).
+		u64 TranslateBlock(u64 count, BasicBlock *&block);
+		// fills in the pre-decoded form of a recorded instruction (see BasicBlock::OpKind), if it has one.
+		// next is where the instruction was seen to continue (ignored for jumps) - if it disagrees with the decode, the instruction is left to its handler.
+		void PreDecode(BasicBlock::Op &op, u64 next) const;
+		// executes a previously-translated block. returns the number of instructions executed.
+		// stops early if any instruction fails or if control flow leaves the recorded path.
+		u64 ExecuteBlock(BasicBlock &block);
+		// performs a pre-decoded binary op with a memory operand (modes 2-4). returns false on failure (e.g. out of bounds).
+		bool ExecuteMemoryOp(const BasicBlock::Op &op);
+
+		// attempts to compile (a prefix of) the block to native code. on failure, the block is left unchanged.
+		void CompileBlock(BasicBlock &block);
+		// executes the native code for a compiled block. returns the number of instructions executed.
+		u64 ExecuteNative(const BasicBlock &block);
+
+		// discards all translated blocks (and resizes the block map if enabled)
+		void ResetBlocks();
+
 	public: // -- public memory access -- //
 
 		// Reads a C-style string from memory. Returns true if successful, otherwise fails with OutOfBounds and returns false
@@ -366,7 +664,7 @@ namespace CSX64
 		template<typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
 		bool GetMemRaw(u64 pos, u64 &res)
 		{
-			if (pos >= mem_size || pos + sizeof(T) > mem_size) { Terminate(ErrorCode::OutOfBounds); return false; }
+			if (InvalidRange(pos, sizeof(T))) { Terminate(ErrorCode::OutOfBounds); return false; }
 			
 			res = bin_read<T>(reinterpret_cast<const char*>(mem) + pos);
 
@@ -381,7 +679,7 @@ namespace CSX64
 		template<typename T, std::enable_if_t<std::is_trivial<T>::value, int> = 0>
 		bool SetMemRaw(u64 pos, u64 val)
 		{
-			if (pos >= mem_size || pos + sizeof(T) > mem_size) { Terminate(ErrorCode::OutOfBounds); return false; }
+			if (InvalidRange(pos, sizeof(T))) { Terminate(ErrorCode::OutOfBounds); return false; }
 			if (pos < ReadonlyBarrier) { Terminate(ErrorCode::AccessViolation); return false; }
 
 			bin_write<T>(reinterpret_cast<char*>(mem) + pos, (T)val); // aliasing ok because casting to char type
@@ -411,18 +709,19 @@ namespace CSX64
 		// get a compact imm and advances the execution pointer. returns true on success.
 		bool GetCompactImmAdv(u64 &res);
 
-		// gets an address and advances the execution pointer. returns true on success
-		bool GetAddressAdv(u64 &res);
+		// gets an address and advances the execution pointer. returns true on success.
+		// access marks that the address is about to be loaded from or stored to (only those are recorded by the tracer - e.g. not LEA).
+		bool GetAddressAdv(u64 &res, bool access = true);
 
 	public: // -- register access -- //
 
-		u64                        &RFLAGS() { return _RFLAGS; }
-		BitfieldWrapper<u64, 0, 32> EFLAGS() { return {_RFLAGS}; }
-		BitfieldWrapper<u64, 0, 16> FLAGS() { return {_RFLAGS}; }
+		u64                        &RFLAGS() { FlushFlags(); return _RFLAGS; }
+		BitfieldWrapper<u64, 0, 32> EFLAGS() { FlushFlags(); return {_RFLAGS}; }
+		BitfieldWrapper<u64, 0, 16> FLAGS() { FlushFlags(); return {_RFLAGS}; }
 		
-		u64 RFLAGS() const { return _RFLAGS; }
-		u32 EFLAGS() const { return (u32)_RFLAGS; }
-		u16 FLAGS() const { return (u16)_RFLAGS; }
+		u64 RFLAGS() const { return CurrentFlags(); }
+		u32 EFLAGS() const { return (u32)CurrentFlags(); }
+		u16 FLAGS() const { return (u16)CurrentFlags(); }
 
 		u64                      &RIP() { return _RIP; }
 		ReferenceRouter<u32, u64> EIP() { return {_RIP}; }
@@ -581,15 +880,15 @@ namespace CSX64
 		// source: https://en.wikipedia.org/wiki/FLAGS_register
 		// source: http://www.eecg.toronto.edu/~amza/www.mindsec.com/files/x86regs.html
 
-		FlagWrapper<u64, 0>         CF() { return {_RFLAGS}; }
-		FlagWrapper<u64, 2>         PF() { return {_RFLAGS}; }
-		FlagWrapper<u64, 4>         AF() { return {_RFLAGS}; }
-		FlagWrapper<u64, 6>         ZF() { return {_RFLAGS}; }
-		FlagWrapper<u64, 7>         SF() { return {_RFLAGS}; }
+		FlagWrapper<u64, 0>         CF() { FlushFlags(); return {_RFLAGS}; }
+		FlagWrapper<u64, 2>         PF() { FlushFlags(); return {_RFLAGS}; }
+		FlagWrapper<u64, 4>         AF() { FlushFlags(); return {_RFLAGS}; }
+		FlagWrapper<u64, 6>         ZF() { FlushFlags(); return {_RFLAGS}; }
+		FlagWrapper<u64, 7>         SF() { FlushFlags(); return {_RFLAGS}; }
 		FlagWrapper<u64, 8>         TF() { return {_RFLAGS}; }
 		FlagWrapper<u64, 9>         IF() { return {_RFLAGS}; }
 		FlagWrapper<u64, 10>        DF() { return {_RFLAGS}; }
-		FlagWrapper<u64, 11>        OF() { return {_RFLAGS}; }
+		FlagWrapper<u64, 11>        OF() { FlushFlags(); return {_RFLAGS}; }
 		BitfieldWrapper<u64, 12, 2> IOPL() { return {_RFLAGS}; }
 		FlagWrapper<u64, 14>        NT() { return {_RFLAGS}; }
 
@@ -600,15 +899,15 @@ namespace CSX64
 		FlagWrapper<u64, 20> VIP() { return {_RFLAGS}; }
 		FlagWrapper<u64, 21> ID() { return {_RFLAGS}; }
 
-		bool CF() const { return _RFLAGS & FlagWrapper<u64, 0>::mask; }
-		bool PF() const { return _RFLAGS & FlagWrapper<u64, 2>::mask; }
-		bool AF() const { return _RFLAGS & FlagWrapper<u64, 4>::mask; }
-		bool ZF() const { return _RFLAGS & FlagWrapper<u64, 6>::mask; }
-		bool SF() const { return _RFLAGS & FlagWrapper<u64, 7>::mask; }
+		bool CF() const { return CurrentFlags() & FlagWrapper<u64, 0>::mask; }
+		bool PF() const { return CurrentFlags() & FlagWrapper<u64, 2>::mask; }
+		bool AF() const { return CurrentFlags() & FlagWrapper<u64, 4>::mask; }
+		bool ZF() const { return CurrentFlags() & FlagWrapper<u64, 6>::mask; }
+		bool SF() const { return CurrentFlags() & FlagWrapper<u64, 7>::mask; }
 		bool TF() const { return _RFLAGS & FlagWrapper<u64, 8>::mask; }
 		bool IF() const { return _RFLAGS & FlagWrapper<u64, 9>::mask; }
 		bool DF() const { return _RFLAGS & FlagWrapper<u64, 10>::mask; }
-		bool OF() const { return _RFLAGS & FlagWrapper<u64, 11>::mask; }
+		bool OF() const { return CurrentFlags() & FlagWrapper<u64, 11>::mask; }
 		u64 IOPL() const { return (_RFLAGS & BitfieldWrapper<u64, 12, 2>::mask) >> 12; }
 		bool NT() const { return _RFLAGS & FlagWrapper<u64, 14>::mask; }
 
@@ -748,6 +1047,9 @@ namespace CSX64
 		// holds cpu delegates for simd fp comparisons
 		static const VPUBinaryDelegate __TryProcessVEC_FCMP_lookup[];
 
+		// the whole-vector vpu kernels for the host cpu (selected at startup)
+		static const VPUKernelTable VPUKernels;
+
 	private: // -- operators -- //
 
 		/*
@@ -808,6 +1110,50 @@ namespace CSX64
 		// updates the flags for integral ops (identical for most integral ops)
 		void UpdateFlagsZSP(u64 value, u64 sizecode);
 
+		// the integer ALU ops (shared by the handlers and pre-decoded block ops - see BasicBlock::Op).
+		// each returns the (truncated) result and updates the status flags (or defers them in lazy flags mode).
+		u64 AluADD(u64 a, u64 b, u64 sizecode);
+		u64 AluSUB(u64 a, u64 b, u64 sizecode);
+		u64 AluAND(u64 a, u64 b, u64 sizecode);
+		u64 AluOR(u64 a, u64 b, u64 sizecode);
+		u64 AluXOR(u64 a, u64 b, u64 sizecode);
+		u64 AluINC(u64 a, u64 sizecode);
+		u64 AluDEC(u64 a, u64 sizecode);
+
+		// returns true if the flag-based condition code cc holds (0-17 - see ProcessJcc)
+		bool Condition(u64 cc);
+
+		// computes RFLAGS with the deferred status flag update applied (see LazyFlags)
+		u64 ComputeFlags() const;
+		// gets RFLAGS, including any deferred status flag update
+		u64 CurrentFlags() const { return pending_flags.op == FlagOp::None ? _RFLAGS : ComputeFlags(); }
+		// applies any deferred status flag update to RFLAGS
+		void FlushFlags() { if (pending_flags.op != FlagOp::None) { _RFLAGS = ComputeFlags(); pending_flags.op = FlagOp::None; } }
+
+		// defers the status flag update for an integer ALU op (lazy flags mode only).
+		// INC and DEC preserve CF, so the deferred CF (if any) is applied to RFLAGS first.
+		void DeferFlags(FlagOp op, u64 a, u64 b, u64 res, u64 sizecode)
+		{
+			if ((op == FlagOp::INC || op == FlagOp::DEC) && pending_flags.op != FlagOp::None)
+			{
+				bool cf;
+				switch (pending_flags.op)
+				{
+				case FlagOp::ADD: cf = pending_flags.res < pending_flags.a; break;
+				case FlagOp::SUB: cf = pending_flags.a < pending_flags.b; break;
+				case FlagOp::LOGIC: cf = false; break;
+				default: cf = _RFLAGS & FlagWrapper<u64, 0>::mask; break;
+				}
+				_RFLAGS = cf ? _RFLAGS | FlagWrapper<u64, 0>::mask : _RFLAGS & ~FlagWrapper<u64, 0>::mask;
+			}
+
+			pending_flags.a = a;
+			pending_flags.b = b;
+			pending_flags.res = res;
+			pending_flags.sizecode = (u8)sizecode;
+			pending_flags.op = op;
+		}
+
 		// -- impl -- //
 
 		bool ProcessNOP() { return true; }
@@ -905,6 +1251,16 @@ namespace CSX64
 		bool __ProcessSTRING_STOS(u64 sizecode);
 		bool __ProcessSTRING_SCAS(u64 sizecode);
 
+		// bulk versions of the repeated string ops (OTRF only) - these perform the leading iterations whose elements are all in bounds
+		// (and, for CMPS/SCAS, that don't end the repetition) in one go, leaving the rest (including any error) to the element-by-element loop.
+		// CMPS/SCAS/LODS always leave the last iteration to the loop so that it sets the flags / register exactly.
+		u64 __StringSpan(u64 pos, u64 size, u64 count, bool write) const;
+		void __BulkSTRING_MOVS(u64 sizecode);
+		void __BulkSTRING_CMPS(u64 sizecode, bool equal);
+		void __BulkSTRING_LODS(u64 sizecode);
+		void __BulkSTRING_STOS(u64 sizecode);
+		void __BulkSTRING_SCAS(u64 sizecode, bool equal);
+
 		bool ProcessSTRING();
 
 		bool __Process_BSx_common(u64 &s, u64 &src, u64 &sizecode);
@@ -979,8 +1335,10 @@ namespace CSX64
 		// -- vpu stuff -- //
 
 		bool ProcessVPUMove();
-		bool ProcessVPUBinary(u64 elem_size_mask, VPUBinaryDelegate func);
-		bool ProcessVPUUnary(u64 elem_size_mask, VPUUnaryDelegate func);
+		bool ProcessVPUBinary(u64 elem_size_mask, VPUBinaryDelegate func, const VPUBinaryKernel *kernels = nullptr);
+		bool ProcessVPUUnary(u64 elem_size_mask, VPUUnaryDelegate func, const VPUUnaryKernel *kernels = nullptr);
+		// stores a whole-vector result into the first elem_count elements of the dest register (applying the mask)
+		void __StoreVPUResult(u64 dest, const ZMMRegister &res, u64 elem_sizecode, u64 elem_count, u64 mask, bool zmask);
 
 		bool ProcessVPUCVT_packed(u64 elem_count, u64 to_elem_sizecode, u64 from_elem_sizecode, VPUCVTDelegate func);
 
@@ -257,6 +257,12 @@ namespace CSX64
 		// fills the register with zeros
 		void clear() { std::memset(data, 0, sizeof(data)); }
 
+	public: // -- raw access -- //
+
+		// gets a pointer to the (64-byte aligned) raw data block
+		unsigned char *raw() noexcept { return data; }
+		const unsigned char *raw() const noexcept { return data; }
+
 	public: // -- partition access -- //
 
 		// gets the value of type T at the specified index (index offsets based on T)
@@ -7,6 +7,8 @@
 #include <cstring>
 #include <exception>
 #include <stdexcept>
+#include <memory>
+#include <iosfwd>
 
 #include "CoreTypes.h"
 
@@ -23,6 +25,10 @@ namespace CSX64
 
 		std::vector<u8> _content; // executable contents (actually loaded into memory for execution)
 
+		// the executable contents held in an anonymous file instead of _content (see map) - shared by copies
+		struct Image;
+		std::shared_ptr<const Image> _image;
+
 	public: // -- ctor / dtor / asgn -- //
 
 		// creates an empty executable
@@ -69,13 +75,13 @@ namespace CSX64
 		u64 bss_seglen() const noexcept { return _seglens[3]; }
 
 		// gets the content of the executable in proper segment order (und if empty) (does not include bss) (i.e. holds text, rodata, and data in that order).
-		const u8 *content() const& noexcept { return _content.data(); }
+		const u8 *content() const& noexcept;
 		const u8 *content() && noexcept = delete;
 		// gets the size of the content array
-		std::size_t content_size() const noexcept { return _content.size(); }
+		std::size_t content_size() const noexcept { return _seglens[0] + _seglens[1] + _seglens[2]; }
 
 		// returns the total size of all segments (including bss) (>= content_size)
-		std::size_t total_size() const noexcept { return _content.size() + _seglens[3]; }
+		std::size_t total_size() const noexcept { return content_size() + _seglens[3]; }
 
 	public: // -- IO -- //
 
@@ -91,7 +97,39 @@ namespace CSX64
 		// throws any exception resulting from failed memory allocation.
 		// if an exception is thrown, this executable is left in the empty state.
 		void load(const std::string &path);
+		// as load, but places the content in a page-aligned anonymous file that Computer::Initialize maps directly into memory
+		// (the read-only segments are shared by every instance and the data segment is copy-on-write) rather than copying it.
+		// the image is shared by copies of this executable, so many instances of one program hold a single copy of it.
+		// where this isn't supported (see Computer::ReservedMemory), it's the same as load.
+		void map(const std::string &path);
+
+	private: // -- helpers -- //
+
+		friend class Computer;
+
+		// gets the file holding the image (see map), or -1 if the content is held in memory
+		int image_fd() const noexcept;
+
+		// validates the header of an executable file of file_size bytes and reads the segment lengths (leaving file at the start of the content).
+		// throws as load on failure (without clearing).
+		void load_header(std::istream &file, u64 file_size);
 	};
+
+	// the content of an executable held in an anonymous file (see Executable::map)
+	struct Executable::Image
+	{
+		int fd = -1;              // the file holding the content (zero padded to a whole number of pages)
+		const u8 *data = nullptr; // a read-only mapping of the file
+		std::size_t size = 0;     // the size of the file and mapping
+
+		Image() = default;
+		~Image();
+
+		Image(const Image&) = delete;
+		Image &operator=(const Image&) = delete;
+	};
+
+	inline int Executable::image_fd() const noexcept { return _image ? _image->fd : -1; }
 }
 
 #endif
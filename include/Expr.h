@@ -5,6 +5,8 @@
 #include <iostream>
 #include <unordered_map>
 #include <vector>
+#include <deque>
+#include <string_view>
 #include <memory>
 
 #include "CoreTypes.h"
@@ -58,23 +60,34 @@ namespace CSX64
 		// maps expr op values to a human-readable form
 		static const std::unordered_map<Expr::OPs, std::string> Op_to_Str;
 
+		class Arena;
+		class ArenaScope;
+
 	private:
-		std::string _Token;
+		// the token (or null if none). tokens from the same arena are interned (see Arena), so they're equal iff their pointers are equal.
+		const std::string *_Token;
 
 		u64 _Result;
 		bool _Floating;
 
+		// makes a token - interned in the current arena (see ArenaScope), or owned by the caller if there is none
+		static const std::string *MakeToken(std::string str);
+		// makes a token equal to another one - shares it if it's already interned in the current arena
+		static const std::string *CopyToken(const std::string *token);
+		// releases a token made by MakeToken() or CopyToken() - interned tokens are freed with their arena
+		static void ReleaseToken(const std::string *token);
+
 		// Caches the specified result - converts this node into an evaluated leaf
 		void CacheResult(u64 result, bool floating);
 
-		// helper function for Evaluate()
-		bool __Evaluate__(std::unordered_map<std::string, Expr> &symbols, u64 &res, bool &floating, std::string &err, std::vector<std::string> &visited);
+		// evaluation engine shared by Evaluate() and EvaluateAll() - walks the symbol dependency graph iteratively
+		class Evaluator;
 
 		// helper function for the FindPath() variants
 		bool _FindPath(const std::string &value, std::vector<Expr*> &path, bool upper);
 
 		// helper for GetStringValues()
-		void _GetStringValues(std::vector<std::string*> &vals);
+		void _GetStringValues(std::vector<const std::string*> &vals) const;
 
 		// helper for ReadFrom()
 		static std::unique_ptr<Expr> _ReadFrom(std::istream &istr);
@@ -97,23 +110,16 @@ namespace CSX64
 		// assigns this tree the resources of another tree. the other tree is left in a valid but undefined state.
 		Expr &operator=(Expr &&other);
 
+		~Expr();
+
 		// frees children recursively and sets this node to a valid but undefined evaluated state - effectively creates an empty node
 		void Clear();
 
 		// returns a pointer to the unevaluated token or null if there is none (i.e. not a leaf or already evaluated)
-		const std::string *Token() const& { return _Token.empty() ? nullptr : &_Token; }
-		const std::string *Token() && = delete;
-		// assigns this node the specified token to be evaluated - may not be an empty string
-		template<typename T>
-		void Token(T &&val)
-		{
-			_Token = std::forward<T>(val);
-			if (_Token.empty()) throw std::invalid_argument("Expr token cannot be empty string");
-
-			OP = OPs::None;
-			Left = nullptr;
-			Right = nullptr;
-		}
+		const std::string *Token() const { return _Token; }
+		// assigns this node the specified token to be evaluated - may not be an empty string.
+		// well-formed numeric literals are parsed immediately, making this an evaluated leaf.
+		void Token(std::string val);
 
 		// Gets if this node is a leaf
 		bool IsLeaf() const { return OP == OPs::None; }
@@ -139,6 +145,13 @@ namespace CSX64
 		/// <param name="symbols">the symbols table for lookup</param>
 		bool Evaluatable(std::unordered_map<std::string, Expr> &symbols);
 
+		/// <summary>
+		/// Evaluates every symbol in the table that can be evaluated, caching the results.
+		/// Each symbol is visited once in dependency order (cycles and undefined references are left unevaluated), so this is linear in the size of the table.
+		/// </summary>
+		/// <param name="symbols">the symbols table to evaluate</param>
+		static void EvaluateAll(std::unordered_map<std::string, Expr> &symbols);
+
 		/// <summary>
 		/// Finds the path to the specified value in the expression tree. Returns true on success. This version reuses the stack object by first clearing its contents.
 		/// </summary>
@@ -168,8 +181,17 @@ namespace CSX64
 		/// <param name="value">The value to replace it with</param>
 		void Resolve(const std::string &expr, const std::string &value);
 
+		// as Resolve(), but taking tokens held by other expressions (see Token()) - faster when resolving the same token in many expressions.
+		// an expr token interned by an arena is only matched by pointer, so this expression's tokens must come from the same arena.
+		// the caller must keep both tokens held (e.g. by an expression of its own) for the duration of the call.
+		void Resolve(const std::string *expr, u64 result, bool floating);
+		void Resolve(const std::string *expr, const std::string *value);
+		// resolves every token in the map with the token it maps to, in a single pass - faster than resolving them one at a time.
+		// tokens are matched by pointer, so the keys must be interned by the arena this expression's tokens come from.
+		void Resolve(const std::unordered_map<const std::string*, const std::string*> &tokens);
+
 		// Gets a list of all the unevaluated string values in this expression
-		std::vector<std::string*> GetStringValues();
+		std::vector<const std::string*> GetStringValues() const;
 
 		/// <summary>
 		/// Populates add and sub lists with terms that are strictly being added and subtracted. All items in add are being added. All items in sub are subtracted.
@@ -204,9 +226,67 @@ namespace CSX64
 
 		// --------------------------------
 
+		// nodes are allocated from the current arena (see ArenaScope), or from the system if there is none.
+		// a node can be freed on any thread, so long as its arena (if any) is still alive and not in use by another thread.
+		static void *operator new(std::size_t size);
+		static void operator delete(void *ptr, std::size_t size) noexcept;
+
+		// --------------------------------
+
 		// writes a human-readable form of the given expression. use WriteTo() for the binary form.
 		friend std::ostream &operator<<(std::ostream &ostr, const Expr &expr);
 	};
+
+	// an expression token string and the arena that interned it (or null if it's owned by the single node holding it).
+	// the string must be the first member, since tokens are passed around as pointers to it.
+	struct ExprToken
+	{
+		std::string str;
+		Expr::Arena *arena;
+	};
+
+	// owns the nodes and interned tokens of the expressions made while it's current (see ArenaScope), and frees them all at once when destroyed.
+	// nodes are allocated in blocks and recycled when freed. tokens are stored once per arena, so copying an expression doesn't copy its token strings.
+	// an arena must outlive every expression made with it, and may only be used by one thread at a time (no locking is done).
+	class Expr::Arena
+	{
+	private:
+		friend class Expr;
+
+		std::deque<ExprToken> tokens;
+		std::unordered_map<std::string_view, const std::string*> index; // keys view the strings they map to
+
+		std::vector<std::unique_ptr<void*[]>> blocks;
+		std::size_t block_used = 0; // the number of node slots used in the last block
+		void *free_nodes = nullptr; // freed nodes, linked through their first bytes
+
+		// gets the interned copy of a token string
+		const std::string *Intern(std::string str);
+
+		void *AllocNode();
+		void FreeNode(void *node) noexcept;
+
+	public:
+		Arena() = default;
+
+		Arena(const Arena&) = delete;
+		Arena &operator=(const Arena&) = delete;
+	};
+
+	// makes an arena (or null for the system heap) the one expressions are made with on this thread for the lifetime of the scope.
+	// the previously-current arena is restored afterwards, so scopes can be nested.
+	class Expr::ArenaScope
+	{
+	private:
+		Arena *prev;
+
+	public:
+		explicit ArenaScope(Arena *arena);
+		~ArenaScope();
+
+		ArenaScope(const ArenaScope&) = delete;
+		ArenaScope &operator=(const ArenaScope&) = delete;
+	};
 }
 
 #endif
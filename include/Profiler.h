@@ -0,0 +1,75 @@
+#ifndef DRAGAZO_CSX64_PROFILER_H
+#define DRAGAZO_CSX64_PROFILER_H
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <utility>
+
+#include "CoreTypes.h"
+#include "SymbolMap.h"
+
+namespace CSX64
+{
+	// the execution profile of a computer (see Computer::Profiling).
+	// counts every executed instruction by address and opcode, estimates the host time spent on each opcode, and records call graph edges.
+	// addresses are positions in the text segment, which map back to symbols via the linker.
+	class Profiler
+	{
+	public: // -- types -- //
+
+		// a call graph edge (from the call instruction to the callee's entry point)
+		struct Edge
+		{
+			u64 calls = 0;  // the number of times the call was made
+			u64 ticks = 0;  // instructions executed inside the callee (inclusive) for calls that have returned
+		};
+
+	public: // -- data -- //
+
+		// one in this many instructions is timed to estimate the host time per opcode
+		static constexpr u64 SampleInterval = 16;
+		// the deepest call stack that's tracked (deeper calls are still counted, but not timed)
+		static constexpr std::size_t MaxCallDepth = 1 << 16;
+
+		u64 ticks = 0;               // total instructions executed while profiling
+		std::vector<u64> rip_counts; // number of times the instruction at each position was executed (indexed by RIP)
+
+		u64 op_counts[256] = {};     // number of times each opcode was executed
+		u64 op_sample_ns[256] = {};  // total host time of the sampled executions of each opcode
+		u64 op_samples[256] = {};    // number of sampled executions of each opcode
+
+		std::map<std::pair<u64, u64>, Edge> edges; // call graph edges, keyed by (call site, callee)
+
+	private: // -- state -- //
+
+		friend class Computer;
+
+		// a call that hasn't returned yet
+		struct Frame
+		{
+			Edge *edge;
+			u64 start; // ticks when the call was made
+		};
+		std::vector<Frame> call_stack;
+		u64 untracked_depth = 0; // the number of calls past MaxCallDepth that haven't returned yet
+
+		u64 sample_phase = 0; // counts up to SampleInterval
+
+	public: // -- interface -- //
+
+		// discards all the profile data
+		void Clear();
+
+		// gets the estimated total host time (in ns) spent on an opcode (extrapolated from the samples)
+		double OpTime(u64 op) const noexcept { return op_samples[op] != 0 ? (double)op_sample_ns[op] * op_counts[op] / op_samples[op] : 0; }
+
+		// writes the profile as text, one record per line (addresses in hex):
+		// "ticks <total>", then "rip <address> <count>" for each executed instruction,
+		// "op <opcode> <count> <estimated ns>" for each executed opcode, and "call <site> <callee> <calls> <inclusive ticks>" for each edge.
+		// if symbols is non-null, each address is followed by its description (see SymbolMap::describe) in square brackets.
+		std::ostream &Write(std::ostream &ostr, const SymbolMap *symbols = nullptr) const;
+	};
+}
+
+#endif
@@ -0,0 +1,194 @@
+#ifndef DRAGAZO_CSX64_SCHEDULER_H
+#define DRAGAZO_CSX64_SCHEDULER_H
+
+#include <memory>
+#include <vector>
+#include <deque>
+#include <unordered_map>
+#include <functional>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+#include "CoreTypes.h"
+#include "ExeTypes.h"
+#include "Computer.h"
+
+namespace CSX64
+{
+	// an interactive input stream fed by the host (e.g. a session's stdin) - safe to push data from any thread.
+	// reading with no data available suspends the guest (see Computer::SuspendedRead) until more is pushed or the channel is closed.
+	// this wrapper can read, but cannot write or seek.
+	class ChannelFileWrapper : public IFileWrapper
+	{
+	private: // -- data -- //
+
+		mutable std::mutex mutex;
+
+		std::vector<unsigned char> b;         // the pending data
+		std::size_t                b_pos = 0; // position of the read head in b
+		bool                       closed = false;
+
+		std::function<void()> on_data; // called (without the lock held) after data is pushed or the channel is closed
+
+	public: // -- ctor / dtor / asgn -- //
+
+		ChannelFileWrapper() = default;
+
+		ChannelFileWrapper(const ChannelFileWrapper&) = delete;
+		ChannelFileWrapper &operator=(const ChannelFileWrapper&) = delete;
+
+	public: // -- host interface -- //
+
+		// sets the function to call when data arrives (typically Scheduler::Wake for the owning session).
+		// should be set before the guest can read from the channel, otherwise a suspended reader might not be woken.
+		void OnData(std::function<void()> f) { std::lock_guard<std::mutex> lock(mutex); on_data = std::move(f); }
+
+		// appends data to the channel
+		void Push(const void *data, std::size_t len);
+		// marks the end of the data - once the pending data has been read, reads return 0 (eof) instead of suspending
+		void Close();
+
+	public: // -- interface -- //
+
+		virtual bool IsInteractive() const override { std::lock_guard<std::mutex> lock(mutex); return !closed; }
+
+		virtual bool CanRead() const override { return true; }
+		virtual bool CanWrite() const override { return false; }
+
+		virtual bool CanSeek() const override { return false; }
+
+		virtual i64 Read(void *buf, i64 cap) override;
+		virtual i64 Write(const void*, i64) override { throw FileWrapperPermissionsException("FileWrapper not flagged for writing"); }
+
+		virtual i64 Seek(i64, std::ios::seekdir) override { throw FileWrapperPermissionsException("FileWrapper not flagged for seeking"); }
+	};
+
+	// multiplexes any number of computers (sessions) over a fixed pool of worker threads.
+	// runnable sessions are executed round-robin in slices of at most Quantum ticks, so each waits at most one round between slices.
+	// a session that suspends for input is parked (taking no worker time) until Wake() is called for it.
+	class Scheduler
+	{
+	public: // -- types -- //
+
+		typedef u64 SessionID;
+
+		// called on a worker thread when a session's computer stops running (terminated or errored)
+		typedef std::function<void(SessionID, Computer&)> ExitHandler;
+
+		// execution statistics for a single session
+		struct SessionStats
+		{
+			u64 ticks = 0;            // instructions executed
+			u64 slices = 0;           // times it was given a worker
+			u64 parks = 0;            // times it was parked awaiting input
+
+			long long run_ns = 0;     // total time spent executing
+			long long wait_ns = 0;    // total time spent runnable but waiting for a worker
+			long long max_wait_ns = 0; // the longest wait for a worker (the latency bound actually observed)
+		};
+
+		// statistics for the scheduler as a whole
+		struct Stats
+		{
+			std::size_t sessions = 0;  // sessions currently held (in any state)
+			std::size_t runnable = 0;  // sessions running or waiting for a worker
+			std::size_t parked = 0;    // sessions awaiting input
+			std::size_t finished = 0;  // sessions that have stopped running
+
+			u64 ticks = 0;             // total instructions executed
+			u64 slices = 0;            // total slices executed
+			double ticks_per_second = 0; // throughput since the scheduler was created
+
+			long long max_wait_ns = 0; // the longest wait of any slice for a worker
+			double mean_wait_ns = 0;   // the mean wait of a slice for a worker
+
+			// jain's fairness index of the ticks executed by each unfinished session - 1 if they all got the same amount, down to 1/n
+			double fairness = 1;
+		};
+
+	private: // -- data -- //
+
+		enum class State { Runnable, Running, Parked, Finished };
+
+		struct Session
+		{
+			SessionID id;
+			std::unique_ptr<Computer> computer;
+			ExitHandler on_exit;
+
+			State state = State::Runnable;
+			bool woken = false; // marks that Wake() was called while running (so it shouldn't be parked)
+
+			std::chrono::steady_clock::time_point queued; // when it last became runnable
+			SessionStats stats;
+		};
+
+		const u64 quantum;
+
+		mutable std::mutex mutex;
+		std::condition_variable work_cv; // signaled when a session becomes runnable (or on shutdown)
+		std::condition_variable idle_cv; // signaled when a slice ends
+
+		std::unordered_map<SessionID, std::unique_ptr<Session>> sessions;
+		std::deque<Session*> run_queue;
+		std::size_t running = 0; // number of sessions currently executing
+		SessionID next_id = 0;
+		bool stopping = false;
+
+		u64 total_ticks = 0, total_slices = 0;
+		long long total_wait_ns = 0, max_wait_ns = 0;
+		const std::chrono::steady_clock::time_point created;
+
+		std::vector<std::thread> workers;
+
+	public: // -- ctor / dtor / asgn -- //
+
+		// the default number of ticks in a slice
+		static constexpr u64 DefaultQuantum = 100000;
+
+		// starts a scheduler with the specified number of worker threads (0 for one per hardware thread) and slice size
+		explicit Scheduler(unsigned threads = 0, u64 quantum = DefaultQuantum);
+		// stops the workers (after their current slices) - sessions that haven't finished are simply destroyed
+		~Scheduler();
+
+		Scheduler(const Scheduler&) = delete;
+		Scheduler &operator=(const Scheduler&) = delete;
+
+	public: // -- sessions -- //
+
+		// adds an initialized computer as a new runnable session and returns its id.
+		// on_exit (if non-null) is called on a worker thread when it stops running.
+		SessionID Add(std::unique_ptr<Computer> computer, ExitHandler on_exit = nullptr);
+
+		// makes a session runnable again after it was parked awaiting input (call this after giving it more data).
+		// if it's currently executing, it won't be parked at the end of the slice. no-op for other states or unknown ids.
+		void Wake(SessionID id);
+
+		// removes a session that isn't runnable (i.e. parked or finished) and returns its computer (null on failure)
+		std::unique_ptr<Computer> Remove(SessionID id);
+
+		// returns true iff the session exists and has stopped running
+		bool Finished(SessionID id) const;
+
+		// blocks until no session is runnable (every session is parked or finished)
+		void WaitIdle();
+
+	public: // -- stats -- //
+
+		// gets the statistics of a session (default-constructed for unknown ids)
+		SessionStats SessionStatistics(SessionID id) const;
+		// gets the statistics of the scheduler as a whole
+		Stats Statistics() const;
+
+	private: // -- helpers -- //
+
+		// pushes a session onto the run queue (lock must be held)
+		void Enqueue(Session &s);
+
+		void WorkerLoop();
+	};
+}
+
+#endif
@@ -0,0 +1,86 @@
+#ifndef DRAGAZO_CSX64_SYMBOLMAP_H
+#define DRAGAZO_CSX64_SYMBOLMAP_H
+
+#include <string>
+#include <vector>
+
+#include "CoreTypes.h"
+
+namespace CSX64
+{
+	// maps addresses in an executable back to the labels and source lines they came from (see Link).
+	// symbols and lines are kept sorted by address, so lookups are a binary search.
+	// a symbol covers the addresses from its own up to (but not including) the next symbol's.
+	class SymbolMap
+	{
+	public: // -- types -- //
+
+		struct Symbol
+		{
+			u64 address;
+			std::string name;
+			u32 file; // index of the source file (see file)
+			int line; // the line where it was defined
+		};
+		struct Line
+		{
+			u64 address; // the address of the first instruction assembled from the line
+			u32 file;    // index of the source file (see file)
+			int line;
+		};
+
+	private: // -- data -- //
+
+		std::vector<std::string> files;
+		std::vector<Symbol> symbols; // sorted by address (ties in insertion order)
+		std::vector<Line> lines;     // sorted by address
+
+	public: // -- construction -- //
+
+		// empties the map
+		void clear() noexcept;
+
+		// adds a source file and returns its index
+		u32 add_file(std::string name);
+		// adds a symbol or a line - finalize() must be called after adding before any lookups
+		void add_symbol(u64 address, std::string name, u32 file, int line);
+		void add_line(u64 address, u32 file, int line);
+
+		// sorts the symbols and lines by address
+		void finalize();
+
+	public: // -- access -- //
+
+		bool empty() const noexcept { return symbols.empty() && lines.empty(); }
+
+		// gets the name of a source file by index
+		const std::string &file(u32 index) const { return files.at(index); }
+
+		const std::vector<Symbol> &all_symbols() const noexcept { return symbols; }
+		const std::vector<Line> &all_lines() const noexcept { return lines; }
+
+		// gets the symbol covering an address (the first symbol at the greatest address <= address) - null if none
+		const Symbol *find_symbol(u64 address) const noexcept;
+		// gets the line covering an address (the line at the greatest address <= address) - null if none
+		const Line *find_line(u64 address) const noexcept;
+
+		// describes an address as "symbol+offset (file:line)" - parts that aren't known are omitted (an unknown address is just hex)
+		std::string describe(u64 address) const;
+
+	public: // -- IO -- //
+
+		// saves this map to a file located at (path).
+		// throws FileOpenError if the file cannot be opened (for writing).
+		// throws IOError if any write operation fails.
+		void save(const std::string &path) const;
+		// loads this map with the content of a file located at (path).
+		// throws FileOpenError if the file cannot be opened (for reading).
+		// throws TypeError if the file is not a CSX64 symbol map.
+		// throws VersionError if the file is of an incompatible version.
+		// throws FormatError if the file is corrupted.
+		// if an exception is thrown, this map is left empty.
+		void load(const std::string &path);
+	};
+}
+
+#endif
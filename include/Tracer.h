@@ -0,0 +1,134 @@
+#ifndef DRAGAZO_CSX64_TRACER_H
+#define DRAGAZO_CSX64_TRACER_H
+
+#include <iostream>
+#include <vector>
+#include <memory>
+
+#include "CoreTypes.h"
+#include "SymbolMap.h"
+
+namespace CSX64
+{
+	// the execution trace of a computer (see Computer::Tracing).
+	// records the address and opcode of each executed instruction (and optionally the effective address of each memory operand) in a fixed-size ring buffer.
+	// once the buffer is full, the oldest records are overwritten, so the trace always holds the most recent history (e.g. leading up to a crash).
+	//
+	// the buffer is split into blocks, each a sequence of records whose addresses are delta encoded from the previous record of the same kind in the block.
+	// each record starts with a header byte [1: more][5: value][2: kind] followed by the rest of the zigzag encoded delta as a base-128 varint (if more is set).
+	// an instruction record (kind 1) is followed by the opcode byte, and an effective address record (kind 2) belongs to the instruction before it.
+	// sequential code takes 2 bytes per instruction.
+	//
+	// recording is single-writer (the executing thread) and never blocks or allocates.
+	// reading the trace is not synchronized with recording - it must be done while nothing is being recorded (e.g. from the executing thread or while the computer is stopped).
+	class Tracer
+	{
+	public: // -- types -- //
+
+		// a decoded instruction record
+		struct Entry
+		{
+			u64 rip;                    // the address of the instruction
+			u8 op;                      // the opcode (0 if the address was outside the text segment)
+			std::vector<u64> addresses; // the effective addresses of its memory operands (if recorded)
+		};
+
+		// the raw records of a trace, one string of bytes per block (oldest first)
+		typedef std::vector<std::vector<u8>> Blocks;
+
+	public: // -- data -- //
+
+		static constexpr u64 BlockSize = 4096;
+		static constexpr u64 MaxRecordSize = 11; // the longest header and varint, plus the opcode
+
+		static constexpr u64 DefaultCapacity = 1024 * 1024;
+
+	private: // -- state -- //
+
+		std::unique_ptr<u8[]> data;     // the blocks
+		std::unique_ptr<u32[]> lengths; // the number of bytes used in each block (updated when the writer moves on)
+		u64 block_count;
+
+		u8 *block; // the block being written
+		u64 fill;  // bytes used in the block being written
+		u64 seq;   // the number of blocks started before the one being written
+
+		u64 last_rip, last_address;
+
+		// moves on to the next block, overwriting the oldest one
+		void NextBlock();
+
+		// writes a record header and delta
+		void Put(u64 delta, u8 kind) noexcept
+		{
+			u64 v = (delta << 1) ^ (u64)((i64)delta >> 63); // zigzag so small negative deltas are short too
+			const u8 first = (u8)(((v & 31) << 2) | kind);
+			v >>= 5;
+
+			if (v == 0) { block[fill++] = first; return; }
+
+			block[fill++] = first | 0x80;
+			for (; v >= 0x80; v >>= 7) block[fill++] = (u8)(v | 0x80);
+			block[fill++] = (u8)v;
+		}
+
+	public: // -- ctor/dtor -- //
+
+		// creates an empty trace with room for about capacity bytes of records (at least two blocks)
+		explicit Tracer(u64 capacity = DefaultCapacity);
+
+		Tracer(const Tracer&) = delete;
+		Tracer &operator=(const Tracer&) = delete;
+
+	public: // -- recording -- //
+
+		// discards all the records
+		void Clear();
+
+		// records an executed instruction
+		void Instruction(u64 rip, u8 op) noexcept
+		{
+			if (fill > BlockSize - MaxRecordSize) NextBlock();
+			Put(rip - last_rip, 1);
+			block[fill++] = op;
+			last_rip = rip;
+		}
+		// records the effective address of a memory operand of the last instruction
+		void Address(u64 address) noexcept
+		{
+			if (fill > BlockSize - MaxRecordSize) NextBlock();
+			Put(address - last_address, 2);
+			last_address = address;
+		}
+
+	public: // -- access -- //
+
+		// copies the blocks still in the buffer (oldest first).
+		// must not be called while records are being added (see class description).
+		Blocks Snapshot() const;
+
+		// decodes the records of a trace into entries (oldest first).
+		// throws FormatError if the records are corrupted.
+		static std::vector<Entry> Decode(const Blocks &blocks);
+
+		// decodes the current content of the trace (see Snapshot)
+		std::vector<Entry> Entries() const { return Decode(Snapshot()); }
+
+		// writes decoded entries as text, one per line (addresses in hex): "<rip> <opcode>" followed by " <address>" for each effective address.
+		// if symbols is non-null, each rip is followed by its description (see SymbolMap::describe) in square brackets.
+		static std::ostream &Write(std::ostream &ostr, const std::vector<Entry> &entries, const SymbolMap *symbols = nullptr);
+
+	public: // -- IO -- //
+
+		// writes the current content of the trace (see Snapshot) to a binary stream (see Load).
+		// throws IOError if the writes fail.
+		void Save(std::ostream &ostr) const;
+		// reads the records of a trace saved by Save.
+		// throws TypeError if the stream is not a CSX64 trace.
+		// throws VersionError if the trace is of an incompatible version.
+		// throws FormatError if the trace is corrupted.
+		static Blocks Load(std::istream &istr);
+	};
+}
+
+#endif
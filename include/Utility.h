@@ -20,6 +20,7 @@
 #include <unordered_set>
 #include <algorithm>
 #include <type_traits>
+#include <functional>
 
 #include "CoreTypes.h"
 #include "punning.h"
@@ -29,6 +30,8 @@ namespace CSX64
 	// -- versioning info -- //
 
 	const u64 Version = 0x500;
+	// object file format version - bumped on its own when only the object file layout changes (e.g. the debug info section)
+	const u64 ObjectFileVersion = 0x501;
 
 	// -- arch encoding helpers -- //
 
@@ -57,6 +60,20 @@ namespace CSX64
 	// reads a binary representation of str from the stream.
 	std::istream &BinRead(std::istream &istr, std::string &str);
 
+	// -- hashing -- //
+
+	// computes the 64-bit FNV-1a hash of count bytes from the buffer (continuing from a previous hash if provided).
+	// this is for content fingerprints (e.g. cache keys), not security.
+	u64 HashBytes(const void *p, std::size_t count, u64 hash = 0xcbf29ce484222325);
+
+	// -- parallelism -- //
+
+	// runs job(i) for each i in [0, count) on a pool of worker threads (0 for one per hardware thread), the calling thread being one of them.
+	// the jobs are dealt out in contiguous runs and idle workers steal pending jobs from busy ones.
+	// if a job throws, the jobs not yet started are skipped and the (first) exception is rethrown on the calling thread once every worker is done.
+	// with one thread (or job), the jobs are run in sequence on the calling thread.
+	void ParallelFor(std::size_t count, unsigned threads, const std::function<void(std::size_t)> &job);
+
 	// -- container utilities -- //
 
 	// returns true if the container has at least one entry equal to val
@@ -123,6 +140,9 @@ namespace CSX64
 	// if <ptr> is null, does nothing.
 	void aligned_free(void *ptr);
 
+	// returns true iff the len bytes starting at p are all zero
+	bool AllZero(const void *p, std::size_t len);
+
 	/// <summary>
 	/// Writes a value to the array
 	/// </summary>
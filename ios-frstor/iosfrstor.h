@@ -0,0 +1,12 @@
+#ifndef IOSFRSTOR_H
+#define IOSFRSTOR_H
+#include <ios>
+class iosfrstor {
+	std::ios_base &s; std::ios_base::fmtflags f; std::streamsize p, w;
+public:
+	std::ios_base &fmt() { return s; }
+	explicit iosfrstor(std::ios_base &_s) : s(_s), f(_s.flags()), p(_s.precision()), w(_s.width()) {}
+	~iosfrstor() { s.flags(f); s.precision(p); s.width(w); }
+	iosfrstor(const iosfrstor&) = delete; iosfrstor &operator=(const iosfrstor&) = delete;
+};
+#endif
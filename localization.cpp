@@ -45,6 +45,11 @@ const char *exe_dir()
 	return obj.res;
 }
 
+unsigned long long process_id()
+{
+	return GetCurrentProcessId();
+}
+
 #elif defined(unix) || defined(__unix__) || defined(__unix)
 
 // ---------- //
@@ -85,6 +90,11 @@ const char *exe_dir()
     return obj.res;
 }
 
+unsigned long long process_id()
+{
+    return (unsigned long long)getpid();
+}
+
 #else
 
 // --------------------- //
@@ -98,5 +108,10 @@ const char *exe_dir()
 	return nullptr;
 }
 
+unsigned long long process_id()
+{
+	return 0;
+}
+
 #endif
 
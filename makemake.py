@@ -17,6 +17,12 @@ exe_name = "csx.exe"
 # the list of source directories - their contents are searched for .cpp files
 source_dirs = [ "./", "src/" ]
 
+# the list of test directories - each .cpp file in them is a standalone test program (returns nonzero on failure)
+test_dirs = [ "tests/" ]
+
+# the source directories whose objects are linked into the test programs (everything but the driver)
+lib_dirs = [ "src/" ]
+
 # the directory to place object files in
 objdir = "obj/"
 
@@ -31,18 +37,23 @@ build_info = [
 
 # --------------------------------------
 
-source = []
-for dir in source_dirs:
-    for name in os.listdir(dir):
-        if name.endswith(".cpp"):
-            dep = []
-            with open(dir + name, "r") as file:
-                for line in file:
-                    match = re.fullmatch("\\s*#include \"(.*)\"\\s*", line)
-                    if match: dep.append(match.groups()[0])
-            source.append(type("obj", (object,), { "name" : name, "dir" : dir, "dep" : dep, "size" : os.path.getsize(dir + name) }))
+def parse_sources(dirs):
+    res = []
+    for dir in dirs:
+        for name in os.listdir(dir):
+            if name.endswith(".cpp"):
+                dep = []
+                with open(dir + name, "r") as file:
+                    for line in file:
+                        match = re.fullmatch("\\s*#include \"(.*)\"\\s*", line)
+                        if match: dep.append(match.groups()[0])
+                res.append(type("obj", (object,), { "name" : name, "dir" : dir, "dep" : dep, "size" : os.path.getsize(dir + name) }))
 
-source.sort(key=lambda s: s.size, reverse=True)
+    res.sort(key=lambda s: s.size, reverse=True)
+    return res
+
+source = parse_sources(source_dirs)
+tests = parse_sources(test_dirs)
 
 print("Parsed Dependencies:\n")
 for s in source:
@@ -71,7 +82,31 @@ with open(out_name, "w") as out:
             for d in s.dep: dep += " {}".format(s.dir + d)
             obj_path = f"{objdir + build.name}/{s.name[:-4]}.o"
             out.write(f"{obj_path}:{dep}\n\t{build.compile.format(s.dir + s.name)} -o {obj_path}\n\n")
-    
+
+        # each test is linked with the library objects and run by the {build}-test target (test objects get their own directory so names can't collide)
+        os.makedirs(objdir + build.name + "/tests")
+
+        lib_objs = ""
+        for s in source:
+            if s.dir in lib_dirs: lib_objs += f" {objdir + build.name}/{s.name[:-4]}.o"
+
+        test_exes = ""
+        for s in tests:
+            dep = ""
+            for d in s.dep: dep += " {}".format(s.dir + d)
+            obj_path = f"{objdir + build.name}/tests/{s.name[:-4]}.o"
+            exe_path = f"{objdir + build.name}/tests/{s.name[:-4]}.exe"
+            out.write(f"{obj_path}:{dep}\n\t{build.compile.format(s.dir + s.name)} -o {obj_path}\n\n")
+            out.write(f"{exe_path}:{lib_objs} {obj_path}\n\t{build.link.format(lib_objs + ' ' + obj_path)} -o {exe_path}\n\n")
+            test_exes += f" {exe_path}"
+        objsets.append(test_exes + test_exes.replace(".exe", ".o"))
+
+        out.write(f"{build.name}-test:{test_exes}\n")
+        for exe in test_exes.split(): out.write(f"\t{exe}\n")
+        out.write("\n")
+
+    out.write("test: release-test\n\n")
+
     clean_cmd = f"clean:\n\trm -f {exe_name}"
     for set in objsets: clean_cmd += f"\n\trm -f {set}"
     out.write(clean_cmd + "\n\n")
@@ -110,6 +110,9 @@ bool AssembleArgs::TryExtractLineHeader(std::string &rawline)
 			temp.Left = Expr::NewToken(SegOffsets.at(current_seg));
 			temp.Right = Expr::NewInt(line_pos_in_seg);
 			file.Symbols.emplace(label_def, std::move(temp));
+
+			// and keep a record of it for the symbol map (the symbol itself may be renamed or eliminated)
+			file.Labels.push_back({ label_def, current_seg, line_pos_in_seg, line });
 		}
 	}
 
@@ -132,8 +135,8 @@ bool AssembleArgs::TryExtractLineHeader(std::string &rawline)
 
 	// -- finalize -- //
 
-	// chop off everything we consumed (pos currently points to the start of op)
-	rawline = rawline.substr(pos);
+	// chop off everything we consumed (pos currently points to the start of op) - in place to reuse its buffer
+	rawline.erase(0, pos);
 
 	return true;
 }
@@ -204,12 +207,14 @@ bool AssembleArgs::TrySplitOnCommas(std::vector<std::string> &vec, const std::st
 		// make sure we closed any parens
 		if (depth != 0) { res = { AssembleError::FormatError, "Unmatched parens in argument" }; return false; }
 
-		// get the arg (remove leading/trailing white space - some logic requires them not be there e.g. address parser)
-		std::string arg = Trim(str.substr(pos, end - pos));
+		// get the arg (remove leading/trailing white space - some logic requires them not be there e.g. address parser).
+		// leading white space was already skipped, so just find the end (this avoids building a temporary to trim)
+		std::size_t arg_end = end;
+		while (arg_end > pos && std::isspace((unsigned char)str[arg_end - 1])) --arg_end;
 		// make sure arg isn't empty
-		if (arg.empty()) { res = { AssembleError::FormatError, "Empty argument encountered" }; return false; }
+		if (arg_end == pos) { res = { AssembleError::FormatError, "Empty argument encountered" }; return false; }
 		// add this token
-		vec.emplace_back(std::move(arg));
+		vec.emplace_back(str, pos, arg_end - pos);
 	}
 
 	// successfully parsed line
@@ -232,7 +237,7 @@ bool AssembleArgs::SplitLine(const std::string &rawline)
 	for (end = pos; end < rawline.size() && !std::isspace((unsigned char)rawline[end]); ++end);
 
 	// if we got something, record as op, otherwise is empty string
-	if (pos < rawline.size()) op = rawline.substr(pos, end - pos);
+	if (pos < rawline.size()) op.assign(rawline, pos, end - pos);
 	else op.clear();
 
 	// -- parse args -- //
@@ -2255,7 +2260,7 @@ bool AssembleArgs::TryProcessShift(OPCode opcode)
 
 		if (!TryAppendVal(1, (a_sizecode << 2) | 1)) return false;
 		if (!__TryProcessShift_mid()) return false;
-		if (!TryAppendAddress(1, b, std::move(ptr_base))) return false;
+		if (!TryAppendAddress(a, b, std::move(ptr_base))) return false;
 	}
 	else { res = {AssembleError::UsageError, "line " + tostr(line) + ": Expected a cpu register or memory value as first operand"}; return false; }
 
@@ -18,6 +18,10 @@
 #include <limits>
 #include <memory>
 #include <fstream>
+#include <sstream>
+#include <string_view>
+#include <mutex>
+#include <shared_mutex>
 
 #include "../include/Assembly.h"
 #include "../include/Utility.h"
@@ -53,6 +57,55 @@ namespace CSX64
 
 	// -- object file -- //
 
+	ObjectFile::ObjectFile(const ObjectFile &other) : ObjectFile() { *this = other; }
+	ObjectFile &ObjectFile::operator=(const ObjectFile &other)
+	{
+		if (this == &other) return *this;
+
+		// copy the expressions into a new arena (ours is only replaced once our old expressions are gone)
+		std::shared_ptr<Expr::Arena> arena = other._Arena ? std::make_shared<Expr::Arena>() : nullptr;
+		{
+			Expr::ArenaScope arena_scope(arena.get());
+
+			Symbols = other.Symbols;
+
+			TextHoles = other.TextHoles;
+			RodataHoles = other.RodataHoles;
+			DataHoles = other.DataHoles;
+		}
+		_Arena = std::move(arena);
+
+		_Clean = other._Clean;
+
+		GlobalSymbols = other.GlobalSymbols;
+		ExternalSymbols = other.ExternalSymbols;
+
+		TextAlign = other.TextAlign;
+		RodataAlign = other.RodataAlign;
+		DataAlign = other.DataAlign;
+		BSSAlign = other.BSSAlign;
+
+		Text = other.Text;
+		Rodata = other.Rodata;
+		Data = other.Data;
+		BssLen = other.BssLen;
+
+		Literals = other.Literals;
+
+		Labels = other.Labels;
+		TextLines = other.TextLines;
+
+		return *this;
+	}
+	ObjectFile::~ObjectFile()
+	{
+		// the expressions have to be freed before their arena (which is destroyed first, since it's declared last)
+		Symbols.clear();
+		TextHoles.clear();
+		RodataHoles.clear();
+		DataHoles.clear();
+	}
+
 	void ObjectFile::clear() noexcept
 	{
 		_Clean = false;
@@ -77,22 +130,35 @@ namespace CSX64
 		BssLen = 0;
 
 		Literals.clear();
+
+		Labels.clear();
+		TextLines.clear();
+
+		// the expressions are gone, so the arena can go too
+		_Arena = nullptr;
 	}
 
 	static const u8 obj_header[] = { 'C', 'S', 'X', '6', '4', 'o', 'b', 'j' };
 
 	void ObjectFile::save(const std::string &path) const
 	{
-		// ensure the object is clean
+		// ensure the object is clean (before creating the file)
 		if (!is_clean()) throw DirtyError("Attempt to save dirty object file");
 
 		std::ofstream file(path, std::ios::binary);
 		if (!file) throw FileOpenError("Failed to open file for saving object file");
 
-		// -- write obj_header and CSX64 version number -- //
+		save(file);
+	}
+	void ObjectFile::save(std::ostream &file) const
+	{
+		// ensure the object is clean
+		if (!is_clean()) throw DirtyError("Attempt to save dirty object file");
+
+		// -- write obj_header and object file version number -- //
 
 		BinWrite(file, reinterpret_cast<const char*>(obj_header), sizeof(obj_header));
-		BinWrite(file, Version);
+		BinWrite(file, ObjectFileVersion);
 
 		// -- write globals -- //
 
@@ -150,6 +216,24 @@ namespace CSX64
 
 		Literals.write_to(file);
 
+		// -- write debug info -- //
+
+		BinWrite<u64>(file, Labels.size());
+		for (const LabelData &label : Labels)
+		{
+			BinWrite(file, label.Name);
+			BinWrite<u8>(file, (u8)label.Segment);
+			BinWrite(file, label.Address);
+			BinWrite<i32>(file, label.Line);
+		}
+
+		BinWrite<u64>(file, TextLines.size());
+		for (const LineData &line : TextLines)
+		{
+			BinWrite(file, line.Address);
+			BinWrite<i32>(file, line.Line);
+		}
+
 		// -- validation -- //
 
 		// make sure the writes succeeded
@@ -160,8 +244,14 @@ namespace CSX64
 		std::ifstream file(path, std::ios::binary);
 		if (!file) throw FileOpenError("Failed to open file for loading object file");
 
-		// mark as initially dirty
-		_Clean = false;
+		load(file);
+	}
+	void ObjectFile::load(std::istream &file)
+	{
+		// start from an empty file (this also marks it as dirty) with a new arena for the expressions we read
+		clear();
+		_Arena = std::make_shared<Expr::Arena>();
+		Expr::ArenaScope arena_scope(_Arena.get());
 
 		u64 val;
 		std::string str;
@@ -180,9 +270,9 @@ namespace CSX64
 
 		// read the version number and make sure it matches - match failure is a version error, not a format error
 		if (!BinRead(file, val)) goto err;
-		if (val != Version)
+		if (val != ObjectFileVersion)
 		{
-			throw VersionError("Executable was from an incompatible version of CSX64");
+			throw VersionError("Object file was from an incompatible version of CSX64");
 		}
 
 		// -- read globals -- //
@@ -278,6 +368,34 @@ namespace CSX64
 
 		if (!Literals.read_from(file)) goto err;
 
+		// -- read debug info -- //
+
+		Labels.clear();
+		TextLines.clear();
+		{
+			u8 seg;
+			i32 line;
+
+			if (!BinRead(file, val)) goto err;
+			for (u64 i = 0; i < val; ++i)
+			{
+				LabelData label;
+				if (!BinRead(file, label.Name) || !BinRead(file, seg) || !BinRead(file, label.Address) || !BinRead(file, line)) goto err;
+				label.Segment = (AsmSegment)seg;
+				label.Line = line;
+				Labels.emplace_back(std::move(label));
+			}
+
+			if (!BinRead(file, val)) goto err;
+			for (u64 i = 0; i < val; ++i)
+			{
+				LineData data;
+				if (!BinRead(file, data.Address) || !BinRead(file, line)) goto err;
+				data.Line = line;
+				TextLines.push_back(data);
+			}
+		}
+
 		// -- done -- //
 
 		// validate the object
@@ -377,7 +495,8 @@ namespace CSX64
 		else return 3;
 	}
 
-	void RenameSymbol(ObjectFile &file, std::string from, std::string to)
+	// renames a symbol in the file's symbol tables (but not in its expressions) - see RenameSymbol()
+	static void _RenameSymbolEntry(ObjectFile &file, const std::string &from, const std::string &to)
 	{
 		// make sure "to" doesn't already exist
 		if (ContainsKey(file.Symbols, to) || Contains(file.ExternalSymbols, to))
@@ -411,16 +530,57 @@ namespace CSX64
 		}
 		// otherwise we don't know what it is
 		else throw std::runtime_error("Attempt to rename symbol \"" + from + "\" to \"" + to + "\" (does not exist)");
+	}
+
+	void RenameSymbol(ObjectFile &file, std::string from, std::string to)
+	{
+		_RenameSymbolEntry(file, from, to);
+
+		// make the tokens in the file's arena, so they match by pointer
+		Expr::ArenaScope arena_scope(file.arena());
 
 		// -- now the easy part -- //
+
+		// hold both tokens while resolving (so each is made once rather than once per expression)
+		const Expr from_ref = Expr::CreateToken(std::move(from));
+		const Expr to_ref = Expr::CreateToken(std::move(to));
+		const std::string *from_token = from_ref.Token();
+		const std::string *to_token = to_ref.Token();
 		
 		// find and replace in symbol table expressions
-		for(auto &entry : file.Symbols) entry.second.Resolve(from, to);
+		for(auto &entry : file.Symbols) entry.second.Resolve(from_token, to_token);
 
 		// find and replace in hole expressions
-		for(auto &entry : file.TextHoles) entry.expr.Resolve(from, to);
-		for (auto &entry : file.RodataHoles) entry.expr.Resolve(from, to);
-		for (auto &entry : file.DataHoles) entry.expr.Resolve(from, to);
+		for(auto &entry : file.TextHoles) entry.expr.Resolve(from_token, to_token);
+		for (auto &entry : file.RodataHoles) entry.expr.Resolve(from_token, to_token);
+		for (auto &entry : file.DataHoles) entry.expr.Resolve(from_token, to_token);
+	}
+
+	// renames several symbols as RenameSymbol() would one at a time, but replaces them in a single pass over the file's expressions.
+	// the new names must be distinct from the old ones, and the file's arena must be current (see ObjectFile::arena()).
+	static void _RenameSymbols(ObjectFile &file, const std::vector<std::pair<std::string, std::string>> &renames)
+	{
+		std::vector<Expr> refs; // holds the tokens while resolving
+		std::unordered_map<const std::string*, const std::string*> tokens;
+		refs.reserve(renames.size() * 2);
+		tokens.reserve(renames.size());
+
+		for (const auto &rename : renames)
+		{
+			_RenameSymbolEntry(file, rename.first, rename.second);
+
+			refs.push_back(Expr::CreateToken(rename.first));
+			refs.push_back(Expr::CreateToken(rename.second));
+			tokens.emplace(refs[refs.size() - 2].Token(), refs.back().Token());
+		}
+
+		// find and replace in symbol table expressions
+		for (auto &entry : file.Symbols) entry.second.Resolve(tokens);
+
+		// find and replace in hole expressions
+		for (auto &entry : file.TextHoles) entry.expr.Resolve(tokens);
+		for (auto &entry : file.RodataHoles) entry.expr.Resolve(tokens);
+		for (auto &entry : file.DataHoles) entry.expr.Resolve(tokens);
 	}
 	
 	// helper for imm parser
@@ -493,26 +653,48 @@ namespace CSX64
 
 	// Stores all the predefined symbols that are not defined by the assembler itself
 	std::unordered_map<std::string, Expr> PredefinedSymbols;
+	// guards PredefinedSymbols - any number of assemblies can read it while nothing is being defined
+	std::shared_mutex PredefinedSymbolsMutex;
 
 	void DefineSymbol(std::string key, std::string value)
 	{
 		Expr expr;
 		expr.Token(std::move(value));
+		std::unique_lock<std::shared_mutex> lock(PredefinedSymbolsMutex);
 		PredefinedSymbols.emplace(std::move(key), std::move(expr));
 	}
 	void DefineSymbol(std::string key, u64 value)
 	{
 		Expr expr;
 		expr.IntResult(value);
+		std::unique_lock<std::shared_mutex> lock(PredefinedSymbolsMutex);
 		PredefinedSymbols.emplace(std::move(key), std::move(expr));
 	}
 	void DefineSymbol(std::string key, double value)
 	{
 		Expr expr;
 		expr.FloatResult(value);
+		std::unique_lock<std::shared_mutex> lock(PredefinedSymbolsMutex);
 		PredefinedSymbols.emplace(std::move(key), std::move(expr));
 	}
 
+	u64 PredefinedSymbolsHash()
+	{
+		// hash the definitions in key order so the result doesn't depend on the table's layout (floats in hex so they're exact and distinct from ints)
+		std::shared_lock<std::shared_mutex> lock(PredefinedSymbolsMutex);
+
+		std::vector<const std::pair<const std::string, Expr>*> defs;
+		for (const auto &entry : PredefinedSymbols) defs.push_back(&entry);
+		std::sort(defs.begin(), defs.end(), [](auto a, auto b) { return a->first < b->first; });
+
+		std::ostringstream ostr;
+		ostr << std::hexfloat;
+		for (auto def : defs) ostr << def->first << '=' << def->second << '\n';
+
+		const std::string str = ostr.str();
+		return HashBytes(str.data(), str.size());
+	}
+
 	// -- patching -- //
 
 	/// <summary>
@@ -551,6 +733,61 @@ namespace CSX64
 		else { err = "line " + tostr(data.Line) + ": Failed to evaluate expression\n-> " + err; return PatchError::Unevaluated; }
 	}
 
+	// -- source reading -- //
+
+	// reads lines of source code from a stream a large block at a time (extracting a character at a time is very slow)
+	class SourceLineReader
+	{
+	private: // -- data -- //
+
+		static constexpr std::size_t BlockSize = 64 * 1024;
+
+		std::istream &istr;
+		std::vector<char> buf;
+		std::size_t pos = 0, end = 0; // the unread content of buf is [pos, end)
+		bool more;                    // false once the last line has been returned
+
+	public: // -- interface -- //
+
+		explicit SourceLineReader(std::istream &_istr) : istr(_istr), buf(BlockSize), more((bool)_istr) {}
+
+		// gets the next line (without its new line char). returns false when there are no more lines.
+		// whatever follows the last new line is a line too (even if it's empty).
+		// the view is only valid until the next call.
+		bool next(std::string_view &line)
+		{
+			if (!more) return false;
+
+			while (true)
+			{
+				if (const char *nl = static_cast<const char*>(std::memchr(buf.data() + pos, '\n', end - pos)))
+				{
+					line = std::string_view(buf.data() + pos, nl - (buf.data() + pos));
+					pos = nl + 1 - buf.data();
+					return true;
+				}
+
+				// if the stream is exhausted, the rest is the last line
+				if (!istr)
+				{
+					line = std::string_view(buf.data() + pos, end - pos);
+					pos = end;
+					more = false;
+					return true;
+				}
+
+				// move the partial line to the front (growing the buffer if it's full) and read another block after it
+				std::memmove(buf.data(), buf.data() + pos, end - pos);
+				end -= pos;
+				pos = 0;
+				if (end == buf.size()) buf.resize(buf.size() * 2);
+
+				istr.read(buf.data() + end, buf.size() - end);
+				end += (std::size_t)istr.gcount();
+			}
+		}
+	};
+
 	// -- let the fun begin -- //
 
 	// tries to patch and eliminate as many holes as possible. returns true unless there was a hard error during evaluation (e.g. unsupported floating-point format).
@@ -595,11 +832,18 @@ namespace CSX64
 		// clear out the destination object file
 		_file_.clear();
 
+		// expressions made while assembling are allocated from an arena owned by the object file (freed all at once along with it)
+		_file_._Arena = std::make_shared<Expr::Arena>();
+		Expr::ArenaScope arena_scope(_file_._Arena.get());
+
 		// create the asm args for parsing - reference the (cleared) destination object file
 		AssembleArgs args(_file_);
 
 		// add all the predefined symbols
-		args.file.Symbols.insert(PredefinedSymbols.begin(), PredefinedSymbols.end());
+		{
+			std::shared_lock<std::shared_mutex> lock(PredefinedSymbolsMutex);
+			args.file.Symbols.insert(PredefinedSymbols.begin(), PredefinedSymbols.end());
+		}
 		
 		// -- add a few more that we create -- //
 		
@@ -616,34 +860,17 @@ namespace CSX64
 		args.file.Symbols.insert(std::make_pair("__pi__", Expr::CreateFloat(3.141592653589793238462643383279502884197169399375105820974)));
 		args.file.Symbols.insert(std::make_pair("__e__", Expr::CreateFloat(2.718281828459045235360287471352662497757247093699959574966)));
 
-		// potential parsing args for an instruction
-		u64 a = 0;
-		bool floating;
-
-		std::string err; // error location for evaluation
-
-		std::string rawline; // raw line to parse
-		int ch;              // character extracted
+		SourceLineReader reader(code);
+		std::string_view line; // line from the reader
+		std::string rawline;   // raw line to parse (reused so it rarely allocates)
 
 		const asm_router *router; // router temporary
 
-		while (code)
+		while (reader.next(line))
 		{
-			// get the line to parse
-			rawline.clear();
-			while ((ch = code.get()) != EOF)
-			{
-				// if we hit a comment char, discard it and the rest of the line
-				if (ch == CommentChar)
-				{
-					code.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
-					break; // we extracted a new line char, so stop line processing loop
-				}
-				// if we hit a new line char, we're done (don't append it to the string)
-				else if (ch == '\n') break;
-				// otherwise it's a normal char - add it to the raw line
-				else rawline.push_back(ch);
-			}
+			// get the line to parse - if there's a comment char, discard it and the rest of the line
+			if (const void *comment = std::memchr(line.data(), CommentChar, line.size())) line = line.substr(0, static_cast<const char*>(comment) - line.data());
+			rawline.assign(line.data(), line.size());
 			++args.line;
 
 			// if this is a shebang line (must have "#!" at the start of line 1)
@@ -676,6 +903,10 @@ namespace CSX64
 
 					// perform the assembly action
 					if (!(*router)(args)) return args.res;
+
+					// record where text from a new line starts (for the symbol map)
+					if (args.current_seg == AsmSegment::TEXT && args.file.Text.size() > args.line_pos_in_seg && (args.file.TextLines.empty() || args.file.TextLines.back().Line != args.line))
+						args.file.TextLines.push_back({ args.line_pos_in_seg, args.line });
 				}
 			}
 		}
@@ -683,7 +914,7 @@ namespace CSX64
 		// -- minimize symbols and holes -- //
 
 		// link each symbol to internal symbols (minimizes file size)
-		for(auto &entry : args.file.Symbols) entry.second.Evaluate(args.file.Symbols, a, floating, err);
+		Expr::EvaluateAll(args.file.Symbols);
 
 		// eliminate as many holes as possible
 		if (!_ElimHoles(args.file.Symbols, args.file.TextHoles, args.file.Text, args.res)) return args.res;
@@ -694,7 +925,7 @@ namespace CSX64
 		
 		// these are copies to ensure removing/renaming in the symbol table doesn't make them dangling pointers
 		std::vector<std::string> elim_symbols;   // symbol names to be eliminated
-		std::vector<std::string> rename_symbols; // symbol names that we can rename to be shorter
+		std::vector<std::pair<std::string, std::string>> rename_symbols; // symbol names that we can rename to be shorter (and their new names)
 
 		// for each symbol
 		for(auto &entry : args.file.Symbols)
@@ -709,7 +940,7 @@ namespace CSX64
 					elim_symbols.push_back(entry.first);
 				}
 				// otherwise we can rename it to something shorter (because it's still needed internally, but not needed externally)
-				else rename_symbols.push_back(entry.first);
+				else rename_symbols.emplace_back(entry.first, "^" + tohex(rename_symbols.size()));
 			}
 		}
 		// remove all the symbols we can eliminate
@@ -721,7 +952,7 @@ namespace CSX64
 		if (!args.VerifyIntegrity()) return args.res;
 
 		// rename all the symbols we can shorten (done after verify to ensure there's no verify error messages with the renamed symbols)
-		for (std::size_t i = 0; i < rename_symbols.size(); ++i) RenameSymbol(args.file, std::move(rename_symbols[i]), "^" + tohex(i));
+		_RenameSymbols(args.file, rename_symbols);
 		
 		// validate assembled result (referentially-bound to _file_ argument)
 		args.file._Clean = true;
@@ -729,13 +960,37 @@ namespace CSX64
 		// return no error
 		return {AssembleError::None, ""};
 	}
-	LinkResult Link(Executable &exe, std::list<std::pair<std::string, ObjectFile>> &objs, const std::string &entry_point)
+	// gets the segment whose address a (segment origin or offset) token refers to, or INVALID if it's not one of those tokens
+	static AsmSegment _TokenSegment(const std::string &token)
+	{
+		for (const auto &entry : SegOffsets) if (entry.second == token) return entry.first;
+		for (const auto &entry : SegOrigins) if (entry.second == token) return entry.first;
+		return AsmSegment::INVALID;
+	}
+	// empties every segment of an object file whose flag isn't set in live (see AsmSegment), along with its holes and debug info
+	static void _DropSegments(ObjectFile &obj, int live)
+	{
+		if (!(live & (int)AsmSegment::TEXT)) { obj.Text.clear(); obj.TextHoles.clear(); obj.TextLines.clear(); obj.TextAlign = 1; }
+		if (!(live & (int)AsmSegment::RODATA)) { obj.Rodata.clear(); obj.RodataHoles.clear(); obj.RodataAlign = 1; }
+		if (!(live & (int)AsmSegment::DATA)) { obj.Data.clear(); obj.DataHoles.clear(); obj.DataAlign = 1; }
+		if (!(live & (int)AsmSegment::BSS)) { obj.BssLen = 0; obj.BSSAlign = 1; }
+
+		obj.Labels.erase(std::remove_if(obj.Labels.begin(), obj.Labels.end(), [live](const LabelData &label) { return !(live & (int)label.Segment); }), obj.Labels.end());
+	}
+
+	// an entry in the linker's global symbol index
+	struct GlobalSymbolInfo
+	{
+		std::pair<std::string, ObjectFile> *obj; // the object file that defines the symbol
+		Expr *value;                             // its definition (in obj's symbol table)
+	};
+
+	LinkResult Link(Executable &exe, std::list<std::pair<std::string, ObjectFile>> &objs, const std::string &entry_point, SymbolMap *symbols, unsigned threads, bool gc)
 	{
 		// parsing locations for evaluation
 		u64 _res;
 		bool _floating;
 		std::string _err;
-		LinkResult res;
 
 		// -- ensure args are good -- //
 
@@ -753,16 +1008,15 @@ namespace CSX64
 		// _start file must declare an external named "_start"
 		if (!Contains(objs.front().second.ExternalSymbols, "_start")) return LinkResult{LinkError::FormatError, "_start file must declare an external named \"_start\""};
 
-		// rename "_start" symbol in _start file to whatever the entry point is (makes _start dirty)
-		try { objs.front().second.make_dirty(); RenameSymbol(objs.front().second, "_start", entry_point); }
-		catch (...) { return {LinkError::FormatError, "an error occured while renaming \"_start\" in the _start file"}; }
+		// the _start file's "_start" external refers to the entry point (resolved by name, so its expressions needn't be rewritten)
+		std::pair<std::string, ObjectFile> *const start_file = &objs.front();
 
 		// -- define things -- //
 
-		// create segments (we don't know how large the resulting file will be, so it needs to be expandable)
-		std::vector<u8> text;
-		std::vector<u8> rodata;
-		std::vector<u8> data;
+		// segment sizes (the segments themselves are allocated once the layout is known)
+		u64 textlen = 0;
+		u64 rodatalen = 0;
+		u64 datalen = 0;
 		u64 bsslen = 0;
 
 		// segment alignments
@@ -771,13 +1025,24 @@ namespace CSX64
 		u64 dataalign = 1;
 		u64 bssalign = 1;
 
-		// a table for relating global symbols to their object file
-		std::unordered_map<std::string, std::pair<std::string, ObjectFile>*> global_to_obj;
+		// the global symbol index - relates each global symbol to its object file and definition (built once, then only looked up)
+		std::unordered_map<std::string, GlobalSymbolInfo> globals;
+
+		// gets the global symbol that an external symbol of an object file refers to (or null if there is none)
+		const auto resolve = [&](const std::pair<std::string, ObjectFile> *item, const std::string &external) -> const GlobalSymbolInfo*
+		{
+			auto it = globals.find(item == start_file && external == "_start" ? entry_point : external);
+			return it != globals.end() ? &it->second : nullptr;
+		};
 
 		// the queue of object files that need to be added to the executable
 		std::deque<std::pair<std::string, ObjectFile>*> include_queue;
+		// every object file that has ever been added to include_queue
+		std::unordered_set<std::pair<std::string, ObjectFile>*> queued;
 		// a table for relating included object files to their beginning positions in the resulting binary (text, rodata, data, bss) tuples
 		std::unordered_map<std::pair<std::string, ObjectFile>*, std::tuple<u64, u64, u64, u64>> included;
+		// the included object files in the order they were included
+		std::vector<std::pair<std::string, ObjectFile>*> included_order;
 
 		BinaryLiteralCollection total_literals; // destination to merge all binary literals throughout all included object files
 		std::unordered_map<std::pair<std::string, ObjectFile>*, std::vector<std::size_t>> obj_to_total_literals_locations; // maps from an included object file to its literal index map in total_literals
@@ -787,20 +1052,19 @@ namespace CSX64
 
 		// -- populate things -- //
 
-		// populate global_to_obj with ALL global symbols
+		// populate the global symbol index with ALL global symbols
 		for (auto &obj : objs)
 		{
-			const Expr *value;
+			Expr *value;
 
 			for (const auto &global : obj.second.GlobalSymbols)
 			{
 				// make sure source actually defined this symbol (just in case of corrupted object file)
 				if (!TryGetValue(obj.second.Symbols, global, value)) return LinkResult{LinkError::MissingSymbol, obj.first + ": Global symbol \"" + global + "\" was not defined"};
-				// make sure it wasn't already defined
-				if (ContainsKey(global_to_obj, global)) return LinkResult{LinkError::SymbolRedefinition, obj.first + ": Global symbol \"" + global + "\" was defined by " + global_to_obj[global]->first};
 
-				// add to the table
-				global_to_obj.emplace(global, &obj);
+				// add to the index - make sure it wasn't already defined
+				auto ins = globals.emplace(global, GlobalSymbolInfo{ &obj, value });
+				if (!ins.second) return LinkResult{LinkError::SymbolRedefinition, obj.first + ": Global symbol \"" + global + "\" was defined by " + ins.first->second.obj->first};
 			}
 		}
 
@@ -814,8 +1078,71 @@ namespace CSX64
 				if (ContainsKey(obj.second.Symbols, reserved)) return LinkResult{LinkError::SymbolRedefinition, obj.first + ": defined symbol with name \"" + reserved + "\" (reserved)"};
 		}
 
+		// -- find live segments -- //
+
+		// object file to the flags of its segments that are reachable from the _start file's text (see AsmSegment) - only used by gc
+		std::unordered_map<std::pair<std::string, ObjectFile>*, int> live;
+
+		// a segment is reached through the holes of a live segment: the symbols their expressions use (transitively, including externals) and the segments those are addresses in.
+		// whole segments are the smallest unit we can drop, because the assembler folds references within a segment (e.g. label differences) into constants.
+		if (gc)
+		{
+			std::vector<std::pair<std::pair<std::string, ObjectFile>*, AsmSegment>> pending_segs; // live segments whose holes haven't been scanned
+			std::vector<std::pair<std::pair<std::string, ObjectFile>*, const Expr*>> pending_exprs; // expressions (and the file they're from) that haven't been scanned
+			std::unordered_set<const Expr*> scanned_symbols; // definitions of symbols that have already been added to pending_exprs
+			std::unordered_set<const std::string*> scanned_tokens; // tokens that have already been resolved
+
+			const auto mark = [&](std::pair<std::string, ObjectFile> *item, AsmSegment seg)
+			{
+				int &flags = live[item];
+				if (!(flags & (int)seg)) { flags |= (int)seg; pending_segs.emplace_back(item, seg); }
+			};
+			mark(start_file, AsmSegment::TEXT);
+
+			while (!pending_segs.empty() || !pending_exprs.empty())
+			{
+				// scan an expression for the segments and symbols it uses
+				if (!pending_exprs.empty())
+				{
+					const auto [item, expr] = pending_exprs.back();
+					pending_exprs.pop_back();
+
+					for (const std::string *tok : expr->GetStringValues())
+					{
+						// a token interned by a file's arena is only used by that file's expressions, so it always resolves the same way (a token that isn't is only used by one node)
+						if (!scanned_tokens.insert(tok).second) continue;
+
+						const Expr *def;
+						std::pair<std::string, ObjectFile> *owner = item;
+
+						// segment addresses reach the segment
+						if (AsmSegment seg = _TokenSegment(*tok); seg != AsmSegment::INVALID) { mark(item, seg); continue; }
+
+						// symbols reach whatever their definitions do (anything else is either defined later in Link or an error reported later)
+						if (TryGetValue(item->second.Symbols, *tok, def)) {}
+						else if (!Contains(item->second.ExternalSymbols, *tok)) continue;
+						else if (const GlobalSymbolInfo *global = resolve(item, *tok)) { owner = global->obj; def = global->value; }
+						else continue;
+
+						if (scanned_symbols.insert(def).second) pending_exprs.emplace_back(owner, def);
+					}
+				}
+				// scan a live segment's holes
+				else
+				{
+					const auto [item, seg] = pending_segs.back();
+					pending_segs.pop_back();
+
+					const ObjectFile &obj = item->second;
+					const std::vector<HoleData> *holes = seg == AsmSegment::TEXT ? &obj.TextHoles : seg == AsmSegment::RODATA ? &obj.RodataHoles : seg == AsmSegment::DATA ? &obj.DataHoles : nullptr; // bss has no content
+					if (holes) for (const HoleData &hole : *holes) pending_exprs.emplace_back(item, &hole.expr);
+				}
+			}
+		}
+
 		// start the merge process with the _start file
-		include_queue.push_back(&objs.front()); // (by this point [0] is guaranteed to exist)
+		include_queue.push_back(start_file);
+		queued.insert(start_file);
 
 		// -- merge things -- //
 
@@ -830,10 +1157,17 @@ namespace CSX64
 			// all included files are dirty
 			obj.make_dirty();
 
+			// drop the segments that can't be reached (a file can be included without any, e.g. if only its constant globals are used)
+			if (gc)
+			{
+				auto it = live.find(item);
+				_DropSegments(obj, it != live.end() ? it->second : 0);
+			}
+
 			// account for alignment requirements
-			Align(text, obj.TextAlign);
-			Align(rodata, obj.RodataAlign);
-			Align(data, obj.DataAlign);
+			textlen = Align(textlen, obj.TextAlign);
+			rodatalen = Align(rodatalen, obj.RodataAlign);
+			datalen = Align(datalen, obj.DataAlign);
 			bsslen = Align(bsslen, obj.BSSAlign);
 
 			// update segment alignments
@@ -842,42 +1176,28 @@ namespace CSX64
 			dataalign = std::max<u64>(dataalign, obj.DataAlign);
 			bssalign = std::max<u64>(bssalign, obj.BSSAlign);
 
-			// add it to the set of included files
-			included.emplace(item, std::tuple<u64, u64, u64, u64>(text.size(), rodata.size(), data.size(), bsslen));
-
-			// offset holes to be relative to the start of their total segment (not relative to resulting file)
-			for (HoleData &hole : obj.TextHoles) hole.Address += text.size();
-			for (HoleData &hole : obj.RodataHoles) hole.Address += rodata.size();
-			for (HoleData &hole : obj.DataHoles) hole.Address += data.size();
+			// add it to the set of included files (its segments are copied in once the layout is known)
+			included.emplace(item, std::tuple<u64, u64, u64, u64>(textlen, rodatalen, datalen, bsslen));
+			included_order.push_back(item);
 
 			// reserve space for segments
-			text.resize(text.size() + obj.Text.size());
-			rodata.resize(rodata.size() + obj.Rodata.size());
-			data.resize(data.size() + obj.Data.size());
-
-			// append segments
-			if (obj.Text.size() > 0) std::memcpy(text.data() + (text.size() - obj.Text.size()), obj.Text.data(), obj.Text.size());
-			if (obj.Rodata.size() > 0) std::memcpy(rodata.data() + (rodata.size() - obj.Rodata.size()), obj.Rodata.data(), obj.Rodata.size());
-			if (obj.Data.size() > 0) std::memcpy(data.data() + (data.size() - obj.Data.size()), obj.Data.data(), obj.Data.size());
+			textlen += obj.Text.size();
+			rodatalen += obj.Rodata.size();
+			datalen += obj.Data.size();
 			bsslen += obj.BssLen;
 
 			// for each external symbol
 			for (const std::string &external : obj.ExternalSymbols)
 			{
-				std::pair<std::string, ObjectFile> **global_source;
-
 				// if this is a global symbol somewhere
-				if (TryGetValue(global_to_obj, external, global_source))
+				if (const GlobalSymbolInfo *global = resolve(item, external))
 				{
-					// if the source isn't already included and it isn't already in queue to be included
-					if (!ContainsKey(included, *global_source) && !Contains(include_queue, *global_source))
-					{
-						// add it to the queue
-						include_queue.push_back(*global_source);
-					}
+					// if the source hasn't already been included or queued to be included, add it to the queue.
+					// with gc, this includes files that have no live segments: their globals still have to be defined (and checked) like any other.
+					if (queued.insert(global->obj).second) include_queue.push_back(global->obj);
 				}
 				// otherwise it wasn't defined
-				else return LinkResult{LinkError::MissingSymbol, item->first + ": No global symbol found to match external symbol \"" + external + "\""};
+				else return LinkResult{LinkError::MissingSymbol, item->first + ": No global symbol found to match external symbol \"" + (item == start_file && external == "_start" ? entry_point : external) + "\""};
 			}
 
 			// merge top level binary literals for this include file and fix their aliasing literal ranges
@@ -915,8 +1235,7 @@ namespace CSX64
 			}
 
 			// this object file's literals collection is now invalid - just clear it all out
-			obj.Literals.literals.clear();
-			obj.Literals.top_level_literals.clear();
+			obj.Literals.clear();
 		}
 
 		// after merging, but before alignment, we need to handle all the provisioned binary literals.
@@ -926,20 +1245,16 @@ namespace CSX64
 		for (std::size_t i = 0; i < total_literals.top_level_literals.size(); ++i)
 		{
 			// for each top level literal, compute its (future) offset in the rodata segment and while we're at it calculate the total size of all top level literals
-			rodata_top_level_literal_offsets[i] = rodata.size() + literals_size;
+			rodata_top_level_literal_offsets[i] = rodatalen + literals_size;
 			literals_size += total_literals.top_level_literals[i].size();
 		}
-
-		// now that we know where all the literals should go, resize the rodata segment and copy them to their appropriate places
-		rodata.resize(rodata.size() + literals_size);
-		for (std::size_t i = 0; i < total_literals.top_level_literals.size(); ++i)
-		{
-			std::memcpy(&rodata[0] + rodata_top_level_literal_offsets[i], total_literals.top_level_literals[i].data(), total_literals.top_level_literals[i].size());
-		}
+		rodatalen += literals_size;
 
 		// and now go ahead and resolve all the missing binary literal symbols with relative address from the rodata origin
 		for (const auto &entry : obj_to_total_literals_locations)
 		{
+			Expr::ArenaScope arena_scope(entry.first->second.arena());
+
 			for (std::size_t i = 0; i < entry.second.size(); ++i)
 			{
 				// alias the literal range in total_literals
@@ -957,16 +1272,26 @@ namespace CSX64
 		}
 
 		// account for segment alignments
-		Pad(text, AlignOffset(text.size(), rodataalign));
-		Pad(rodata, AlignOffset(text.size() + rodata.size(), dataalign));
-		Pad(data, AlignOffset(text.size() + rodata.size() + data.size(), bssalign));
-		bsslen += AlignOffset(text.size() + rodata.size() + data.size() + bsslen, 2); // the whole executable is 16-bit aligned (for stack)
+		textlen += AlignOffset(textlen, rodataalign);
+		rodatalen += AlignOffset(textlen + rodatalen, dataalign);
+		datalen += AlignOffset(textlen + rodatalen + datalen, bssalign);
+		bsslen += AlignOffset(textlen + rodatalen + datalen + bsslen, 2); // the whole executable is 16-bit aligned (for stack)
+
+		// the layout is now final, so allocate the segments (zero-filled, which covers all the alignment padding) and copy in the literals
+		std::vector<u8> text(textlen);
+		std::vector<u8> rodata(rodatalen);
+		std::vector<u8> data(datalen);
+		for (std::size_t i = 0; i < total_literals.top_level_literals.size(); ++i)
+		{
+			std::memcpy(rodata.data() + rodata_top_level_literal_offsets[i], total_literals.top_level_literals[i].data(), total_literals.top_level_literals[i].size());
+		}
 		
 		// now that we're done merging we need to define segment offsets in the result
 		for (auto &entry : included)
 		{
 			// alias the object file
 			ObjectFile &obj = entry.first->second;
+			Expr::ArenaScope arena_scope(obj.arena());
 
 			// define the segment origins
 			obj.Symbols.emplace(SegOrigins.at(AsmSegment::TEXT), Expr::CreateInt(0));
@@ -997,32 +1322,46 @@ namespace CSX64
 		{
 			// alias the object file
 			ObjectFile &obj = entry.first->second;
+			Expr::ArenaScope arena_scope(obj.arena());
 
 			// for each external symbol
 			for (const std::string &external : obj.ExternalSymbols)
 			{
 				// add externals to local scope //
 
-				// if obj already has a symbol of the same name
-				if (ContainsKey(obj.Symbols, external)) return {LinkError::SymbolRedefinition, entry.first->first + ": defined external symbol \"" + external + "\""};
-				// otherwise define it as a local in obj
-				else obj.Symbols.emplace(external, global_to_obj.at(external)->second.Symbols.at(external));
+				// define it as a local in obj (the global has already been evaluated, so this is just a copy of its value) - obj can't already have a symbol of the same name
+				if (!obj.Symbols.emplace(external, *resolve(entry.first, external)->value).second) return {LinkError::SymbolRedefinition, entry.first->first + ": defined external symbol \"" + external + "\""};
 			}
 		}
 		
-		// -- patch things -- //
+		// -- copy and patch things -- //
 
-		// for each object file
-		for (auto &entry : included)
+		// each object file only touches its own symbols, holes, and part of each segment, so they can all be done at once
+		std::vector<LinkResult> results(included_order.size(), LinkResult{ LinkError::None, "" });
+		ParallelFor(included_order.size(), threads, [&](std::size_t i)
 		{
-			// alias object file
-			ObjectFile &obj = entry.first->second;
+			ObjectFile &obj = included_order[i]->second;
+			const std::tuple<u64, u64, u64, u64> &pos = included.at(included_order[i]);
+			Expr::ArenaScope arena_scope(obj.arena()); // each file's arena is only used by the thread patching it
+
+			// copy in the segments
+			if (obj.Text.size() > 0) std::memcpy(text.data() + std::get<0>(pos), obj.Text.data(), obj.Text.size());
+			if (obj.Rodata.size() > 0) std::memcpy(rodata.data() + std::get<1>(pos), obj.Rodata.data(), obj.Rodata.size());
+			if (obj.Data.size() > 0) std::memcpy(data.data() + std::get<2>(pos), obj.Data.data(), obj.Data.size());
+
+			// offset holes to be relative to the start of their total segment (not relative to resulting file)
+			for (HoleData &hole : obj.TextHoles) hole.Address += std::get<0>(pos);
+			for (HoleData &hole : obj.RodataHoles) hole.Address += std::get<1>(pos);
+			for (HoleData &hole : obj.DataHoles) hole.Address += std::get<2>(pos);
 
 			// patch all the holes
-			if (!_FixAllHoles(obj.Symbols, obj.TextHoles, text, res)) return {res.Error, entry.first->first + ":\n" + res.ErrorMsg};
-			if (!_FixAllHoles(obj.Symbols, obj.RodataHoles, rodata, res)) return { res.Error, entry.first->first + ":\n" + res.ErrorMsg };
-			if (!_FixAllHoles(obj.Symbols, obj.DataHoles, data, res)) return { res.Error, entry.first->first + ":\n" + res.ErrorMsg };
-		}
+			LinkResult &r = results[i];
+			if (!_FixAllHoles(obj.Symbols, obj.TextHoles, text, r) || !_FixAllHoles(obj.Symbols, obj.RodataHoles, rodata, r) || !_FixAllHoles(obj.Symbols, obj.DataHoles, data, r))
+				r.ErrorMsg = included_order[i]->first + ":\n" + r.ErrorMsg;
+		});
+
+		// report the first failure (in include order)
+		for (const LinkResult &r : results) if (r.Error != LinkError::None) return r;
 
 		// -- finalize things -- //
 
@@ -1030,11 +1369,41 @@ namespace CSX64
 		try
 		{
 			exe.construct(text, rodata, data, bsslen);
-			return { LinkError::None, "" };
 		}
 		catch (const std::overflow_error&)
 		{
 			return { LinkError::FormatError, "Sum of segment sizes exceeded maximum size" };
 		}
+
+		// build the symbol map if requested (files are in the order given, for determinism)
+		if (symbols)
+		{
+			symbols->clear();
+			for (auto &obj : objs)
+			{
+				auto it = included.find(&obj);
+				if (it == included.end()) continue;
+
+				const u32 file = symbols->add_file(obj.first);
+
+				// the address where this file's part of each segment starts
+				const auto base = [&](AsmSegment seg) -> u64
+				{
+					switch (seg)
+					{
+					case AsmSegment::TEXT: return std::get<0>(it->second);
+					case AsmSegment::RODATA: return text.size() + std::get<1>(it->second);
+					case AsmSegment::DATA: return text.size() + rodata.size() + std::get<2>(it->second);
+					default: return text.size() + rodata.size() + data.size() + std::get<3>(it->second);
+					}
+				};
+
+				for (const LabelData &label : obj.second.Labels) symbols->add_symbol(base(label.Segment) + label.Address, label.Name, file, label.Line);
+				for (const LineData &line : obj.second.TextLines) symbols->add_line(std::get<0>(it->second) + line.Address, file, line.Line);
+			}
+			symbols->finalize();
+		}
+
+		return { LinkError::None, "" };
 	}
 }
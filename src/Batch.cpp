@@ -0,0 +1,66 @@
+#include <sstream>
+#include <memory>
+#include <chrono>
+#include <algorithm>
+
+#include "../include/Batch.h"
+#include "../include/Utility.h"
+
+namespace CSX64
+{
+	static void RunBatchJob(const BatchJob &job, const BatchOptions &options, BatchResult &result)
+	{
+		if (job.exe == nullptr) { result.init_error = "no executable"; return; }
+
+		// the output streams must outlive the computer (its file wrappers refer to them)
+		std::ostringstream out, err;
+		Computer computer;
+
+		computer.MaxMemory(options.max_memory);
+
+		try
+		{
+			computer.Initialize(*job.exe, job.args);
+		}
+		catch (const std::exception &ex)
+		{
+			result.init_error = ex.what();
+			return;
+		}
+		result.initialized = true;
+
+		// set private flags
+		computer.FSF() = options.fsf;
+
+		// same settings as a console run (raw speed)
+		computer.OTRF() = true;
+		computer.BlockExecution(true);
+		computer.LazyFlags(true);
+		computer.JitCompilation(options.jit);
+
+		// tie standard streams to this instance's private streams
+		computer.OpenFileWrapper(0, std::make_unique<TerminalInputFileWrapper>(new std::istringstream(job.input), true, false));
+		computer.OpenFileWrapper(1, std::make_unique<TerminalOutputFileWrapper>(&out, false, false));
+		computer.OpenFileWrapper(2, std::make_unique<TerminalOutputFileWrapper>(&err, false, false));
+
+		if (options.configure) options.configure(computer);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		while (computer.Running()) computer.Tick(~(u64)0);
+		auto stop = std::chrono::high_resolution_clock::now();
+
+		result.ns = std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+		result.error = computer.Error();
+		result.return_value = computer.ReturnValue();
+		result.output = out.str();
+		result.errors = err.str();
+	}
+
+	std::vector<BatchResult> RunBatch(const std::vector<BatchJob> &jobs, const BatchOptions &options)
+	{
+		std::vector<BatchResult> results(jobs.size());
+		ParallelFor(jobs.size(), options.threads, [&](std::size_t i) { RunBatchJob(jobs[i], options, results[i]); });
+
+		return results;
+	}
+}
@@ -1,6 +1,7 @@
 #include <utility>
 #include <vector>
 #include <cstring>
+#include <algorithm>
 
 #include "../include/Utility.h"
 #include "../include/Assembly.h"
@@ -9,104 +10,310 @@ namespace CSX64
 {
 	static constexpr std::size_t npos = ~(std::size_t)0;
 
-	// returns the index in super where the entire contents of sub can be found.
-	// if such an index is not found, returns npos
-	std::size_t find_subregion(const std::vector<u8> &super, const std::vector<u8> &sub)
-	{
-		// firstly, if super is smaller than sub, it's definitely not going to work
-		if (super.size() < sub.size()) return npos;
+	// the base of the polynomial rolling hash used to find top level literals contained in a new one
+	static constexpr u64 HashBase = 0x100000001b3;
 
-		// for each possible starting position for this to work
-		for (u64 start = super.size() - sub.size(); start != npos; --start)
-		{
-			// if this subregion contains the same data, return the start position (success)
-			if (std::memcmp(super.data() + start, sub.data(), sub.size()) == 0) return start;
-		}
+	// computes the rolling hash of len bytes
+	static u64 RollingHash(const u8 *p, std::size_t len)
+	{
+		u64 h = 0;
+		for (std::size_t i = 0; i < len; ++i) h = h * HashBase + p[i] + 1;
+		return h;
+	}
 
-		// if we get here it wasn't found
-		return npos;
+	// gets a pointer to the transition of a suffix automaton state on ch (null if none)
+	template<typename State>
+	static auto SamNext(State &state, u8 ch) -> decltype(&state.next[0].second)
+	{
+		for (auto &t : state.next) if (t.first == ch) return &t.second;
+		return nullptr;
 	}
 
 	std::size_t BinaryLiteralCollection::_insert(const BinaryLiteral &info)
 	{
 		// if this literal already existed verbatim, we don't need a duplicate entry for it in literals
-		for (std::size_t i = 0; i < literals.size(); ++i) if (literals[i] == info) return i;
+		if (auto it = literal_index.find(info); it != literal_index.end()) return it->second;
 
 		// otherwise we need to insert it as a new literal
 		literals.push_back(info);
+		literal_index.emplace(info, literals.size() - 1);
+		top_level_refs[info.top_level_index].push_back(literals.size() - 1);
 		return literals.size() - 1;
 	}
-	std::size_t BinaryLiteralCollection::add(std::vector<u8> &&value)
+
+	void BinaryLiteralCollection::_push_top_level(std::vector<u8> &&value)
+	{
+		const std::size_t id = top_level_info.size();
+		top_level_info.push_back({ top_level_literals.size(), npos });
+
+		_sam_add(value);
+		top_level_hashes[value.size()].emplace(RollingHash(value.data(), value.size()), id);
+
+		top_level_ids.push_back(id);
+		top_level_refs.emplace_back();
+		top_level_literals.emplace_back(std::move(value));
+
+		_sam_mark(id);
+	}
+	void BinaryLiteralCollection::_retarget(std::size_t from, std::size_t to, std::size_t offset)
+	{
+		std::vector<std::size_t> refs = std::move(top_level_refs[from]);
+		top_level_refs[from].clear();
+
+		for (std::size_t k : refs)
+		{
+			// re-key the literal (if it's the one the index refers to - otherwise it was a duplicate)
+			BinaryLiteral &lit = literals[k];
+			if (auto it = literal_index.find(lit); it != literal_index.end() && it->second == k) literal_index.erase(it);
+
+			lit.top_level_index = to;
+			lit.start += offset;
+
+			// if it's now a duplicate, the index refers to the first one (like a linear search would find)
+			auto res = literal_index.emplace(lit, k);
+			if (!res.second && k < res.first->second) res.first->second = k;
+			top_level_refs[to].push_back(k);
+		}
+	}
+	void BinaryLiteralCollection::_absorb(std::size_t index, std::size_t parent)
+	{
+		const std::size_t id = top_level_ids[index];
+		top_level_info[id] = { npos, parent };
+
+		// it's no longer a top level literal, so new literals can't be found inside it by hash
+		const std::vector<u8> &value = top_level_literals[index];
+		auto &table = top_level_hashes[value.size()];
+		for (auto range = table.equal_range(RollingHash(value.data(), value.size())); range.first != range.second; ++range.first)
+			if (range.first->second == id) { table.erase(range.first); break; }
+	}
+
+	bool BinaryLiteralCollection::_find_container(const std::vector<u8> &value, std::size_t &index, std::size_t &start) const
+	{
+		if (top_level_literals.empty()) return false;
+
+		// the empty literal is in every top level literal (at the end, like any other match it's the last position)
+		if (value.empty()) { index = 0; start = top_level_literals[0].size(); return true; }
+
+		// walk the automaton - if we get through all of value, it's a substring of some top level literal
+		std::size_t state = 0;
+		for (u8 ch : value)
+		{
+			const std::size_t *next = SamNext(sam[state], ch);
+			if (!next) return false;
+			state = *next;
+		}
+
+		// the state knows where value goes: the last occurrence in the first top level literal that contains it
+		index = top_level_info[sam[state].first].index;
+		start = sam[state].last - value.size();
+		return true;
+	}
+	void BinaryLiteralCollection::_sam_add(const std::vector<u8> &value)
 	{
-		// look for any top level literal that value is a subregion of
-		for (std::size_t i = 0; i < top_level_literals.size(); ++i)
+		// this is the standard online construction, generalized to multiple strings (each starts over from the root)
+		if (sam.empty()) sam.push_back({ 0, npos, npos, 0, 0, {} });
+		sam_last = 0;
+
+		// clones state q as a state of length len, redirecting p's chain of transitions on ch from q to the clone. returns the clone.
+		const auto clone = [this](std::size_t p, std::size_t q, u8 ch, std::size_t len)
 		{
-			// if we found one, we can just share it
-			if (std::size_t start = find_subregion(top_level_literals[i], value); start != npos) return _insert({ i, start, value.size() });
+			const std::size_t c = sam.size();
+			SamState state = sam[q]; // the clone's strings occur wherever q's do (the new literal's occurrences are added by _sam_mark)
+			state.len = len;
+			sam.push_back(std::move(state));
+
+			for (; p != npos; p = sam[p].link)
+			{
+				std::size_t *next = SamNext(sam[p], ch);
+				if (!next || *next != q) break;
+				*next = c;
+			}
+			sam[q].link = c;
+			return c;
+		};
+
+		for (std::size_t i = 0; i < value.size(); ++i)
+		{
+			const u8 ch = value[i];
+
+			// if this string is already in the automaton (from another top level literal), reuse (or split) its state
+			if (const std::size_t *existing = SamNext(sam[sam_last], ch))
+			{
+				const std::size_t q = *existing;
+				sam_last = sam[sam_last].len + 1 == sam[q].len ? q : clone(sam_last, q, ch, sam[sam_last].len + 1);
+				continue;
+			}
+
+			const std::size_t cur = sam.size();
+			sam.push_back({ sam[sam_last].len + 1, 0, npos, 0, 0, {} });
+
+			std::size_t p = sam_last;
+			for (; p != npos && !SamNext(sam[p], ch); p = sam[p].link) sam[p].next.emplace_back(ch, cur);
+
+			if (p != npos)
+			{
+				const std::size_t q = *SamNext(sam[p], ch);
+				sam[cur].link = sam[p].len + 1 == sam[q].len ? q : clone(p, q, ch, sam[p].len + 1);
+			}
+
+			sam_last = cur;
 		}
+	}
+
+	void BinaryLiteralCollection::_sam_mark(std::size_t id)
+	{
+		const std::size_t index = top_level_info[id].index;
+		const std::vector<u8> &value = top_level_literals[index];
+		const std::size_t stamp = ++sam_stamp;
+
+		// get the state of each prefix of value - the suffix links of the one ending at i lead through every state with an occurrence ending at i
+		std::vector<std::size_t> prefixes(value.size());
+		std::size_t state = 0;
+		for (std::size_t i = 0; i < value.size(); ++i) prefixes[i] = state = *SamNext(sam[state], value[i]);
 
-		// if that didn't work, look for any top level literal that is a subregion of value (i.e. the other way)
-		for (std::size_t i = 0; i < top_level_literals.size(); ++i)
+		// go from the longest prefix to the shortest, so each state is first reached from its last occurrence in value.
+		// a state that was already reached had all its suffix links handled then, so stop there.
+		for (std::size_t i = value.size(); i-- > 0; )
 		{
-			// if we found one, we can replace this top level literal
-			std::size_t start = find_subregion(value, top_level_literals[i]);
-			if (start != npos)
+			for (std::size_t s = prefixes[i]; s != npos && sam[s].stamp != stamp; s = sam[s].link)
 			{
-				// replace the top level literal with value and update the starting position of any literals that referenced the top level literal we just replaced
-				top_level_literals[i] = std::move(value);
-				for (auto &lit : literals) if (lit.top_level_index == i) lit.start += start;
+				SamState &st = sam[s];
+				st.stamp = stamp;
 
-				// now we need to look through the top level literals again and see if any of them are contained in value (the new top level literal)
-				for (std::size_t j = 0; j < top_level_literals.size(); )
+				// take over unless it's already in a top level literal before this one
+				if (st.first == npos || top_level_info[st.first].parent != npos || top_level_info[st.first].index > index || st.first == id)
 				{
-					if (j != i)
-					{
-						// if top level literal j is contained in value, we can remove j
-						start = find_subregion(top_level_literals[i], top_level_literals[j]);
-						if (start != npos)
-						{
-							// remove j from the top level literal list via the move pop idiom
-							top_level_literals[j] = std::move(top_level_literals.back());
-							top_level_literals.pop_back();
-
-							// if i was the one we moved, repoint i to j (its new home)
-							if (i == top_level_literals.size()) i = j;
-
-							// update all the literals to reflect the change
-							for (auto &lit : literals)
-							{
-								// if it referenced the deleted top level literal, repoint it to value and apply the start offset
-								if (lit.top_level_index == j)
-								{
-									lit.top_level_index = i;
-									lit.start += start;
-								}
-								// if it referenced the moved top level literal (the one that we used for move pop idiom), repoint it to j
-								else if (lit.top_level_index == top_level_literals.size())
-								{
-									lit.top_level_index = j;
-								}
-							}
-						}
-						else ++j;
-					}
-					else ++j;
+					st.first = id;
+					st.last = i + 1;
 				}
+			}
+		}
+	}
+
+	std::size_t BinaryLiteralCollection::add(std::vector<u8> &&value)
+	{
+		// look for any top level literal that value is a subregion of - if we found one, we can just share it
+		std::size_t index, start;
+		if (_find_container(value, index, start)) return _insert({ index, start, value.size() });
 
-				// add the literal
-				return _insert({ i, 0, top_level_literals[i].size() });
+		// if that didn't work, look for any top level literals that are subregions of value (i.e. the other way).
+		// for each length of top level literal, slide a window that size over value and look up its hash (keeping the last position of each).
+		std::unordered_map<std::size_t, std::size_t> contained; // maps id to its start in value
+		for (const auto &entry : top_level_hashes)
+		{
+			const std::size_t len = entry.first;
+			if (len > value.size() || entry.second.empty()) continue;
+
+			u64 power = 1; // HashBase^len (the weight of the byte leaving the window)
+			for (std::size_t i = 0; i < len; ++i) power *= HashBase;
+
+			u64 h = RollingHash(value.data(), len);
+			for (std::size_t pos = 0; ; ++pos)
+			{
+				for (auto range = entry.second.equal_range(h); range.first != range.second; ++range.first)
+				{
+					const std::size_t id = range.first->second;
+					if (std::memcmp(top_level_literals[top_level_info[id].index].data(), value.data() + pos, len) == 0) contained[id] = pos;
+				}
+
+				if (pos + len >= value.size()) break;
+				h = h * HashBase + value[pos + len] + 1 - (value[pos] + 1) * power;
 			}
 		}
 
 		// if that also didn't work then we just have to add value as a new top level literal
-		top_level_literals.emplace_back(std::move(value));
-		return _insert({ top_level_literals.size() - 1, 0, top_level_literals.back().size() });
+		if (contained.empty())
+		{
+			_push_top_level(std::move(value));
+			return _insert({ top_level_literals.size() - 1, 0, top_level_literals.back().size() });
+		}
+
+		// otherwise replace the first contained top level literal with value (updating the starting position of any literals that referenced it)
+		std::size_t i = npos;
+		for (const auto &entry : contained) i = std::min(i, top_level_info[entry.first].index);
+		start = contained[top_level_ids[i]];
+
+		const std::size_t id = top_level_info.size();
+		_absorb(i, id);
+		_retarget(i, i, start);
+
+		top_level_info.push_back({ i, npos });
+		_sam_add(value);
+		top_level_hashes[value.size()].emplace(RollingHash(value.data(), value.size()), id);
+		top_level_ids[i] = id;
+		top_level_literals[i] = std::move(value);
+
+		// now remove all the other contained top level literals, repointing their literals to value
+		std::vector<std::size_t> moved; // the ids of the top level literals that moved to fill a gap
+		for (std::size_t j = 0; j < top_level_literals.size(); )
+		{
+			auto it = contained.find(top_level_ids[j]);
+			if (j == i || it == contained.end()) { ++j; continue; }
+
+			_absorb(j, id);
+			_retarget(j, i, it->second);
+
+			// remove j from the top level literal list via the move pop idiom
+			const std::size_t back = top_level_literals.size() - 1;
+			if (j != back)
+			{
+				top_level_literals[j] = std::move(top_level_literals[back]);
+				top_level_ids[j] = top_level_ids[back];
+				top_level_info[top_level_ids[j]].index = j;
+				_retarget(back, j, 0);
+				moved.push_back(top_level_ids[j]);
+			}
+			top_level_literals.pop_back();
+			top_level_ids.pop_back();
+			top_level_refs.pop_back();
+
+			// if i was the one we moved, repoint i to j (its new home)
+			if (i == back) i = j;
+		}
+
+		// value and the ones that moved are now the first occurrence of some strings (and took over from the ones that were absorbed)
+		_sam_mark(id);
+		for (std::size_t m : moved) if (top_level_info[m].parent == npos) _sam_mark(m);
+
+		// add the literal
+		return _insert({ i, 0, top_level_literals[i].size() });
+	}
+
+	bool BinaryLiteralCollection::_reindex()
+	{
+		std::vector<std::vector<u8>> tops = std::move(top_level_literals);
+		std::vector<BinaryLiteral> lits = std::move(literals);
+		clear();
+
+		for (auto &top : tops) _push_top_level(std::move(top));
+
+		// literals must refer to ranges within their top level literals
+		literals.reserve(lits.size());
+		for (const BinaryLiteral &lit : lits)
+		{
+			if (lit.top_level_index >= top_level_literals.size() || lit.start > top_level_literals[lit.top_level_index].size() || lit.length > top_level_literals[lit.top_level_index].size() - lit.start) return false;
+
+			// keep the literals in order (even duplicates) since they're referenced by index
+			literals.push_back(lit);
+			literal_index.emplace(lit, literals.size() - 1);
+			top_level_refs[lit.top_level_index].push_back(literals.size() - 1);
+		}
+
+		return true;
 	}
 
 	void BinaryLiteralCollection::clear() noexcept
 	{
 		literals.clear();
 		top_level_literals.clear();
+
+		literal_index.clear();
+		top_level_ids.clear();
+		top_level_refs.clear();
+		top_level_info.clear();
+		sam.clear();
+		sam_last = 0;
+		top_level_hashes.clear();
 	}
 
 	// -----------------------------------------------------------------------------------
@@ -160,6 +367,9 @@ namespace CSX64
 			if (!BinRead(reader, i.top_level_index) || !BinRead(reader, i.start) || !BinRead(reader, i.length)) return reader;
 		}
 
+		// build the index for the new contents
+		if (!_reindex()) reader.setstate(std::ios::failbit);
+
 		return reader;
 	}
 }
@@ -0,0 +1,310 @@
+#include "../include/Computer.h"
+
+// this file implements basic block execution.
+// a block is recorded the first time it executes (by stepping it with the interpreter) and is afterwards replayed directly from its op list.
+// replay skips the running/suspended_read/ExeBarrier checks and the opcode fetch for each instruction.
+// the common integer ops (on registers, imms, and memory) and jumps are decoded once when recorded and replayed from a switch with no operand decoding at all.
+// every other op calls its handler, after which RIP is checked to still be on the recorded path (which handles e.g. non-OTRF REP and suspended reads).
+
+namespace CSX64
+{
+    // the maximum number of instructions in a single block
+    static constexpr u64 MaxBlockLength = 256;
+
+    // returns true if the opcode ends a basic block (i.e. it can alter control flow or execution state)
+    static bool EndsBlock(u64 op)
+    {
+        switch ((OPCode)op)
+        {
+        case OPCode::JMP: case OPCode::Jcc: case OPCode::LOOPcc:
+        case OPCode::CALL: case OPCode::RET:
+        case OPCode::SYSCALL: case OPCode::HLT:
+            return true;
+
+        default: return false;
+        }
+    }
+
+    void Computer::BlockExecution(bool enable)
+    {
+        block_execution = enable;
+        ResetBlocks();
+    }
+    void Computer::ResetBlocks()
+    {
+        blocks.clear();
+        block_map.clear();
+        jit_code.reset();
+
+        // if enabled, make room for the entire text segment - otherwise release the map
+        if (block_execution) block_map.resize(ExeBarrier);
+        else std::vector<BasicBlock*>().swap(block_map);
+    }
+
+    u64 Computer::TickBlocks(u64 count)
+    {
+        u64 ticks = 0;
+        BasicBlock *prev = nullptr; // the block that was just executed (for chaining)
+
+        while (ticks < count)
+        {
+            // fail if terminated or awaiting data
+            if (!running || suspended_read) break;
+
+            // make sure we're before the executable barrier
+            const u64 pos = RIP();
+            if (pos >= ExeBarrier) { Terminate(ErrorCode::AccessViolation); break; }
+
+            // find the block starting here - try the previous block's successor links before the block map
+            BasicBlock *block;
+            if (prev && prev->succ[0] && prev->succ[0]->ops.front().pos == pos) block = prev->succ[0];
+            else if (prev && prev->succ[1] && prev->succ[1]->ops.front().pos == pos) block = prev->succ[1];
+            else
+            {
+                block = block_map[pos];
+
+                // if we found one, link it as the most recent successor of the previous block
+                if (block && prev) { prev->succ[1] = prev->succ[0]; prev->succ[0] = block; }
+            }
+
+            // if there's no block here yet, translate one (this also executes it)
+            if (!block) { ticks += TranslateBlock(count - ticks, block); prev = block; continue; }
+
+            // if the whole block doesn't fit in the remaining tick count, finish with the interpreter
+            if (block->ops.size() > count - ticks) { ticks += TickInterpreted(count - ticks); break; }
+
+            ticks += ExecuteBlock(*block);
+            prev = block;
+        }
+
+        return ticks;
+    }
+
+    u64 Computer::TranslateBlock(u64 count, BasicBlock *&block)
+    {
+        const u64 start = RIP();
+        block = nullptr;
+
+        // the new block is owned by the block list from the start
+        blocks.push_back(std::make_unique<BasicBlock>());
+        BasicBlock *const res = blocks.back().get();
+
+        for (u64 ticks = 0; ticks < count; )
+        {
+            // record and perform the instruction (the caller and the previous iteration ensure RIP is in the text segment)
+            const u64 pos = RIP();
+            const u64 op = reinterpret_cast<const u8*>(mem)[RIP()++];
+            res->ops.push_back({ opcode_handlers[op], pos });
+
+            bool success = (this->*opcode_handlers[op])();
+            ++ticks;
+
+            // if it failed or stopped execution, discard the recording (it may be incomplete)
+            if (!success || !running || suspended_read) { blocks.pop_back(); return ticks; }
+
+            PreDecode(res->ops.back(), RIP());
+
+            // the block ends at control flow, at any backwards motion of RIP (e.g. non-OTRF REP), or at the length limit
+            if (EndsBlock(op) || RIP() <= pos || res->ops.size() >= MaxBlockLength || RIP() >= ExeBarrier)
+            {
+                block = block_map[start] = res;
+                return ticks;
+            }
+        }
+
+        // ran out of ticks before the block ended - discard the partial recording
+        blocks.pop_back();
+        return count;
+    }
+
+    void Computer::PreDecode(BasicBlock::Op &op, u64 next) const
+    {
+        using OpKind = BasicBlock::OpKind;
+
+        // reads an instruction field (little-endian) - fails if it would leave the text segment
+        const u8 *const text = reinterpret_cast<const u8*>(mem);
+        u64 pos = op.pos + 1;
+        const auto read = [&](u64 size, u64 &res)
+        {
+            if (pos >= ExeBarrier || ExeBarrier - pos < size) return false;
+            res = 0;
+            for (u64 i = 0; i < size; ++i) res |= (u64)text[pos + i] << (i * 8);
+            pos += size;
+            return true;
+        };
+
+        OpKind kind;
+        u64 s1, s2, imm = 0;
+        switch ((OPCode)text[op.pos])
+        {
+        case OPCode::MOV: kind = OpKind::MOV; goto binary;
+        case OPCode::ADD: kind = OpKind::ADD; goto binary;
+        case OPCode::SUB: kind = OpKind::SUB; goto binary;
+        case OPCode::AND: kind = OpKind::AND; goto binary;
+        case OPCode::OR: kind = OpKind::OR; goto binary;
+        case OPCode::XOR: kind = OpKind::XOR; goto binary;
+        case OPCode::CMP: kind = OpKind::CMP; goto binary;
+        case OPCode::TEST: kind = OpKind::TEST; goto binary;
+        binary:
+            // any mode (see FetchBinaryOpFormat) with no high registers
+            if (!read(1, s1) || !read(1, s2) || (s1 & 3) != 0 || (s2 >> 4) > 4) return;
+            if ((s2 >> 4) >= 2)
+            {
+                // the address (see GetAddressAdv) - 8-bit addressing is undefined behavior, so leave that to the handler
+                u64 settings, regs = 0;
+                if (!read(1, settings) || ((settings & 3) != 0 && !read(1, regs)) || ((settings >> 2) & 3) == 0) return;
+                if ((settings & 0x80) != 0 && !read(Size((settings >> 2) & 3), op.disp)) return;
+
+                op.addr_settings = (u8)settings;
+                op.addr_regs = (u8)regs;
+            }
+            if (((s2 >> 4) == 1 || (s2 >> 4) == 4) && !read(Size((s1 >> 2) & 3), imm)) return;
+            if (pos != next) return;
+
+            op.sizecode = (u8)((s1 >> 2) & 3);
+            op.dest = (u8)(s1 >> 4);
+            op.src = (u8)(s2 & 15);
+            op.mode = (u8)(s2 >> 4);
+            break;
+
+        case OPCode::INC: kind = OpKind::INC; goto unary;
+        case OPCode::DEC: kind = OpKind::DEC; goto unary;
+        unary:
+            // only registers (see FetchUnaryOpFormat) with no high registers
+            if (!read(1, s1) || (s1 & 3) != 0 || pos != next) return;
+
+            op.sizecode = (u8)((s1 >> 2) & 3);
+            op.dest = (u8)(s1 >> 4);
+            break;
+
+        case OPCode::Jcc:
+            // only the flag conditions (not CXZ)
+            if (!read(1, s2) || s2 >= 18) return;
+            op.dest = (u8)s2;
+            kind = OpKind::Jcc;
+            goto jump;
+        case OPCode::JMP: kind = OpKind::JMP; goto jump;
+        jump:
+            // only imm targets (see FetchIMMRMFormat) - 8-bit addressing is undefined behavior, so leave that to the handler
+            if (!read(1, s1) || (s1 & 3) != 2 || ((s1 >> 2) & 3) == 0 || !read(Size((s1 >> 2) & 3), imm)) return;
+            break;
+
+        default: return;
+        }
+
+        op.imm = imm;
+        op.next = pos;
+        op.kind = kind;
+    }
+
+    u64 Computer::ExecuteBlock(BasicBlock &block)
+    {
+        const BasicBlock::Op *op = block.ops.data(), *const end = op + block.ops.size();
+        u64 ticks = 0;
+
+        // if native compilation is enabled, run the compiled prefix (or compile it once the block is hot)
+        if (jit_compilation)
+        {
+            if (block.native)
+            {
+                ticks = ExecuteNative(block);
+                op += ticks;
+            }
+            else if (++block.exec_count == JitThreshold) CompileBlock(block);
+        }
+
+        using OpKind = BasicBlock::OpKind;
+        for (; op != end; ++op)
+        {
+            ++ticks;
+
+            if (op->kind == OpKind::Handler)
+            {
+                // skip the opcode byte and perform the instruction
+                ++RIP();
+                if (!(this->*op->handler)()) break;
+
+                // if we're no longer on the recorded path, stop here (the caller will find the correct block)
+                if (op + 1 != end && RIP() != op[1].pos) break;
+                continue;
+            }
+
+            // pre-decoded ops stay on the recorded path (jumps end the block)
+            RIP() = op->next;
+
+            // jumps have no registers (dest is the condition code)
+            if (op->kind == OpKind::JMP) { RIP() = op->imm; continue; }
+            if (op->kind == OpKind::Jcc) { if (Condition(op->dest)) RIP() = op->imm; continue; }
+
+            // memory operands can fail
+            if (op->mode >= 2) { if (!ExecuteMemoryOp(*op)) break; continue; }
+
+            const u64 sizecode = op->sizecode;
+            CPURegister &dest = CPURegisters[op->dest];
+            const u64 b = op->mode == 1 ? op->imm : (u64)CPURegisters[op->src][sizecode];
+
+            switch (op->kind)
+            {
+            case OpKind::MOV: dest[sizecode] = b; break;
+            case OpKind::ADD: dest[sizecode] = AluADD(dest[sizecode], b, sizecode); break;
+            case OpKind::SUB: dest[sizecode] = AluSUB(dest[sizecode], b, sizecode); break;
+            case OpKind::AND: dest[sizecode] = AluAND(dest[sizecode], b, sizecode); break;
+            case OpKind::OR: dest[sizecode] = AluOR(dest[sizecode], b, sizecode); break;
+            case OpKind::XOR: dest[sizecode] = AluXOR(dest[sizecode], b, sizecode); break;
+            case OpKind::CMP: AluSUB(dest[sizecode], b, sizecode); break;
+            case OpKind::TEST: AluAND(dest[sizecode], b, sizecode); break;
+            case OpKind::INC: dest[sizecode] = AluINC(dest[sizecode], sizecode); break;
+            case OpKind::DEC: dest[sizecode] = AluDEC(dest[sizecode], sizecode); break;
+            case OpKind::JMP: case OpKind::Jcc: case OpKind::Handler: break;
+            }
+        }
+
+        return ticks;
+    }
+    bool Computer::ExecuteMemoryOp(const BasicBlock::Op &op)
+    {
+        using OpKind = BasicBlock::OpKind;
+        const u64 sizecode = op.sizecode;
+
+        // compute the address (see GetAddressAdv)
+        const u64 addr_sizecode = (op.addr_settings >> 2) & 3;
+        u64 m = op.disp;
+        if ((op.addr_settings & 2) != 0) m += CPURegisters[op.addr_regs >> 4][addr_sizecode] << ((op.addr_settings >> 4) & 3);
+        if ((op.addr_settings & 1) != 0) m += CPURegisters[op.addr_regs & 15][addr_sizecode];
+
+        if (address_tracer) address_tracer->Address(m);
+
+        // get the operands (see FetchBinaryOpFormat) - mov doesn't read its destination
+        u64 a = 0, b;
+        if (op.mode == 2)
+        {
+            if (!GetMemRaw_szc(m, sizecode, b)) return false;
+            a = CPURegisters[op.dest][sizecode];
+        }
+        else
+        {
+            b = op.mode == 3 ? (u64)CPURegisters[op.src][sizecode] : op.imm;
+            if (op.kind != OpKind::MOV && !GetMemRaw_szc(m, sizecode, a)) return false;
+        }
+
+        u64 res;
+        switch (op.kind)
+        {
+        case OpKind::MOV: res = b; break;
+        case OpKind::ADD: res = AluADD(a, b, sizecode); break;
+        case OpKind::SUB: res = AluSUB(a, b, sizecode); break;
+        case OpKind::AND: res = AluAND(a, b, sizecode); break;
+        case OpKind::OR: res = AluOR(a, b, sizecode); break;
+        case OpKind::XOR: res = AluXOR(a, b, sizecode); break;
+        case OpKind::CMP: AluSUB(a, b, sizecode); return true;
+        case OpKind::TEST: AluAND(a, b, sizecode); return true;
+
+        default: return true; // only binary ops have memory modes
+        }
+
+        // store the result (see StoreBinaryOpFormat)
+        if (op.mode != 2) return SetMemRaw_szc(m, sizecode, res);
+        CPURegisters[op.dest][sizecode] = res;
+        return true;
+    }
+}
@@ -0,0 +1,235 @@
+#include <cstring>
+#include <algorithm>
+
+#include "../include/Computer.h"
+#include "../include/csx_exceptions.h"
+
+// this file implements the binary checkpoint format (see Computer::SaveCheckpoint).
+// a checkpoint is the header and version number, the host layout info, the register/execution state, the file descriptors, and then memory.
+// memory is a sequence of runs (u64 offset, u64 length, then the content) terminated by a run of length zero.
+// with compression, runs cover only the pages that aren't entirely zero - the rest of memory is restored as zero.
+
+namespace CSX64
+{
+	static const u8 header[] = { 'C', 'S', 'X', '6', '4', 'c', 'h', 'k' };
+
+	// the granularity of zero page compression (independent of the host page size so checkpoints are portable between hosts)
+	static constexpr u64 CheckpointPageSize = 4096;
+
+	// the rng isn't trivial (it has a seeding ctor), but its state is plain data that's stored as raw bytes
+	static_assert(std::is_trivially_copyable<FastRNG>::value, "FastRNG must be trivially copyable");
+
+	// flags for the checkpoint file descriptor records
+	static constexpr u8 FileInteractive = 1, FileCanRead = 2, FileCanWrite = 4, FileCanSeek = 8;
+
+	static void WriteRun(std::ostream &ostr, const char *base, u64 pos, u64 len)
+	{
+		BinWrite(ostr, pos);
+		BinWrite(ostr, len);
+		BinWrite(ostr, base + pos, (std::size_t)len);
+	}
+
+	void Computer::SaveCheckpoint(std::ostream &ostr, bool compress) const
+	{
+		// write checkpoint header and CSX64 version number
+		ostr.write(reinterpret_cast<const char*>(header), sizeof(header));
+		BinWrite(ostr, Version);
+
+		// long double is stored raw, so it's only portable between hosts with the same representation
+		BinWrite(ostr, (u8)sizeof(long double));
+
+		// -- state -- //
+
+		BinWrite(ostr, mem_size);
+		BinWrite(ostr, min_mem_size);
+		BinWrite(ostr, max_mem_size);
+
+		BinWrite(ostr, ExeBarrier);
+		BinWrite(ostr, ReadonlyBarrier);
+		BinWrite(ostr, StackBarrier);
+
+		BinWrite(ostr, (u8)running);
+		BinWrite(ostr, (u8)suspended_read);
+		BinWrite(ostr, (u32)error);
+		BinWrite(ostr, (i32)return_value);
+
+		// write the flags with any deferred update applied
+		BinWrite(ostr, CPURegisters);
+		BinWrite(ostr, CurrentFlags());
+		BinWrite(ostr, _RIP);
+
+		BinWrite(ostr, FPURegisters);
+		BinWrite(ostr, FPU_control);
+		BinWrite(ostr, FPU_status);
+		BinWrite(ostr, FPU_tag);
+
+		BinWrite(ostr, ZMMRegisters);
+		BinWrite(ostr, _MXCSR);
+
+		BinWrite(ostr, reinterpret_cast<const char*>(&Rand), sizeof(Rand));
+
+		// -- file descriptors -- //
+
+		u8 file_count = 0;
+		for (const auto &f : FileDescriptors) if (f) ++file_count;
+		BinWrite(ostr, file_count);
+
+		for (int i = 0; i < FDCount; ++i)
+		{
+			IFileWrapper *f = FileDescriptors[i].get();
+			if (!f) continue;
+
+			u8 flags = (f->IsInteractive() ? FileInteractive : 0) | (f->CanRead() ? FileCanRead : 0) | (f->CanWrite() ? FileCanWrite : 0) | (f->CanSeek() ? FileCanSeek : 0);
+
+			// getting the position of a seekable file can still fail (e.g. a closed stream) - just record it as unknown
+			i64 position = -1;
+			if (flags & FileCanSeek)
+			{
+				try { position = f->Seek(0, std::ios::cur); }
+				catch (...) { position = -1; }
+			}
+
+			BinWrite(ostr, (u8)i);
+			BinWrite(ostr, flags);
+			BinWrite(ostr, position);
+		}
+
+		// -- memory -- //
+
+		const char *const base = static_cast<const char*>(mem);
+		if (!compress)
+		{
+			if (mem_size != 0) WriteRun(ostr, base, 0, mem_size);
+		}
+		else
+		{
+			// write each maximal run of pages that aren't all zero
+			u64 run = 0, run_len = 0;
+			for (u64 pos = 0; pos < mem_size && ostr; pos += CheckpointPageSize)
+			{
+				const u64 len = std::min(CheckpointPageSize, mem_size - pos);
+				if (!AllZero(base + pos, (std::size_t)len))
+				{
+					if (run_len == 0) run = pos;
+					run_len += len;
+				}
+				else if (run_len != 0)
+				{
+					WriteRun(ostr, base, run, run_len);
+					run_len = 0;
+				}
+			}
+			if (run_len != 0) WriteRun(ostr, base, run, run_len);
+		}
+		// terminate with an empty run
+		BinWrite(ostr, (u64)0);
+		BinWrite(ostr, (u64)0);
+
+		// make sure the writes succeeded
+		if (!ostr) throw IOError("Failed to write checkpoint");
+	}
+	void Computer::LoadCheckpoint(std::istream &istr, std::vector<CheckpointFile> *files)
+	{
+		u8 header_temp[sizeof(header)];
+		u64 Version_temp;
+		u8 ld_size;
+
+		ComputerSnapshot snap;
+		std::vector<CheckpointFile> files_temp;
+		u8 running_temp, suspended_read_temp, file_count;
+		u32 error_temp;
+		i32 return_value_temp;
+
+		void *ptr = nullptr;
+		u64 cap = 0, reserve = 0;
+
+		// -- checkpoint validation -- //
+
+		// read the header and make sure it matches - match failure is a type error, not a format error.
+		if (!istr.read(reinterpret_cast<char*>(header_temp), sizeof(header)) || istr.gcount() != sizeof(header)) goto err;
+		if (std::memcmp(header_temp, header, sizeof(header))) throw TypeError("Stream was not a CSX64 checkpoint");
+
+		// read the version number and host info and make sure they match - match failure is a version error, not a format error.
+		if (!BinRead(istr, Version_temp) || !BinRead(istr, ld_size)) goto err;
+		if (Version_temp != Version) throw VersionError("Checkpoint was from an incompatible version of CSX64");
+		if (ld_size != sizeof(long double)) throw VersionError("Checkpoint was from an incompatible host");
+
+		// -- state -- //
+
+		if (!BinRead(istr, snap.mem_size) || !BinRead(istr, snap.min_mem_size) || !BinRead(istr, snap.max_mem_size)) goto err;
+		if (!BinRead(istr, snap.ExeBarrier) || !BinRead(istr, snap.ReadonlyBarrier) || !BinRead(istr, snap.StackBarrier)) goto err;
+
+		// the memory size must be within its own limits (sys_brk relies on it)
+		if (snap.min_mem_size > snap.mem_size || snap.mem_size > snap.max_mem_size) goto err;
+
+		// the barriers must be in order and within memory (execution relies on it)
+		if (snap.ExeBarrier > snap.ReadonlyBarrier || snap.ReadonlyBarrier > snap.StackBarrier || snap.StackBarrier > snap.mem_size) goto err;
+
+		if (!BinRead(istr, running_temp) || !BinRead(istr, suspended_read_temp) || !BinRead(istr, error_temp) || !BinRead(istr, return_value_temp)) goto err;
+		snap.running = running_temp != 0;
+		snap.suspended_read = suspended_read_temp != 0;
+		snap.error = (ErrorCode)error_temp;
+		snap.return_value = return_value_temp;
+
+		if (!BinRead(istr, snap.CPURegisters) || !BinRead(istr, snap._RFLAGS) || !BinRead(istr, snap._RIP)) goto err;
+		if (!BinRead(istr, snap.FPURegisters) || !BinRead(istr, snap.FPU_control) || !BinRead(istr, snap.FPU_status) || !BinRead(istr, snap.FPU_tag)) goto err;
+		if (!BinRead(istr, snap.ZMMRegisters) || !BinRead(istr, snap._MXCSR)) goto err;
+		if (!BinRead(istr, reinterpret_cast<char*>(&snap.Rand), sizeof(snap.Rand))) goto err;
+
+		// -- file descriptors -- //
+
+		if (!BinRead(istr, file_count) || file_count > FDCount) goto err;
+		for (u8 i = 0; i < file_count; ++i)
+		{
+			u8 fd, flags;
+			i64 position;
+			if (!BinRead(istr, fd) || !BinRead(istr, flags) || !BinRead(istr, position) || fd >= FDCount) goto err;
+
+			files_temp.push_back({ (int)fd, (flags & FileInteractive) != 0, (flags & FileCanRead) != 0, (flags & FileCanWrite) != 0, (flags & FileCanSeek) != 0, position });
+		}
+
+		// -- memory -- //
+
+		// allocate a fresh array with the checkpoint's max memory (it determines the reservation)
+		if (snap.mem_size != 0)
+		{
+			const u64 max_mem_size_temp = max_mem_size;
+			max_mem_size = snap.max_mem_size;
+			ptr = AllocateMemory(snap.mem_size, cap, reserve);
+			max_mem_size = max_mem_size_temp;
+			if (!ptr) throw MemoryAllocException("failed to allocate checkpoint memory");
+
+			// reserved memory starts zeroed, but a heap array doesn't
+			if constexpr (!ReservedMemory) std::memset(ptr, 0, snap.mem_size);
+		}
+
+		// read the runs straight into the new array - they must be in order and within memory
+		for (u64 end = 0; ; )
+		{
+			u64 pos, len;
+			if (!BinRead(istr, pos) || !BinRead(istr, len)) goto err;
+			if (len == 0) break;
+
+			if (pos < end || pos > snap.mem_size || len > snap.mem_size - pos) goto err;
+			if (!BinRead(istr, static_cast<char*>(ptr) + pos, (std::size_t)len)) goto err;
+			end = pos + len;
+		}
+
+		// -- commit -- //
+
+		FreeMemory(mem, mem_reserve);
+		mem = ptr;
+		mem_size = snap.mem_size;
+		mem_cap = cap;
+		mem_reserve = reserve;
+
+		RestoreState(snap);
+
+		if (files) *files = std::move(files_temp);
+		return;
+
+	err:
+		FreeMemory(ptr, reserve);
+		throw FormatError("Checkpoint was corrupted");
+	}
+}
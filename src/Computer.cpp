@@ -10,10 +10,10 @@ namespace CSX64
 {
     bool Computer::realloc(u64 size, bool preserve_contents, bool force_realloc)
     {
-        // if we have enough space already, just use that unless we were told not to
-        if (size <= mem_cap && !force_realloc)
+        // if the array can be resized in place, just use that unless we were told not to
+        if (!force_realloc && ResizeMemory(size))
         {
-            // just need to update size (we already have the requisite capacity)
+            // just need to update size (we now have the requisite capacity)
             mem_size = size;
             return true;
         }
@@ -21,7 +21,8 @@ namespace CSX64
         else
         {
             // get the new array (64-byte aligned in case we want to use mm512 intrinsics later on)
-            void *ptr = CSX64::aligned_malloc(size, MemAlignment);
+            u64 cap, reserve;
+            void *ptr = AllocateMemory(size, cap, reserve);
             // make sure that succeeded
             if (!ptr) return false;
 
@@ -29,11 +30,13 @@ namespace CSX64
             if (preserve_contents) std::memcpy(ptr, mem, std::min(mem_size, size));
 
             // delete old array
-            CSX64::aligned_free(mem);
+            FreeMemory(mem, mem_reserve);
 
             // use new array
             mem = ptr;
-            mem_size = mem_cap = size;
+            mem_size = size;
+            mem_cap = cap;
+            mem_reserve = reserve;
 
             return true;
         }
@@ -49,22 +52,31 @@ namespace CSX64
 		// make sure it's within max memory usage limits
 		if (size > max_mem_size) throw MemoryAllocException("executable size exceeded max memory");
 		
-		// allocate the required space (we can safely discard any previous values)
-		if (!this->realloc(size, false)) throw MemoryAllocException("memory allocation failed");
+		// if the executable has an image, map it straight into memory (see Executable::map)
+		if (!MapExecutable(exe, size))
+		{
+			// otherwise allocate the required space (we can safely discard any previous values)
+			if (!this->realloc(size, false)) throw MemoryAllocException("memory allocation failed");
+
+			// copy the executable content into our memory array
+			std::memcpy(mem, exe.content(), exe.content_size());
+			// zero the bss segment
+			std::memset(reinterpret_cast<char*>(mem) + exe.content_size(), 0, exe.bss_seglen());
+		}
 
 		// mark the minimum memory size (so client code can't truncate off program code/data/stack/etc.)
 		min_mem_size = size;
 
-		// copy the executable content into our memory array
-		std::memcpy(mem, exe.content(), exe.content_size());
-		// zero the bss segment
-		std::memset(reinterpret_cast<char*>(mem) + exe.content_size(), 0, exe.bss_seglen());
-
 		// set up memory barriers
 		ExeBarrier = exe.text_seglen();
 		ReadonlyBarrier = exe.text_seglen() + exe.rodata_seglen();
 		StackBarrier = exe.text_seglen() + exe.rodata_seglen() + exe.data_seglen() + exe.bss_seglen();
 
+		// discard any blocks from the previous executable
+		ResetBlocks();
+		if (profiler) profiler->Clear();
+		if (tracer) tracer->Clear();
+
 		// set up cpu registers
 		for (int i = 0; i < 16; ++i) CPURegisters[i].x64() = Rand();
 
@@ -127,6 +139,10 @@ namespace CSX64
 	}
 
 	u64 Computer::Tick(u64 count)
+	{
+		return profiler || tracer ? TickInstrumented(count) : block_execution ? TickBlocks(count) : TickInterpreted(count);
+	}
+	u64 Computer::TickInterpreted(u64 count)
 	{
 		u64 ticks, op;
 		for (ticks = 0; ticks < count; ++ticks)
@@ -137,8 +153,8 @@ namespace CSX64
 			// make sure we're before the executable barrier
 			if (RIP() >= ExeBarrier) { Terminate(ErrorCode::AccessViolation); break; }
 
-			// fetch the instruction
-			if (!GetMemAdv<u8>(op)) break;
+			// fetch the instruction (no bounds check needed - the executable barrier is always in bounds)
+			op = reinterpret_cast<const u8*>(mem)[RIP()++];
 
 			#if __OPCODE_COUNTS
 			// update op exe count
@@ -163,6 +179,9 @@ namespace CSX64
             error = err;
             running = false;
 
+            // save the history leading up to the error (if requested)
+            if (err != ErrorCode::None && tracer && !trace_dump.empty()) DumpTrace();
+
             CloseFiles(); // close all the file descriptors
         }
     }
@@ -193,6 +212,80 @@ namespace CSX64
         if (running) suspended_read = false; 
     }
 
+    std::shared_ptr<const ComputerSnapshot> Computer::Snapshot() const
+    {
+        std::shared_ptr<ComputerSnapshot> snap(new ComputerSnapshot());
+
+        if (!CaptureMemory(*snap)) throw MemoryAllocException("failed to capture memory");
+        snap->mem_size = mem_size;
+        snap->min_mem_size = min_mem_size;
+        snap->max_mem_size = max_mem_size;
+
+        snap->ExeBarrier = ExeBarrier;
+        snap->ReadonlyBarrier = ReadonlyBarrier;
+        snap->StackBarrier = StackBarrier;
+
+        snap->running = running;
+        snap->suspended_read = suspended_read;
+        snap->error = error;
+        snap->return_value = return_value;
+
+        // capture the flags with any deferred update applied
+        std::copy(std::begin(CPURegisters), std::end(CPURegisters), snap->CPURegisters);
+        snap->_RFLAGS = CurrentFlags();
+        snap->_RIP = _RIP;
+
+        std::copy(std::begin(FPURegisters), std::end(FPURegisters), snap->FPURegisters);
+        snap->FPU_control = FPU_control;
+        snap->FPU_status = FPU_status;
+        snap->FPU_tag = FPU_tag;
+
+        std::copy(std::begin(ZMMRegisters), std::end(ZMMRegisters), snap->ZMMRegisters);
+        snap->_MXCSR = _MXCSR;
+
+        snap->Rand = Rand;
+
+        return snap;
+    }
+    void Computer::Fork(const ComputerSnapshot &snap)
+    {
+        // the memory is the only thing that can fail, so do it first (strong guarantee)
+        if (!MapMemory(snap)) throw MemoryAllocException("failed to map snapshot memory");
+        RestoreState(snap);
+    }
+    void Computer::RestoreState(const ComputerSnapshot &snap)
+    {
+        min_mem_size = snap.min_mem_size;
+        max_mem_size = snap.max_mem_size;
+
+        ExeBarrier = snap.ExeBarrier;
+        ReadonlyBarrier = snap.ReadonlyBarrier;
+        StackBarrier = snap.StackBarrier;
+
+        running = snap.running;
+        suspended_read = snap.suspended_read;
+        error = snap.error;
+        return_value = snap.return_value;
+
+        std::copy(std::begin(snap.CPURegisters), std::end(snap.CPURegisters), CPURegisters);
+        _RFLAGS = snap._RFLAGS;
+        pending_flags.op = FlagOp::None;
+        _RIP = snap._RIP;
+
+        std::copy(std::begin(snap.FPURegisters), std::end(snap.FPURegisters), FPURegisters);
+        FPU_control = snap.FPU_control;
+        FPU_status = snap.FPU_status;
+        FPU_tag = snap.FPU_tag;
+
+        std::copy(std::begin(snap.ZMMRegisters), std::end(snap.ZMMRegisters), ZMMRegisters);
+        _MXCSR = snap._MXCSR;
+
+        Rand = snap.Rand;
+
+        // discard any blocks from the previous state (same as Initialize)
+        ResetBlocks();
+    }
+
     int Computer::OpenFileWrapper(std::unique_ptr<IFileWrapper> f)
     {
         int fd = FindAvailableFD();
@@ -17,7 +17,7 @@ namespace CSX64
 {
 	Executable::Executable() { clear(); }
 
-	Executable::Executable(Executable &&other) noexcept : _content(std::move(other._content))
+	Executable::Executable(Executable &&other) noexcept : _content(std::move(other._content)), _image(std::move(other._image))
 	{
 		std::memcpy(_seglens, other._seglens, sizeof(_seglens));
 
@@ -37,6 +37,7 @@ namespace CSX64
 
 		swap(a._seglens, b._seglens);
 		swap(a._content, b._content);
+		swap(a._image, b._image);
 	}
 
 	// ------------------------------------------------- //
@@ -61,6 +62,7 @@ namespace CSX64
 
 		// resize _content to hold all the segments (except bss) - if this throws, set to empty state and rethrow
 		_content.clear();
+		_image.reset();
 		try { _content.resize(text.size() + rodata.size() + data.size()); }
 		catch (...) { clear(); throw; }
 
@@ -81,8 +83,11 @@ namespace CSX64
 	{
 		for (u64 &i : _seglens) i = 0;
 		_content.clear();
+		_image.reset();
 	}
 
+	const u8 *Executable::content() const& noexcept { return _image ? _image->data : _content.data(); }
+
 	// ------------------------------------------------- //
 
 	static const u8 header[] = { 'C', 'S', 'X', '6', '4', 'e', 'x', 'e' };
@@ -101,47 +106,24 @@ namespace CSX64
 		// write the segment lengths
 		file.write(reinterpret_cast<const char*>(_seglens), sizeof(_seglens));
 
-		// write the content of the executable
-		file.write(reinterpret_cast<const char*>(_content.data()), _content.size());
+		// write the content of the executable (held in the image if it was mapped)
+		file.write(reinterpret_cast<const char*>(content()), content_size());
 
 		// make sure the writes succeeded
 		if (!file) throw IOError("Failed to write Executable to file");
 	}
-	void Executable::load(const std::string &path)
+	void Executable::load_header(std::istream &file, u64 file_size)
 	{
-		std::ifstream file(path, std::ios::binary | std::ios::ate);
-		if (!file)
-		{
-			clear(); // if we throw an exception we must set to the empty state first
-			throw FileOpenError("Failed to open file for loading Executable");
-		}
-
-		// get the file size and seek back to the beginning
-		const u64 file_size = file.tellg();
-		file.seekg(0);
-
 		u8 header_temp[sizeof(header)];
 		u64 Version_temp;
 
-		// -- file validation -- //
-
 		// read the header from the file and make sure it matches - match failure is a type error, not a format error.
 		if (!file.read(reinterpret_cast<char*>(header_temp), sizeof(header)) || file.gcount() != sizeof(header)) goto err;
-		if (std::memcmp(header_temp, header, sizeof(header)))
-		{
-			clear(); // if we throw an exception we must set to the empty state first
-			throw TypeError("File was not a CSX64 executable");
-		}
+		if (std::memcmp(header_temp, header, sizeof(header))) throw TypeError("File was not a CSX64 executable");
 
 		// read the version number from the file and make sure it matches - match failure is a version error, not a format error.
 		if (!BinRead(file, Version_temp)) goto err;
-		if (Version_temp != Version)
-		{
-			clear(); // if we throw an exception we must set to the empty state first
-			throw VersionError("Executable was from an incompatible version of CSX64");
-		}
-
-		// -- read executable info -- //
+		if (Version_temp != Version) throw VersionError("Executable was from an incompatible version of CSX64");
 
 		// read the segment lengths - make sure we got everything
 		if (!file.read(reinterpret_cast<char*>(_seglens), sizeof(_seglens)) || file.gcount() != sizeof(_seglens)) goto err;
@@ -155,20 +137,39 @@ namespace CSX64
 		// make sure the file is the correct size
 		if (file_size != 48 + _seglens[0] + _seglens[1] + _seglens[2]) goto err;
 
-		// -- read executable content -- //
-
-		// allocate space to hold the executable content - if that fails set the exe to empty state and rethrow
-		_content.clear();
-		try { _content.resize(_seglens[0] + _seglens[1] + _seglens[2]); }
-		catch (...) { clear(); throw; }
-
-		// read the content - make sure we got everything
-		if (!file.read(reinterpret_cast<char*>(_content.data()), _content.size()) || (std::size_t)file.gcount() != _content.size()) goto err;
-
 		return;
 
 	err:
-		clear(); // if we throw an exception we must leave the exe in the empty state
 		throw FormatError("Executable file was corrupted");
 	}
+
+	void Executable::load(const std::string &path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			clear(); // if we throw an exception we must set to the empty state first
+			throw FileOpenError("Failed to open file for loading Executable");
+		}
+
+		// get the file size and seek back to the beginning
+		const u64 file_size = file.tellg();
+		file.seekg(0);
+
+		// if we throw an exception we must leave the exe in the empty state
+		try
+		{
+			load_header(file, file_size);
+
+			// allocate space to hold the executable content
+			_content.clear();
+			_image.reset();
+			_content.resize(_seglens[0] + _seglens[1] + _seglens[2]);
+
+			// read the content - make sure we got everything
+			if (!file.read(reinterpret_cast<char*>(_content.data()), _content.size()) || (std::size_t)file.gcount() != _content.size())
+				throw FormatError("Executable file was corrupted");
+		}
+		catch (...) { clear(); throw; }
+	}
 }
@@ -1,3 +1,9 @@
+#include <unordered_set>
+#include <cstddef>
+#include <new>
+#include <string_view>
+#include <type_traits>
+
 #include "../include/Expr.h"
 
 // -- Expr method impl  -- //
@@ -60,22 +66,121 @@ namespace CSX64
 		{Expr::OPs::NullCoalesce, "??"},
 	};
 
+	// -- arenas -- //
+
+	static thread_local Expr::Arena *current_arena = nullptr; // the arena expressions are made with on this thread (null for the system heap)
+
+	Expr::ArenaScope::ArenaScope(Arena *arena) : prev(current_arena) { current_arena = arena; }
+	Expr::ArenaScope::~ArenaScope() { current_arena = prev; }
+
+	// every node is prefixed by the arena it came from (or null if it came from the system)
+	struct NodeHeader { Expr::Arena *arena; };
+
+	static_assert(sizeof(NodeHeader) == sizeof(void*) && alignof(Expr) <= alignof(void*) && sizeof(Expr) % sizeof(void*) == 0, "Expr can't be allocated from an arena");
+
+	static constexpr std::size_t NodeSlots = 1 + sizeof(Expr) / sizeof(void*); // pointer-sized units per node (header included)
+	static constexpr std::size_t BlockNodes = 1024; // nodes per arena block
+
+	const std::string *Expr::Arena::Intern(std::string str)
+	{
+		auto it = index.find(str);
+		if (it != index.end()) return it->second;
+
+		tokens.push_back({ std::move(str), this });
+		const std::string *token = &tokens.back().str;
+		index.emplace(*token, token);
+		return token;
+	}
+
+	void *Expr::Arena::AllocNode()
+	{
+		if (free_nodes)
+		{
+			void *node = free_nodes;
+			free_nodes = *static_cast<void**>(node);
+			return node;
+		}
+
+		if (blocks.empty() || block_used == BlockNodes)
+		{
+			blocks.emplace_back(new void*[NodeSlots * BlockNodes]);
+			block_used = 0;
+		}
+		return blocks.back().get() + NodeSlots * block_used++;
+	}
+	void Expr::Arena::FreeNode(void *node) noexcept
+	{
+		*static_cast<void**>(node) = free_nodes;
+		free_nodes = node;
+	}
+
+	// -- tokens -- //
+
+	static_assert(std::is_standard_layout<ExprToken>::value, "ExprToken must be standard layout");
+
+	static Expr::Arena *TokenArena(const std::string *token) { return reinterpret_cast<const ExprToken*>(token)->arena; }
+
+	const std::string *Expr::MakeToken(std::string str)
+	{
+		if (current_arena) return current_arena->Intern(std::move(str));
+		return &(new ExprToken{ std::move(str), nullptr })->str;
+	}
+	const std::string *Expr::CopyToken(const std::string *token)
+	{
+		if (!token || (current_arena && TokenArena(token) == current_arena)) return token;
+		return MakeToken(*token);
+	}
+	void Expr::ReleaseToken(const std::string *token)
+	{
+		if (token && !TokenArena(token)) delete reinterpret_cast<const ExprToken*>(token);
+	}
+
+	// checks if a node's token matches a key token - an interned key only matches by pointer, otherwise the strings are compared
+	static bool TokenMatches(const std::string *token, const std::string *key)
+	{
+		return token == key || (token && !TokenArena(key) && *token == *key);
+	}
+
+	// -- node allocation -- //
+
+	void *Expr::operator new(std::size_t size)
+	{
+		// derived types go straight to the system
+		Arena *arena = size == sizeof(Expr) ? current_arena : nullptr;
+
+		void *node = arena ? arena->AllocNode() : ::operator new(sizeof(NodeHeader) + size);
+		return new (node) NodeHeader{ arena } + 1;
+	}
+	void Expr::operator delete(void *ptr, std::size_t) noexcept
+	{
+		if (!ptr) return;
+
+		NodeHeader *node = static_cast<NodeHeader*>(ptr) - 1;
+		if (node->arena) node->arena->FreeNode(node);
+		else ::operator delete(node);
+	}
+
 	// ------------------------------
 
-	Expr::Expr() : _Result(0), _Floating(false), OP(OPs::None) {}
+	Expr::Expr() : _Token(nullptr), _Result(0), _Floating(false), OP(OPs::None) {}
 
-	Expr::Expr(const Expr &other) : _Token(other._Token), _Result(other._Result), _Floating(other._Floating), OP(other.OP)
+	Expr::Expr(const Expr &other) : _Token(CopyToken(other._Token)), _Result(other._Result), _Floating(other._Floating), OP(other.OP)
 	{
+
 		// copy children recursively
 		if (other.Left) Left = std::make_unique<Expr>(*other.Left);
 		if (other.Right) Right = std::make_unique<Expr>(*other.Right);
 	}
-	Expr::Expr(Expr &&other) : _Token(std::move(other._Token)), _Result(other._Result), _Floating(other._Floating),
+	Expr::Expr(Expr &&other) : _Token(other._Token), _Result(other._Result), _Floating(other._Floating),
 		OP(other.OP), Left(std::move(other.Left)), Right(std::move(other.Right))
 	{
 		// empty other
 		other.OP = OPs::None;
-		other._Token.clear();
+		other._Token = nullptr;
+	}
+	Expr::~Expr()
+	{
+		ReleaseToken(_Token);
 	}
 
 	Expr &Expr::operator=(const Expr &other)
@@ -117,125 +222,94 @@ namespace CSX64
 		Right = nullptr;
 
 		// discard token
-		_Token.clear();
+		ReleaseToken(_Token);
+		_Token = nullptr;
 
 		// store data
 		_Result = result;
 		_Floating = floating;
 	}
 
-	bool Expr::__Evaluate__(std::unordered_map<std::string, Expr> &symbols, u64 &res, bool &floating, std::string &err, std::vector<std::string> &visited)
+	// parses a numeric literal token (e.g. 0x_12ab, 1011b, 1.5e3) - returns false if it's ill-formed
+	static bool TryParseNumericLiteral(const std::string &tok, u64 &res, bool &floating)
 	{
-		Expr *expr;
-		const std::string *tok;
-
-		res = 0; // initialize out params
 		floating = false;
 
-		u64 L, R, Aux; // parsing locations for left and right subtrees
-		bool LF, RF, AuxF;
-
-		bool ret = true; // return value
+		// remove underscores (e.g. 0b_0011_1101_1101_1111) and convert to lowercase for convenience
+		std::string fixed_tok = ToLower(remove_ch(tok, '_'));
+		if (fixed_tok.empty()) return false;
 
-		// switch through op
-		switch (OP)
-		{
-		case OPs::None: // -- value -- //
-			tok = Token();
-
-			// if this has already been evaluated, return the cached result
-			if (tok == nullptr) { res = _Result; floating = _Floating; return true; }
-
-			// if it's a number
-			if (std::isdigit((*tok)[0]))
-			{
-				// remove underscores (e.g. 0b_0011_1101_1101_1111) and convert to lowercase for convenience
-				std::string fixed_tok = ToLower(remove_ch((*tok), '_'));
+		// -- try parsing as int -- //
 
-				// -- try parsing as int -- //
+		// hex prefixes
+		if (StartsWith(fixed_tok, "0x") || StartsWith(fixed_tok, "0h")) { if (TryParseUInt64(fixed_tok.substr(2), res, 16)) return true; }
+		// hex suffixes
+		else if (fixed_tok.back() == 'x' || fixed_tok.back() == 'h') { if (TryParseUInt64(fixed_tok.substr(0, fixed_tok.size() - 1), res, 16)) return true; }
 
-				// hex prefixes
-				if (StartsWith(fixed_tok, "0x") || StartsWith(fixed_tok, "0h")) { if (TryParseUInt64(fixed_tok.substr(2), res, 16)) break; }
-				// hex suffixes
-				else if (fixed_tok.back() == 'x' || fixed_tok.back() == 'h') { if (TryParseUInt64(fixed_tok.substr(0, fixed_tok.size() - 1), res, 16)) break; }
+		// dec prefixes
+		else if (StartsWith(fixed_tok, "0d") || StartsWith(fixed_tok, "0t")) { if (TryParseUInt64(fixed_tok.substr(2), res, 10)) return true; }
+		// dec suffixes
+		else if (fixed_tok.back() == 'd' || fixed_tok.back() == 't') { if (TryParseUInt64(fixed_tok.substr(0, fixed_tok.size() - 1), res, 10)) return true; }
 
-				// dec prefixes
-				else if (StartsWith(fixed_tok, "0d") || StartsWith(fixed_tok, "0t")) { if (TryParseUInt64(fixed_tok.substr(2), res, 10)) break; }
-				// dec suffixes
-				else if (fixed_tok.back() == 'd' || fixed_tok.back() == 't') { if (TryParseUInt64(fixed_tok.substr(0, fixed_tok.size() - 1), res, 10)) break; }
+		// oct prefixes
+		else if (StartsWith(fixed_tok, "0o") || StartsWith(fixed_tok, "0q")) { if (TryParseUInt64(fixed_tok.substr(2), res, 8)) return true; }
+		// oct suffixes
+		else if (fixed_tok.back() == 'o' || fixed_tok.back() == 'q') { if (TryParseUInt64(fixed_tok.substr(0, fixed_tok.size() - 1), res, 8)) return true; }
 
-				// oct prefixes
-				else if (StartsWith(fixed_tok, "0o") || StartsWith(fixed_tok, "0q")) { if (TryParseUInt64(fixed_tok.substr(2), res, 8)) break; }
-				// oct suffixes
-				else if (fixed_tok.back() == 'o' || fixed_tok.back() == 'q') { if (TryParseUInt64(fixed_tok.substr(0, fixed_tok.size() - 1), res, 8)) break; }
+		// bin prefixes
+		else if (StartsWith(fixed_tok, "0b") || StartsWith(fixed_tok, "0y")) { if (TryParseUInt64(fixed_tok.substr(2), res, 2)) return true; }
+		// bin suffixes
+		else if (fixed_tok.back() == 'b' || fixed_tok.back() == 'y') { if (TryParseUInt64(fixed_tok.substr(0, fixed_tok.size() - 1), res, 2)) return true; }
 
-				// bin prefixes
-				else if (StartsWith(fixed_tok, "0b") || StartsWith(fixed_tok, "0y")) { if (TryParseUInt64(fixed_tok.substr(2), res, 2)) break; }
-				// bin suffixes
-				else if (fixed_tok.back() == 'b' || fixed_tok.back() == 'y') { if (TryParseUInt64(fixed_tok.substr(0, fixed_tok.size() - 1), res, 2)) break; }
+		// otherwise is dec
+		else { if (TryParseUInt64(fixed_tok, res, 10)) return true; }
 
-				// otherwise is dec
-				else { if (TryParseUInt64(fixed_tok, res, 10)) break; }
-
-				// -- try parsing as float -- //
-
-				// try floating-point
-				double fval;
-				if (TryParseDouble(fixed_tok, fval)) { res = DoubleAsUInt64(fval); floating = true; break; }
-
-				// if nothing worked, it's an ill-formed numeric literal
-				err = "Ill-formed numeric literal encountered: \"" + (*Token()) + "\"";
-				return false;
-			}
-			// if it's a character constant
-			else if ((*tok)[0] == '"' || (*tok)[0] == '\'' || (*tok)[0] == '`')
-			{
-				// get the characters
-				std::string chars;
-				if (!TryExtractStringChars((*tok), chars, err)) return false;
+		// -- try parsing as float -- //
 
-				// must be 1-8 chars
-				if (chars.size() == 0) { err = "Ill-formed character literal encountered (empty): " + (*tok); return false; }
-				if (chars.size() > 8) { err = "Ill-formed character literal encountered (too long): " + (*tok); return false; }
+		double fval;
+		if (TryParseDouble(fixed_tok, fval)) { res = DoubleAsUInt64(fval); floating = true; return true; }
 
-				res = 0; // zero res just in case that's removed from the top of the function later on
+		return false;
+	}
 
-				// build the value
-				for (int i = 0; i < (int)chars.size(); ++i) res |= (u64)(chars[i] & 0xff) << (i * 8);
+	void Expr::Token(std::string val)
+	{
+		if (val.empty()) throw std::invalid_argument("Expr token cannot be empty string");
 
-				break;
-			}
-			// if it's a defined symbol we haven't already visited
-			else if (!Contains(visited, *tok) && TryGetValue(symbols, (*tok), expr))
-			{
-				visited.push_back((*tok)); // mark token as visited
+		OP = OPs::None;
+		Left = nullptr;
+		Right = nullptr;
 
-				// if we can't evaluate it, fail
-				if (!expr->__Evaluate__(symbols, res, floating, err, visited)) { err = "Failed to evaluate referenced symbol \"" + (*tok) + "\"\n-> " + err; return false; }
+		// numeric literals are parsed once up front (ill-formed ones are kept so evaluating them reports the error)
+		u64 res;
+		bool floating;
+		if (std::isdigit((unsigned char)val[0]) && TryParseNumericLiteral(val, res, floating)) CacheResult(res, floating);
+		else
+		{
+			const std::string *token = MakeToken(std::move(val));
+			ReleaseToken(_Token);
+			_Token = token;
+		}
+	}
 
-				visited.pop_back(); // unmark token (must be done for diamond expressions i.e. a=b+c, b=d, c=d, d=0)
+	// applies an operator (other than Condition) to its evaluated operands (R is ignored for unary operators)
+	static bool ApplyOp(Expr::OPs op, u64 L, bool LF, u64 R, bool RF, u64 &res, bool &floating, std::string &err)
+	{
+		using OPs = Expr::OPs;
 
-				break; // break so we can resolve the reference
-			}
-			// otherwise we can't evaluate it
-			else { err = "Failed to evaluate \"" + (*tok) + "\""; return false; }
+		res = 0; // initialize out params
+		floating = false;
 
+		switch (op)
+		{
 		// -- binary operators -- //
 
 		case OPs::Mul:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) { res = DoubleAsUInt64((LF ? AsDouble(L) : (i64)L) * (RF ? AsDouble(R) : (i64)R)); floating = true; }
 			else res = L * R;
 			break;
 
 		case OPs::UDiv:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF)
 			{
 				double _num = LF ? AsDouble(L) : (double)L;
@@ -256,10 +330,6 @@ namespace CSX64
 
 			break;
 		case OPs::UMod:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF)
 			{
 				double _num = LF ? AsDouble(L) : (double)L;
@@ -280,10 +350,6 @@ namespace CSX64
 			break;
 
 		case OPs::SDiv:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF)
 			{
 				double _num = LF ? AsDouble(L) : (double)(i64)L;
@@ -305,10 +371,6 @@ namespace CSX64
 
 			break;
 		case OPs::SMod:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF)
 			{
 				double _num = LF ? AsDouble(L) : (double)(i64)L;
@@ -329,194 +391,115 @@ namespace CSX64
 			break;
 
 		case OPs::Add:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) { res = DoubleAsUInt64((LF ? AsDouble(L) : (i64)L) + (RF ? AsDouble(R) : (i64)R)); floating = true; }
 			else res = L + R;
 			break;
 		case OPs::Sub:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) { res = DoubleAsUInt64((LF ? AsDouble(L) : (i64)L) - (RF ? AsDouble(R) : (i64)R)); floating = true; }
 			else res = L - R;
 			break;
 
 		case OPs::SL:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
 			
 			res = L << R; floating = LF || RF;
 			break;
 		case OPs::SR:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			res = L >> R; floating = LF || RF;
 			break;
 
 		case OPs::Less:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) res = (LF ? AsDouble(L) : (i64)L) < (RF ? AsDouble(R) : (i64)R) ? 1 : 0ul;
 			else res = (i64)L < (i64)R ? 1 : 0ul;
 			break;
 		case OPs::LessE:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) res = (LF ? AsDouble(L) : (i64)L) <= (RF ? AsDouble(R) : (i64)R) ? 1 : 0ul;
 			else res = (i64)L <= (i64)R ? 1 : 0ul;
 			break;
 		case OPs::Great:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) res = (LF ? AsDouble(L) : (i64)L) > (RF ? AsDouble(R) : (i64)R) ? 1 : 0ul;
 			else res = (i64)L > (i64)R ? 1 : 0ul;
 			break;
 		case OPs::GreatE:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) res = (LF ? AsDouble(L) : (i64)L) >= (RF ? AsDouble(R) : (i64)R) ? 1 : 0ul;
 			else res = (i64)L >= (i64)R ? 1 : 0ul;
 			break;
 
 		case OPs::Eq:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) res = (LF ? AsDouble(L) : (i64)L) == (RF ? AsDouble(R) : (i64)R) ? 1 : 0ul;
 			else res = L == R ? 1 : 0ul;
 			break;
 		case OPs::Neq:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (LF || RF) res = (LF ? AsDouble(L) : (i64)L) != (RF ? AsDouble(R) : (i64)R) ? 1 : 0ul;
 			else res = L != R ? 1 : 0ul;
 			break;
 
 		case OPs::BitAnd:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			res = L & R; floating = LF || RF;
 			break;
 		case OPs::BitXor:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			res = L ^ R; floating = LF || RF;
 			break;
 		case OPs::BitOr:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			res = L | R; floating = LF || RF;
 			break;
 
 		case OPs::LogAnd:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			res = !IsZero(L, LF) && !IsZero(R, RF) ? 1 : 0ul;
 			break;
 		case OPs::LogOr:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			res = !IsZero(L, LF) || !IsZero(R, RF) ? 1 : 0ul;
 			break;
 
 			// unary ops
 
 		case OPs::Neg:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			res = LF ? DoubleAsUInt64(-AsDouble(L)) : ~L + 1; floating = LF;
 			break;
 		case OPs::BitNot:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			res = ~L; floating = LF;
 			break;
 		case OPs::LogNot:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			res = IsZero(L, LF) ? 1 : 0ul;
 			break;
 
 		case OPs::Int:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			// float converts to int, otherwise pass-through
 			res = LF ? (u64)(i64)AsDouble(L) : L;
 			break;
 		case OPs::Float:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			// int converts to float, otherwise pass-through
 			res = LF ? L : DoubleAsUInt64((double)(i64)L);
 			floating = true;
 			break;
 
 		case OPs::Floor:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			// floor the result - results in a float
 			res = DoubleAsUInt64(std::floor(LF ? AsDouble(L) : (double)(i64)L));
 			floating = true;
 			break;
 		case OPs::Ceil:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			// ceil the result - results in a float
 			res = DoubleAsUInt64(std::ceil(LF ? AsDouble(L) : (double)(i64)L));
 			floating = true;
 			break;
 		case OPs::Round:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			// round the result - results in a float
 			res = DoubleAsUInt64(std::round(LF ? AsDouble(L) : (double)(i64)L));
 			floating = true;
 			break;
 		case OPs::Trunc:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
-
 			// trunc the result - results in a float
 			res = DoubleAsUInt64(std::trunc(LF ? AsDouble(L) : (double)(i64)L));
 			floating = true;
 			break;
 
 		case OPs::Repr64:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
 			if (!LF) { err = "REPR64 requires a floating-point argument"; return false; }
 
 			// convert the float to a 64-bit representation (already storing as 64-bit representation)
 			res = L;
 			break;
 		case OPs::Repr32:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
 			if (!LF) { err = "REPR32 requires a floating-point argument"; return false; }
 
 			// convert the float to a 32-bit representation
@@ -524,7 +507,6 @@ namespace CSX64
 			break;
 
 		case OPs::Float64:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
 			if (LF) { err = "FLOAT64 requires an integer argument"; return false; }
 
 			// convert the 64-bit representation to a float
@@ -532,7 +514,6 @@ namespace CSX64
 			floating = true;
 			break;
 		case OPs::Float32:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
 			if (LF) { err = "FLOAT32 requires an integer argument"; return false; }
 
 			// convert the 32-bit representation to a float
@@ -541,7 +522,6 @@ namespace CSX64
 			break;
 
 		case OPs::Prec64:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
 			if (!LF) { err = "PREC64 requires a floating-point argument"; return false; }
 
 			// truncate the precision to 64 bits (already storing in 64-bit floating point, so that would be no-op)
@@ -549,7 +529,6 @@ namespace CSX64
 			floating = true;
 			break;
 		case OPs::Prec32:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) return false;
 			if (!LF) { err = "PREC32 requires a floating-point argument"; return false; }
 
 			// truncate the precision to 32 bits (stored as a 64-bit floating, just chop off some precision from the end)
@@ -560,29 +539,262 @@ namespace CSX64
 		// -- misc operators -- //
 
 		case OPs::NullCoalesce:
-			if (!Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
 			if (!IsZero(L, LF)) { res = L; floating = LF; }
 			else /*          */ { res = R; floating = RF; }
 			break;
-		case OPs::Condition:
-			if (!Left->__Evaluate__(symbols, Aux, AuxF, err, visited)) ret = false;
-			if (!Right->Left->__Evaluate__(symbols, L, LF, err, visited)) ret = false;
-			if (!Right->Right->__Evaluate__(symbols, R, RF, err, visited)) ret = false;
-			if (ret == false) return false;
-
-			if (!IsZero(Aux, AuxF)) { res = L; floating = LF; }
-			else /*              */ { res = R; floating = RF; }
-			break;
 
 		default: err = "Unknown operation"; return false;
 		}
 
-		// cache the result
-		CacheResult(res, floating);
+		return true;
+	}
+
+	// evaluates expressions iteratively (with explicit stacks, since trees can be arbitrarily deep).
+	// a symbol is evaluated the first time it's referenced, and its result (or error) is remembered for the rest of the pass.
+	// this makes a depth-first traversal of the symbol dependency graph, where a reference to a symbol that is still being evaluated is a cycle.
+	class Expr::Evaluator
+	{
+	private: // -- types -- //
+
+		enum class State { Active, Evaluated, Failed };
+
+		// a symbol that has been reached in this pass
+		struct Symbol
+		{
+			State state;
+			u64 res;
+			bool floating;
+			std::string err; // the error it failed with
+		};
+
+		// a symbol table entry
+		typedef std::pair<const std::string, Expr> Entry;
+
+		// a pending step: expand a node into its operands, apply a node's operator to its evaluated operands,
+		// or (if symbol is non-null) finish evaluating a symbol (and resolve the node that referenced it, if any)
+		struct Frame
+		{
+			Expr *node;
+			Entry *symbol;
+			bool expanded;
+		};
+
+		// an evaluated operand
+		struct Value
+		{
+			u64 res;
+			bool floating;
+			bool ok;
+		};
+
+	private: // -- data -- //
+
+		std::unordered_map<std::string, Expr> &symbols;
+		std::unordered_map<const Entry*, Symbol> states; // keyed by symbol table entry
+
+		std::vector<Frame> frames;
+		std::vector<Value> values;
+
+		void Fail(std::string &err, std::string msg) { err = std::move(msg); values.push_back({ 0, false, false }); }
+
+		// evaluates a leaf, pushing its value or (for an unvisited symbol) the frames to evaluate it
+		void Leaf(Expr &node, std::string &err)
+		{
+			const std::string *tok = node._Token;
+			u64 res;
+			bool floating;
+
+			// if this has already been evaluated, use the cached result
+			if (tok == nullptr) { values.push_back({ node._Result, node._Floating, true }); return; }
+
+			// if it's a number (valid ones were already parsed when the token was created)
+			if (std::isdigit((unsigned char)(*tok)[0]))
+			{
+				if (!TryParseNumericLiteral(*tok, res, floating)) { Fail(err, "Ill-formed numeric literal encountered: \"" + *tok + "\""); return; }
+			}
+			// if it's a character constant
+			else if ((*tok)[0] == '"' || (*tok)[0] == '\'' || (*tok)[0] == '`')
+			{
+				// get the characters
+				std::string chars;
+				if (!TryExtractStringChars(*tok, chars, err)) { values.push_back({ 0, false, false }); return; }
+
+				// must be 1-8 chars
+				if (chars.size() == 0) { Fail(err, "Ill-formed character literal encountered (empty): " + *tok); return; }
+				if (chars.size() > 8) { Fail(err, "Ill-formed character literal encountered (too long): " + *tok); return; }
+
+				// build the value
+				res = 0;
+				floating = false;
+				for (int i = 0; i < (int)chars.size(); ++i) res |= (u64)(chars[i] & 0xff) << (i * 8);
+			}
+			// otherwise it's a symbol
+			else
+			{
+				auto entry = symbols.find(*tok);
+
+				// if it's not defined we can't evaluate it
+				if (entry == symbols.end()) { Fail(err, "Failed to evaluate \"" + *tok + "\""); return; }
+
+				Expr &expr = entry->second;
+				auto state = states.find(&*entry);
+
+				// if it's already been evaluated we don't need to track it
+				if (expr.IsEvaluated()) { res = expr._Result; floating = expr._Floating; }
+				// if we've already reached it in this pass
+				else if (state != states.end())
+				{
+					if (state->second.state == State::Active) { Fail(err, "Failed to evaluate \"" + *tok + "\""); return; } // cycle
+					if (state->second.state == State::Failed) { Fail(err, "Failed to evaluate referenced symbol \"" + *tok + "\"\n-> " + state->second.err); return; }
+
+					res = state->second.res;
+					floating = state->second.floating;
+				}
+				// otherwise evaluate it, then come back to resolve this node
+				else
+				{
+					states.emplace(&*entry, Symbol{ State::Active, 0, false, {} });
+					frames.push_back({ &node, &*entry, true });
+					frames.push_back({ &expr, nullptr, false });
+					return;
+				}
+			}
+
+			// cache the result
+			node.CacheResult(res, floating);
+			values.push_back({ res, floating, true });
+		}
+
+		// performs the pending step on the top of the frame stack
+		void Step(std::string &err)
+		{
+			const Frame frame = frames.back();
+			frames.pop_back();
+
+			// finishing a symbol
+			if (frame.symbol)
+			{
+				const Value val = values.back();
+				Symbol &sym = states[frame.symbol];
+
+				if (val.ok)
+				{
+					sym.state = State::Evaluated;
+					sym.res = val.res;
+					sym.floating = val.floating;
+
+					if (frame.node) frame.node->CacheResult(val.res, val.floating);
+				}
+				else
+				{
+					sym.state = State::Failed;
+					sym.err = err;
+
+					if (frame.node) err = "Failed to evaluate referenced symbol \"" + frame.symbol->first + "\"\n-> " + err;
+				}
+				return;
+			}
+
+			Expr &node = *frame.node;
+
+			if (node.OP == OPs::None) { Leaf(node, err); return; }
+
+			// operands are evaluated left to right (so they're pushed in reverse), then we come back to apply the operator
+			if (!frame.expanded)
+			{
+				frames.push_back({ &node, nullptr, true });
+				if (node.OP == OPs::Condition)
+				{
+					frames.push_back({ node.Right->Right.get(), nullptr, false });
+					frames.push_back({ node.Right->Left.get(), nullptr, false });
+				}
+				else if (node.Right) frames.push_back({ node.Right.get(), nullptr, false });
+				frames.push_back({ node.Left.get(), nullptr, false });
+				return;
+			}
+
+			// pop the operands (all of them are evaluated even if one fails, so the last error is the one reported)
+			Value aux = { 0, false, true }, left, right = { 0, false, true };
+			if (node.OP == OPs::Condition || node.Right) { right = values.back(); values.pop_back(); }
+			left = values.back(); values.pop_back();
+			if (node.OP == OPs::Condition) { aux = values.back(); values.pop_back(); }
+
+			if (!aux.ok || !left.ok || !right.ok) { values.push_back({ 0, false, false }); return; }
+
+			u64 res;
+			bool floating;
+			if (node.OP == OPs::Condition)
+			{
+				if (!IsZero(aux.res, aux.floating)) { res = left.res; floating = left.floating; }
+				else /*                          */ { res = right.res; floating = right.floating; }
+			}
+			else if (!ApplyOp(node.OP, left.res, left.floating, right.res, right.floating, res, floating, err)) { values.push_back({ 0, false, false }); return; }
+
+			// cache the result
+			node.CacheResult(res, floating);
+			values.push_back({ res, floating, true });
+		}
+
+	public: // -- interface -- //
+
+		explicit Evaluator(std::unordered_map<std::string, Expr> &_symbols) : symbols(_symbols) {}
+
+		// evaluates an expression. if it's the definition of a symbol, symbol is its entry in the table, otherwise null.
+		bool Run(Expr &expr, Entry *symbol, u64 &res, bool &floating, std::string &err)
+		{
+			if (symbol) states.emplace(symbol, Symbol{ State::Active, 0, false, {} });
+
+			if (symbol) frames.push_back({ nullptr, symbol, true });
+			frames.push_back({ &expr, nullptr, false });
+			while (!frames.empty()) Step(err);
+
+			const Value val = values.back();
+			values.pop_back();
+
+			res = val.res;
+			floating = val.floating;
+			return val.ok;
+		}
+
+		// gets if a symbol has already been evaluated (successfully or not) in this pass
+		bool Reached(const Entry *symbol) const { return states.find(symbol) != states.end(); }
+	};
+
+	bool Expr::Evaluate(std::unordered_map<std::string, Expr> &symbols, u64 &res, bool &floating, std::string &err)
+	{
+		return Evaluator(symbols).Run(*this, nullptr, res, floating, err);
+	}
+	bool Expr::Evaluatable(std::unordered_map<std::string, Expr> &symbols)
+	{
+		u64 res;
+		bool floating;
+		std::string err;
+		return Evaluate(symbols, res, floating, err);
+	}
 
+	void Expr::EvaluateAll(std::unordered_map<std::string, Expr> &symbols)
+	{
+		Evaluator evaluator(symbols);
+		u64 res;
+		bool floating;
+		std::string err;
+
+		for (auto &entry : symbols)
+		{
+			if (entry.second.IsEvaluated() || evaluator.Reached(&entry)) continue;
+
+			evaluator.Run(entry.second, &entry, res, floating, err);
+		}
+	}
+
+	// checks if a token is equal to value, optionally converting it to upper case first (without making a copy)
+	static bool TokenEquals(const std::string *token, const std::string &value, bool upper)
+	{
+		if (!token || token->size() != value.size()) return false;
+		if (!upper) return *token == value;
+
+		for (std::size_t i = 0; i < value.size(); ++i)
+			if ((char)std::toupper((unsigned char)(*token)[i]) != value[i]) return false;
 		return true;
 	}
 
@@ -595,7 +807,7 @@ namespace CSX64
 		if (OP == OPs::None)
 		{
 			// if we found the value, we're done
-			if ((upper ? ToUpper(_Token) : _Token) == value) return true;
+			if (TokenEquals(_Token, value, upper)) return true;
 		}
 		// otherwise test children
 		else
@@ -609,13 +821,13 @@ namespace CSX64
 		return false;
 	}
 
-	void Expr::_GetStringValues(std::vector<std::string*> &vals)
+	void Expr::_GetStringValues(std::vector<const std::string*> &vals) const
 	{
 		// if we're a leaf
 		if (OP == OPs::None)
 		{
 			// if we have a string value, add it
-			if (!_Token.empty()) vals.push_back(&_Token);
+			if (_Token) vals.push_back(_Token);
 		}
 		// otherwise call on children
 		else
@@ -625,23 +837,9 @@ namespace CSX64
 		}
 	}
 
-	bool Expr::Evaluate(std::unordered_map<std::string, Expr> &symbols, u64 &res, bool &floating, std::string &err)
-	{
-		// refer to helper function
-		std::vector<std::string> visited;
-		return __Evaluate__(symbols, res, floating, err, visited);
-	}
-	bool Expr::Evaluatable(std::unordered_map<std::string, Expr> &symbols)
-	{
-		u64 res;
-		bool floating;
-		std::string err;
-		return Evaluate(symbols, res, floating, err);
-	}
-
 	bool Expr::FindPath(const std::string &value, std::vector<Expr*> &path, bool upper)
 	{
-		// make sure value isn't empty (would result in weird binding results since _Token is empty for null Token())
+		// make sure value isn't empty (would result in weird binding results since an empty Token() is null)
 		if (value.empty()) throw std::invalid_argument("attempt to find empty string in expression tree");
 
 		// refer to helper
@@ -652,7 +850,7 @@ namespace CSX64
 	Expr *Expr::Find(const std::string &value, bool upper)
 	{
 		// if we're a leaf, test ourself
-		if (OP == OPs::None) return (upper ? ToUpper(_Token) : _Token) == value ? this : nullptr;
+		if (OP == OPs::None) return TokenEquals(_Token, value, upper) ? this : nullptr;
 		// otherwise test children
 		else
 		{
@@ -661,13 +859,66 @@ namespace CSX64
 		}
 	}
 
+	void Expr::Resolve(const std::string *expr, u64 result, bool floating)
+	{
+		if (!expr) return;
+
+		// if we're a leaf
+		if (OP == OPs::None)
+		{
+			// if we have this value, replace with result
+			if (TokenMatches(_Token, expr)) CacheResult(result, floating);
+		}
+		// otherwise call on children
+		else
+		{
+			Left->Resolve(expr, result, floating);
+			if (Right) Right->Resolve(expr, result, floating);
+		}
+	}
+	void Expr::Resolve(const std::string *expr, const std::string *value)
+	{
+		if (!expr) return;
+
+		// if we're a leaf
+		if (OP == OPs::None)
+		{
+			// if we have this value, replace with result
+			if (TokenMatches(_Token, expr)) { const std::string *token = CopyToken(value); ReleaseToken(_Token); _Token = token; }
+		}
+		// otherwise call on children
+		else
+		{
+			Left->Resolve(expr, value);
+			if (Right) Right->Resolve(expr, value);
+		}
+	}
+
+	void Expr::Resolve(const std::unordered_map<const std::string*, const std::string*> &tokens)
+	{
+		// if we're a leaf
+		if (OP == OPs::None)
+		{
+			// if we have one of the values, replace it
+			if (!_Token) return;
+			auto it = tokens.find(_Token);
+			if (it != tokens.end()) { const std::string *token = CopyToken(it->second); ReleaseToken(_Token); _Token = token; }
+		}
+		// otherwise call on children
+		else
+		{
+			Left->Resolve(tokens);
+			if (Right) Right->Resolve(tokens);
+		}
+	}
+
 	void Expr::Resolve(const std::string &expr, u64 result, bool floating)
 	{
 		// if we're a leaf
 		if (OP == OPs::None)
 		{
 			// if we have this value, replace with result
-			if (_Token == expr) CacheResult(result, floating);
+			if (_Token && *_Token == expr) CacheResult(result, floating);
 		}
 		// otherwise call on children
 		else
@@ -678,11 +929,13 @@ namespace CSX64
 	}
 	void Expr::Resolve(const std::string &expr, const std::string &value)
 	{
+		if (value.empty()) throw std::invalid_argument("Expr token cannot be empty string");
+
 		// if we're a leaf
 		if (OP == OPs::None)
 		{
 			// if we have this value, replace with result
-			if (_Token == expr) _Token = value;
+			if (_Token && *_Token == expr) { const std::string *token = MakeToken(value); ReleaseToken(_Token); _Token = token; }
 		}
 		// otherwise call on children
 		else
@@ -692,10 +945,10 @@ namespace CSX64
 		}
 	}
 
-	std::vector<std::string*> Expr::GetStringValues()
+	std::vector<const std::string*> Expr::GetStringValues() const
 	{
 		// call helper with an empty list
-		std::vector<std::string*> vals;
+		std::vector<const std::string*> vals;
 		_GetStringValues(vals);
 		return vals;
 	}
@@ -807,13 +1060,13 @@ namespace CSX64
 	std::ostream &Expr::WriteTo(std::ostream &writer, const Expr &expr)
 	{
 		// write type header
-		BinWrite<u8>(writer, (!expr._Token.empty() ? 128 : 0) | (expr._Floating ? 64 : 0) | (expr.Right ? 32 : 0) | (int)expr.OP);
+		BinWrite<u8>(writer, (expr._Token ? 128 : 0) | (expr._Floating ? 64 : 0) | (expr.Right ? 32 : 0) | (int)expr.OP);
 
 		// if it's a leaf
 		if (expr.OP == OPs::None)
 		{
 			// if it's a token, write that
-			if (!expr._Token.empty()) BinWrite(writer, expr._Token);
+			if (expr._Token) BinWrite(writer, *expr._Token);
 			// otherwise write the cached data
 			else BinWrite(writer, expr._Result);
 		}
@@ -844,7 +1097,12 @@ namespace CSX64
 		if (expr->OP == OPs::None)
 		{
 			// if it's a token, read that
-			if (type & 128) BinRead(istr, expr->_Token);
+			if (type & 128)
+			{
+				std::string token;
+				BinRead(istr, token);
+				if (!token.empty()) expr->Token(std::move(token));
+			}
 			// otherwise read the cached data
 			else
 			{
@@ -877,7 +1135,7 @@ namespace CSX64
 	{
 		if (expr.OP == Expr::OPs::None)
 		{
-			if (!expr._Token.empty()) ostr << expr._Token;
+			if (expr._Token) ostr << *expr._Token;
 			else if (expr._Floating) ostr << AsDouble(expr._Result);
 			else ostr << (i64)expr._Result;
 		}
@@ -12,6 +12,7 @@
 #include <limits>
 #include <type_traits>
 #include <ctime>
+#include <algorithm>
 
 #include "../include/Computer.h"
 
@@ -420,6 +421,38 @@ namespace CSX64
         }
     }
 
+    u64 Computer::ComputeFlags() const
+    {
+        const PendingFlags &p = pending_flags;
+        const u64 a = p.a, b = p.b, res = p.res, sizecode = p.sizecode;
+
+        // ZF, SF, and PF are the same for all deferred ops
+        u64 flags = (res == 0 ? MASK_UNION_1(ZF) : 0) | (Negative(res, sizecode) ? MASK_UNION_1(SF) : 0) | (parity_table[res & 0xff] ? MASK_UNION_1(PF) : 0);
+
+        // see the corresponding Process*() functions for the eager versions of these
+        switch (p.op)
+        {
+        case FlagOp::ADD:
+            flags |= (res < a ? MASK_UNION_1(CF) : 0) | ((res & 0xf) < (a & 0xf) ? MASK_UNION_1(AF) : 0)
+                | (Positive(a ^ b, sizecode) && Negative(a ^ res, sizecode) ? MASK_UNION_1(OF) : 0);
+            return (_RFLAGS & ~MASK_UNION_6(ZF, SF, PF, CF, AF, OF)) | flags;
+        case FlagOp::SUB:
+            flags |= (a < b ? MASK_UNION_1(CF) : 0) | ((a & 0xf) < (b & 0xf) ? MASK_UNION_1(AF) : 0)
+                | (Negative((a ^ b) & (a ^ res), sizecode) ? MASK_UNION_1(OF) : 0);
+            return (_RFLAGS & ~MASK_UNION_6(ZF, SF, PF, CF, AF, OF)) | flags;
+        case FlagOp::LOGIC:
+            return (_RFLAGS & ~MASK_UNION_5(ZF, SF, PF, CF, OF)) | flags; // AF is undefined - leave it as is
+        case FlagOp::INC:
+            flags |= ((res & 0xf) == 0 ? MASK_UNION_1(AF) : 0) | (Positive(a, sizecode) && Negative(res, sizecode) ? MASK_UNION_1(OF) : 0);
+            return (_RFLAGS & ~MASK_UNION_5(ZF, SF, PF, AF, OF)) | flags;
+        case FlagOp::DEC:
+            flags |= ((a & 0xf) == 0 ? MASK_UNION_1(AF) : 0) | (Negative(a, sizecode) && Positive(res, sizecode) ? MASK_UNION_1(OF) : 0);
+            return (_RFLAGS & ~MASK_UNION_5(ZF, SF, PF, AF, OF)) | flags;
+
+        default: return _RFLAGS;
+        }
+    }
+
     // -------------------------------------------------
 
     /*
@@ -756,35 +789,40 @@ namespace CSX64
 
         // get the flag
         bool flag;
-        switch (ext)
-        {
-        case 0: flag = ZF(); break;
-        case 1: flag = !ZF(); break;
-        case 2: flag = SF(); break;
-        case 3: flag = !SF(); break;
-        case 4: flag = PF(); break;
-        case 5: flag = !PF(); break;
-        case 6: flag = OF(); break;
-        case 7: flag = !OF(); break;
-        case 8: flag = CF(); break;
-        case 9: flag = !CF(); break;
-        case 10: flag = cc_b(); break;
-        case 11: flag = cc_be(); break;
-        case 12: flag = cc_a(); break;
-        case 13: flag = cc_ae(); break;
-        case 14: flag = cc_l(); break;
-        case 15: flag = cc_le(); break;
-        case 16: flag = cc_g(); break;
-        case 17: flag = cc_ge(); break;
-        case 18: flag = CPURegisters[2][sizecode] == 0; break;
-
-        default: Terminate(ErrorCode::UndefinedBehavior); return false;
-        }
+        if (ext < 18) flag = Condition(ext);
+        else if (ext == 18) flag = CPURegisters[2][sizecode] == 0;
+        else { Terminate(ErrorCode::UndefinedBehavior); return false; }
 
         if (flag) RIP() = val; // jump
 
         return true;
     }
+    bool Computer::Condition(u64 cc)
+    {
+        switch (cc)
+        {
+        case 0: return ZF();
+        case 1: return !ZF();
+        case 2: return SF();
+        case 3: return !SF();
+        case 4: return PF();
+        case 5: return !PF();
+        case 6: return OF();
+        case 7: return !OF();
+        case 8: return CF();
+        case 9: return !CF();
+        case 10: return cc_b();
+        case 11: return cc_be();
+        case 12: return cc_a();
+        case 13: return cc_ae();
+        case 14: return cc_l();
+        case 15: return cc_le();
+        case 16: return cc_g();
+        case 17: return cc_ge();
+
+        default: return false;
+        }
+    }
     bool Computer::ProcessLOOPcc()
     {
         u64 ext, s, val;
@@ -884,7 +922,7 @@ namespace CSX64
     bool Computer::ProcessLEA()
     {
         u64 s, address;
-        if (!GetMemAdv<u8>(s) || !GetAddressAdv(address)) return false;
+        if (!GetMemAdv<u8>(s) || !GetAddressAdv(address, false)) return false;
         u64 sizecode = (s >> 2) & 3;
 
         if constexpr (StrictUND)
@@ -901,16 +939,22 @@ namespace CSX64
     {
         u64 s1, s2, m, a, b;
         if (!FetchBinaryOpFormat(s1, s2, m, a, b)) return false;
-        u64 sizecode = (s1 >> 2) & 3;
-
+        return StoreBinaryOpFormat(s1, s2, m, AluADD(a, b, (s1 >> 2) & 3));
+    }
+    u64 Computer::AluADD(u64 a, u64 b, u64 sizecode)
+    {
         u64 res = Truncate(a + b, sizecode);
 
-        UpdateFlagsZSP(res, sizecode);
-        CF() = res < a;
-        AF() = (res & 0xf) < (a & 0xf); // AF is just like CF but only the low nibble
-        OF() = Positive(a ^ b, sizecode) && Negative(a ^ res, sizecode); // overflow if sign(a)=sign(b) and sign(a)!=sign(res)
+        if (lazy_flags) DeferFlags(FlagOp::ADD, a, b, res, sizecode);
+        else
+        {
+            UpdateFlagsZSP(res, sizecode);
+            CF() = res < a;
+            AF() = (res & 0xf) < (a & 0xf); // AF is just like CF but only the low nibble
+            OF() = Positive(a ^ b, sizecode) && Negative(a ^ res, sizecode); // overflow if sign(a)=sign(b) and sign(a)!=sign(res)
+        }
 
-        return StoreBinaryOpFormat(s1, s2, m, res);
+        return res;
     }
     bool Computer::ProcessSUB()
     {
@@ -921,11 +965,15 @@ namespace CSX64
     {
         u64 s1, s2, m, a, b;
         if (!FetchBinaryOpFormat(s1, s2, m, a, b)) return false;
-        u64 sizecode = (s1 >> 2) & 3;
-
+        u64 res = AluSUB(a, b, (s1 >> 2) & 3);
+        return !apply || StoreBinaryOpFormat(s1, s2, m, res);
+    }
+    u64 Computer::AluSUB(u64 a, u64 b, u64 sizecode)
+    {
         u64 res = Truncate(a - b, sizecode);
 
-        if constexpr (FlagAccessMasking)
+        if (lazy_flags) DeferFlags(FlagOp::SUB, a, b, res, sizecode);
+        else if constexpr (FlagAccessMasking)
         {
 			RFLAGS() &= ~MASK_UNION_6(ZF, SF, PF, CF, AF, OF);
 			RFLAGS() |= (res == 0 ? MASK_UNION_1(ZF) : 0) | (Negative(res, sizecode) ? MASK_UNION_1(SF) : 0) | (parity_table[res & 0xff] ? MASK_UNION_1(PF) : 0)
@@ -939,7 +987,7 @@ namespace CSX64
             OF() = Negative((a ^ b) & (a ^ res), sizecode); // overflow if sign(a)!=sign(b) and sign(a)!=sign(res)
         }
 
-        return !apply || StoreBinaryOpFormat(s1, s2, m, res);
+        return res;
     }
 
     bool Computer::ProcessMUL_x()
@@ -1426,16 +1474,23 @@ namespace CSX64
     {
         u64 s1, s2, m, a, b;
         if (!FetchBinaryOpFormat(s1, s2, m, a, b)) return false;
-        u64 sizecode = (s1 >> 2) & 3;
-
+        u64 res = AluAND(a, b, (s1 >> 2) & 3);
+        return !apply || StoreBinaryOpFormat(s1, s2, m, res);
+    }
+    u64 Computer::AluAND(u64 a, u64 b, u64 sizecode)
+    {
         u64 res = a & b;
 
-        UpdateFlagsZSP(res, sizecode);
-        OF() = false;
-        CF() = false;
-        AF() = Rand() & 1;
+        if (lazy_flags) DeferFlags(FlagOp::LOGIC, a, b, res, sizecode);
+        else
+        {
+            UpdateFlagsZSP(res, sizecode);
+            OF() = false;
+            CF() = false;
+            AF() = Rand() & 1;
+        }
 
-        return !apply || StoreBinaryOpFormat(s1, s2, m, res);
+        return res;
     }
 
     bool Computer::ProcessAND()
@@ -1446,42 +1501,59 @@ namespace CSX64
     {
         u64 s1, s2, m, a, b;
         if (!FetchBinaryOpFormat(s1, s2, m, a, b)) return false;
-        u64 sizecode = (s1 >> 2) & 3;
-
+        u64 res = AluOR(a, b, (s1 >> 2) & 3);
+        return StoreBinaryOpFormat(s1, s2, m, res);
+    }
+    u64 Computer::AluOR(u64 a, u64 b, u64 sizecode)
+    {
         u64 res = a | b;
 
-        UpdateFlagsZSP(res, sizecode);
-        OF() = false;
-        CF() = false;
-        AF() = Rand() & 1;
+        if (lazy_flags) DeferFlags(FlagOp::LOGIC, a, b, res, sizecode);
+        else
+        {
+            UpdateFlagsZSP(res, sizecode);
+            OF() = false;
+            CF() = false;
+            AF() = Rand() & 1;
+        }
 
-        return StoreBinaryOpFormat(s1, s2, m, res);
+        return res;
     }
     bool Computer::ProcessXOR()
     {
         u64 s1, s2, m, a, b;
         if (!FetchBinaryOpFormat(s1, s2, m, a, b)) return false;
-        u64 sizecode = (s1 >> 2) & 3;
-
+        u64 res = AluXOR(a, b, (s1 >> 2) & 3);
+        return StoreBinaryOpFormat(s1, s2, m, res);
+    }
+    u64 Computer::AluXOR(u64 a, u64 b, u64 sizecode)
+    {
         u64 res = a ^ b;
 
-        UpdateFlagsZSP(res, sizecode);
-        OF() = false;
-        CF() = false;
-        AF() = Rand() & 1;
+        if (lazy_flags) DeferFlags(FlagOp::LOGIC, a, b, res, sizecode);
+        else
+        {
+            UpdateFlagsZSP(res, sizecode);
+            OF() = false;
+            CF() = false;
+            AF() = Rand() & 1;
+        }
 
-        return StoreBinaryOpFormat(s1, s2, m, res);
+        return res;
     }
 
     bool Computer::ProcessINC()
     {
         u64 s, m, a;
         if (!FetchUnaryOpFormat(s, m, a)) return false;
-        u64 sizecode = (s >> 2) & 3;
-
+        return StoreUnaryOpFormat(s, m, AluINC(a, (s >> 2) & 3));
+    }
+    u64 Computer::AluINC(u64 a, u64 sizecode)
+    {
         u64 res = Truncate(a + 1, sizecode);
 
-        if constexpr (FlagAccessMasking)
+        if (lazy_flags) DeferFlags(FlagOp::INC, a, 1, res, sizecode);
+        else if constexpr (FlagAccessMasking)
         {
 			RFLAGS() &= ~MASK_UNION_5(ZF, SF, PF, AF, OF);
 			RFLAGS() |= (res == 0 ? MASK_UNION_1(ZF) : 0) | (Negative(res, sizecode) ? MASK_UNION_1(SF) : 0) | (parity_table[res & 0xff] ? MASK_UNION_1(PF) : 0)
@@ -1494,17 +1566,20 @@ namespace CSX64
             OF() = Positive(a, sizecode) && Negative(res, sizecode); // + -> - is overflow
         }
 
-        return StoreUnaryOpFormat(s, m, res);
+        return res;
     }
     bool Computer::ProcessDEC()
     {
         u64 s, m, a;
         if (!FetchUnaryOpFormat(s, m, a)) return false;
-        u64 sizecode = (s >> 2) & 3;
-
+        return StoreUnaryOpFormat(s, m, AluDEC(a, (s >> 2) & 3));
+    }
+    u64 Computer::AluDEC(u64 a, u64 sizecode)
+    {
         u64 res = Truncate(a - 1, sizecode);
 
-        if constexpr (FlagAccessMasking)
+        if (lazy_flags) DeferFlags(FlagOp::DEC, a, 1, res, sizecode);
+        else if constexpr (FlagAccessMasking)
         {
 			RFLAGS() &= ~MASK_UNION_5(ZF, SF, PF, AF, OF);
 			RFLAGS() |= (res == 0 ? MASK_UNION_1(ZF) : 0) | (Negative(res, sizecode) ? MASK_UNION_1(SF) : 0) | (parity_table[res & 0xff] ? MASK_UNION_1(PF) : 0)
@@ -1517,7 +1592,7 @@ namespace CSX64
             OF() = Negative(a, sizecode) && Positive(res, sizecode); // - -> + is overflow
         }
 
-        return StoreUnaryOpFormat(s, m, res);
+        return res;
     }
 
     bool Computer::ProcessNEG()
@@ -2048,6 +2123,147 @@ namespace CSX64
         return true;
     }
 
+
+    // fills n elements of type T starting at dest with val
+    template<typename T>
+    static void __StringFill(char *dest, u64 n, T val)
+    {
+        for (u64 i = 0; i < n; ++i) bin_write<T>(dest + i * sizeof(T), val);
+    }
+    // returns the index of the first of n element pairs (stepping by step bytes) for which (a == b) != equal, or n if there is none
+    template<typename T>
+    static u64 __StringFindCMPS(const char *a, const char *b, u64 n, i64 step, bool equal)
+    {
+        for (u64 i = 0; i < n; ++i, a += step, b += step) if ((bin_read<T>(a) == bin_read<T>(b)) != equal) return i;
+        return n;
+    }
+    // returns the index of the first of n elements (stepping by step bytes) for which (element == val) != equal, or n if there is none
+    template<typename T>
+    static u64 __StringFindSCAS(const char *p, T val, u64 n, i64 step, bool equal)
+    {
+        for (u64 i = 0; i < n; ++i, p += step) if ((bin_read<T>(p) == val) != equal) return i;
+        return n;
+    }
+
+    u64 Computer::__StringSpan(u64 pos, u64 size, u64 count, bool write) const
+    {
+        // writes can't go below the readonly barrier
+        const u64 low = write ? ReadonlyBarrier : 0;
+        if (pos < low || pos > mem_size || mem_size - pos < size) return 0;
+
+        // count the elements from pos to the end of memory (or down to the low bound) in the DF direction
+        return std::min(count, DF() ? (pos - low) / size + 1 : (mem_size - pos) / size);
+    }
+
+    void Computer::__BulkSTRING_MOVS(u64 sizecode)
+    {
+        const u64 size = Size(sizecode);
+        const u64 n = std::min(__StringSpan(RSI(), size, RCX(), false), __StringSpan(RDI(), size, RCX(), true));
+        if (n == 0) return;
+
+        // get the (lowest) start of each range
+        const u64 bytes = n * size;
+        const u64 src = DF() ? RSI() - (bytes - size) : RSI();
+        const u64 dest = DF() ? RDI() - (bytes - size) : RDI();
+
+        // if the destination overlaps the source ahead of it, element-by-element copying repeats data (unlike memmove) - leave that to the loop
+        if (DF() ? dest < src && src < dest + bytes : src < dest && dest < src + bytes) return;
+
+        std::memmove(reinterpret_cast<char*>(mem) + dest, reinterpret_cast<const char*>(mem) + src, bytes);
+
+        if (DF()) { RSI() -= bytes; RDI() -= bytes; }
+        else { RSI() += bytes; RDI() += bytes; }
+        RCX() -= n;
+    }
+    void Computer::__BulkSTRING_CMPS(u64 sizecode, bool equal)
+    {
+        const u64 size = Size(sizecode);
+        const u64 n = std::min(__StringSpan(RSI(), size, RCX(), false), __StringSpan(RDI(), size, RCX(), false));
+        if (n <= 1) return;
+
+        const char *a = reinterpret_cast<const char*>(mem) + RSI();
+        const char *b = reinterpret_cast<const char*>(mem) + RDI();
+        const i64 step = DF() ? -(i64)size : (i64)size;
+
+        // find the iteration that ends the repetition (the scan for the first mismatch going forward is just a byte mismatch)
+        u64 end;
+        if (equal && !DF()) end = (u64)(std::mismatch(a, a + n * size, b).first - a) / size;
+        else switch (sizecode)
+        {
+        case 0: end = __StringFindCMPS<u8>(a, b, n, step, equal); break;
+        case 1: end = __StringFindCMPS<u16>(a, b, n, step, equal); break;
+        case 2: end = __StringFindCMPS<u32>(a, b, n, step, equal); break;
+        default: end = __StringFindCMPS<u64>(a, b, n, step, equal); break;
+        }
+
+        // skip everything before it (or before the last one in bounds) - the loop performs that iteration and sets the flags
+        const u64 skip = std::min(end, n - 1);
+        if (DF()) { RSI() -= skip * size; RDI() -= skip * size; }
+        else { RSI() += skip * size; RDI() += skip * size; }
+        RCX() -= skip;
+    }
+    void Computer::__BulkSTRING_LODS(u64 sizecode)
+    {
+        const u64 size = Size(sizecode);
+        const u64 n = __StringSpan(RSI(), size, RCX(), false);
+        if (n <= 1) return;
+
+        // only the last load matters - skip to it
+        if (DF()) RSI() -= (n - 1) * size;
+        else RSI() += (n - 1) * size;
+        RCX() -= n - 1;
+    }
+    void Computer::__BulkSTRING_STOS(u64 sizecode)
+    {
+        const u64 size = Size(sizecode);
+        const u64 n = __StringSpan(RDI(), size, RCX(), true);
+        if (n == 0) return;
+
+        // every element gets the same value, so direction only matters for where the range starts
+        const u64 bytes = n * size;
+        char *const dest = reinterpret_cast<char*>(mem) + (DF() ? RDI() - (bytes - size) : RDI());
+        switch (sizecode)
+        {
+        case 0: std::memset(dest, (int)RAX() & 0xff, bytes); break;
+        case 1: __StringFill<u16>(dest, n, (u16)RAX()); break;
+        case 2: __StringFill<u32>(dest, n, (u32)RAX()); break;
+        default: __StringFill<u64>(dest, n, RAX()); break;
+        }
+
+        if (DF()) RDI() -= bytes;
+        else RDI() += bytes;
+        RCX() -= n;
+    }
+    void Computer::__BulkSTRING_SCAS(u64 sizecode, bool equal)
+    {
+        const u64 size = Size(sizecode);
+        const u64 n = __StringSpan(RDI(), size, RCX(), false);
+        if (n <= 1) return;
+
+        const char *p = reinterpret_cast<const char*>(mem) + RDI();
+        const i64 step = DF() ? -(i64)size : (i64)size;
+
+        // find the iteration that ends the repetition (the forward byte search for a match is just memchr)
+        u64 end;
+        if (!equal && !DF() && sizecode == 0)
+        {
+            const void *match = std::memchr(p, (int)RAX() & 0xff, n);
+            end = match ? (u64)(static_cast<const char*>(match) - p) : n;
+        }
+        else switch (sizecode)
+        {
+        case 0: end = __StringFindSCAS<u8>(p, (u8)RAX(), n, step, equal); break;
+        case 1: end = __StringFindSCAS<u16>(p, (u16)RAX(), n, step, equal); break;
+        case 2: end = __StringFindSCAS<u32>(p, (u32)RAX(), n, step, equal); break;
+        default: end = __StringFindSCAS<u64>(p, RAX(), n, step, equal); break;
+        }
+
+        // skip everything before it (or before the last one in bounds) - the loop performs that iteration and sets the flags
+        const u64 skip = std::min(end, n - 1);
+        if (DF()) RDI() -= skip * size;
+        else RDI() += skip * size;
+        RCX() -= skip;
+    }
     /*
     [6: mode][2: size]
         mode = 0:        MOVS
@@ -2082,6 +2298,7 @@ namespace CSX64
             // if we can do the whole thing in a single tick
             if (OTRF())
             {
+                __BulkSTRING_MOVS(sizecode);
                 while (RCX())
                 {
                     if (!__ProcessSTRING_MOVS(sizecode)) return false;
@@ -2106,6 +2323,7 @@ namespace CSX64
             // if we can do the whole thing in a single tick
             if (OTRF())
             {
+                __BulkSTRING_CMPS(sizecode, true);
                 while (RCX())
                 {
                     if (!__ProcessSTRING_CMPS(sizecode)) return false;
@@ -2127,6 +2345,7 @@ namespace CSX64
             // if we can do the whole thing in a single tick
             if (OTRF())
             {
+                __BulkSTRING_CMPS(sizecode, false);
                 while (RCX())
                 {
                     if (!__ProcessSTRING_CMPS(sizecode)) return false;
@@ -2151,6 +2370,7 @@ namespace CSX64
 
             if (OTRF())
             {
+                __BulkSTRING_LODS(sizecode);
                 while (RCX())
                 {
                     if (!__ProcessSTRING_LODS(sizecode)) return false;
@@ -2173,6 +2393,7 @@ namespace CSX64
             
             if (OTRF())
             {
+                __BulkSTRING_STOS(sizecode);
                 while (RCX())
                 {
                     if (!__ProcessSTRING_STOS(sizecode)) return false;
@@ -2196,6 +2417,7 @@ namespace CSX64
             // if we can do the whole thing in a single tick
             if (OTRF())
             {
+                __BulkSTRING_SCAS(sizecode, true);
                 while (RCX())
                 {
                     if (!__ProcessSTRING_SCAS(sizecode)) return false;
@@ -2217,6 +2439,7 @@ namespace CSX64
             // if we can do the whole thing in a single tick
             if (OTRF())
             {
+                __BulkSTRING_SCAS(sizecode, false);
                 while (RCX())
                 {
                     if (!__ProcessSTRING_SCAS(sizecode)) return false;
@@ -3305,12 +3528,26 @@ namespace CSX64
 
         return true;
     }
+    void Computer::__StoreVPUResult(u64 dest, const ZMMRegister &res, u64 elem_sizecode, u64 elem_count, u64 mask, bool zmask)
+    {
+        const u64 size = Size(elem_sizecode);
+        unsigned char *d = ZMMRegisters[dest].raw();
+
+        // if every element is selected, copy them all at once
+        const u64 all = elem_count == 64 ? ~(u64)0 : ((u64)1 << elem_count) - 1;
+        if ((mask & all) == all) { std::memcpy(d, res.raw(), elem_count * size); return; }
+
+        for (u64 i = 0; i < elem_count; ++i, mask >>= 1)
+            if (mask & 1) std::memcpy(d + i * size, res.raw() + i * size, size);
+            else if (zmask) std::memset(d + i * size, 0, size);
+    }
+
     /*
     [5: dest][1: aligned][2: dest_size]   [1: has_mask][1: zmask][1: scalar][1:][2: elem_size][1:][1: mem]   ([count: mask])   [3:][5: src1]
     mem = 0: [3:][5: src2]   dest <- f(src1, src2)
     mem = 1: [address]       dest <- f(src1, M[address])
     */
-    bool Computer::ProcessVPUBinary(u64 elem_size_mask, VPUBinaryDelegate func)
+    bool Computer::ProcessVPUBinary(u64 elem_size_mask, VPUBinaryDelegate func, const VPUBinaryKernel *kernels)
     {
         // read settings bytes
         u64 s1, s2, _src1, _src2, res, m;
@@ -3369,6 +3606,15 @@ namespace CSX64
 
             u64 src2 = _src2 & 0x1f;
 
+            // vectors are done all at once if the op has a kernel for this element size
+            if (kernels && elem_count > 1 && kernels[elem_sizecode])
+            {
+                ZMMRegister temp;
+                kernels[elem_sizecode](temp.raw(), ZMMRegisters[src1].raw(), ZMMRegisters[src2].raw(), Size(dest_sizecode + 4));
+                __StoreVPUResult(dest, temp, elem_sizecode, elem_count, mask, zmask);
+                return true;
+            }
+
             for (u64 i = 0; i < elem_count; ++i, mask >>= 1)
                 if (mask & 1)
                 {
@@ -3385,6 +3631,16 @@ namespace CSX64
             // if we're in vector mode and aligned flag is set, make sure address is aligned
             if (elem_count > 1 && (s1 & 4) != 0 && m % Size(dest_sizecode + 4) != 0) { Terminate(ErrorCode::AlignmentViolation); return false; }
 
+            // vectors are done all at once if the op has a kernel for this element size (and the whole vector is in bounds)
+            if (kernels && elem_count > 1 && kernels[elem_sizecode] && !InvalidRange(m, Size(dest_sizecode + 4)))
+            {
+                ZMMRegister temp{};
+                std::memcpy(temp.raw(), reinterpret_cast<const char*>(mem) + m, Size(dest_sizecode + 4));
+                kernels[elem_sizecode](temp.raw(), ZMMRegisters[src1].raw(), temp.raw(), Size(dest_sizecode + 4));
+                __StoreVPUResult(dest, temp, elem_sizecode, elem_count, mask, zmask);
+                return true;
+            }
+
             for (u64 i = 0; i < elem_count; ++i, mask >>= 1, m += Size(elem_sizecode))
                 if (mask & 1)
                 {
@@ -3404,7 +3660,7 @@ namespace CSX64
     mem = 0: [3:][5: src]   dest <- f(src)
     mem = 1: [address]      dest <- f(M[address])
     */
-    bool Computer::ProcessVPUUnary(u64 elem_size_mask, VPUUnaryDelegate func)
+    bool Computer::ProcessVPUUnary(u64 elem_size_mask, VPUUnaryDelegate func, const VPUUnaryKernel *kernels)
     {
         // read settings bytes
         u64 s1, s2, _src, res, m;
@@ -3452,6 +3708,14 @@ namespace CSX64
 
             u64 src = _src & 0x1f;
 
+            // vectors are done all at once if the op has a kernel for this element size (unless an element would fail)
+            ZMMRegister temp;
+            if (kernels && elem_count > 1 && kernels[elem_sizecode] && kernels[elem_sizecode](temp.raw(), ZMMRegisters[src].raw(), Size(dest_sizecode + 4)))
+            {
+                __StoreVPUResult(dest, temp, elem_sizecode, elem_count, mask, zmask);
+                return true;
+            }
+
             for (u64 i = 0; i < elem_count; ++i, mask >>= 1)
                 if (mask & 1)
                 {
@@ -3468,6 +3732,18 @@ namespace CSX64
             // if we're in vector mode and aligned flag is set, make sure address is aligned
             if (elem_count > 1 && (s1 & 4) != 0 && m % Size(dest_sizecode + 4) != 0) { Terminate(ErrorCode::AlignmentViolation); return false; }
 
+            // vectors are done all at once if the op has a kernel for this element size (and the whole vector is in bounds)
+            if (kernels && elem_count > 1 && kernels[elem_sizecode] && !InvalidRange(m, Size(dest_sizecode + 4)))
+            {
+                ZMMRegister temp{};
+                std::memcpy(temp.raw(), reinterpret_cast<const char*>(mem) + m, Size(dest_sizecode + 4));
+                if (kernels[elem_sizecode](temp.raw(), temp.raw(), Size(dest_sizecode + 4)))
+                {
+                    __StoreVPUResult(dest, temp, elem_sizecode, elem_count, mask, zmask);
+                    return true;
+                }
+            }
+
             for (u64 i = 0; i < elem_count; ++i, mask >>= 1, m += Size(elem_sizecode))
                 if (mask & 1)
                 {
@@ -3681,10 +3957,10 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_FADD() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FADD); }
-    bool Computer::TryProcessVEC_FSUB() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FSUB); }
-    bool Computer::TryProcessVEC_FMUL() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FMUL); }
-    bool Computer::TryProcessVEC_FDIV() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FDIV); }
+    bool Computer::TryProcessVEC_FADD() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FADD, VPUKernels.FADD); }
+    bool Computer::TryProcessVEC_FSUB() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FSUB, VPUKernels.FSUB); }
+    bool Computer::TryProcessVEC_FMUL() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FMUL, VPUKernels.FMUL); }
+    bool Computer::TryProcessVEC_FDIV() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FDIV, VPUKernels.FDIV); }
 
     bool Computer::__TryPerformVEC_AND(u64, u64 &res, u64 a, u64 b, u64)
     {
@@ -3707,10 +3983,10 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_AND()  { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_AND); }
-    bool Computer::TryProcessVEC_OR()   { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_OR); }
-    bool Computer::TryProcessVEC_XOR()  { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_XOR); }
-    bool Computer::TryProcessVEC_ANDN() { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_ANDN); }
+    bool Computer::TryProcessVEC_AND()  { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_AND, VPUKernels.AND); }
+    bool Computer::TryProcessVEC_OR()   { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_OR, VPUKernels.OR); }
+    bool Computer::TryProcessVEC_XOR()  { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_XOR, VPUKernels.XOR); }
+    bool Computer::TryProcessVEC_ANDN() { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_ANDN, VPUKernels.ANDN); }
 
     bool Computer::__TryPerformVEC_ADD(u64, u64 &res, u64 a, u64 b, u64)
     {
@@ -3747,9 +4023,9 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_ADD()   { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_ADD); }
-    bool Computer::TryProcessVEC_ADDS()  { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_ADDS); }
-    bool Computer::TryProcessVEC_ADDUS() { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_ADDUS); }
+    bool Computer::TryProcessVEC_ADD()   { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_ADD, VPUKernels.ADD); }
+    bool Computer::TryProcessVEC_ADDS()  { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_ADDS, VPUKernels.ADDS); }
+    bool Computer::TryProcessVEC_ADDUS() { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_ADDUS, VPUKernels.ADDUS); }
 
     bool Computer::__TryPerformVEC_SUB(u64, u64 &res, u64 a, u64 b, u64)
     {
@@ -3768,9 +4044,9 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_SUB()   { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_SUB); }
-    bool Computer::TryProcessVEC_SUBS()  { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_SUBS); }
-    bool Computer::TryProcessVEC_SUBUS() { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_SUBUS); }
+    bool Computer::TryProcessVEC_SUB()   { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_SUB, VPUKernels.SUB); }
+    bool Computer::TryProcessVEC_SUBS()  { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_SUBS, VPUKernels.SUBS); }
+    bool Computer::TryProcessVEC_SUBUS() { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_SUBUS, VPUKernels.SUBUS); }
 
     bool Computer::__TryPerformVEC_MULL(u64 elem_sizecode, u64 &res, u64 a, u64 b, u64)
     {
@@ -3778,7 +4054,7 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_MULL() { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_MULL); }
+    bool Computer::TryProcessVEC_MULL() { return ProcessVPUBinary(15, &Computer::__TryPerformVEC_MULL, VPUKernels.MULL); }
 
     bool Computer::__TryProcessVEC_FMIN(u64 elem_sizecode, u64 &res, u64 a, u64 b, u64)
     {
@@ -3797,8 +4073,8 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_FMIN() { return ProcessVPUBinary(12, &Computer::__TryProcessVEC_FMIN); }
-    bool Computer::TryProcessVEC_FMAX() { return ProcessVPUBinary(12, &Computer::__TryProcessVEC_FMAX); }
+    bool Computer::TryProcessVEC_FMIN() { return ProcessVPUBinary(12, &Computer::__TryProcessVEC_FMIN, VPUKernels.FMIN); }
+    bool Computer::TryProcessVEC_FMAX() { return ProcessVPUBinary(12, &Computer::__TryProcessVEC_FMAX, VPUKernels.FMAX); }
 
     bool Computer::__TryProcessVEC_UMIN(u64, u64 &res, u64 a, u64 b, u64)
     {
@@ -3823,10 +4099,10 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_UMIN() { return ProcessVPUBinary(15, &Computer::__TryProcessVEC_UMIN); }
-    bool Computer::TryProcessVEC_SMIN() { return ProcessVPUBinary(15, &Computer::__TryProcessVEC_SMIN); }
-    bool Computer::TryProcessVEC_UMAX() { return ProcessVPUBinary(15, &Computer::__TryProcessVEC_UMAX); }
-    bool Computer::TryProcessVEC_SMAX() { return ProcessVPUBinary(15, &Computer::__TryProcessVEC_SMAX); }
+    bool Computer::TryProcessVEC_UMIN() { return ProcessVPUBinary(15, &Computer::__TryProcessVEC_UMIN, VPUKernels.UMIN); }
+    bool Computer::TryProcessVEC_SMIN() { return ProcessVPUBinary(15, &Computer::__TryProcessVEC_SMIN, VPUKernels.SMIN); }
+    bool Computer::TryProcessVEC_UMAX() { return ProcessVPUBinary(15, &Computer::__TryProcessVEC_UMAX, VPUKernels.UMAX); }
+    bool Computer::TryProcessVEC_SMAX() { return ProcessVPUBinary(15, &Computer::__TryProcessVEC_SMAX, VPUKernels.SMAX); }
 
     bool Computer::__TryPerformVEC_FADDSUB(u64 elem_sizecode, u64 &res, u64 a, u64 b, u64 index)
     {
@@ -3838,7 +4114,7 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_FADDSUB() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FADDSUB); }
+    bool Computer::TryProcessVEC_FADDSUB() { return ProcessVPUBinary(12, &Computer::__TryPerformVEC_FADDSUB, VPUKernels.FADDSUB); }
 
     bool Computer::__TryPerformVEC_AVG(u64, u64 &res, u64 a, u64 b, u64)
     {
@@ -3846,7 +4122,7 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_AVG() { return ProcessVPUBinary(3, &Computer::__TryPerformVEC_AVG); }
+    bool Computer::TryProcessVEC_AVG() { return ProcessVPUBinary(3, &Computer::__TryPerformVEC_AVG, VPUKernels.AVG); }
 
     // constants used to represent the result of a "true" simd floatint-point comparison
     static constexpr u64 __fp64_simd_cmp_true = 0xffffffffffffffff;
@@ -4014,7 +4290,7 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::TryProcessVEC_FSQRT() { return ProcessVPUUnary(12, &Computer::__TryProcessVEC_FSQRT); }
+    bool Computer::TryProcessVEC_FSQRT() { return ProcessVPUUnary(12, &Computer::__TryProcessVEC_FSQRT, VPUKernels.FSQRT); }
     bool Computer::TryProcessVEC_FRSQRT() { return ProcessVPUUnary(12, &Computer::__TryProcessVEC_FRSQRT); }
 
     // VPUCVTDelegates for conversions
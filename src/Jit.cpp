@@ -0,0 +1,761 @@
+#include "../include/Computer.h"
+
+// this file implements native compilation of basic blocks (see Computer::JitCompilation).
+// only the integer subset of the instruction set is compiled (mov, add, sub, and, or, xor, cmp, test, inc, dec, neg, not, shifts by an imm, lea, push, pop).
+// a block is compiled up to its first unsupported instruction - the remainder of the block is executed by the interpreter.
+// the block may end with a compiled jmp or jcc to an imm target.
+
+// guest state is kept in memory (CPURegisters and a JitFrame) - there is no register allocation.
+// all error checks (bounds, readonly, stack) for an instruction are performed before it modifies any state.
+// a failed check exits the native code with RIP pointing at the failing instruction, so the interpreter re-executes it and raises the error itself.
+
+#if CSX64_JIT
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstddef>
+
+namespace CSX64
+{
+	// executable memory for compiled blocks - code is appended and never removed (only released all at once)
+	class JitCodeBuffer
+	{
+	private: // -- data -- //
+
+		struct chunk_t
+		{
+			u8 *data;
+			std::size_t size;
+		};
+
+		std::vector<chunk_t> chunks; // all the mapped chunks (the last one is being filled)
+		std::size_t used = 0;        // number of bytes used in the last chunk
+
+		static constexpr std::size_t ChunkSize = 64 * 1024;
+
+	public: // -- ctor/dtor -- //
+
+		JitCodeBuffer() = default;
+		~JitCodeBuffer()
+		{
+			for (const chunk_t &chunk : chunks) munmap(chunk.data, chunk.size);
+		}
+
+		JitCodeBuffer(const JitCodeBuffer&) = delete;
+		JitCodeBuffer &operator=(const JitCodeBuffer&) = delete;
+
+	public: // -- interface -- //
+
+		// copies the code into executable memory and returns a pointer to it. returns null on failure.
+		void *add(const std::vector<u8> &code)
+		{
+			// if there's not enough room in the current chunk, map a new one
+			if (chunks.empty() || used + code.size() > chunks.back().size)
+			{
+				std::size_t page = (std::size_t)sysconf(_SC_PAGESIZE);
+				std::size_t size = std::max(ChunkSize, (code.size() + page - 1) / page * page);
+
+				void *ptr = mmap(nullptr, size, PROT_READ | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+				if (ptr == MAP_FAILED) return nullptr;
+
+				chunks.push_back({ static_cast<u8*>(ptr), size });
+				used = 0;
+			}
+
+			// make the chunk writable just long enough to copy the code in (never writable and executable at the same time)
+			chunk_t &chunk = chunks.back();
+			if (mprotect(chunk.data, chunk.size, PROT_READ | PROT_WRITE) != 0) return nullptr;
+			std::memcpy(chunk.data + used, code.data(), code.size());
+			if (mprotect(chunk.data, chunk.size, PROT_READ | PROT_EXEC) != 0) return nullptr;
+
+			void *res = chunk.data + used;
+			used += (code.size() + 15) & ~(std::size_t)15; // keep entry points 16-byte aligned
+			return res;
+		}
+	};
+
+	// host register numbers (x86-64 encoding)
+	enum HostReg : u8
+	{
+		RAX = 0, RCX = 1, RDX = 2, RBX = 3, RSP = 4, RBP = 5, RSI = 6, RDI = 7,
+		R8 = 8, R9 = 9, R10 = 10, R11 = 11, R12 = 12, R13 = 13, R14 = 14, R15 = 15,
+
+		NoIndex = 0xff, // marks a memory operand with no index register
+	};
+
+	// pinned host registers during native code execution (all callee-saved)
+	static constexpr u8 RegsBase = RBX;    // pointer to CPURegisters
+	static constexpr u8 MemBase = R12;     // pointer to memory array
+	static constexpr u8 MemSize = R13;     // memory size
+	static constexpr u8 FrameBase = R14;   // pointer to the JitFrame
+
+	// the CPURegisters index of RSP (see Computer::RSP)
+	static constexpr u64 StackPointer = 7;
+
+	// host condition codes for CSX64 condition codes 0-17 (see ProcessJcc)
+	static constexpr u8 HostConditions[] =
+	{
+		0x4, 0x5, // Z, NZ
+		0x8, 0x9, // S, NS
+		0xa, 0xb, // P, NP
+		0x0, 0x1, // O, NO
+		0x2, 0x3, // C, NC
+		0x2, 0x6, 0x7, 0x3, // B, BE, A, AE
+		0xc, 0xe, 0xf, 0xd, // L, LE, G, GE
+	};
+
+	// the status flags (CF, PF, AF, ZF, SF, OF) as they appear in RFLAGS
+	static constexpr u32 StatusFlags = 0x8d5;
+
+	// a minimal x86-64 assembler for the instruction forms the compiler needs
+	class JitEmitter
+	{
+	public: // -- data -- //
+
+		std::vector<u8> code;
+
+	public: // -- raw emission -- //
+
+		void byte(u8 val) { code.push_back(val); }
+		void dword(u32 val) { for (int i = 0; i < 4; ++i) code.push_back((u8)(val >> (i * 8))); }
+		void qword(u64 val) { for (int i = 0; i < 8; ++i) code.push_back((u8)(val >> (i * 8))); }
+
+		// emits a rex prefix if needed. force emits one even if empty (for spl/bpl/sil/dil byte access).
+		void rex(bool w, u8 reg, u8 index, u8 base, bool force = false)
+		{
+			u8 r = 0x40 | (w ? 8 : 0) | ((reg >> 3) & 1) << 2 | (index == NoIndex ? 0 : ((index >> 3) & 1) << 1) | ((base >> 3) & 1);
+			if (r != 0x40 || force) byte(r);
+		}
+		// emits the modrm (and sib) bytes for a [base + index + disp32] operand
+		void modrm_mem(u8 reg, u8 base, u8 index, i32 disp)
+		{
+			if (index != NoIndex) { byte(0x84 | (reg & 7) << 3); byte((index & 7) << 3 | (base & 7)); }
+			else if ((base & 7) == 4) { byte(0x84 | (reg & 7) << 3); byte(0x24); }
+			else byte(0x80 | (reg & 7) << 3 | (base & 7));
+			dword((u32)disp);
+		}
+		// emits the operand size prefix and rex prefix for an operation of the given size (in bytes) on registers reg and rm
+		void size_prefix(u64 size, u8 reg, u8 index, u8 base)
+		{
+			if (size == 2) byte(0x66);
+			rex(size == 8, reg, index, base, size == 1 && ((reg >= 4 && reg < 8) || (index == NoIndex && base >= 4 && base < 8)));
+		}
+
+	public: // -- instructions -- //
+
+		// reg <- zero extended value of the given size at [base + index + disp]
+		void load(u8 reg, u64 size, u8 base, u8 index, i32 disp)
+		{
+			rex(size == 8, reg, index, base);
+			switch (size)
+			{
+			case 1: byte(0x0f); byte(0xb6); break;
+			case 2: byte(0x0f); byte(0xb7); break;
+			default: byte(0x8b); break;
+			}
+			modrm_mem(reg, base, index, disp);
+		}
+		// [base + index + disp] <- low size bytes of reg
+		void store(u8 reg, u64 size, u8 base, u8 index, i32 disp)
+		{
+			if (size == 2) byte(0x66);
+			rex(size == 8, reg, index, base, size == 1 && reg >= 4 && reg < 8);
+			byte(size == 1 ? 0x88 : 0x89);
+			modrm_mem(reg, base, index, disp);
+		}
+		// reg <- imm (full 64 bits)
+		void mov_imm(u8 reg, u64 imm)
+		{
+			if (imm <= 0xffffffff) { rex(false, 0, NoIndex, reg); byte(0xb8 | (reg & 7)); dword((u32)imm); }
+			else { rex(true, 0, NoIndex, reg); byte(0xb8 | (reg & 7)); qword(imm); }
+		}
+		// op dst, src - opcode is the full-size "r/m, reg" form (the byte form is opcode - 1)
+		void alu(u8 opcode, u64 size, u8 dst, u8 src)
+		{
+			size_prefix(size, src, NoIndex, dst);
+			byte(size == 1 ? opcode - 1 : opcode);
+			byte(0xc0 | (src & 7) << 3 | (dst & 7));
+		}
+		// op reg, imm32 (sign extended) using the 0x81 group
+		void alu_imm(u8 ext, u64 size, u8 reg, u32 imm)
+		{
+			size_prefix(size, 0, NoIndex, reg);
+			byte(0x81);
+			byte(0xc0 | ext << 3 | (reg & 7));
+			dword(imm);
+		}
+		// cmp reg, [FrameBase + disp] (64-bit)
+		void cmp_frame(u8 reg, i32 disp)
+		{
+			rex(true, reg, NoIndex, FrameBase);
+			byte(0x3b);
+			modrm_mem(reg, FrameBase, NoIndex, disp);
+		}
+		// dst <- [base + disp] (64-bit lea)
+		void lea(u8 dst, u8 base, i32 disp)
+		{
+			rex(true, dst, NoIndex, base);
+			byte(0x8d);
+			modrm_mem(dst, base, NoIndex, disp);
+		}
+		// unary group op (opcode is the full-size form, the byte form is opcode - 1)
+		void unary(u8 opcode, u8 ext, u64 size, u8 reg)
+		{
+			size_prefix(size, 0, NoIndex, reg);
+			byte(size == 1 ? opcode - 1 : opcode);
+			byte(0xc0 | ext << 3 | (reg & 7));
+		}
+		// shift group op by an imm count
+		void shift(u8 ext, u64 size, u8 reg, u8 count)
+		{
+			size_prefix(size, 0, NoIndex, reg);
+			byte(size == 1 ? 0xc0 : 0xc1);
+			byte(0xc0 | ext << 3 | (reg & 7));
+			byte(count);
+		}
+
+		// emits a jcc rel32 and returns the position of the rel32 for patching
+		std::size_t jcc(u8 cc) { byte(0x0f); byte(0x80 | cc); dword(0); return code.size() - 4; }
+		// points a previously-emitted rel32 at the current position
+		void patch(std::size_t pos)
+		{
+			u32 rel = (u32)(code.size() - (pos + 4));
+			for (int i = 0; i < 4; ++i) code[pos + i] = (u8)(rel >> (i * 8));
+		}
+
+		void prologue()
+		{
+			byte(0x53);              // push rbx
+			byte(0x41); byte(0x54);  // push r12
+			byte(0x41); byte(0x55);  // push r13
+			byte(0x41); byte(0x56);  // push r14
+			alu(0x89, 8, FrameBase, RDI); // mov r14, rdi
+
+			load(RegsBase, 8, FrameBase, NoIndex, offsetof(Computer::JitFrame, regs));
+			load(MemBase, 8, FrameBase, NoIndex, offsetof(Computer::JitFrame, mem));
+			load(MemSize, 8, FrameBase, NoIndex, offsetof(Computer::JitFrame, mem_size));
+		}
+		// merges any pending flags, sets the frame's RIP, returns the instruction count, and restores the host registers
+		void exit(u64 rip, u64 count, u32 pending)
+		{
+			if (pending != 0) merge_flags(pending);
+
+			mov_imm(RAX, rip);
+			store(RAX, 8, FrameBase, NoIndex, offsetof(Computer::JitFrame, rip));
+			mov_imm(RAX, count);
+
+			byte(0x41); byte(0x5e);  // pop r14
+			byte(0x41); byte(0x5d);  // pop r13
+			byte(0x41); byte(0x5c);  // pop r12
+			byte(0x5b);              // pop rbx
+			byte(0xc3);              // ret
+		}
+
+		// saves the host flags on the host stack (does not modify host flags)
+		void push_flags() { byte(0x9c); } // pushfq
+		// pops the saved host flags into the frame's scratch slot
+		void pop_flags()
+		{
+			rex(false, 0, NoIndex, FrameBase); byte(0x8f); modrm_mem(0, FrameBase, NoIndex, offsetof(Computer::JitFrame, host_flags)); // pop [r14 + host_flags]
+		}
+		// merges the flags selected by mask from the frame's scratch slot into the frame's RFLAGS
+		void merge_flags(u32 mask)
+		{
+			load(RSI, 8, FrameBase, NoIndex, offsetof(Computer::JitFrame, host_flags));
+			load(RDI, 8, FrameBase, NoIndex, offsetof(Computer::JitFrame, rflags));
+			alu_imm(4, 4, RSI, mask);  // and esi, mask
+			alu_imm(4, 8, RDI, ~mask); // and rdi, ~mask
+			alu(0x09, 8, RDI, RSI);    // or rdi, rsi
+			store(RDI, 8, FrameBase, NoIndex, offsetof(Computer::JitFrame, rflags));
+		}
+		// test dword [FrameBase + disp], imm
+		void test_frame(i32 disp, u32 imm)
+		{
+			rex(false, 0, NoIndex, FrameBase);
+			byte(0xf7);
+			modrm_mem(0, FrameBase, NoIndex, disp);
+			dword(imm);
+		}
+	};
+
+	// reads instruction bytes during compilation (with bounds checking)
+	struct JitReader
+	{
+		const u8 *mem;
+		u64 size;
+		u64 pos;
+
+		bool read(u64 bytes, u64 &res)
+		{
+			if (pos >= size || pos + bytes > size) return false;
+			res = 0;
+			for (u64 i = 0; i < bytes; ++i) res |= (u64)mem[pos + i] << (i * 8);
+			pos += bytes;
+			return true;
+		}
+	};
+
+	// compiles a block of instructions - see Computer::CompileBlock
+	class JitCompiler
+	{
+	private: // -- data -- //
+
+		JitEmitter e;
+		JitReader r;
+
+		// a pending side exit - the rel32 to patch, the index of the instruction to exit at, and the pending flags at that point
+		struct exit_t
+		{
+			std::size_t patch;
+			u64 index;
+			u32 pending;
+		};
+		std::vector<exit_t> exits;
+		const std::vector<Computer::BasicBlock::Op> &ops;
+
+		// the status flags which have been captured in the frame's scratch slot but not yet merged into RFLAGS.
+		// only the most recent capture is kept - it's merged when a capture of fewer flags (or a flag read) needs the older values.
+		u32 pending = 0;
+
+	public: // -- ctor -- //
+
+		JitCompiler(const std::vector<Computer::BasicBlock::Op> &_ops, const void *mem, u64 mem_size)
+			: r{ static_cast<const u8*>(mem), mem_size, 0 }, ops(_ops)
+		{}
+
+	private: // -- helpers -- //
+
+		// emits a jcc to the side exit for instruction i
+		void side_exit(u8 cc, u64 i) { exits.push_back({ e.jcc(cc), i, pending }); }
+
+		// records the host flags selected by mask as the result of the current instruction
+		void flags(u32 mask)
+		{
+			e.push_flags();
+
+			// a partial capture would lose the other flags from the previous capture, so merge that first (this clobbers the host flags, hence the push)
+			if (mask != StatusFlags && pending != 0) e.merge_flags(pending);
+
+			e.pop_flags();
+			pending = mask;
+		}
+
+		// computes the address encoded at the current read position into RDX. returns false if it can't be decoded.
+		bool address()
+		{
+			u64 settings, regs = 0, imm = 0;
+			if (!r.read(1, settings) || ((settings & 3) != 0 && !r.read(1, regs))) return false;
+			u64 sizecode = (settings >> 2) & 3;
+			if ((settings & 0x80) != 0 && !r.read(Size(sizecode), imm)) return false;
+
+			e.mov_imm(RDX, imm);
+			if ((settings & 2) != 0)
+			{
+				e.load(RAX, Size(sizecode), RegsBase, NoIndex, (i32)(regs >> 4) * 8);
+				if ((settings >> 4) & 3) e.shift(4, 8, RAX, (u8)((settings >> 4) & 3)); // shl rax, mult
+				e.alu(0x01, 8, RDX, RAX); // add rdx, rax
+			}
+			if ((settings & 1) != 0)
+			{
+				e.load(RAX, Size(sizecode), RegsBase, NoIndex, (i32)(regs & 15) * 8);
+				e.alu(0x01, 8, RDX, RAX); // add rdx, rax
+			}
+
+			return true;
+		}
+		// checks that [RDX, RDX + size) is in bounds (and not readonly if write is set) - otherwise side exits at instruction i
+		void check(u64 size, bool write, u64 i)
+		{
+			e.alu(0x39, 8, RDX, MemSize); // cmp rdx, r13
+			side_exit(0x3, i);            // jae
+			e.lea(RAX, RDX, (i32)size);   // lea rax, [rdx + size]
+			e.alu(0x39, 8, RAX, MemSize); // cmp rax, r13
+			side_exit(0x7, i);            // ja
+			if (write)
+			{
+				e.cmp_frame(RDX, offsetof(Computer::JitFrame, readonly_barrier));
+				side_exit(0x2, i); // jb
+			}
+		}
+
+		// loads/stores guest registers (sizecode semantics match CPURegister::operator[])
+		void load_reg(u8 host, u64 reg, u64 sizecode) { e.load(host, Size(sizecode), RegsBase, NoIndex, (i32)reg * 8); }
+		void store_reg(u8 host, u64 reg, u64 sizecode)
+		{
+			// 32-bit writes zero the high bits - all values produced by 32-bit host ops are already zero extended
+			e.store(host, sizecode >= 2 ? 8 : Size(sizecode), RegsBase, NoIndex, (i32)reg * 8);
+		}
+		void load_mem(u8 host, u64 sizecode) { e.load(host, Size(sizecode), MemBase, RDX, 0); }
+		void store_mem(u8 host, u64 sizecode) { e.store(host, Size(sizecode), MemBase, RDX, 0); }
+
+	private: // -- instruction compilers -- //
+
+		// each returns true if the instruction was compiled (otherwise nothing meaningful was emitted for it)
+
+		// mov/add/sub/and/or/xor/cmp/test - opcode is the host "r/m, reg" opcode (0x89 for mov)
+		bool binary(u64 i, u8 opcode)
+		{
+			u64 s1, s2, imm = 0;
+			if (!r.read(1, s1) || !r.read(1, s2)) return false;
+			u64 sizecode = (s1 >> 2) & 3, mode = s2 >> 4;
+			if ((s1 & 3) != 0 || mode > 4) return false; // no high registers
+
+			bool is_mov = opcode == 0x89;
+			bool apply = opcode != 0x39 && opcode != 0x85; // cmp and test don't store the result
+
+			// get the operands (a in RAX, b in RCX) - memory operands are checked before anything else happens
+			switch (mode)
+			{
+			case 0:
+				if (!is_mov) load_reg(RAX, s1 >> 4, sizecode);
+				load_reg(RCX, s2 & 15, sizecode);
+				break;
+			case 1:
+				if (!r.read(Size(sizecode), imm)) return false;
+				if (!is_mov) load_reg(RAX, s1 >> 4, sizecode);
+				e.mov_imm(RCX, imm);
+				break;
+			case 2:
+				if (!address()) return false;
+				check(Size(sizecode), false, i);
+				if (!is_mov) load_reg(RAX, s1 >> 4, sizecode);
+				load_mem(RCX, sizecode);
+				break;
+			case 3: case 4:
+				if (!address()) return false;
+				if (mode == 4 && !r.read(Size(sizecode), imm)) return false;
+				check(Size(sizecode), apply, i);
+				if (!is_mov) load_mem(RAX, sizecode);
+				if (mode == 3) load_reg(RCX, s2 & 15, sizecode); else e.mov_imm(RCX, imm);
+				break;
+			}
+
+			// perform the operation
+			u8 res = RCX;
+			if (!is_mov)
+			{
+				e.alu(opcode, Size(sizecode), RAX, RCX);
+				flags(StatusFlags);
+				res = RAX;
+			}
+
+			// store the result
+			if (apply)
+			{
+				if (mode <= 2) store_reg(res, s1 >> 4, sizecode);
+				else store_mem(res, sizecode);
+			}
+
+			return true;
+		}
+
+		// inc/dec/neg/not - opcode/ext select the host group op. mask is the set of flags the op modifies.
+		bool unary(u64 i, u8 opcode, u8 ext, u32 mask)
+		{
+			u64 s;
+			if (!r.read(1, s)) return false;
+			u64 sizecode = (s >> 2) & 3;
+			if ((s & 2) != 0) return false; // no high registers
+
+			if ((s & 1) == 0) load_reg(RAX, s >> 4, sizecode);
+			else
+			{
+				if (!address()) return false;
+				check(Size(sizecode), true, i);
+				load_mem(RAX, sizecode);
+			}
+
+			e.unary(opcode, ext, Size(sizecode), RAX);
+			if (mask != 0) flags(mask);
+
+			if ((s & 1) == 0) store_reg(RAX, s >> 4, sizecode);
+			else store_mem(RAX, sizecode);
+
+			return true;
+		}
+
+		// shl/shr/sal/sar by an imm count - ext selects the host shift op
+		bool shift(u64 i, u8 ext)
+		{
+			u64 s, count;
+			if (!r.read(1, s) || !r.read(1, count)) return false;
+			u64 sizecode = (s >> 2) & 3;
+			if ((s & 2) != 0 || (count & 0x80) != 0) return false; // no high registers or CL counts
+			count &= sizecode == 3 ? 0x3f : 0x1f;
+
+			if ((s & 1) == 0) load_reg(RAX, s >> 4, sizecode);
+			else
+			{
+				if (!address()) return false;
+				check(Size(sizecode), count != 0, i); // a shift of zero only reads the operand
+				load_mem(RAX, sizecode);
+			}
+
+			// a shift of zero is a no-op (flags unchanged)
+			if (count == 0) return true;
+
+			e.shift(ext, Size(sizecode), RAX, (u8)count);
+			flags(StatusFlags);
+
+			if ((s & 1) == 0) store_reg(RAX, s >> 4, sizecode);
+			else store_mem(RAX, sizecode);
+
+			return true;
+		}
+
+		bool lea()
+		{
+			u64 s;
+			if (!r.read(1, s) || !address()) return false;
+			u64 sizecode = (s >> 2) & 3;
+
+			if (sizecode == 2) e.alu(0x89, 4, RDX, RDX); // mov edx, edx (zero extend)
+			store_reg(RDX, s >> 4, sizecode);
+			return true;
+		}
+
+		bool push(u64 i)
+		{
+			u64 s, imm;
+			if (!r.read(1, s)) return false;
+			u64 sizecode = (s >> 2) & 3;
+
+			// get the value into RCX
+			switch (s & 3)
+			{
+			case 0: load_reg(RCX, s >> 4, sizecode); break;
+			case 1: return false; // no high registers
+			case 2: if (!r.read(Size(sizecode), imm)) return false; e.mov_imm(RCX, imm); break;
+			case 3:
+				if (!address()) return false;
+				check(Size(sizecode), false, i);
+				load_mem(RCX, sizecode);
+				break;
+			}
+
+			// compute the new stack pointer in RDX and check it
+			load_reg(RDX, StackPointer, 3);
+			e.alu_imm(5, 8, RDX, (u32)Size(sizecode)); // sub rdx, size
+			e.cmp_frame(RDX, offsetof(Computer::JitFrame, stack_barrier));
+			side_exit(0x2, i); // jb
+			check(Size(sizecode), true, i);
+
+			store_reg(RDX, StackPointer, 3);
+			store_mem(RCX, sizecode);
+			return true;
+		}
+
+		bool pop(u64 i)
+		{
+			u64 s;
+			if (!r.read(1, s)) return false;
+			u64 sizecode = (s >> 2) & 3;
+			if ((s & 1) != 0) return false; // register destinations only
+
+			// get the stack pointer in RDX and check it
+			load_reg(RDX, StackPointer, 3);
+			e.cmp_frame(RDX, offsetof(Computer::JitFrame, stack_barrier));
+			side_exit(0x2, i); // jb
+			check(Size(sizecode), false, i);
+
+			load_mem(RCX, sizecode);
+			e.alu_imm(0, 8, RDX, (u32)Size(sizecode)); // add rdx, size
+			store_reg(RDX, StackPointer, 3);
+			store_reg(RCX, s >> 4, sizecode); // after RSP update (pop rsp semantics)
+			return true;
+		}
+
+		// emits a jump that is taken if CSX64 condition code cc holds for the flags at [FrameBase + src] - returns the rel32 position for patching
+		std::size_t condition(int cc, i32 src)
+		{
+			// flag masks for condition codes 0-13 and whether they're taken on a set (jnz) or clear (jz) result
+			static constexpr u32 masks[] = { 0x40, 0x40, 0x80, 0x80, 0x04, 0x04, 0x800, 0x800, 0x01, 0x01, 0x01, 0x41, 0x41, 0x01 };
+			static constexpr bool on_set[] = { true, false, true, false, true, false, true, false, true, false, true, true, false, false };
+
+			if (cc < 14)
+			{
+				e.test_frame(src, masks[cc]);
+				return e.jcc(on_set[cc] ? 0x5 : 0x4);
+			}
+
+			// the signed conditions depend on SF != OF (bit 7 of flags ^ (flags >> 4))
+			e.load(RAX, 4, FrameBase, NoIndex, src);
+			e.alu(0x89, 4, RCX, RAX);  // mov ecx, eax
+			e.shift(5, 4, RCX, 4);     // shr ecx, 4
+			e.alu(0x31, 4, RCX, RAX);  // xor ecx, eax
+			e.alu_imm(4, 4, RCX, 0x80); // and ecx, 0x80
+			if (cc == 15 || cc == 16)
+			{
+				e.alu_imm(4, 4, RAX, 0x40); // and eax, ZF
+				e.alu(0x09, 4, RCX, RAX);   // or ecx, eax
+			}
+			return e.jcc(cc == 14 || cc == 15 ? 0x5 : 0x4); // L, LE are taken on nonzero - GE, G on zero
+		}
+
+		// jmp/jcc with an imm target - cc is the CSX64 condition code (or -1 for jmp). ends the native code.
+		bool jump(u64 i, int cc)
+		{
+			u64 s, target;
+			if (!r.read(1, s) || (s & 3) != 2 || !r.read(Size((s >> 2) & 3), target)) return false;
+
+			u64 next = r.pos; // position of the following instruction
+
+			if (cc >= 0)
+			{
+				// test the flags from the most recent capture if it holds all of them - otherwise merge and test RFLAGS
+				if (pending != StatusFlags && pending != 0) { e.merge_flags(pending); pending = 0; }
+				i32 src = pending != 0 ? offsetof(Computer::JitFrame, host_flags) : offsetof(Computer::JitFrame, rflags);
+
+				std::size_t taken = condition(cc, src);
+				e.exit(next, i + 1, pending);
+				e.patch(taken);
+			}
+			e.exit(target, i + 1, pending);
+
+			return true;
+		}
+
+	public: // -- interface -- //
+
+		// compiles the longest supported prefix of the block. returns the number of instructions compiled (zero for none).
+		u64 compile()
+		{
+			e.prologue();
+
+			u64 i;
+			bool jumped = false; // marks that we ended with a compiled jump
+			for (i = 0; i < ops.size(); ++i)
+			{
+				// start decoding after the opcode
+				r.pos = ops[i].pos;
+				u64 op;
+				if (!r.read(1, op)) break;
+
+				// remember where the code for this instruction started (so we can roll it back if unsupported)
+				std::size_t code_start = e.code.size(), exits_start = exits.size();
+				u32 prev_pending = pending;
+
+				bool ok;
+				int cc = -1;
+				switch ((OPCode)op)
+				{
+				case OPCode::MOV: ok = binary(i, 0x89); break;
+				case OPCode::ADD: ok = binary(i, 0x01); break;
+				case OPCode::SUB: ok = binary(i, 0x29); break;
+				case OPCode::AND: ok = binary(i, 0x21); break;
+				case OPCode::OR: ok = binary(i, 0x09); break;
+				case OPCode::XOR: ok = binary(i, 0x31); break;
+				case OPCode::CMP: ok = binary(i, 0x39); break;
+				case OPCode::TEST: ok = binary(i, 0x85); break;
+
+				case OPCode::INC: ok = unary(i, 0xff, 0, StatusFlags & ~1u); break; // CF is unaffected
+				case OPCode::DEC: ok = unary(i, 0xff, 1, StatusFlags & ~1u); break; // CF is unaffected
+				case OPCode::NOT: ok = unary(i, 0xf7, 2, 0); break;
+				case OPCode::NEG: ok = unary(i, 0xf7, 3, StatusFlags); break;
+
+				case OPCode::SHL: case OPCode::SAL: ok = shift(i, 4); break;
+				case OPCode::SHR: ok = shift(i, 5); break;
+				case OPCode::SAR: ok = shift(i, 7); break;
+
+				case OPCode::LEA: ok = lea(); break;
+				case OPCode::PUSH: ok = push(i); break;
+				case OPCode::POP: ok = pop(i); break;
+
+				case OPCode::Jcc:
+					if (!r.read(1, op) || op >= sizeof(HostConditions)) { ok = false; break; }
+					cc = (int)op;
+					[[fallthrough]];
+				case OPCode::JMP:
+					// jumps can only be the last instruction
+					ok = i + 1 == ops.size() && jump(i, cc);
+					jumped = ok;
+					break;
+
+				default: ok = false; break;
+				}
+
+				// if it was a jump, the native code is complete
+				if (jumped) { ++i; break; }
+
+				// if it failed or the decoded length disagrees with the recorded block, roll back and stop here
+				if (!ok || (i + 1 < ops.size() && r.pos != ops[i + 1].pos))
+				{
+					e.code.resize(code_start);
+					exits.resize(exits_start);
+					pending = prev_pending;
+					break;
+				}
+			}
+
+			// if we didn't end with a jump, exit to the interpreter at the next instruction
+			if (!jumped) e.exit(i < ops.size() ? ops[i].pos : r.pos, i, pending);
+
+			// emit the side exits
+			for (const auto &exit : exits)
+			{
+				e.patch(exit.patch);
+				e.exit(ops[exit.index].pos, exit.index, exit.pending);
+			}
+
+			return i;
+		}
+
+		const std::vector<u8> &code() const { return e.code; }
+	};
+
+	void Computer::JitCompilation(bool enable)
+	{
+		jit_compilation = enable;
+
+		// drop all compiled code (blocks will be recompiled once they're hot again)
+		for (auto &block : blocks) { block->native = nullptr; block->exec_count = 0; }
+		jit_code.reset();
+	}
+
+	void Computer::CompileBlock(BasicBlock &block)
+	{
+		static_assert(sizeof(CPURegister) == 8, "native code assumes CPURegisters is an array of u64");
+
+		JitCompiler compiler(block.ops, mem, mem_size);
+
+		// if nothing could be compiled, don't bother (the block will never be tried again)
+		if (compiler.compile() == 0) return;
+
+		if (!jit_code) jit_code = std::make_shared<JitCodeBuffer>();
+		void *ptr = jit_code->add(compiler.code());
+		if (ptr) block.native = reinterpret_cast<JitFunction>(ptr);
+	}
+
+	u64 Computer::ExecuteNative(const BasicBlock &block)
+	{
+		JitFrame frame;
+		frame.regs = CPURegisters;
+		frame.mem = mem;
+		frame.mem_size = mem_size;
+		frame.readonly_barrier = ReadonlyBarrier;
+		frame.stack_barrier = StackBarrier;
+		frame.rflags = RFLAGS();
+		frame.rip = RIP();
+
+		u64 ticks = block.native(&frame);
+
+		RFLAGS() = frame.rflags;
+		RIP() = frame.rip;
+		return ticks;
+	}
+}
+
+#else
+
+namespace CSX64
+{
+	// native compilation isn't supported on this platform - it can never be enabled
+
+	void Computer::JitCompilation(bool) { jit_compilation = false; }
+
+	void Computer::CompileBlock(BasicBlock&) {}
+	u64 Computer::ExecuteNative(const BasicBlock&) { return 0; }
+}
+
+#endif
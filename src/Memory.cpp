@@ -53,7 +53,7 @@ namespace CSX64
 
     bool Computer::GetMemRaw(u64 pos, u64 size, u64 &res)
     {
-        if (pos >= mem_size || pos + size > mem_size) { Terminate(ErrorCode::OutOfBounds); return false; }
+        if (InvalidRange(pos, size)) { Terminate(ErrorCode::OutOfBounds); return false; }
 
         switch (size)
         {
@@ -67,7 +67,7 @@ namespace CSX64
     }
     bool Computer::GetMemRaw_szc(u64 pos, u64 sizecode, u64 &res)
     {
-        if (pos >= mem_size || pos + Size(sizecode) > mem_size) { Terminate(ErrorCode::OutOfBounds); return false; }
+        if (InvalidRange(pos, Size(sizecode))) { Terminate(ErrorCode::OutOfBounds); return false; }
 
         switch (sizecode)
         {
@@ -82,7 +82,7 @@ namespace CSX64
 
     bool Computer::SetMemRaw(u64 pos, u64 size, u64 val)
     {
-        if (pos >= mem_size || pos + size > mem_size) { Terminate(ErrorCode::OutOfBounds); return false; }
+        if (InvalidRange(pos, size)) { Terminate(ErrorCode::OutOfBounds); return false; }
         if (pos < ReadonlyBarrier) { Terminate(ErrorCode::AccessViolation); return false; }
 
         switch (size)
@@ -97,8 +97,8 @@ namespace CSX64
     }
     bool Computer::SetMemRaw_szc(u64 pos, u64 sizecode, u64 val)
     {
-        if (pos >= mem_size || pos + Size(sizecode) > mem_size) { Terminate(ErrorCode::OutOfBounds); return false; }
-        if (pos < ReadonlyBarrier) { Terminate(ErrorCode::AccessViolation); std::cerr << "\ntried to access: " << std::hex << pos << std::dec << '\n'; return false; }
+        if (InvalidRange(pos, Size(sizecode))) { Terminate(ErrorCode::OutOfBounds); return false; }
+        if (pos < ReadonlyBarrier) { Terminate(ErrorCode::AccessViolation); return false; }
 
         switch (sizecode)
         {
@@ -154,11 +154,12 @@ namespace CSX64
         return true;
     }
 
-    bool Computer::GetAddressAdv(u64 &res)
+    bool Computer::GetAddressAdv(u64 &res, bool access)
     {
         // [1: imm][1:][2: mult_1][2: size][1: r1][1: r2]   ([4: r1][4: r2])   ([size: imm])
 
         u8 settings, sizecode, regs = 0; // regs = 0 is only to appease warnings
+
         res = 0; // initialize res - functions as imm parsing location, so it has to start at 0
 
         // get the settings byte and regs byte if applicable
@@ -181,6 +182,8 @@ namespace CSX64
         // if r2 was used, add that
         if ((settings & 1) != 0) res += CPURegisters[regs & 15][sizecode];
 
+        if (access && address_tracer) address_tracer->Address(res);
+
         // got an address
         return true;
     }
@@ -0,0 +1,130 @@
+#include <chrono>
+#include <iomanip>
+
+#include "../include/Computer.h"
+
+// this file implements execution profiling (see Computer::Profiling) and the instrumented engine shared with tracing (see Computer::Tracing).
+// the instrumented engine is a copy of the interpreter loop that also records each instruction, so profiling and tracing cost nothing when disabled.
+
+namespace CSX64
+{
+	void Profiler::Clear()
+	{
+		ticks = 0;
+		rip_counts.clear();
+
+		std::fill(std::begin(op_counts), std::end(op_counts), 0);
+		std::fill(std::begin(op_sample_ns), std::end(op_sample_ns), 0);
+		std::fill(std::begin(op_samples), std::end(op_samples), 0);
+
+		edges.clear();
+		call_stack.clear();
+		untracked_depth = 0;
+		sample_phase = 0;
+	}
+
+	std::ostream &Profiler::Write(std::ostream &ostr, const SymbolMap *symbols) const
+	{
+		const auto flags = ostr.flags();
+
+		// writes an address (and its description if we have symbols)
+		const auto address = [&](u64 addr)
+		{
+			ostr << std::hex << addr << std::dec;
+			if (symbols) ostr << " [" << symbols->describe(addr) << ']';
+		};
+
+		ostr << std::dec << "ticks " << ticks << '\n';
+
+		for (u64 i = 0; i < rip_counts.size(); ++i)
+			if (rip_counts[i] != 0) { ostr << "rip "; address(i); ostr << ' ' << rip_counts[i] << '\n'; }
+
+		for (u64 i = 0; i < 256; ++i)
+			if (op_counts[i] != 0) ostr << "op " << i << ' ' << op_counts[i] << ' ' << (u64)OpTime(i) << '\n';
+
+		for (const auto &edge : edges)
+		{
+			ostr << "call "; address(edge.first.first); ostr << ' '; address(edge.first.second);
+			ostr << ' ' << edge.second.calls << ' ' << edge.second.ticks << '\n';
+		}
+
+		ostr.flags(flags);
+		return ostr;
+	}
+
+	void Computer::Profiling(bool enable)
+	{
+		if (!enable) profiler.reset();
+		else if (!profiler) profiler = std::make_unique<Profiler>();
+	}
+
+	u64 Computer::TickInstrumented(u64 count)
+	{
+		Profiler *const prof = profiler.get();
+		Tracer *const trace = tracer.get();
+		if (prof && prof->rip_counts.size() != ExeBarrier) prof->rip_counts.resize(ExeBarrier);
+
+		u64 ticks, op;
+		for (ticks = 0; ticks < count; ++ticks)
+		{
+			// fail if terminated or awaiting data
+			if (!running || suspended_read) break;
+
+			// make sure we're before the executable barrier (a jump out of the text segment is still traced)
+			const u64 pos = RIP();
+			if (pos >= ExeBarrier)
+			{
+				if (trace) trace->Instruction(pos, 0);
+				Terminate(ErrorCode::AccessViolation);
+				break;
+			}
+
+			// fetch the instruction (no bounds check needed - the executable barrier is always in bounds)
+			op = reinterpret_cast<const u8*>(mem)[RIP()++];
+
+			if (trace) trace->Instruction(pos, (u8)op);
+
+			// without a profile, there's nothing else to record
+			if (!prof) { (this->*opcode_handlers[op])(); continue; }
+
+			++prof->ticks;
+			++prof->rip_counts[pos];
+			++prof->op_counts[op];
+
+			// perform the instruction (timing a sample of them)
+			bool success;
+			if (++prof->sample_phase == Profiler::SampleInterval)
+			{
+				prof->sample_phase = 0;
+
+				auto start = std::chrono::steady_clock::now();
+				success = (this->*opcode_handlers[op])();
+				auto stop = std::chrono::steady_clock::now();
+
+				prof->op_sample_ns[op] += std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+				++prof->op_samples[op];
+			}
+			else success = (this->*opcode_handlers[op])();
+
+			if (!success) continue;
+
+			// track calls and returns for the call graph
+			if (op == (u64)OPCode::CALL)
+			{
+				Profiler::Edge &edge = prof->edges[{ pos, RIP() }];
+				++edge.calls;
+				if (prof->call_stack.size() < Profiler::MaxCallDepth) prof->call_stack.push_back({ &edge, prof->ticks });
+				else ++prof->untracked_depth;
+			}
+			// returns from untracked calls must not pop the tracked frames of their callers
+			else if (op == (u64)OPCode::RET && prof->untracked_depth != 0) --prof->untracked_depth;
+			else if (op == (u64)OPCode::RET && !prof->call_stack.empty())
+			{
+				prof->call_stack.back().edge->ticks += prof->ticks - prof->call_stack.back().start;
+				prof->call_stack.pop_back();
+			}
+		}
+
+		return ticks;
+	}
+}
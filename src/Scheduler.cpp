@@ -0,0 +1,218 @@
+#include <cstring>
+#include <algorithm>
+
+#include "../include/Scheduler.h"
+
+namespace CSX64
+{
+	// -- ChannelFileWrapper -- //
+
+	void ChannelFileWrapper::Push(const void *data, std::size_t len)
+	{
+		std::function<void()> notify;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+
+			// drop the consumed prefix before growing the buffer
+			if (b_pos > 0) { b.erase(b.begin(), b.begin() + b_pos); b_pos = 0; }
+			b.insert(b.end(), static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + len);
+
+			notify = on_data;
+		}
+		if (notify) notify();
+	}
+	void ChannelFileWrapper::Close()
+	{
+		std::function<void()> notify;
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			closed = true;
+			notify = on_data;
+		}
+		if (notify) notify();
+	}
+
+	i64 ChannelFileWrapper::Read(void *buf, i64 cap)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::size_t len = std::min(b.size() - b_pos, (std::size_t)cap);
+		std::memcpy(buf, b.data() + b_pos, len);
+		b_pos += len;
+
+		return (i64)len;
+	}
+
+	// -- Scheduler -- //
+
+	Scheduler::Scheduler(unsigned threads, u64 _quantum) : quantum(_quantum), created(std::chrono::steady_clock::now())
+	{
+		if (threads == 0) threads = std::max(std::thread::hardware_concurrency(), 1u);
+
+		for (unsigned i = 0; i < threads; ++i) workers.emplace_back(&Scheduler::WorkerLoop, this);
+	}
+	Scheduler::~Scheduler()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		work_cv.notify_all();
+
+		for (std::thread &t : workers) t.join();
+	}
+
+	void Scheduler::Enqueue(Session &s)
+	{
+		s.state = State::Runnable;
+		s.queued = std::chrono::steady_clock::now();
+		run_queue.push_back(&s);
+		work_cv.notify_one();
+	}
+
+	Scheduler::SessionID Scheduler::Add(std::unique_ptr<Computer> computer, ExitHandler on_exit)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		std::unique_ptr<Session> s = std::make_unique<Session>();
+		s->id = next_id++;
+		s->computer = std::move(computer);
+		s->on_exit = std::move(on_exit);
+
+		Session &ref = *s;
+		sessions.emplace(ref.id, std::move(s));
+		Enqueue(ref);
+
+		return ref.id;
+	}
+
+	void Scheduler::Wake(SessionID id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = sessions.find(id);
+		if (it == sessions.end()) return;
+		Session &s = *it->second;
+
+		if (s.state == State::Parked) Enqueue(s);
+		else if (s.state == State::Running) s.woken = true;
+	}
+
+	std::unique_ptr<Computer> Scheduler::Remove(SessionID id)
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = sessions.find(id);
+		if (it == sessions.end()) return nullptr;
+		if (it->second->state != State::Parked && it->second->state != State::Finished) return nullptr;
+
+		std::unique_ptr<Computer> computer = std::move(it->second->computer);
+		sessions.erase(it);
+		return computer;
+	}
+
+	bool Scheduler::Finished(SessionID id) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = sessions.find(id);
+		return it != sessions.end() && it->second->state == State::Finished;
+	}
+
+	void Scheduler::WaitIdle()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		idle_cv.wait(lock, [this] { return run_queue.empty() && running == 0; });
+	}
+
+	Scheduler::SessionStats Scheduler::SessionStatistics(SessionID id) const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		auto it = sessions.find(id);
+		return it != sessions.end() ? it->second->stats : SessionStats{};
+	}
+	Scheduler::Stats Scheduler::Statistics() const
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+
+		Stats stats;
+		stats.sessions = sessions.size();
+		stats.ticks = total_ticks;
+		stats.slices = total_slices;
+		stats.max_wait_ns = max_wait_ns;
+		stats.mean_wait_ns = total_slices != 0 ? (double)total_wait_ns / total_slices : 0;
+
+		const double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - created).count();
+		stats.ticks_per_second = secs > 0 ? total_ticks / secs : 0;
+
+		// jain's index: (sum x)^2 / (n * sum x^2)
+		double sum = 0, sum_sq = 0;
+		std::size_t n = 0;
+		for (const auto &entry : sessions)
+		{
+			const Session &s = *entry.second;
+			switch (s.state)
+			{
+			case State::Runnable: case State::Running: ++stats.runnable; break;
+			case State::Parked: ++stats.parked; break;
+			case State::Finished: ++stats.finished; continue;
+			}
+
+			sum += (double)s.stats.ticks;
+			sum_sq += (double)s.stats.ticks * (double)s.stats.ticks;
+			++n;
+		}
+		if (sum_sq > 0) stats.fairness = sum * sum / (n * sum_sq);
+
+		return stats;
+	}
+
+	void Scheduler::WorkerLoop()
+	{
+		std::unique_lock<std::mutex> lock(mutex);
+		while (true)
+		{
+			work_cv.wait(lock, [this] { return stopping || !run_queue.empty(); });
+			if (stopping) return;
+
+			Session &s = *run_queue.front();
+			run_queue.pop_front();
+			s.state = State::Running;
+			++running;
+
+			// account for the time spent waiting for a worker
+			auto start = std::chrono::steady_clock::now();
+			const long long wait = std::chrono::duration_cast<std::chrono::nanoseconds>(start - s.queued).count();
+			s.stats.wait_ns += wait;
+			s.stats.max_wait_ns = std::max(s.stats.max_wait_ns, wait);
+			total_wait_ns += wait;
+			max_wait_ns = std::max(max_wait_ns, wait);
+
+			// run the slice without the lock (only this worker touches a running session's computer)
+			lock.unlock();
+			Computer &c = *s.computer;
+			if (c.SuspendedRead()) c.ResumeSuspendedRead();
+			const u64 ticks = c.Tick(quantum);
+			auto stop = std::chrono::steady_clock::now();
+			const bool finished = !c.Running();
+			if (finished && s.on_exit) s.on_exit(s.id, c);
+			lock.lock();
+
+			s.stats.ticks += ticks;
+			++s.stats.slices;
+			s.stats.run_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(stop - start).count();
+			total_ticks += ticks;
+			++total_slices;
+			--running;
+
+			// if it stopped, it's done - if it's awaiting input (and wasn't woken in the meantime), park it - otherwise back of the line
+			if (finished) s.state = State::Finished;
+			else if (c.SuspendedRead() && !s.woken) { s.state = State::Parked; ++s.stats.parks; }
+			else Enqueue(s);
+			s.woken = false;
+
+			idle_cv.notify_all();
+		}
+	}
+}
@@ -0,0 +1,163 @@
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#include "../include/SymbolMap.h"
+#include "../include/Utility.h"
+#include "../include/csx_exceptions.h"
+
+namespace CSX64
+{
+	void SymbolMap::clear() noexcept
+	{
+		files.clear();
+		symbols.clear();
+		lines.clear();
+	}
+
+	u32 SymbolMap::add_file(std::string name)
+	{
+		files.push_back(std::move(name));
+		return (u32)(files.size() - 1);
+	}
+	void SymbolMap::add_symbol(u64 address, std::string name, u32 file, int line) { symbols.push_back({ address, std::move(name), file, line }); }
+	void SymbolMap::add_line(u64 address, u32 file, int line) { lines.push_back({ address, file, line }); }
+
+	void SymbolMap::finalize()
+	{
+		std::stable_sort(symbols.begin(), symbols.end(), [](const Symbol &a, const Symbol &b) { return a.address < b.address; });
+		std::stable_sort(lines.begin(), lines.end(), [](const Line &a, const Line &b) { return a.address < b.address; });
+	}
+
+	const SymbolMap::Symbol *SymbolMap::find_symbol(u64 address) const noexcept
+	{
+		// find the last symbol at or before address, then back up to the first one at that same address
+		auto it = std::upper_bound(symbols.begin(), symbols.end(), address, [](u64 addr, const Symbol &s) { return addr < s.address; });
+		if (it == symbols.begin()) return nullptr;
+		const u64 at = (--it)->address;
+		while (it != symbols.begin() && (it - 1)->address == at) --it;
+		return &*it;
+	}
+	const SymbolMap::Line *SymbolMap::find_line(u64 address) const noexcept
+	{
+		auto it = std::upper_bound(lines.begin(), lines.end(), address, [](u64 addr, const Line &l) { return addr < l.address; });
+		return it == lines.begin() ? nullptr : &*(it - 1);
+	}
+
+	std::string SymbolMap::describe(u64 address) const
+	{
+		std::string res;
+
+		if (const Symbol *sym = find_symbol(address))
+		{
+			res = sym->name;
+			if (address != sym->address) res += "+" + tohex(address - sym->address);
+		}
+		else res = tohex(address);
+
+		if (const Line *line = find_line(address)) res += " (" + files[line->file] + ":" + tostr(line->line) + ")";
+
+		return res;
+	}
+
+	// ------------------------------------------------- //
+
+	static const u8 header[] = { 'C', 'S', 'X', '6', '4', 'm', 'a', 'p' };
+
+	void SymbolMap::save(const std::string &path) const
+	{
+		std::ofstream file(path, std::ios::binary);
+		if (!file) throw FileOpenError("Failed to open file for saving symbol map");
+
+		// write map header and CSX64 version number
+		file.write(reinterpret_cast<const char*>(header), sizeof(header));
+		BinWrite(file, Version);
+
+		BinWrite<u64>(file, files.size());
+		for (const std::string &f : files) BinWrite(file, f);
+
+		BinWrite<u64>(file, symbols.size());
+		for (const Symbol &s : symbols)
+		{
+			BinWrite(file, s.address);
+			BinWrite(file, s.name);
+			BinWrite(file, s.file);
+			BinWrite<i32>(file, s.line);
+		}
+
+		BinWrite<u64>(file, lines.size());
+		for (const Line &l : lines)
+		{
+			BinWrite(file, l.address);
+			BinWrite(file, l.file);
+			BinWrite<i32>(file, l.line);
+		}
+
+		// make sure the writes succeeded
+		if (!file) throw IOError("Failed to write symbol map to file");
+	}
+	void SymbolMap::load(const std::string &path)
+	{
+		clear();
+
+		std::ifstream file(path, std::ios::binary);
+		if (!file) throw FileOpenError("Failed to open file for loading symbol map");
+
+		u8 header_temp[sizeof(header)];
+		u64 val;
+		i32 line;
+
+		// if we throw an exception we must leave the map empty (this covers the type and version errors and failed allocations)
+		try
+		{
+			// read the header and make sure it matches - match failure is a type error, not a format error.
+			if (!BinRead(file, reinterpret_cast<char*>(header_temp), sizeof(header))) goto err;
+			if (std::memcmp(header_temp, header, sizeof(header))) throw TypeError("File was not a CSX64 symbol map");
+
+			// read the version number and make sure it matches - match failure is a version error, not a format error.
+			if (!BinRead(file, val)) goto err;
+			if (val != Version) throw VersionError("Symbol map was from an incompatible version of CSX64");
+
+			// the counts aren't trusted to preallocate - the tables grow as entries are actually read, so a bogus count just runs out of file
+			if (!BinRead(file, val)) goto err;
+			for (u64 i = 0; i < val; ++i)
+			{
+				std::string f;
+				if (!BinRead(file, f)) goto err;
+				files.push_back(std::move(f));
+			}
+
+			// the entries must be sorted and refer to valid files
+			if (!BinRead(file, val)) goto err;
+			for (u64 i = 0; i < val; ++i)
+			{
+				Symbol s;
+				if (!BinRead(file, s.address) || !BinRead(file, s.name) || !BinRead(file, s.file) || !BinRead(file, line)) goto err;
+				s.line = line;
+				if (s.file >= files.size() || (i > 0 && s.address < symbols.back().address)) goto err;
+				symbols.push_back(std::move(s));
+			}
+
+			if (!BinRead(file, val)) goto err;
+			for (u64 i = 0; i < val; ++i)
+			{
+				Line l;
+				if (!BinRead(file, l.address) || !BinRead(file, l.file) || !BinRead(file, line)) goto err;
+				l.line = line;
+				if (l.file >= files.size() || (i > 0 && l.address < lines.back().address)) goto err;
+				lines.push_back(l);
+			}
+
+			return;
+		}
+		catch (...)
+		{
+			clear();
+			throw;
+		}
+
+	err:
+		clear();
+		throw FormatError("Symbol map file was corrupted");
+	}
+}
@@ -0,0 +1,192 @@
+#include <fstream>
+#include <cstring>
+#include <algorithm>
+
+#include "../include/Computer.h"
+#include "../include/csx_exceptions.h"
+
+// this file implements execution tracing (see Computer::Tracing).
+// a saved trace is the header and version number, the number of blocks, then each block's length and content (oldest first).
+
+namespace CSX64
+{
+	static const u8 header[] = { 'C', 'S', 'X', '6', '4', 't', 'r', 'c' };
+
+	Tracer::Tracer(u64 capacity)
+	{
+		block_count = std::max<u64>(2, capacity / BlockSize);
+		data = std::make_unique<u8[]>(block_count * BlockSize);
+		lengths = std::make_unique<u32[]>(block_count);
+
+		Clear();
+	}
+
+	void Tracer::Clear()
+	{
+		block = data.get();
+		fill = 0;
+		seq = 0;
+		last_rip = last_address = 0;
+	}
+
+	void Tracer::NextBlock()
+	{
+		lengths[seq % block_count] = (u32)fill;
+
+		// each block starts from zero so it can be decoded on its own
+		++seq;
+		block = data.get() + (seq % block_count) * BlockSize;
+		fill = 0;
+		last_rip = last_address = 0;
+	}
+
+	Tracer::Blocks Tracer::Snapshot() const
+	{
+		// once the buffer has wrapped around, the oldest block still present is the one after the block being written
+		const u64 first = seq + 1 > block_count ? seq + 1 - block_count : 0;
+
+		Blocks res;
+		for (u64 s = first; s <= seq; ++s)
+		{
+			const u8 *p = data.get() + (s % block_count) * BlockSize;
+			const u64 len = s == seq ? fill : lengths[s % block_count];
+			res.emplace_back(p, p + len);
+		}
+		return res;
+	}
+
+	std::vector<Tracer::Entry> Tracer::Decode(const Blocks &blocks)
+	{
+		std::vector<Entry> res;
+
+		for (const std::vector<u8> &b : blocks)
+		{
+			u64 rip = 0, address = 0;
+
+			for (std::size_t i = 0; i < b.size(); )
+			{
+				// read the header and the rest of the varint
+				const u8 first = b[i++];
+				u64 v = (first >> 2) & 31;
+				if (first & 0x80)
+				{
+					for (int shift = 5; ; shift += 7)
+					{
+						if (i >= b.size() || shift > 63) throw FormatError("Trace was corrupted");
+						const u8 next = b[i++];
+						v |= (u64)(next & 0x7f) << shift;
+						if ((next & 0x80) == 0) break;
+					}
+				}
+				const u64 delta = (v >> 1) ^ (0 - (v & 1));
+
+				switch (first & 3)
+				{
+				case 1:
+					if (i >= b.size()) throw FormatError("Trace was corrupted");
+					rip += delta;
+					res.push_back({ rip, b[i++], {} });
+					break;
+				case 2:
+					// the instruction may have been in a block that was overwritten - in that case drop it
+					address += delta;
+					if (!res.empty()) res.back().addresses.push_back(address);
+					break;
+
+				default: throw FormatError("Trace was corrupted");
+				}
+			}
+		}
+
+		return res;
+	}
+
+	std::ostream &Tracer::Write(std::ostream &ostr, const std::vector<Entry> &entries, const SymbolMap *symbols)
+	{
+		const auto flags = ostr.flags();
+
+		for (const Entry &e : entries)
+		{
+			ostr << std::hex << e.rip;
+			if (symbols) ostr << " [" << symbols->describe(e.rip) << ']';
+			ostr << ' ' << std::dec << (unsigned)e.op << std::hex;
+			for (u64 address : e.addresses) ostr << ' ' << address;
+			ostr << '\n';
+		}
+
+		ostr.flags(flags);
+		return ostr;
+	}
+
+	// ------------------------------------------------- //
+
+	void Tracer::Save(std::ostream &ostr) const
+	{
+		const Blocks blocks = Snapshot();
+
+		// write trace header and CSX64 version number
+		ostr.write(reinterpret_cast<const char*>(header), sizeof(header));
+		BinWrite(ostr, Version);
+
+		BinWrite<u64>(ostr, blocks.size());
+		for (const std::vector<u8> &b : blocks)
+		{
+			BinWrite<u64>(ostr, b.size());
+			BinWrite(ostr, reinterpret_cast<const char*>(b.data()), b.size());
+		}
+
+		// make sure the writes succeeded
+		if (!ostr) throw IOError("Failed to write trace");
+	}
+	Tracer::Blocks Tracer::Load(std::istream &istr)
+	{
+		u8 header_temp[sizeof(header)];
+		u64 val;
+		Blocks blocks;
+
+		// read the header and make sure it matches - match failure is a type error, not a format error.
+		if (!BinRead(istr, reinterpret_cast<char*>(header_temp), sizeof(header))) goto err;
+		if (std::memcmp(header_temp, header, sizeof(header))) throw TypeError("Stream was not a CSX64 trace");
+
+		// read the version number and make sure it matches - match failure is a version error, not a format error.
+		if (!BinRead(istr, val)) goto err;
+		if (val != Version) throw VersionError("Trace was from an incompatible version of CSX64");
+
+		// blocks can't be any longer than they are in the buffer
+		if (!BinRead(istr, val)) goto err;
+		while (val-- > 0)
+		{
+			u64 len;
+			if (!BinRead(istr, len) || len > BlockSize) goto err;
+
+			blocks.emplace_back(len);
+			if (!BinRead(istr, reinterpret_cast<char*>(blocks.back().data()), (std::size_t)len)) goto err;
+		}
+
+		return blocks;
+
+	err:
+		throw FormatError("Trace was corrupted");
+	}
+
+	// ------------------------------------------------- //
+
+	void Computer::Tracing(bool enable, bool addresses, u64 capacity)
+	{
+		if (!enable) tracer.reset();
+		else tracer = std::make_unique<Tracer>(capacity);
+
+		address_tracer = enable && addresses ? tracer.get() : nullptr;
+	}
+
+	void Computer::DumpTrace()
+	{
+		std::ofstream file(trace_dump, std::ios::binary);
+		try
+		{
+			if (!file) throw FileOpenError("Failed to open file for saving trace");
+			tracer->Save(file);
+		}
+		catch (const std::exception &ex) { std::cerr << ex.what() << ": " << trace_dump << '\n'; }
+	}
+}
@@ -1,3 +1,6 @@
+#include <mutex>
+#include <thread>
+
 #include "../include/Utility.h"
 
 #include "../ios-frstor/iosfrstor.h"
@@ -43,6 +46,85 @@ namespace CSX64
 		return BinRead(istr, str.data(), len);
 	}
 
+	// -- hashing -- //
+
+	u64 HashBytes(const void *p, std::size_t count, u64 hash)
+	{
+		const u8 *bytes = static_cast<const u8*>(p);
+		for (std::size_t i = 0; i < count; ++i) hash = (hash ^ bytes[i]) * 0x100000001b3;
+		return hash;
+	}
+
+	// -- parallelism -- //
+
+	// a worker's pending jobs (as indices) - the owner takes from the front, thieves take from the back
+	struct ParallelQueue
+	{
+		std::mutex mutex;
+		std::deque<std::size_t> jobs;
+	};
+
+	// gets the next job for worker self - its own if it has any, otherwise one stolen from another worker.
+	// jobs are never added after the pool starts, so returns false only when there's no work left anywhere.
+	static bool TakeParallelJob(std::vector<ParallelQueue> &queues, std::size_t self, std::size_t &job)
+	{
+		for (std::size_t i = 0; i < queues.size(); ++i)
+		{
+			ParallelQueue &q = queues[(self + i) % queues.size()];
+			std::lock_guard<std::mutex> lock(q.mutex);
+
+			if (q.jobs.empty()) continue;
+			if (i == 0) { job = q.jobs.front(); q.jobs.pop_front(); }
+			else { job = q.jobs.back(); q.jobs.pop_back(); }
+			return true;
+		}
+		return false;
+	}
+
+	void ParallelFor(std::size_t count, unsigned threads, const std::function<void(std::size_t)> &job)
+	{
+		std::size_t thread_count = threads != 0 ? threads : std::max(std::thread::hardware_concurrency(), 1u);
+		thread_count = std::min(thread_count, count);
+
+		if (thread_count <= 1)
+		{
+			for (std::size_t i = 0; i < count; ++i) job(i);
+			return;
+		}
+
+		// deal out contiguous runs of jobs to each worker (stealing evens out any imbalance)
+		std::vector<ParallelQueue> queues(thread_count);
+		for (std::size_t i = 0; i < count; ++i) queues[i * thread_count / count].jobs.push_back(i);
+
+		std::exception_ptr error;
+		std::mutex error_mutex;
+
+		auto worker = [&](std::size_t self)
+		{
+			try
+			{
+				std::size_t j;
+				while (TakeParallelJob(queues, self, j)) job(j);
+			}
+			catch (...)
+			{
+				// empty the queues so everyone else stops too
+				for (ParallelQueue &q : queues) { std::lock_guard<std::mutex> lock(q.mutex); q.jobs.clear(); }
+
+				std::lock_guard<std::mutex> lock(error_mutex);
+				if (!error) error = std::current_exception();
+			}
+		};
+
+		// the calling thread acts as worker 0
+		std::vector<std::thread> workers;
+		for (std::size_t i = 1; i < thread_count; ++i) workers.emplace_back(worker, i);
+		worker(0);
+		for (std::thread &t : workers) t.join();
+
+		if (error) std::rethrow_exception(error);
+	}
+
 	// -- memory utilities -- //
 
 	void *aligned_malloc(std::size_t size, std::size_t align)
@@ -75,6 +157,13 @@ namespace CSX64
 		if (ptr) std::free(reinterpret_cast<void**>(ptr)[-1]); // aliasing is safe because only we (should) ever modify it
 	}
 
+	bool AllZero(const void *p, std::size_t len)
+	{
+		// if the first byte is zero, comparing the range to itself shifted by one checks the rest
+		const char *bytes = static_cast<const char*>(p);
+		return len == 0 || (*bytes == 0 && std::memcmp(bytes, bytes + 1, len - 1) == 0);
+	}
+
 	bool Write(std::vector<u8> &arr, u64 pos, u64 size, u64 val)
 	{
 		// make sure we're not exceeding memory bounds
@@ -0,0 +1,279 @@
+#include <cmath>
+#include <type_traits>
+
+#include "../include/Computer.h"
+
+// this file implements the whole-vector kernels used by the packed vpu ops (see VPUKernelTable).
+// instead of dispatching every element through a delegate, a kernel processes an entire xmm/ymm/zmm register at once.
+// there's a portable version of each kernel and, on x86-64 hosts that support it (checked at startup via cpuid), an avx2 version.
+// kernels only exist for ops where doing every element at once gives bit-identical results to the delegates -
+// the fp kernels use the same ieee operations as the delegates, so the host rounding and (masked) exception behavior is unchanged.
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define CSX64_VPU_AVX2 1
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define CSX64_TARGET_AVX2
+#else
+#define CSX64_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#else
+#define CSX64_VPU_AVX2 0
+#endif
+
+namespace CSX64
+{
+	// -- portable kernels -- //
+
+	// applies op to each element of type T in the first bytes bytes
+	template<typename T, T(*op)(T, T, u64)>
+	static void PortableBinary(void *res, const void *a, const void *b, u64 bytes)
+	{
+		for (u64 i = 0; i < bytes / sizeof(T); ++i)
+		{
+			T val = op(bin_read<T>(static_cast<const char*>(a) + i * sizeof(T)), bin_read<T>(static_cast<const char*>(b) + i * sizeof(T)), i);
+			bin_write<T>(static_cast<char*>(res) + i * sizeof(T), val);
+		}
+	}
+
+	template<typename T> static T FAdd(T a, T b, u64) { return a + b; }
+	template<typename T> static T FSub(T a, T b, u64) { return a - b; }
+	template<typename T> static T FMul(T a, T b, u64) { return a * b; }
+	template<typename T> static T FDiv(T a, T b, u64) { return a / b; }
+	template<typename T> static T FMin(T a, T b, u64) { return a < b ? a : b; } // same NaN handling as the delegates (second operand)
+	template<typename T> static T FMax(T a, T b, u64) { return a > b ? a : b; }
+	template<typename T> static T FAddSub(T a, T b, u64 index) { return index % 2 == 0 ? a - b : a + b; }
+
+	// the bitwise ops don't depend on element size, so they always work on 64-bit chunks
+	static u64 And(u64 a, u64 b, u64) { return a & b; }
+	static u64 Or(u64 a, u64 b, u64) { return a | b; }
+	static u64 Xor(u64 a, u64 b, u64) { return a ^ b; }
+	static u64 AndN(u64 a, u64 b, u64) { return ~a & b; }
+
+	// the integer ops work on unsigned types (wider arithmetic avoids promotion to signed int)
+	template<typename T> static T Add(T a, T b, u64) { return (T)((u64)a + (u64)b); }
+	template<typename T> static T Sub(T a, T b, u64) { return (T)((u64)a - (u64)b); }
+	template<typename T> static T MulLow(T a, T b, u64) { return (T)((u64)a * (u64)b); }
+	template<typename T> static T AddSat(T a, T b, u64)
+	{
+		constexpr T smask = (T)((T)1 << (sizeof(T) * 8 - 1));
+		T res = (T)((u64)a + (u64)b);
+
+		// if a and b have the same sign but res doesn't, saturate
+		if ((T)((a ^ res) & (b ^ res) & smask) != 0) res = (a & smask) != 0 ? smask : (T)(smask - 1);
+		return res;
+	}
+	// same as the delegate - adds the negative (so subtracting the minimum value doesn't saturate)
+	template<typename T> static T SubSat(T a, T b, u64 index) { return AddSat<T>(a, (T)(0 - (u64)b), index); }
+	template<typename T> static T AddUSat(T a, T b, u64) { T res = (T)((u64)a + (u64)b); return res < a ? (T)~(T)0 : res; }
+	template<typename T> static T SubUSat(T a, T b, u64) { return a > b ? (T)(a - b) : 0; }
+	template<typename T> static T UMin(T a, T b, u64) { return a < b ? a : b; }
+	template<typename T> static T UMax(T a, T b, u64) { return a > b ? a : b; }
+	template<typename T> static T SMin(T a, T b, u64) { return (std::make_signed_t<T>)a < (std::make_signed_t<T>)b ? a : b; }
+	template<typename T> static T SMax(T a, T b, u64) { return (std::make_signed_t<T>)a > (std::make_signed_t<T>)b ? a : b; }
+	template<typename T> static T Avg(T a, T b, u64) { return (T)(((u64)a + (u64)b + 1) >> 1); }
+
+	template<typename T>
+	static bool PortableSqrt(void *res, const void *a, u64 bytes)
+	{
+		// negative elements are an error - leave those to the delegate
+		for (u64 i = 0; i < bytes / sizeof(T); ++i)
+			if (bin_read<T>(static_cast<const char*>(a) + i * sizeof(T)) < 0) return false;
+
+		for (u64 i = 0; i < bytes / sizeof(T); ++i)
+			bin_write<T>(static_cast<char*>(res) + i * sizeof(T), std::sqrt(bin_read<T>(static_cast<const char*>(a) + i * sizeof(T))));
+		return true;
+	}
+
+	static VPUKernelTable PortableVPUKernels()
+	{
+		VPUKernelTable k = {};
+
+		k.FADD[2] = PortableBinary<float, FAdd<float>>; k.FADD[3] = PortableBinary<double, FAdd<double>>;
+		k.FSUB[2] = PortableBinary<float, FSub<float>>; k.FSUB[3] = PortableBinary<double, FSub<double>>;
+		k.FMUL[2] = PortableBinary<float, FMul<float>>; k.FMUL[3] = PortableBinary<double, FMul<double>>;
+		k.FDIV[2] = PortableBinary<float, FDiv<float>>; k.FDIV[3] = PortableBinary<double, FDiv<double>>;
+		k.FMIN[2] = PortableBinary<float, FMin<float>>; k.FMIN[3] = PortableBinary<double, FMin<double>>;
+		k.FMAX[2] = PortableBinary<float, FMax<float>>; k.FMAX[3] = PortableBinary<double, FMax<double>>;
+		k.FADDSUB[2] = PortableBinary<float, FAddSub<float>>; k.FADDSUB[3] = PortableBinary<double, FAddSub<double>>;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			k.AND[i] = PortableBinary<u64, And>;
+			k.OR[i] = PortableBinary<u64, Or>;
+			k.XOR[i] = PortableBinary<u64, Xor>;
+			k.ANDN[i] = PortableBinary<u64, AndN>;
+		}
+
+		#define CSX64_PORTABLE_INT(field, op) \
+			k.field[0] = PortableBinary<u8, op<u8>>; k.field[1] = PortableBinary<u16, op<u16>>; \
+			k.field[2] = PortableBinary<u32, op<u32>>; k.field[3] = PortableBinary<u64, op<u64>>;
+
+		CSX64_PORTABLE_INT(ADD, Add);
+		CSX64_PORTABLE_INT(ADDS, AddSat);
+		CSX64_PORTABLE_INT(ADDUS, AddUSat);
+		CSX64_PORTABLE_INT(SUB, Sub);
+		CSX64_PORTABLE_INT(SUBS, SubSat);
+		CSX64_PORTABLE_INT(SUBUS, SubUSat);
+		CSX64_PORTABLE_INT(MULL, MulLow);
+		CSX64_PORTABLE_INT(UMIN, UMin);
+		CSX64_PORTABLE_INT(SMIN, SMin);
+		CSX64_PORTABLE_INT(UMAX, UMax);
+		CSX64_PORTABLE_INT(SMAX, SMax);
+
+		#undef CSX64_PORTABLE_INT
+
+		// only byte and word averages exist
+		k.AVG[0] = PortableBinary<u8, Avg<u8>>; k.AVG[1] = PortableBinary<u16, Avg<u16>>;
+
+		k.FSQRT[2] = PortableSqrt<float>; k.FSQRT[3] = PortableSqrt<double>;
+
+		return k;
+	}
+
+	// -- avx2 kernels -- //
+
+	#if CSX64_VPU_AVX2
+
+	static bool HostHasAVX2()
+	{
+		#if defined(_MSC_VER) && !defined(__clang__)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7) return false;
+
+		// the os must support avx (osxsave + avx) and save the ymm state
+		__cpuid(info, 1);
+		if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0) return false;
+		if ((_xgetbv(0) & 6) != 6) return false;
+
+		__cpuidex(info, 7, 0);
+		return (info[1] & (1 << 5)) != 0;
+		#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+		#endif
+	}
+
+	// defines an avx2 binary kernel that applies op to each 32-byte chunk (the buffers are 64 bytes, so xmm ops can do a whole chunk)
+	#define CSX64_AVX2_BINARY(name, T, load, store, op) \
+		CSX64_TARGET_AVX2 static void name(void *res, const void *a, const void *b, u64 bytes) \
+		{ \
+			for (u64 i = 0; i < bytes; i += 32) \
+			{ \
+				const auto x = load(reinterpret_cast<const T*>(static_cast<const char*>(a) + i)); \
+				const auto y = load(reinterpret_cast<const T*>(static_cast<const char*>(b) + i)); \
+				store(reinterpret_cast<T*>(static_cast<char*>(res) + i), op(x, y)); \
+			} \
+		}
+	#define CSX64_AVX2_PS(name, op) CSX64_AVX2_BINARY(name, float, _mm256_load_ps, _mm256_store_ps, op)
+	#define CSX64_AVX2_PD(name, op) CSX64_AVX2_BINARY(name, double, _mm256_load_pd, _mm256_store_pd, op)
+	#define CSX64_AVX2_INT(name, op) CSX64_AVX2_BINARY(name, __m256i, _mm256_load_si256, _mm256_store_si256, op)
+
+	CSX64_AVX2_PS(AVX2_FADD_PS, _mm256_add_ps)       CSX64_AVX2_PD(AVX2_FADD_PD, _mm256_add_pd)
+	CSX64_AVX2_PS(AVX2_FSUB_PS, _mm256_sub_ps)       CSX64_AVX2_PD(AVX2_FSUB_PD, _mm256_sub_pd)
+	CSX64_AVX2_PS(AVX2_FMUL_PS, _mm256_mul_ps)       CSX64_AVX2_PD(AVX2_FMUL_PD, _mm256_mul_pd)
+	CSX64_AVX2_PS(AVX2_FDIV_PS, _mm256_div_ps)       CSX64_AVX2_PD(AVX2_FDIV_PD, _mm256_div_pd)
+	CSX64_AVX2_PS(AVX2_FMIN_PS, _mm256_min_ps)       CSX64_AVX2_PD(AVX2_FMIN_PD, _mm256_min_pd)
+	CSX64_AVX2_PS(AVX2_FMAX_PS, _mm256_max_ps)       CSX64_AVX2_PD(AVX2_FMAX_PD, _mm256_max_pd)
+	CSX64_AVX2_PS(AVX2_FADDSUB_PS, _mm256_addsub_ps) CSX64_AVX2_PD(AVX2_FADDSUB_PD, _mm256_addsub_pd)
+
+	CSX64_AVX2_INT(AVX2_AND, _mm256_and_si256)
+	CSX64_AVX2_INT(AVX2_OR, _mm256_or_si256)
+	CSX64_AVX2_INT(AVX2_XOR, _mm256_xor_si256)
+	CSX64_AVX2_INT(AVX2_ANDN, _mm256_andnot_si256)
+
+	CSX64_AVX2_INT(AVX2_ADD_8, _mm256_add_epi8)     CSX64_AVX2_INT(AVX2_ADD_16, _mm256_add_epi16)
+	CSX64_AVX2_INT(AVX2_ADD_32, _mm256_add_epi32)   CSX64_AVX2_INT(AVX2_ADD_64, _mm256_add_epi64)
+	CSX64_AVX2_INT(AVX2_SUB_8, _mm256_sub_epi8)     CSX64_AVX2_INT(AVX2_SUB_16, _mm256_sub_epi16)
+	CSX64_AVX2_INT(AVX2_SUB_32, _mm256_sub_epi32)   CSX64_AVX2_INT(AVX2_SUB_64, _mm256_sub_epi64)
+	CSX64_AVX2_INT(AVX2_ADDS_8, _mm256_adds_epi8)   CSX64_AVX2_INT(AVX2_ADDS_16, _mm256_adds_epi16)
+	CSX64_AVX2_INT(AVX2_ADDUS_8, _mm256_adds_epu8)  CSX64_AVX2_INT(AVX2_ADDUS_16, _mm256_adds_epu16)
+	CSX64_AVX2_INT(AVX2_SUBUS_8, _mm256_subs_epu8)  CSX64_AVX2_INT(AVX2_SUBUS_16, _mm256_subs_epu16)
+	CSX64_AVX2_INT(AVX2_MULL_16, _mm256_mullo_epi16) CSX64_AVX2_INT(AVX2_MULL_32, _mm256_mullo_epi32)
+
+	CSX64_AVX2_INT(AVX2_UMIN_8, _mm256_min_epu8)    CSX64_AVX2_INT(AVX2_UMIN_16, _mm256_min_epu16)  CSX64_AVX2_INT(AVX2_UMIN_32, _mm256_min_epu32)
+	CSX64_AVX2_INT(AVX2_SMIN_8, _mm256_min_epi8)    CSX64_AVX2_INT(AVX2_SMIN_16, _mm256_min_epi16)  CSX64_AVX2_INT(AVX2_SMIN_32, _mm256_min_epi32)
+	CSX64_AVX2_INT(AVX2_UMAX_8, _mm256_max_epu8)    CSX64_AVX2_INT(AVX2_UMAX_16, _mm256_max_epu16)  CSX64_AVX2_INT(AVX2_UMAX_32, _mm256_max_epu32)
+	CSX64_AVX2_INT(AVX2_SMAX_8, _mm256_max_epi8)    CSX64_AVX2_INT(AVX2_SMAX_16, _mm256_max_epi16)  CSX64_AVX2_INT(AVX2_SMAX_32, _mm256_max_epi32)
+	CSX64_AVX2_INT(AVX2_AVG_8, _mm256_avg_epu8)     CSX64_AVX2_INT(AVX2_AVG_16, _mm256_avg_epu16)
+
+	#undef CSX64_AVX2_INT
+	#undef CSX64_AVX2_PD
+	#undef CSX64_AVX2_PS
+	#undef CSX64_AVX2_BINARY
+
+	// lanes is the movemask bits for the elements in the low 16 bytes of a chunk (only those are used by an xmm op)
+	#define CSX64_AVX2_SQRT(name, T, V, load, store, zero, cmp, sqrt, movemask, lanes) \
+		CSX64_TARGET_AVX2 static bool name(void *res, const void *a, u64 bytes) \
+		{ \
+			V x[2]; \
+			for (u64 i = 0; i < bytes; i += 32) \
+			{ \
+				x[i / 32] = load(reinterpret_cast<const T*>(static_cast<const char*>(a) + i)); \
+				/* negative elements are an error - leave those to the delegate */ \
+				int neg = movemask(cmp(x[i / 32], zero(), _CMP_LT_OQ)); \
+				if (bytes - i < 32) neg &= lanes; \
+				if (neg != 0) return false; \
+			} \
+			for (u64 i = 0; i < bytes; i += 32) store(reinterpret_cast<T*>(static_cast<char*>(res) + i), sqrt(x[i / 32])); \
+			return true; \
+		}
+
+	CSX64_AVX2_SQRT(AVX2_FSQRT_PS, float, __m256, _mm256_load_ps, _mm256_store_ps, _mm256_setzero_ps, _mm256_cmp_ps, _mm256_sqrt_ps, _mm256_movemask_ps, 0xf)
+	CSX64_AVX2_SQRT(AVX2_FSQRT_PD, double, __m256d, _mm256_load_pd, _mm256_store_pd, _mm256_setzero_pd, _mm256_cmp_pd, _mm256_sqrt_pd, _mm256_movemask_pd, 0x3)
+	#undef CSX64_AVX2_SQRT
+
+	static void AddAVX2Kernels(VPUKernelTable &k)
+	{
+		k.FADD[2] = AVX2_FADD_PS; k.FADD[3] = AVX2_FADD_PD;
+		k.FSUB[2] = AVX2_FSUB_PS; k.FSUB[3] = AVX2_FSUB_PD;
+		k.FMUL[2] = AVX2_FMUL_PS; k.FMUL[3] = AVX2_FMUL_PD;
+		k.FDIV[2] = AVX2_FDIV_PS; k.FDIV[3] = AVX2_FDIV_PD;
+		k.FMIN[2] = AVX2_FMIN_PS; k.FMIN[3] = AVX2_FMIN_PD;
+		k.FMAX[2] = AVX2_FMAX_PS; k.FMAX[3] = AVX2_FMAX_PD;
+		k.FADDSUB[2] = AVX2_FADDSUB_PS; k.FADDSUB[3] = AVX2_FADDSUB_PD;
+
+		for (int i = 0; i < 4; ++i)
+		{
+			k.AND[i] = AVX2_AND;
+			k.OR[i] = AVX2_OR;
+			k.XOR[i] = AVX2_XOR;
+			k.ANDN[i] = AVX2_ANDN;
+		}
+
+		k.ADD[0] = AVX2_ADD_8; k.ADD[1] = AVX2_ADD_16; k.ADD[2] = AVX2_ADD_32; k.ADD[3] = AVX2_ADD_64;
+		k.SUB[0] = AVX2_SUB_8; k.SUB[1] = AVX2_SUB_16; k.SUB[2] = AVX2_SUB_32; k.SUB[3] = AVX2_SUB_64;
+		k.ADDS[0] = AVX2_ADDS_8; k.ADDS[1] = AVX2_ADDS_16;
+		k.ADDUS[0] = AVX2_ADDUS_8; k.ADDUS[1] = AVX2_ADDUS_16;
+		k.SUBUS[0] = AVX2_SUBUS_8; k.SUBUS[1] = AVX2_SUBUS_16;
+		k.MULL[1] = AVX2_MULL_16; k.MULL[2] = AVX2_MULL_32;
+		// (SUBS stays portable - the delegate doesn't saturate when subtracting the minimum value, unlike vpsubs)
+
+		k.UMIN[0] = AVX2_UMIN_8; k.UMIN[1] = AVX2_UMIN_16; k.UMIN[2] = AVX2_UMIN_32;
+		k.SMIN[0] = AVX2_SMIN_8; k.SMIN[1] = AVX2_SMIN_16; k.SMIN[2] = AVX2_SMIN_32;
+		k.UMAX[0] = AVX2_UMAX_8; k.UMAX[1] = AVX2_UMAX_16; k.UMAX[2] = AVX2_UMAX_32;
+		k.SMAX[0] = AVX2_SMAX_8; k.SMAX[1] = AVX2_SMAX_16; k.SMAX[2] = AVX2_SMAX_32;
+		k.AVG[0] = AVX2_AVG_8; k.AVG[1] = AVX2_AVG_16;
+
+		k.FSQRT[2] = AVX2_FSQRT_PS; k.FSQRT[3] = AVX2_FSQRT_PD;
+	}
+
+	#endif
+
+	// -- selection -- //
+
+	static VPUKernelTable SelectVPUKernels()
+	{
+		VPUKernelTable k = PortableVPUKernels();
+
+		#if CSX64_VPU_AVX2
+		if (HostHasAVX2()) AddAVX2Kernels(k);
+		#endif
+
+		return k;
+	}
+
+	const VPUKernelTable Computer::VPUKernels = SelectVPUKernels();
+}
@@ -0,0 +1,281 @@
+#include "../include/Computer.h"
+
+// this file implements the memory backend (see Computer::ReservedMemory).
+// with reserved memory, the memory array is placed in its own virtual memory mapping.
+// the mapping reserves (but doesn't commit) room for the array to grow several times over, so sys_brk usually grows and shrinks it in place.
+// without reserved memory (non-posix hosts), the memory array is a plain heap allocation.
+// snapshots (see ComputerSnapshot) keep memory in an anonymous file that forks map copy-on-write (or a plain copy without reserved memory).
+// mapped executables (see Executable::map) likewise keep their content in an anonymous file that Initialize maps copy-on-write.
+
+#if CSX64_RESERVED_MEMORY
+
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <string>
+#include <fstream>
+
+namespace CSX64
+{
+	// the host page size (cached so it only needs to be queried once)
+	static const std::size_t PageSize = (std::size_t)sysconf(_SC_PAGESIZE);
+
+	// the address space reserved for a memory array is a few times its size (within these bounds and max memory).
+	// it's kept well below what max memory allows (often effectively unlimited) so thousands of computers (e.g. --batch) fit in the host's address space.
+	// growing past the reservation falls back to allocating a new (proportionally larger) array and copying, so the copies are amortized.
+	static constexpr u64 MinReserve = (u64)256 * 1024 * 1024;
+	static constexpr u64 MaxReserve = (u64)4 * 1024 * 1024 * 1024;
+	static constexpr u64 ReserveFactor = 4;
+
+	// rounds size up to a multiple of the page size
+	static u64 PageRound(u64 size) { return (size + PageSize - 1) / PageSize * PageSize; }
+
+	// gets the reservation for a memory array of size bytes (never less than size)
+	static u64 ReserveSize(u64 size, u64 max_mem_size)
+	{
+		const u64 want = size > MaxReserve / ReserveFactor ? MaxReserve : std::max(MinReserve, size * ReserveFactor);
+		return PageRound(std::max(size, std::min(max_mem_size, want)));
+	}
+
+	void *Computer::AllocateMemory(u64 size, u64 &cap, u64 &reserve)
+	{
+		// calling with 0 yields nullptr (same as aligned_malloc)
+		if (size == 0) return nullptr;
+
+		// reserve room to grow as inaccessible, then commit the requested size.
+		// the reservation is never backed by physical memory or swap until it's committed and touched.
+		cap = PageRound(size);
+		reserve = ReserveSize(size, max_mem_size);
+		char *base = static_cast<char*>(mmap(nullptr, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+		if (base == MAP_FAILED) return nullptr;
+
+		if (mprotect(base, cap, PROT_READ | PROT_WRITE) != 0)
+		{
+			munmap(base, reserve);
+			return nullptr;
+		}
+
+		return base;
+	}
+	void Computer::FreeMemory(void *ptr, u64 reserve)
+	{
+		if (ptr) munmap(ptr, reserve);
+	}
+	bool Computer::ResizeMemory(u64 size)
+	{
+		if (size > mem_reserve) return false;
+
+		char *const base = static_cast<char*>(mem);
+		const u64 cap = PageRound(size);
+
+		// growing commits the next pages of the reservation (they start zeroed)
+		if (cap > mem_cap)
+		{
+			if (mprotect(base + mem_cap, cap - mem_cap, PROT_READ | PROT_WRITE) != 0) return false;
+		}
+		// shrinking hands the freed pages back to the host and makes them inaccessible again.
+		// they're replaced by fresh anonymous pages (rather than just discarded) so that pages from a snapshot (see MapMemory) come back zeroed like the rest.
+		else if (cap < mem_cap)
+		{
+			if (mmap(base + cap, mem_cap - cap, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+			{
+				madvise(base + cap, mem_cap - cap, MADV_DONTNEED);
+				mprotect(base + cap, mem_cap - cap, PROT_NONE);
+			}
+		}
+
+		mem_cap = cap;
+		return true;
+	}
+
+	// creates an anonymous (unnamed) file for holding memory contents (name is only for debugging). returns -1 on failure.
+	static int CreateMemoryFile(const char *name)
+	{
+		#if defined(__linux__)
+		return memfd_create(name, MFD_CLOEXEC);
+		#else
+		// no memfd - create a uniquely-named shared memory object and unlink it right away
+		static std::atomic<u64> counter(0);
+		std::string unique = "/" + std::string(name) + "-" + std::to_string(getpid()) + "-" + std::to_string(counter++);
+		int fd = shm_open(unique.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+		if (fd >= 0) shm_unlink(unique.c_str());
+		return fd;
+		#endif
+	}
+
+	// allocates a memory array of size bytes (as AllocateMemory) whose first len bytes (whole pages) are a private (copy-on-write) mapping of a file.
+	// the rest of the capacity is ordinary anonymous memory. returns null on failure.
+	static char *MapFileMemory(int fd, u64 len, u64 size, u64 max_mem_size, u64 &cap, u64 &reserve)
+	{
+		cap = PageRound(size);
+		reserve = ReserveSize(size, max_mem_size);
+		char *arr = static_cast<char*>(mmap(nullptr, reserve, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0));
+		if (arr == MAP_FAILED) return nullptr;
+
+		len = std::min(len, cap);
+		if ((len != 0 && mmap(arr, len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) ||
+			(cap > len && mprotect(arr + len, cap - len, PROT_READ | PROT_WRITE) != 0))
+		{
+			munmap(arr, reserve);
+			return nullptr;
+		}
+
+		return arr;
+	}
+
+	ComputerSnapshot::~ComputerSnapshot()
+	{
+		if (mem_fd >= 0) close(mem_fd);
+	}
+
+	bool Computer::CaptureMemory(ComputerSnapshot &snap) const
+	{
+		int fd = CreateMemoryFile("csx64-snapshot");
+		if (fd < 0) return false;
+
+		// size the file (it starts out as one big hole that reads as zero)
+		if (ftruncate(fd, (off_t)PageRound(mem_size)) != 0) { close(fd); return false; }
+
+		// write only the pages that aren't entirely zero (memory that was never touched doesn't take any space)
+		const char *const base = static_cast<const char*>(mem);
+		for (u64 pos = 0; pos < mem_size; pos += PageSize)
+		{
+			const std::size_t len = (std::size_t)std::min<u64>(PageSize, mem_size - pos);
+			if (AllZero(base + pos, len)) continue;
+
+			for (std::size_t done = 0; done < len; )
+			{
+				ssize_t n = pwrite(fd, base + pos + done, len - done, (off_t)(pos + done));
+				if (n <= 0) { close(fd); return false; }
+				done += (std::size_t)n;
+			}
+		}
+
+		snap.mem_fd = fd;
+		return true;
+	}
+	bool Computer::MapMemory(const ComputerSnapshot &snap)
+	{
+		// the snapshot's file covers the whole capacity
+		u64 cap, reserve;
+		char *ptr = MapFileMemory(snap.mem_fd, PageRound(snap.mem_size), snap.mem_size, snap.max_mem_size, cap, reserve);
+		if (!ptr) return false;
+
+		FreeMemory(mem, mem_reserve);
+
+		mem = ptr;
+		mem_size = snap.mem_size;
+		mem_cap = cap;
+		mem_reserve = reserve;
+
+		return true;
+	}
+
+	Executable::Image::~Image()
+	{
+		if (data) munmap(const_cast<u8*>(data), size);
+		if (fd >= 0) close(fd);
+	}
+
+	void Executable::map(const std::string &path)
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		if (!file)
+		{
+			clear(); // if we throw an exception we must set to the empty state first
+			throw FileOpenError("Failed to open file for loading Executable");
+		}
+
+		// get the file size and seek back to the beginning
+		const u64 file_size = file.tellg();
+		file.seekg(0);
+
+		// if we throw an exception we must leave the exe in the empty state
+		try
+		{
+			load_header(file, file_size);
+
+			_content.clear();
+			_image.reset();
+			if (content_size() == 0) return;
+
+			// create the (page padded) image file and read the content straight into a shared mapping of it
+			std::shared_ptr<Image> image = std::make_shared<Image>();
+			image->size = PageRound(content_size());
+			if ((image->fd = CreateMemoryFile("csx64-image")) < 0 || ftruncate(image->fd, (off_t)image->size) != 0) throw MemoryAllocException("failed to create executable image");
+
+			void *data = mmap(nullptr, image->size, PROT_READ | PROT_WRITE, MAP_SHARED, image->fd, 0);
+			if (data == MAP_FAILED) throw MemoryAllocException("failed to map executable image");
+			image->data = static_cast<const u8*>(data);
+
+			if (!file.read(static_cast<char*>(data), content_size()) || (std::size_t)file.gcount() != content_size())
+				throw FormatError("Executable file was corrupted");
+
+			// the image is never modified after this (instances map it copy-on-write)
+			mprotect(data, image->size, PROT_READ);
+			_image = std::move(image);
+		}
+		catch (...) { clear(); throw; }
+	}
+
+	bool Computer::MapExecutable(const Executable &exe, u64 size)
+	{
+		if (exe.image_fd() < 0) return false;
+
+		// the image only covers the content - the rest (bss and stack) starts zeroed
+		u64 cap, reserve;
+		char *ptr = MapFileMemory(exe.image_fd(), exe._image->size, size, max_mem_size, cap, reserve);
+		if (!ptr) return false;
+
+		FreeMemory(mem, mem_reserve);
+
+		mem = ptr;
+		mem_size = size;
+		mem_cap = cap;
+		mem_reserve = reserve;
+
+		return true;
+	}
+}
+
+#else
+
+namespace CSX64
+{
+	// without reserved memory, the memory array is a plain 64-byte aligned heap allocation
+
+	void *Computer::AllocateMemory(u64 size, u64 &cap, u64 &reserve)
+	{
+		cap = reserve = size;
+		return CSX64::aligned_malloc(size, MemAlignment);
+	}
+	void Computer::FreeMemory(void *ptr, u64) { CSX64::aligned_free(ptr); }
+	// a heap array can't grow in place - it keeps its capacity when shrinking
+	bool Computer::ResizeMemory(u64 size) { return size <= mem_cap; }
+
+	ComputerSnapshot::~ComputerSnapshot() {}
+
+	bool Computer::CaptureMemory(ComputerSnapshot &snap) const
+	{
+		snap.mem_content.assign(static_cast<const u8*>(mem), static_cast<const u8*>(mem) + mem_size);
+		return true;
+	}
+	bool Computer::MapMemory(const ComputerSnapshot &snap)
+	{
+		if (!this->realloc(snap.mem_size, false)) return false;
+
+		std::memcpy(mem, snap.mem_content.data(), snap.mem_size);
+		return true;
+	}
+
+	Executable::Image::~Image() {}
+
+	// without virtual memory there's nothing to map, so just load it
+	void Executable::map(const std::string &path) { load(path); }
+
+	bool Computer::MapExecutable(const Executable&, u64) { return false; }
+}
+
+#endif
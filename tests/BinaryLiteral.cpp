@@ -0,0 +1,234 @@
+// tests of binary literal deduplication (see BinaryLiteralCollection).
+// the indexed collection must behave exactly like the simple linear search it replaced (kept here as the reference):
+// the same index returned by every add, and the same top level literals and literals (compared through write_to).
+// random sequences of overlapping literals are added over many seeds, including after a write_to/read_from round trip.
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <cstring>
+
+#include "../include/Assembly.h"
+#include "../include/Utility.h"
+
+using namespace CSX64;
+
+namespace
+{
+	constexpr std::size_t npos = ~(std::size_t)0;
+
+	// the linear search implementation of BinaryLiteralCollection
+	class Reference
+	{
+		struct Literal
+		{
+			std::size_t top_level_index, start, length;
+			bool operator==(const Literal &other) const noexcept { return top_level_index == other.top_level_index && start == other.start && length == other.length; }
+		};
+
+		std::vector<Literal> literals;
+		std::vector<std::vector<u8>> top_level_literals;
+
+		// returns the last index in super where the entire contents of sub can be found (npos if none)
+		static std::size_t find_subregion(const std::vector<u8> &super, const std::vector<u8> &sub)
+		{
+			if (super.size() < sub.size()) return npos;
+			for (std::size_t start = super.size() - sub.size(); start != npos; --start)
+				if (std::memcmp(super.data() + start, sub.data(), sub.size()) == 0) return start;
+			return npos;
+		}
+
+		std::size_t insert(const Literal &info)
+		{
+			for (std::size_t i = 0; i < literals.size(); ++i) if (literals[i] == info) return i;
+			literals.push_back(info);
+			return literals.size() - 1;
+		}
+
+	public:
+
+		std::size_t add(std::vector<u8> value)
+		{
+			// share the first top level literal containing value
+			for (std::size_t i = 0; i < top_level_literals.size(); ++i)
+				if (std::size_t start = find_subregion(top_level_literals[i], value); start != npos) return insert({ i, start, value.size() });
+
+			// otherwise replace the first top level literal that value contains, then remove all the others it contains
+			for (std::size_t i = 0; i < top_level_literals.size(); ++i)
+			{
+				std::size_t start = find_subregion(value, top_level_literals[i]);
+				if (start == npos) continue;
+
+				top_level_literals[i] = std::move(value);
+				for (Literal &lit : literals) if (lit.top_level_index == i) lit.start += start;
+
+				for (std::size_t j = 0; j < top_level_literals.size(); )
+				{
+					if (j == i || (start = find_subregion(top_level_literals[i], top_level_literals[j])) == npos) { ++j; continue; }
+
+					top_level_literals[j] = std::move(top_level_literals.back());
+					top_level_literals.pop_back();
+					if (i == top_level_literals.size()) i = j;
+
+					for (Literal &lit : literals)
+					{
+						if (lit.top_level_index == j) { lit.top_level_index = i; lit.start += start; }
+						else if (lit.top_level_index == top_level_literals.size()) lit.top_level_index = j;
+					}
+				}
+
+				return insert({ i, 0, top_level_literals[i].size() });
+			}
+
+			// otherwise it's a new top level literal
+			top_level_literals.push_back(std::move(value));
+			return insert({ top_level_literals.size() - 1, 0, top_level_literals.back().size() });
+		}
+
+		// the same format as BinaryLiteralCollection::write_to
+		void write_to(std::ostream &writer) const
+		{
+			BinWrite<u64>(writer, top_level_literals.size());
+			for (const auto &i : top_level_literals)
+			{
+				BinWrite<u64>(writer, i.size());
+				BinWrite(writer, (const char*)i.data(), i.size());
+			}
+
+			BinWrite<u64>(writer, literals.size());
+			for (const auto &i : literals)
+			{
+				BinWrite(writer, i.top_level_index);
+				BinWrite(writer, i.start);
+				BinWrite(writer, i.length);
+			}
+		}
+	};
+
+	std::string Serialize(const BinaryLiteralCollection &c)
+	{
+		std::ostringstream out;
+		c.write_to(out);
+		return out.str();
+	}
+	std::string Serialize(const Reference &r)
+	{
+		std::ostringstream out;
+		r.write_to(out);
+		return out.str();
+	}
+
+	// makes a random literal - short strings over a small alphabet, pieces of earlier literals, and joins of them (so literals contain each other a lot)
+	std::vector<u8> MakeLiteral(std::mt19937_64 &rng, const std::vector<std::vector<u8>> &history, u8 alphabet)
+	{
+		auto random = [&](std::size_t max_len)
+		{
+			std::vector<u8> res(rng() % (max_len + 1));
+			for (u8 &ch : res) ch = (u8)(rng() % alphabet);
+			return res;
+		};
+		auto piece = [&]
+		{
+			const std::vector<u8> &src = history[rng() % history.size()];
+			const std::size_t start = rng() % (src.size() + 1);
+			const std::size_t len = rng() % (src.size() - start + 1);
+			return std::vector<u8>(src.begin() + start, src.begin() + start + len);
+		};
+
+		if (history.empty()) return random(8);
+		switch (rng() % 5)
+		{
+		case 0: return random(8);
+		case 1: return piece();
+		case 2: return history[rng() % history.size()];
+		default:
+		{
+			// a few pieces joined together (possibly with a little random filler between them), kept short so the literals don't grow without bound
+			std::vector<u8> res;
+			for (u64 n = 2 + rng() % 3; n > 0 && res.size() < 48; --n)
+			{
+				std::vector<u8> p = rng() % 2 ? piece() : history[rng() % history.size()];
+				res.insert(res.end(), p.begin(), p.end());
+				if (rng() % 3 == 0) { p = random(2); res.insert(res.end(), p.begin(), p.end()); }
+			}
+			return res;
+		}
+		}
+	}
+
+	// adds the same literal to the collection and the reference - returns false if they disagree
+	bool Add(BinaryLiteralCollection &c, Reference &r, const std::vector<u8> &value, const std::string &what)
+	{
+		const std::size_t expected = r.add(value);
+		const std::size_t actual = c.add(std::vector<u8>(value));
+
+		if (actual != expected) { std::cerr << what << ": add returned " << actual << " instead of " << expected << '\n'; return false; }
+		if (Serialize(c) != Serialize(r)) { std::cerr << what << ": contents differ from the reference\n"; return false; }
+		return true;
+	}
+
+	bool Check(u64 seed)
+	{
+		std::mt19937_64 rng(seed);
+		const u8 alphabet = (u8)(2 + seed % 3);
+		const std::string what = "seed " + std::to_string(seed);
+
+		BinaryLiteralCollection c;
+		Reference r;
+		std::vector<std::vector<u8>> history;
+
+		for (int i = 0; i < 150; ++i)
+		{
+			history.push_back(MakeLiteral(rng, history, alphabet));
+			if (!Add(c, r, history.back(), what + " add " + std::to_string(i))) return false;
+		}
+
+		// round trip through write_to/read_from - the loaded collection must have the same contents and keep agreeing with the reference as more are added
+		const std::string saved = Serialize(c);
+		BinaryLiteralCollection loaded;
+		loaded.add({ 1, 2, 3 }); // read_from replaces the contents
+		std::istringstream in(saved);
+		if (!loaded.read_from(in)) { std::cerr << what << ": read_from failed\n"; return false; }
+		if (Serialize(loaded) != saved) { std::cerr << what << ": loaded contents differ\n"; return false; }
+
+		for (int i = 0; i < 50; ++i)
+		{
+			history.push_back(MakeLiteral(rng, history, alphabet));
+			if (!Add(loaded, r, history.back(), what + " add " + std::to_string(i) + " after loading")) return false;
+		}
+
+		return true;
+	}
+
+	// read_from must reject literals that don't fit in their top level literal
+	bool CheckCorrupt()
+	{
+		std::ostringstream out;
+		BinWrite<u64>(out, 1);
+		BinWrite<u64>(out, 3);
+		BinWrite(out, "abc", 3);
+		BinWrite<u64>(out, 1);
+		BinWrite<std::size_t>(out, 0);
+		BinWrite<std::size_t>(out, 2);
+		BinWrite<std::size_t>(out, 2);
+
+		BinaryLiteralCollection c;
+		std::istringstream in(out.str());
+		if (c.read_from(in)) { std::cerr << "read_from accepted a literal past the end of its top level literal\n"; return false; }
+		return true;
+	}
+}
+
+int main()
+{
+	int failures = 0;
+
+	for (u64 seed = 0; seed < 500; ++seed) if (!Check(seed)) ++failures;
+	if (!CheckCorrupt()) ++failures;
+
+	if (failures) { std::cerr << failures << " failed\n"; return 1; }
+	std::cout << "all binary literals agree\n";
+	return 0;
+}
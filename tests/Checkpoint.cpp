@@ -0,0 +1,363 @@
+// tests of the binary checkpoint format (see Computer::SaveCheckpoint and Computer::LoadCheckpoint).
+// a program is stopped part way through and saved (with and without compression). loading the checkpoint must restore the same registers, flags, and memory,
+// and the restored computer must finish with the same state as one that was never interrupted.
+// corrupted checkpoints (bad barriers, bad memory runs, truncation) must throw FormatError and leave the computer that was loading them unchanged.
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <utility>
+
+#include "../include/Computer.h"
+#include "../include/Assembly.h"
+#include "../include/csx_exceptions.h"
+
+using namespace CSX64;
+
+namespace
+{
+	// the _start file - calls main and exits with its return value
+	const char *const StartSource = R"(
+extern _start
+segment .text
+    call _start
+    mov ebx, eax
+    mov eax, sys_exit
+    syscall
+)";
+
+	// fills every other page of a buffer (so compression has several runs to write) and returns a checksum
+	const char *const MainSource = R"(
+global main
+segment .text
+main:
+    mov ecx, 200
+    xor eax, eax
+.top:
+    add eax, ecx
+    mov rdx, rcx
+    and edx, 15
+    shl rdx, 13
+    mov qword ptr [buf + rdx], rax
+    add qword ptr [buf + rdx + 8], rcx
+    loop .top
+    and eax, 255
+    ret
+segment .bss
+buf: resb 16 * 8192
+)";
+
+	// the number of operations to run before saving a checkpoint (part way through the loop)
+	const u64 SaveTicks = 333;
+
+	// assembles and links the program. returns true on success.
+	bool Build(Executable &exe)
+	{
+		std::list<std::pair<std::string, ObjectFile>> objs;
+		for (const char *code : { StartSource, MainSource })
+		{
+			std::istringstream in(code);
+			objs.emplace_back(objs.empty() ? "_start" : "main", ObjectFile());
+			AssembleResult res = Assemble(in, objs.back().second);
+			if (res.Error != AssembleError::None) { std::cerr << "assemble error: " << res.ErrorMsg << '\n'; return false; }
+		}
+
+		LinkResult res = Link(exe, objs);
+		if (res.Error != LinkError::None) { std::cerr << "link error: " << res.ErrorMsg << '\n'; return false; }
+		return true;
+	}
+
+	// the observable machine state
+	struct State
+	{
+		u64 regs[16];
+		u64 rflags, rip;
+		bool running;
+		ErrorCode error;
+		int ret;
+		std::vector<u8> mem;
+	};
+
+	State Capture(Computer &c)
+	{
+		const Computer &cc = c;
+		State s{ { cc.RAX(), cc.RBX(), cc.RCX(), cc.RDX(), cc.RSI(), cc.RDI(), cc.RBP(), cc.RSP(),
+			cc.R8(), cc.R9(), cc.R10(), cc.R11(), cc.R12(), cc.R13(), cc.R14(), cc.R15() },
+			cc.RFLAGS(), cc.RIP(), c.Running(), c.Error(), c.ReturnValue(), {} };
+
+		s.mem.resize(c.MemorySize());
+		for (u64 i = 0; i < s.mem.size(); ++i) c.GetMem(i, s.mem[i]);
+
+		return s;
+	}
+
+	// compares two states - returns true if they match
+	bool Compare(const State &ref, const State &s, const std::string &what)
+	{
+		bool ok = true;
+		auto fail = [&](const std::string &msg) { std::cerr << what << ": " << msg << '\n'; ok = false; };
+
+		for (int i = 0; i < 16; ++i)
+			if (ref.regs[i] != s.regs[i]) fail("register " + std::to_string(i) + ": " + std::to_string(ref.regs[i]) + " vs " + std::to_string(s.regs[i]));
+		if (ref.rflags != s.rflags) fail("RFLAGS: " + std::to_string(ref.rflags) + " vs " + std::to_string(s.rflags));
+		if (ref.rip != s.rip) fail("RIP: " + std::to_string(ref.rip) + " vs " + std::to_string(s.rip));
+		if (ref.running != s.running) fail("running: " + std::to_string(ref.running) + " vs " + std::to_string(s.running));
+		if (ref.error != s.error) fail("error: " + std::to_string((int)ref.error) + " vs " + std::to_string((int)s.error));
+		if (ref.ret != s.ret) fail("return value: " + std::to_string(ref.ret) + " vs " + std::to_string(s.ret));
+		if (ref.mem.size() != s.mem.size()) fail("memory size: " + std::to_string(ref.mem.size()) + " vs " + std::to_string(s.mem.size()));
+		else for (std::size_t i = 0; i < ref.mem.size(); ++i)
+			if (ref.mem[i] != s.mem[i]) { fail("memory at " + std::to_string(i)); break; }
+
+		return ok;
+	}
+
+	void Finish(Computer &c)
+	{
+		for (int i = 0; c.Running() && i < 1000; ++i) c.Tick(1024 * 1024);
+	}
+
+	// Initialize randomizes some registers, so separate runs of the program can only be compared by how they finish
+	bool CompareFinished(const State &ref, const State &s, const std::string &what)
+	{
+		bool ok = true;
+		auto fail = [&](const std::string &msg) { std::cerr << what << ": " << msg << '\n'; ok = false; };
+
+		if (s.running) fail("still running");
+		if (ref.error != s.error) fail("error: " + std::to_string((int)ref.error) + " vs " + std::to_string((int)s.error));
+		if (ref.ret != s.ret) fail("return value: " + std::to_string(ref.ret) + " vs " + std::to_string(s.ret));
+
+		return ok;
+	}
+
+	// runs the program part way through (the point where checkpoints are saved)
+	void Start(Computer &c, const Executable &exe, bool lazy)
+	{
+		c.Initialize(exe, {});
+		c.LazyFlags(lazy);
+		c.Tick(SaveTicks);
+	}
+
+	std::string Save(const Computer &c, bool compress)
+	{
+		std::ostringstream out;
+		c.SaveCheckpoint(out, compress);
+		return out.str();
+	}
+
+	// -- round trips -- //
+
+	bool RoundTrip(const Executable &exe, bool lazy, bool compress)
+	{
+		const std::string what = std::string("round trip") + (lazy ? " (lazy)" : "") + (compress ? " (compressed)" : "");
+
+		Computer ref;
+		Start(ref, exe, lazy);
+		std::string checkpoint = Save(ref, compress);
+		if (!ref.Running()) { std::cerr << what << ": program finished before the checkpoint\n"; return false; }
+
+		// load into a computer that was running something else (execution settings aren't part of the checkpoint, so they're set to match)
+		Computer c;
+		c.Initialize(exe, {});
+		c.Tick(SaveTicks / 2);
+		c.LazyFlags(lazy);
+		try
+		{
+			std::istringstream in(checkpoint);
+			c.LoadCheckpoint(in);
+		}
+		catch (const std::exception &ex) { std::cerr << what << ": failed to load: " << ex.what() << '\n'; return false; }
+
+		bool ok = Compare(Capture(ref), Capture(c), what + " (loaded)");
+
+		// both must finish in the same state, and the same way as an uninterrupted run
+		Computer fresh;
+		fresh.Initialize(exe, {});
+		Finish(fresh);
+		Finish(ref);
+		Finish(c);
+		State expected = Capture(fresh), saved = Capture(ref);
+		if (expected.running || expected.error != ErrorCode::None) { std::cerr << what << ": program failed\n"; return false; }
+		ok &= CompareFinished(expected, saved, what + " (saved, finished)");
+		ok &= Compare(saved, Capture(c), what + " (loaded, finished)");
+
+		return ok;
+	}
+
+	// -- corruption -- //
+
+	// the offsets of the fields that are corrupted (see SaveCheckpoint) - header, version, long double size, then memory sizes and barriers
+	const std::size_t MemSizePos = 8 + 8 + 1;
+	const std::size_t MinMemSizePos = MemSizePos + 8;
+	const std::size_t MaxMemSizePos = MemSizePos + 16;
+	const std::size_t ExeBarrierPos = MemSizePos + 24;
+	const std::size_t ReadonlyBarrierPos = MemSizePos + 32;
+	const std::size_t StackBarrierPos = MemSizePos + 40;
+
+	u64 ReadU64(const std::string &str, std::size_t pos)
+	{
+		std::istringstream in(str.substr(pos, 8));
+		u64 val = 0;
+		BinRead(in, val);
+		return val;
+	}
+	std::string WriteU64(std::string str, std::size_t pos, u64 val)
+	{
+		std::ostringstream out;
+		BinWrite(out, val);
+		return str.replace(pos, 8, out.str());
+	}
+
+	// a memory run (see WriteRun in Checkpoint.cpp) - the content is a recognizable pattern
+	void Run(std::ostream &out, u64 pos, u64 len)
+	{
+		BinWrite(out, pos);
+		BinWrite(out, len);
+		for (u64 i = 0; i < len; ++i) BinWrite(out, (u8)(i * 7 + 1));
+	}
+
+	// attempts to load a corrupted checkpoint into a computer part way through the program - it must throw FormatError and leave the computer unchanged
+	bool ExpectFormatError(const Executable &exe, const std::string &checkpoint, const std::string &what)
+	{
+		Computer c;
+		c.Initialize(exe, {});
+		c.Tick(SaveTicks / 2);
+		State before = Capture(c);
+
+		bool ok = true;
+		try
+		{
+			std::istringstream in(checkpoint);
+			c.LoadCheckpoint(in);
+			std::cerr << what << ": loaded without error\n";
+			ok = false;
+		}
+		catch (const FormatError&) {}
+		catch (const std::exception &ex) { std::cerr << what << ": threw the wrong exception: " << ex.what() << '\n'; ok = false; }
+
+		ok &= Compare(before, Capture(c), what);
+
+		// the computer must still be usable
+		Computer fresh;
+		fresh.Initialize(exe, {});
+		Finish(fresh);
+		Finish(c);
+		ok &= CompareFinished(Capture(fresh), Capture(c), what + " (finished)");
+
+		return ok;
+	}
+
+	int Corruption(const Executable &exe)
+	{
+		int failures = 0;
+		auto expect = [&](const std::string &checkpoint, const std::string &what) { if (!ExpectFormatError(exe, checkpoint, what)) ++failures; };
+
+		Computer c;
+		Start(c, exe, false);
+		const std::string full = Save(c, false);
+		const std::string compressed = Save(c, true);
+
+		const u64 mem_size = ReadU64(full, MemSizePos);
+		const u64 exe_barrier = ReadU64(full, ExeBarrierPos);
+		const u64 readonly_barrier = ReadU64(full, ReadonlyBarrierPos);
+		const u64 stack_barrier = ReadU64(full, StackBarrierPos);
+
+		// -- barriers and sizes -- //
+
+		expect(WriteU64(full, ExeBarrierPos, readonly_barrier + 1), "exe barrier past readonly barrier");
+		expect(WriteU64(full, ReadonlyBarrierPos, exe_barrier - 1), "readonly barrier before exe barrier");
+		expect(WriteU64(full, ReadonlyBarrierPos, stack_barrier + 1), "readonly barrier past stack barrier");
+		expect(WriteU64(full, StackBarrierPos, mem_size + 1), "stack barrier past memory");
+		expect(WriteU64(full, MinMemSizePos, mem_size + 1), "memory size below min");
+		expect(WriteU64(full, MaxMemSizePos, mem_size - 1), "memory size above max");
+
+		// -- memory runs -- //
+
+		// everything before the memory runs is the same with or without compression (the uncompressed memory is one run and the terminator)
+		const std::size_t runs_pos = full.size() - (std::size_t)mem_size - 32;
+		const std::string prefix = full.substr(0, runs_pos);
+		if (compressed.compare(0, runs_pos, prefix) != 0) { std::cerr << "compressed checkpoint has a different prefix\n"; ++failures; }
+		if (compressed.size() >= full.size()) { std::cerr << "compression didn't shrink the checkpoint\n"; ++failures; }
+
+		// a well-formed set of runs must load (so the failures below are due to the runs themselves)
+		{
+			std::ostringstream out(prefix, std::ios::ate);
+			Run(out, 0, 4096);
+			Run(out, 8192, 100);
+			Run(out, mem_size - 16, 16);
+			Run(out, 0, 0);
+
+			Computer d;
+			std::istringstream in(out.str());
+			try { d.LoadCheckpoint(in); }
+			catch (const std::exception &ex) { std::cerr << "well-formed runs failed to load: " << ex.what() << '\n'; ++failures; }
+			u8 val;
+			if (d.MemorySize() != mem_size || !d.GetMem(8192 + 1, val) || val != 8 || !d.GetMem(4096, val) || val != 0) { std::cerr << "well-formed runs loaded the wrong memory\n"; ++failures; }
+		}
+		{
+			std::ostringstream out(prefix, std::ios::ate);
+			Run(out, 8192, 4096);
+			Run(out, 0, 4096);
+			Run(out, 0, 0);
+			expect(out.str(), "runs out of order");
+		}
+		{
+			std::ostringstream out(prefix, std::ios::ate);
+			Run(out, 0, 8192);
+			Run(out, 4096, 8192);
+			Run(out, 0, 0);
+			expect(out.str(), "overlapping runs");
+		}
+		{
+			std::ostringstream out(prefix, std::ios::ate);
+			Run(out, mem_size - 8, 16);
+			Run(out, 0, 0);
+			expect(out.str(), "run past the end of memory");
+		}
+		{
+			std::ostringstream out(prefix, std::ios::ate);
+			Run(out, mem_size + 4096, 1);
+			Run(out, 0, 0);
+			expect(out.str(), "run starting past the end of memory");
+		}
+		{
+			std::ostringstream out(prefix, std::ios::ate);
+			BinWrite(out, (u64)4096);
+			BinWrite(out, ~(u64)0 - 100);
+			expect(out.str(), "run with a huge length");
+		}
+
+		// -- truncation -- //
+
+		for (const std::string *checkpoint : { &full, &compressed })
+		{
+			const char *kind = checkpoint == &full ? " (uncompressed)" : " (compressed)";
+			for (std::size_t len : { (std::size_t)0, (std::size_t)4, MemSizePos, StackBarrierPos + 4, runs_pos, runs_pos + 8, runs_pos + 16, runs_pos + 1000, checkpoint->size() - 16, checkpoint->size() - 1 })
+				expect(checkpoint->substr(0, len), "truncated to " + std::to_string(len) + " bytes" + kind);
+		}
+
+		return failures;
+	}
+}
+
+int main()
+{
+	// the syscall codes used by the programs (see AddPredefines in driver.cpp)
+	DefineSymbol("sys_exit", (u64)SyscallCode::sys_exit);
+
+	Executable exe;
+	if (!Build(exe)) return 1;
+
+	int failures = 0;
+
+	for (bool lazy : { false, true })
+		for (bool compress : { false, true })
+			if (!RoundTrip(exe, lazy, compress)) ++failures;
+
+	failures += Corruption(exe);
+
+	if (failures) { std::cerr << failures << " failed\n"; return 1; }
+	std::cout << "all checkpoints agree\n";
+	return 0;
+}
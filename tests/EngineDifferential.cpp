@@ -0,0 +1,552 @@
+// differential tests of the execution engines (see Computer::BlockExecution and Computer::JitCompilation).
+// every program is run by the interpreter, by the basic block engine, and by natively-compiled blocks (with and without lazy flags).
+// all of them must finish with the same registers, flags, memory, error and return value.
+// loops run well past JitThreshold iterations so that the native code is what executes most of the time.
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <list>
+#include <utility>
+#include <iterator>
+#include <algorithm>
+
+#include "../include/Computer.h"
+#include "../include/Assembly.h"
+
+using namespace CSX64;
+
+namespace
+{
+	// the _start file - calls main and exits with its return value
+	const char *const StartSource = R"(
+extern _start
+segment .text
+    call _start
+    mov ebx, eax
+    mov eax, sys_exit
+    syscall
+)";
+
+	// assembles and links a program (source must define a global main). returns true on success.
+	bool Build(const std::string &source, Executable &exe)
+	{
+		std::list<std::pair<std::string, ObjectFile>> objs;
+		for (const std::string &code : { std::string(StartSource), source })
+		{
+			std::istringstream in(code);
+			objs.emplace_back(objs.empty() ? "_start" : "main", ObjectFile());
+			AssembleResult res = Assemble(in, objs.back().second);
+			if (res.Error != AssembleError::None) { std::cerr << "assemble error: " << res.ErrorMsg << '\n' << code << '\n'; return false; }
+		}
+
+		LinkResult res = Link(exe, objs);
+		if (res.Error != LinkError::None) { std::cerr << "link error: " << res.ErrorMsg << '\n'; return false; }
+		return true;
+	}
+
+	enum class Engine { Interpreter, Blocks, Native };
+	const char *const EngineNames[] = { "interpreter", "blocks", "native" };
+
+	// the observable machine state after a program terminates
+	struct State
+	{
+		u64 regs[16];
+		u64 rflags, rip;
+		ErrorCode error;
+		int ret;
+		std::vector<u8> mem;
+	};
+
+	struct Options
+	{
+		u64 stacksize = 64 * 1024;
+		// if nonzero, the computer starts with max memory equal to its initial size (so there's no room reserved to grow in place).
+		// max memory is raised to this afterwards, so sys_brk growth has to move the memory array.
+		u64 grow_max = 0;
+	};
+
+	State Run(const Executable &exe, Engine engine, bool lazy, const Options &opt)
+	{
+		Computer c;
+		if (opt.grow_max) c.MaxMemory(exe.total_size() + opt.stacksize);
+		c.Initialize(exe, {}, opt.stacksize);
+		if (opt.grow_max) c.MaxMemory(opt.grow_max);
+
+		c.BlockExecution(engine != Engine::Interpreter);
+		c.JitCompilation(engine == Engine::Native);
+		c.LazyFlags(lazy);
+
+		for (int i = 0; c.Running() && i < 1000; ++i) c.Tick(1024 * 1024);
+
+		const Computer &cc = c;
+		State s{ { cc.RAX(), cc.RBX(), cc.RCX(), cc.RDX(), cc.RSI(), cc.RDI(), cc.RBP(), cc.RSP(),
+			cc.R8(), cc.R9(), cc.R10(), cc.R11(), cc.R12(), cc.R13(), cc.R14(), cc.R15() },
+			cc.RFLAGS(), cc.RIP(), c.Error(), c.ReturnValue(), {} };
+
+		s.mem.resize(c.MemorySize());
+		for (u64 i = 0; i < s.mem.size(); ++i) c.GetMem(i, s.mem[i]);
+
+		return s;
+	}
+
+	// compares a state against the reference (interpreter) state - returns true if they match
+	bool Compare(const State &ref, const State &s, u64 flag_mask, const char *what)
+	{
+		bool ok = true;
+		auto fail = [&](const std::string &msg) { std::cerr << what << ": " << msg << '\n'; ok = false; };
+
+		for (int i = 0; i < 16; ++i)
+			if (ref.regs[i] != s.regs[i]) fail("register " + std::to_string(i) + ": " + std::to_string(ref.regs[i]) + " vs " + std::to_string(s.regs[i]));
+		if ((ref.rflags & flag_mask) != (s.rflags & flag_mask)) fail("RFLAGS: " + std::to_string(ref.rflags) + " vs " + std::to_string(s.rflags));
+		if (ref.rip != s.rip) fail("RIP: " + std::to_string(ref.rip) + " vs " + std::to_string(s.rip));
+		if (ref.error != s.error) fail("error: " + std::to_string((int)ref.error) + " vs " + std::to_string((int)s.error));
+		if (ref.ret != s.ret) fail("return value: " + std::to_string(ref.ret) + " vs " + std::to_string(s.ret));
+		if (ref.mem.size() != s.mem.size()) fail("memory size: " + std::to_string(ref.mem.size()) + " vs " + std::to_string(s.mem.size()));
+		else for (std::size_t i = 0; i < ref.mem.size(); ++i)
+			if (ref.mem[i] != s.mem[i]) { fail("memory at " + std::to_string(i)); break; }
+
+		return ok;
+	}
+
+	// runs the program on every engine and compares against the interpreter. returns true if they all match.
+	// expected is the error the program should terminate with (checked on the reference run).
+	bool Check(const std::string &name, const std::string &source, ErrorCode expected, const Options &opt = {})
+	{
+		Executable exe;
+		if (!Build(source, exe)) { std::cerr << name << ": failed to build\n"; return false; }
+
+		bool ok = true;
+		for (bool lazy : { false, true })
+		{
+			State ref = Run(exe, Engine::Interpreter, lazy, opt);
+			if (ref.error != expected)
+			{
+				std::cerr << name << ": expected error " << (int)expected << " but got " << (int)ref.error << '\n';
+				ok = false;
+			}
+
+			// AF is undefined after the logic ops and shifts (the interpreter randomizes it), so it's left out
+			const u64 flag_mask = ~(u64)0x10;
+
+			for (Engine engine : { Engine::Blocks, Engine::Native })
+			{
+				if (engine == Engine::Native && !Computer::JitSupported) continue;
+
+				State s = Run(exe, engine, lazy, opt);
+				std::string what = name + " (" + EngineNames[(int)engine] + (lazy ? ", lazy flags)" : ")");
+				if (!Compare(ref, s, flag_mask, what.c_str())) ok = false;
+			}
+		}
+
+		if (!ok) std::cerr << name << " source:\n" << source << '\n';
+		return ok;
+	}
+
+	// -- random alu programs -- //
+
+	// general purpose registers available to random code (rcx is the loop counter, r15 counts taken branches, rsp is the stack)
+	const char *const RegNames[][4] =
+	{
+		{ "al", "ax", "eax", "rax" }, { "bl", "bx", "ebx", "rbx" }, { "dl", "dx", "edx", "rdx" },
+		{ "sil", "si", "esi", "rsi" }, { "dil", "di", "edi", "rdi" }, { "bpl", "bp", "ebp", "rbp" },
+		{ "r8b", "r8w", "r8d", "r8" }, { "r9b", "r9w", "r9d", "r9" }, { "r10b", "r10w", "r10d", "r10" },
+		{ "r11b", "r11w", "r11d", "r11" }, { "r12b", "r12w", "r12d", "r12" }, { "r13b", "r13w", "r13d", "r13" },
+		{ "r14b", "r14w", "r14d", "r14" },
+	};
+	const char *const HighRegNames[] = { "ah", "bh", "dh" };
+	const char *const SizeNames[] = { "byte", "word", "dword", "qword" };
+
+	const char *const BinaryOps[] = { "mov", "add", "adc", "sub", "and", "or", "xor", "cmp", "test" };
+	const char *const UnaryOps[] = { "inc", "dec", "not", "neg" };
+	const char *const ShiftOps[] = { "shl", "shr", "sar", "rcl", "rcr" };
+	const char *const Conditions[] = { "z", "nz", "s", "ns", "p", "np", "o", "no", "c", "nc", "b", "be", "a", "ae", "l", "le", "g", "ge" };
+	const char *const MovConditions[] = { "z", "nz", "ns", "p", "np", "o", "no", "c", "nc", "b", "be", "ae", "l", "le", "g", "ge" }; // movs is the string op
+	const char *const LoopOps[] = { "loop", "loope", "loopne" };
+	const char *const StringSuffixes[] = { "b", "w", "d", "q" };
+
+	constexpr u64 BufSize = 64;  // size of the random code's data buffer
+	constexpr u64 LogSize = 256; // number of RFLAGS log slots
+
+	class ProgramGen
+	{
+	private:
+		std::mt19937_64 rng;
+		std::ostringstream out;
+		int label = 0;
+		int log = 0;
+		int pushes = 0;
+
+		u64 rand(u64 n) { return rng() % n; }
+
+		// values near the boundaries that produce every combination of carry, overflow, zero and sign
+		u64 value(u64 sizecode)
+		{
+			const u64 bits = 8 << sizecode, mask = ~(u64)0 >> (64 - bits), sign = (u64)1 << (bits - 1);
+			u64 v;
+			switch (rand(10))
+			{
+			case 0: v = 0; break;
+			case 1: v = 1; break;
+			case 2: v = mask; break;
+			case 3: v = sign; break;
+			case 4: v = sign - 1; break;
+			case 5: v = sign + 1; break;
+			case 6: v = mask - 1; break;
+			case 7: v = rand(16); break;
+			default: v = rng(); break;
+			}
+			return v & mask;
+		}
+
+		std::string reg(u64 sizecode)
+		{
+			if (sizecode == 0 && rand(8) == 0) return HighRegNames[rand(std::size(HighRegNames))];
+			return RegNames[rand(std::size(RegNames))][sizecode];
+		}
+		std::string mem(u64 sizecode)
+		{
+			// either the data buffer or the unused stack space (a register-relative address)
+			if (rand(4) == 0) return std::string(SizeNames[sizecode]) + " ptr [rsp - " + std::to_string(rand(BufSize - (1 << sizecode) + 1) + (1 << sizecode)) + "]";
+			return std::string(SizeNames[sizecode]) + " ptr [buf + " + std::to_string(rand(BufSize - (1 << sizecode) + 1)) + "]";
+		}
+		std::string imm(u64 sizecode) { return std::to_string(value(sizecode)); }
+
+		void binary()
+		{
+			const char *op = BinaryOps[rand(std::size(BinaryOps))];
+			u64 sizecode = rand(4);
+			std::string a, b;
+			switch (rand(5))
+			{
+			case 0: a = reg(sizecode); b = reg(sizecode); break;
+			case 1: a = reg(sizecode); b = imm(sizecode); break;
+			case 2: a = mem(sizecode); b = reg(sizecode); break;
+			case 3: a = mem(sizecode); b = imm(sizecode); break;
+			default:
+				// test has no r, m form
+				if (op == std::string("test")) { a = mem(sizecode); b = reg(sizecode); }
+				else { a = reg(sizecode); b = mem(sizecode); }
+				break;
+			}
+			out << "    " << op << ' ' << a << ", " << b << '\n';
+		}
+		void unary()
+		{
+			u64 sizecode = rand(4);
+			out << "    " << UnaryOps[rand(std::size(UnaryOps))] << ' ' << (rand(3) == 0 ? mem(sizecode) : reg(sizecode)) << '\n';
+		}
+		void shift()
+		{
+			// CF is undefined for counts of at least the operand size, and OF for counts other than 1 (the interpreter randomizes them).
+			// so counts stay in range, and larger ones are followed by a compare to define the flags again (rcl and rcr also rotate CF in).
+			u64 sizecode = rand(4);
+			u64 count = rand(2) == 0 ? 1 : rand(8 << sizecode);
+			out << "    " << ShiftOps[rand(std::size(ShiftOps))] << ' ' << (rand(3) == 0 ? mem(sizecode) : reg(sizecode)) << ", " << count << '\n';
+			if (count > 1) out << "    cmp " << reg(sizecode) << ", " << imm(sizecode) << '\n';
+		}
+		void lea()
+		{
+			static const int scales[] = { 1, 2, 4, 8 };
+			out << "    lea " << reg(3) << ", [" << reg(3) << " + " << reg(3) << '*' << scales[rand(4)] << " + " << rand(1000) << "]\n";
+		}
+		void push_pop()
+		{
+			if (pushes > 0 && rand(2) == 0) { out << "    pop " << (rand(3) == 0 ? mem(3) : reg(3)) << '\n'; --pushes; }
+			else { out << "    push " << (rand(3) == 0 ? mem(3) : reg(3)) << '\n'; ++pushes; }
+		}
+		void branch()
+		{
+			int l = label++;
+			out << "    j" << Conditions[rand(std::size(Conditions))] << " .skip" << l << '\n';
+			out << "    add r15, " << l + 1 << '\n';
+			out << ".skip" << l << ":\n";
+		}
+		void setcc()
+		{
+			out << "    set" << Conditions[rand(std::size(Conditions))] << ' ' << (rand(3) == 0 ? mem(0) : reg(0)) << '\n';
+		}
+		void movcc()
+		{
+			u64 sizecode = 1 + rand(3);
+			out << "    mov" << MovConditions[rand(std::size(MovConditions))] << ' ' << reg(sizecode) << ", " << (rand(3) == 0 ? mem(sizecode) : reg(sizecode)) << '\n';
+		}
+		void lahf()
+		{
+			// AF is masked out (see Check)
+			out << "    lahf\n";
+			out << "    and ah, " << 0xef << '\n';
+		}
+		void loop()
+		{
+			// rcx is the outer loop counter, so it's saved around the inner loop
+			int l = label++;
+			out << "    push rcx\n";
+			out << "    mov ecx, " << 1 + rand(6) << '\n';
+			out << ".loop" << l << ":\n";
+			out << "    add r15, rcx\n";
+			binary();
+			out << "    " << LoopOps[rand(std::size(LoopOps))] << " .loop" << l << '\n';
+			out << "    pop rcx\n";
+		}
+		void string_op()
+		{
+			// rsi and rdi point into the data buffer, and rcx (the outer loop counter) is saved around the op.
+			// with a rep prefix, the count is small enough that both strings stay in the buffer (in either direction).
+			const u64 sizecode = rand(4), size = (u64)1 << sizecode;
+			const u64 count = rand(BufSize / 2 / size + 1), bytes = std::max<u64>(count, 1) * size;
+			const bool down = rand(4) == 0;
+
+			out << "    push rcx\n";
+			out << "    mov ecx, " << count << '\n';
+			for (const char *r : { "rsi", "rdi" })
+				out << "    lea " << r << ", [buf + " << rand(BufSize - bytes + 1) + (down ? bytes - size : 0) << "]\n";
+			if (down) out << "    std\n";
+
+			const char *const suffix = StringSuffixes[sizecode];
+			switch (rand(5))
+			{
+			case 0: out << (rand(2) ? "    rep movs" : "    movs") << suffix << '\n'; break;
+			case 1: out << (rand(2) ? "    rep stos" : "    stos") << suffix << '\n'; break;
+			case 2: out << (rand(2) ? "    rep lods" : "    lods") << suffix << '\n'; break;
+			case 3: out << (rand(3) == 0 ? "    cmps" : rand(2) ? "    repe cmps" : "    repne cmps") << suffix << '\n'; break;
+			default: out << (rand(3) == 0 ? "    scas" : rand(2) ? "    repe scas" : "    repne scas") << suffix << '\n'; break;
+			}
+
+			if (down) out << "    cld\n";
+			out << "    pop rcx\n";
+		}
+		void log_flags()
+		{
+			// AF is masked out (see Check)
+			int slot = log++ % LogSize;
+			out << "    pushfq\n";
+			out << "    and qword ptr [rsp], " << ~(u64)0x10 << '\n';
+			out << "    pop qword ptr [flag_log + " << slot * 8 << "]\n";
+		}
+
+	public:
+		explicit ProgramGen(u64 seed) : rng(seed) {}
+
+		std::string generate(int ops, int iterations)
+		{
+			out << "global main\nsegment .text\nmain:\n";
+			for (std::size_t i = 0; i < std::size(RegNames); ++i) out << "    mov " << RegNames[i][3] << ", " << value(3) << '\n';
+			out << "    xor r15, r15\n";
+			out << "    mov ecx, " << iterations << '\n';
+			out << ".top:\n";
+
+			for (int i = 0; i < ops; ++i)
+			{
+				switch (rand(22))
+				{
+				case 0: case 1: case 2: case 3: case 4: case 5: binary(); break;
+				case 6: case 7: unary(); break;
+				case 8: case 9: shift(); break;
+				case 10: lea(); break;
+				case 11: push_pop(); break;
+				case 12: case 13: branch(); break;
+				case 14: setcc(); break;
+				case 15: movcc(); break;
+				case 16: lahf(); break;
+				case 17: loop(); break;
+				case 18: string_op(); break;
+				default: log_flags(); break;
+				}
+			}
+			for (; pushes > 0; --pushes) out << "    pop " << reg(3) << '\n';
+
+			out << "    dec ecx\n";
+			out << "    jnz .top\n";
+			out << "    ret\n";
+
+			out << "segment .data\nbuf:\n";
+			for (u64 i = 0; i < BufSize / 8; ++i) out << "    dq " << value(3) << '\n';
+			out << "segment .bss\nflag_log: resq " << LogSize << '\n';
+
+			return out.str();
+		}
+	};
+
+	// -- side exits -- //
+
+	// reads that cross the end of memory part way through (pos < size but pos + size > size)
+	const char *const ReadPastEnd = R"(
+global main
+segment .text
+main:
+    mov eax, sys_brk
+    xor ebx, ebx
+    syscall
+    lea rdi, [rax - 316]
+    mov ecx, 100
+    xor rax, rax
+.top:
+    add rax, qword ptr [rdi]
+    add rdi, 8
+    dec ecx
+    jnz .top
+    ret
+)";
+
+	// reads that start past the end of memory
+	const char *const ReadAtEnd = R"(
+global main
+segment .text
+main:
+    mov eax, sys_brk
+    xor ebx, ebx
+    syscall
+    lea rdi, [rax - 480]
+    mov ecx, 100
+    xor rax, rax
+.top:
+    add eax, dword ptr [rdi]
+    add rdi, 16
+    dec ecx
+    jnz .top
+    ret
+)";
+
+	// a hot store loop whose target moves into the readonly segment (the store block is already compiled when it does)
+	const char *const WriteReadonly = R"(
+global main
+segment .text
+main:
+    lea rdi, [buf]
+    mov ecx, 40
+.top:
+    cmp ecx, 10
+    jne .store
+    lea rdi, [ro]
+    jmp .store
+.store:
+    mov qword ptr [rdi], rcx
+    inc word ptr [rdi + 8]
+    dec ecx
+    jnz .top
+    ret
+segment .rodata
+ro: dq 1, 2
+segment .data
+buf: dq 0, 0
+)";
+
+	// a hot store loop whose target moves into the text segment (the store block is already compiled when it does)
+	const char *const WriteText = R"(
+global main
+segment .text
+main:
+    lea rdi, [buf]
+    mov ecx, 40
+.top:
+    cmp ecx, 10
+    jne .store
+    lea rdi, [main]
+    jmp .store
+.store:
+    add byte ptr [rdi], cl
+    dec ecx
+    jnz .top
+    ret
+segment .data
+buf: dq 0
+)";
+
+	// pushes until the stack overflows
+	const char *const PushOverflow = R"(
+global main
+segment .text
+main:
+    xor rax, rax
+.top:
+    inc rax
+    push rax
+    jmp .top
+)";
+
+	// pops until the stack pointer runs off the end of memory
+	const char *const PopUnderflow = R"(
+global main
+segment .text
+main:
+    xor rbx, rbx
+.top:
+    pop rax
+    add rbx, rax
+    jmp .top
+)";
+
+	// grows memory with sys_brk between runs of a hot loop (the memory array moves, so native code must see the new one).
+	// then shrinks it back so the same hot loop runs off the end.
+	const char *const BrkGrowth = R"(
+global main
+segment .text
+main:
+    mov eax, sys_brk
+    xor ebx, ebx
+    syscall
+    mov r12, rax
+    mov r14, rax
+    mov r13d, 40
+.grow:
+    lea rbx, [r12 + 65536]
+    mov eax, sys_brk
+    syscall
+    or r15, rax
+    lea r12, [r12 + 65536]
+    call touch
+    dec r13d
+    jnz .grow
+
+    mov eax, sys_brk
+    mov rbx, r14
+    syscall
+    call touch
+    ret
+
+touch:
+    lea rdi, [r12 - 8]
+    mov ecx, 20
+.top:
+    mov qword ptr [rdi], rcx
+    add r11, qword ptr [rdi]
+    sub qword ptr [rdi], r13
+    sub rdi, 8
+    dec ecx
+    jnz .top
+    ret
+)";
+}
+
+int main()
+{
+	// the syscall codes used by the programs (see AddPredefines in driver.cpp)
+	DefineSymbol("sys_exit", (u64)SyscallCode::sys_exit);
+	DefineSymbol("sys_brk", (u64)SyscallCode::sys_brk);
+
+	int failures = 0;
+
+	for (u64 seed = 0; seed < 200; ++seed)
+	{
+		ProgramGen gen(seed);
+		if (!Check("random alu " + std::to_string(seed), gen.generate(48, 40), ErrorCode::None)) ++failures;
+	}
+
+	if (!Check("read past end", ReadPastEnd, ErrorCode::OutOfBounds)) ++failures;
+	if (!Check("read at end", ReadAtEnd, ErrorCode::OutOfBounds)) ++failures;
+	if (!Check("write readonly", WriteReadonly, ErrorCode::AccessViolation)) ++failures;
+	if (!Check("write text", WriteText, ErrorCode::AccessViolation)) ++failures;
+	if (!Check("push overflow", PushOverflow, ErrorCode::StackOverflow)) ++failures;
+	if (!Check("pop underflow", PopUnderflow, ErrorCode::OutOfBounds)) ++failures;
+
+	Options grow;
+	grow.grow_max = (u64)1024 * 1024 * 1024;
+	if (!Check("brk growth", BrkGrowth, ErrorCode::OutOfBounds, grow)) ++failures;
+
+	if (failures) { std::cerr << failures << " failed\n"; return 1; }
+	std::cout << "all engines agree\n";
+	return 0;
+}
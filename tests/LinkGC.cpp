@@ -0,0 +1,259 @@
+// tests of linking with gc (see Link) - which segments are dropped and which are kept.
+// every program is linked with and without gc. both must run to the same return value, and gc must drop exactly the unreachable segments.
+// a segment is observed through the labels it defines (the symbol map only has the labels of the segments that were kept).
+
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <list>
+#include <utility>
+
+#include "../include/Computer.h"
+#include "../include/Assembly.h"
+#include "../include/SymbolMap.h"
+
+using namespace CSX64;
+
+namespace
+{
+	// the _start file - calls main and exits with its return value
+	const char *const StartSource = R"(
+extern _start
+segment .text
+    call _start
+    mov ebx, eax
+    mov eax, sys_exit
+    syscall
+)";
+
+	// assembles and links a program (the first source must define a global main). returns true on success.
+	bool Build(const std::vector<std::string> &sources, bool gc, Executable &exe, SymbolMap &symbols)
+	{
+		std::list<std::pair<std::string, ObjectFile>> objs;
+		objs.emplace_back("_start", ObjectFile());
+		for (std::size_t i = 0; i <= sources.size(); ++i)
+		{
+			if (i > 0) objs.emplace_back("file " + std::to_string(i), ObjectFile());
+			std::istringstream in(i > 0 ? sources[i - 1] : std::string(StartSource));
+			AssembleResult res = Assemble(in, objs.back().second);
+			if (res.Error != AssembleError::None) { std::cerr << "assemble error: " << res.ErrorMsg << '\n'; return false; }
+		}
+
+		LinkResult res = Link(exe, objs, "main", &symbols, 1, gc);
+		if (res.Error != LinkError::None) { std::cerr << "link error: " << res.ErrorMsg << '\n'; return false; }
+		return true;
+	}
+
+	// runs an executable to completion - returns its return value (or -1 if it failed)
+	int Run(const Executable &exe)
+	{
+		Computer c;
+		c.Initialize(exe, {});
+		for (int i = 0; c.Running() && i < 1000; ++i) c.Tick(1024 * 1024);
+		return c.Running() || c.Error() != ErrorCode::None ? -1 : c.ReturnValue();
+	}
+
+	bool HasLabel(const SymbolMap &symbols, const std::string &name)
+	{
+		for (const SymbolMap::Symbol &symbol : symbols.all_symbols()) if (symbol.name == name) return true;
+		return false;
+	}
+
+	// links the program with and without gc and checks the return value of each, and which labels gc kept and dropped.
+	// without gc, every label of an included file is kept (dropped labels in files that aren't included at all are marked excluded).
+	bool Check(const std::string &name, const std::vector<std::string> &sources, int expected,
+		const std::vector<std::string> &kept, const std::vector<std::string> &dropped, const std::vector<std::string> &excluded = {})
+	{
+		bool ok = true;
+		auto fail = [&](const std::string &msg) { std::cerr << name << ": " << msg << '\n'; ok = false; };
+
+		u64 sizes[2];
+		for (bool gc : { false, true })
+		{
+			const std::string what = gc ? " (gc)" : "";
+
+			Executable exe;
+			SymbolMap symbols;
+			if (!Build(sources, gc, exe, symbols)) { fail("failed to build" + what); continue; }
+			sizes[gc] = exe.total_size();
+
+			int ret = Run(exe);
+			if (ret != expected) fail("returned " + std::to_string(ret) + " instead of " + std::to_string(expected) + what);
+
+			for (const std::string &label : kept)
+				if (!HasLabel(symbols, label)) fail("label " + label + " was dropped" + what);
+			for (const std::string &label : dropped)
+				if (HasLabel(symbols, label) == gc) fail("label " + label + (gc ? " was kept" : " was dropped") + what);
+			for (const std::string &label : excluded)
+				if (HasLabel(symbols, label)) fail("label " + label + " was included" + what);
+		}
+		if (ok && !dropped.empty() && sizes[1] >= sizes[0]) fail("gc didn't shrink the executable");
+
+		return ok;
+	}
+
+	// -- programs -- //
+
+	// a file that's only used for a constant global keeps none of its segments
+	const std::vector<std::string> ConstantGlobal =
+	{
+		R"(
+global main
+extern K
+segment .text
+main:
+    mov eax, K
+    ret
+)",
+		R"(
+global K
+K: equ 1234
+segment .text
+lib_func:
+    mov eax, 1
+    ret
+segment .rodata
+lib_ro: dq 7
+segment .data
+lib_data: dq 8
+segment .bss
+lib_bss: resq 4
+)",
+	};
+
+	// functions that are only reached through a table of pointers in another file's data
+	const std::vector<std::string> FunctionTable =
+	{
+		R"(
+global main
+extern table
+segment .text
+main:
+    mov rax, qword ptr [table + 8]
+    call rax
+    ret
+)",
+		R"(
+global table
+extern f1
+extern f2
+segment .text
+table_unused:
+    ret
+segment .data
+table: dq f1, f2
+)",
+		R"(
+global f1
+global f2
+segment .text
+f1:
+    mov eax, 11
+    ret
+f2:
+    mov eax, 22
+    ret
+segment .rodata
+funcs_ro: dq 1
+)",
+	};
+
+	// a segment that's only reached through a chain of externals: main's text -> a's data -> b's text -> c's text
+	const std::vector<std::string> ExternalChain =
+	{
+		R"(
+global main
+extern a_ptr
+segment .text
+main:
+    mov rax, qword ptr [a_ptr]
+    call rax
+    ret
+)",
+		R"(
+global a_ptr
+extern b
+segment .text
+a_unused:
+    ret
+segment .data
+a_ptr: dq b
+)",
+		R"(
+global b
+extern c
+segment .text
+b:
+    call c
+    add eax, 1
+    ret
+segment .data
+b_unused: dq 0
+)",
+		R"(
+global c
+segment .text
+c:
+    mov eax, 40
+    ret
+segment .bss
+c_unused: resq 1
+)",
+		R"(
+global d
+segment .text
+d:
+    ret
+)",
+	};
+
+	// binary literals are merged into the executable's rodata whether or not the segments that use them are kept
+	const std::vector<std::string> BinaryLiterals =
+	{
+		R"(
+global main
+extern get_msg
+extern N
+segment .text
+main:
+    call get_msg
+    movzx eax, byte ptr [rax + N]
+    ret
+)",
+		R"(
+global get_msg
+segment .text
+get_msg:
+    lea rax, [$str("hello")]
+    ret
+segment .data
+lit_unused: dq $bin(1, 2, 3)
+)",
+		R"(
+global N
+N: equ 2
+segment .text
+lit2_unused:
+    lea rax, [$str("world")]
+    ret
+)",
+	};
+}
+
+int main()
+{
+	// the syscall codes used by the programs (see AddPredefines in driver.cpp)
+	DefineSymbol("sys_exit", (u64)SyscallCode::sys_exit);
+
+	int failures = 0;
+
+	if (!Check("constant global", ConstantGlobal, 1234, { "main" }, { "lib_func", "lib_ro", "lib_data", "lib_bss" })) ++failures;
+	if (!Check("function table", FunctionTable, 22, { "main", "table", "f1", "f2" }, { "table_unused", "funcs_ro" })) ++failures;
+	if (!Check("external chain", ExternalChain, 41, { "main", "a_ptr", "b", "c" }, { "a_unused", "b_unused", "c_unused" }, { "d" })) ++failures;
+	if (!Check("binary literals", BinaryLiterals, 'l', { "main", "get_msg" }, { "lit_unused", "lit2_unused" })) ++failures;
+
+	if (failures) { std::cerr << failures << " failed\n"; return 1; }
+	std::cout << "all gc links agree\n";
+	return 0;
+}
@@ -0,0 +1,297 @@
+// tests of multiplexing sessions over worker threads (see Scheduler) fed by ChannelFileWrapper.
+// several sessions read their stdin until eof and return the sum of the bytes. they park while they have no input,
+// and another thread pushes their input in pieces. every session must finish with the right sum, and the scheduler's
+// idle state, finished state, tick counts, and Remove must agree with what the sessions did.
+// a Wake that arrives while a session is still running (after it found no input) must not be lost.
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+#include <list>
+#include <utility>
+#include <memory>
+#include <thread>
+#include <chrono>
+#include <future>
+#include <algorithm>
+
+#include "../include/Scheduler.h"
+#include "../include/Assembly.h"
+
+using namespace CSX64;
+
+namespace
+{
+	// the _start file - calls main and exits with its return value
+	const char *const StartSource = R"(
+extern _start
+segment .text
+    call _start
+    mov ebx, eax
+    mov eax, sys_exit
+    syscall
+)";
+
+	// reads stdin until eof and returns the sum of the bytes
+	const char *const SumSource = R"(
+global main
+segment .text
+main:
+    xor edi, edi
+.read:
+    mov eax, sys_read
+    xor ebx, ebx
+    lea rcx, [buf]
+    mov edx, 16
+    syscall
+    cmp rax, 0
+    jle .done
+    xor esi, esi
+.add:
+    movzx ebx, byte ptr [buf + rsi]
+    add edi, ebx
+    inc rsi
+    cmp rsi, rax
+    jb .add
+    jmp .read
+.done:
+    mov eax, edi
+    ret
+segment .bss
+buf: resb 16
+)";
+
+	// runs for a while without input
+	const char *const SpinSource = R"(
+global main
+segment .text
+main:
+    mov ecx, 1000000
+.top:
+    dec ecx
+    jnz .top
+    mov eax, 7
+    ret
+)";
+
+	const u64 Quantum = 1000;
+
+	// assembles and links a program. returns true on success.
+	bool Build(const char *source, Executable &exe)
+	{
+		std::list<std::pair<std::string, ObjectFile>> objs;
+		for (const char *code : { StartSource, source })
+		{
+			std::istringstream in(code);
+			objs.emplace_back(objs.empty() ? "_start" : "main", ObjectFile());
+			AssembleResult res = Assemble(in, objs.back().second);
+			if (res.Error != AssembleError::None) { std::cerr << "assemble error: " << res.ErrorMsg << '\n'; return false; }
+		}
+
+		LinkResult res = Link(exe, objs);
+		if (res.Error != LinkError::None) { std::cerr << "link error: " << res.ErrorMsg << '\n'; return false; }
+		return true;
+	}
+
+	// a channel that receives each piece of its input just after the guest finds it empty - i.e. while the session is still running.
+	// once it's all been read, it closes (so that read returns eof).
+	class LateChannel : public ChannelFileWrapper
+	{
+		std::vector<u8> data;
+		std::size_t pos = 0;
+		bool done = false;
+
+	public:
+		explicit LateChannel(std::vector<u8> _data) : data(std::move(_data)) {}
+
+		virtual i64 Read(void *buf, i64 cap) override
+		{
+			const i64 n = ChannelFileWrapper::Read(buf, cap);
+			if (n == 0 && !done)
+			{
+				const std::size_t len = std::min<std::size_t>(data.size() - pos, 3);
+				if (len != 0) Push(data.data() + pos, len);
+				else { Close(); done = true; }
+				pos += len;
+			}
+			return n;
+		}
+	};
+
+	// a session reading from a channel
+	struct Reader
+	{
+		Scheduler::SessionID id;
+		ChannelFileWrapper *channel; // owned by the session's computer
+		std::vector<u8> input;
+		int sum = 0;
+	};
+
+	// creates a computer running exe with the channel as stdin and adds it to the scheduler (waking the session when data arrives)
+	Scheduler::SessionID AddSession(Scheduler &sched, const Executable &exe, std::unique_ptr<ChannelFileWrapper> channel)
+	{
+		auto c = std::make_unique<Computer>();
+		c->Initialize(exe, {});
+
+		// the session id isn't known until Add returns, but the session can get data (see LateChannel) as soon as it starts running - so waking waits for it
+		std::promise<Scheduler::SessionID> id;
+		std::shared_future<Scheduler::SessionID> future_id = id.get_future().share();
+		channel->OnData([&sched, future_id] { sched.Wake(future_id.get()); });
+		c->OpenFileWrapper(0, std::move(channel));
+
+		const Scheduler::SessionID res = sched.Add(std::move(c));
+		id.set_value(res);
+		return res;
+	}
+
+	// counts the ticks it takes to run exe to completion on its own
+	u64 DirectTicks(const Executable &exe)
+	{
+		Computer c;
+		c.Initialize(exe, {});
+		u64 ticks = 0;
+		for (int i = 0; c.Running() && i < 1000; ++i) ticks += c.Tick(1024 * 1024);
+		return ticks;
+	}
+
+	int Run(const Executable &sum_exe, const Executable &spin_exe, unsigned threads, u64 seed)
+	{
+		int failures = 0;
+		const std::string what = std::to_string(threads) + " threads, seed " + std::to_string(seed);
+		auto fail = [&](const std::string &msg) { std::cerr << what << ": " << msg << '\n'; ++failures; };
+
+		std::mt19937_64 rng(seed);
+		Scheduler sched(threads, Quantum);
+
+		// -- parking -- //
+
+		std::vector<Reader> readers(6);
+		for (Reader &r : readers)
+		{
+			r.input.resize(rng() % 300);
+			for (u8 &ch : r.input) { ch = (u8)rng(); r.sum += ch; }
+
+			auto channel = std::make_unique<ChannelFileWrapper>();
+			r.channel = channel.get();
+			r.id = AddSession(sched, sum_exe, std::move(channel));
+		}
+
+		// with no input they all park
+		sched.WaitIdle();
+		Scheduler::Stats stats = sched.Statistics();
+		if (stats.sessions != readers.size() || stats.parked != readers.size() || stats.runnable != 0 || stats.finished != 0)
+			fail("expected every session to be parked: " + std::to_string(stats.parked) + " parked, " + std::to_string(stats.runnable) + " runnable, " + std::to_string(stats.finished) + " finished");
+
+		u64 ticks = 0;
+		for (const Reader &r : readers)
+		{
+			const Scheduler::SessionStats s = sched.SessionStatistics(r.id);
+			if (sched.Finished(r.id)) fail("session " + std::to_string(r.id) + " finished without input");
+			if (s.parks != 1 || s.ticks == 0 || s.slices < s.parks) fail("session " + std::to_string(r.id) + " has bad stats after parking");
+			ticks += s.ticks;
+		}
+		if (ticks != stats.ticks) fail("session ticks " + std::to_string(ticks) + " don't add up to " + std::to_string(stats.ticks));
+
+		// a parked session can be removed (and waking it afterwards does nothing)
+		const Reader removed = readers.back();
+		readers.pop_back();
+		const u64 removed_ticks = sched.SessionStatistics(removed.id).ticks;
+		std::unique_ptr<Computer> removed_computer = sched.Remove(removed.id);
+		if (!removed_computer || !removed_computer->SuspendedRead()) fail("failed to remove a parked session");
+		if (sched.Remove(removed.id)) fail("removed a session twice");
+		removed.channel->Push("x", 1);
+		if (sched.Statistics().sessions != readers.size() || sched.SessionStatistics(removed.id).ticks != 0) fail("removed session is still there");
+
+		// -- input from another thread -- //
+
+		// a session that's running can't be removed
+		auto spin_computer = std::make_unique<Computer>();
+		spin_computer->Initialize(spin_exe, {});
+		const Scheduler::SessionID spinner = sched.Add(std::move(spin_computer));
+		if (sched.Remove(spinner)) fail("removed a runnable session");
+
+		// a session that gets its input while it's still running
+		Reader late;
+		late.input = { 1, 2, 3, 200, 50, 9, 77 };
+		late.sum = 342;
+		late.id = AddSession(sched, sum_exe, std::make_unique<LateChannel>(late.input));
+
+		std::thread producer([&readers, seed]
+		{
+			std::mt19937_64 rng(seed * 31 + 7);
+			std::vector<std::size_t> pos(readers.size());
+			for (bool more = true; more; )
+			{
+				more = false;
+				for (std::size_t i = 0; i < readers.size(); ++i)
+				{
+					const std::vector<u8> &input = readers[i].input;
+					const std::size_t len = std::min<std::size_t>(input.size() - pos[i], rng() % 40);
+					if (len != 0) readers[i].channel->Push(input.data() + pos[i], len);
+					pos[i] += len;
+					if (pos[i] < input.size()) more = true;
+				}
+				// sometimes give the sessions time to drain the channels and park again
+				if (rng() % 2) std::this_thread::sleep_for(std::chrono::microseconds(rng() % 200));
+			}
+			for (const Reader &r : readers) r.channel->Close();
+		});
+		producer.join();
+
+		sched.WaitIdle();
+		stats = sched.Statistics();
+		if (stats.finished != readers.size() + 2 || stats.runnable != 0 || stats.parked != 0)
+			fail("expected every session to finish: " + std::to_string(stats.parked) + " parked, " + std::to_string(stats.runnable) + " runnable, " + std::to_string(stats.finished) + " finished");
+
+		ticks = removed_ticks;
+		readers.push_back(late);
+		for (const Reader &r : readers)
+		{
+			const Scheduler::SessionStats s = sched.SessionStatistics(r.id);
+			ticks += s.ticks;
+			if (!sched.Finished(r.id)) { fail("session " + std::to_string(r.id) + " didn't finish"); continue; }
+
+			std::unique_ptr<Computer> c = sched.Remove(r.id);
+			if (!c) { fail("failed to remove finished session " + std::to_string(r.id)); continue; }
+			if (c->Error() != ErrorCode::None || c->ReturnValue() != r.sum)
+				fail("session " + std::to_string(r.id) + " returned " + std::to_string(c->ReturnValue()) + " (error " + std::to_string((int)c->Error()) + ") instead of " + std::to_string(r.sum));
+		}
+		if (sched.SessionStatistics(late.id).parks != 0) fail("the session woken while running was parked");
+
+		// the spinner never waits for input, so it runs exactly as it would on its own (in slices of at most a quantum)
+		const Scheduler::SessionStats spin = sched.SessionStatistics(spinner);
+		ticks += spin.ticks;
+		const u64 direct = DirectTicks(spin_exe);
+		if (spin.ticks != direct) fail("spinner took " + std::to_string(spin.ticks) + " ticks instead of " + std::to_string(direct));
+		if (spin.parks != 0 || spin.slices < (direct + Quantum - 1) / Quantum) fail("spinner has bad stats");
+		if (ticks != sched.Statistics().ticks) fail("session ticks " + std::to_string(ticks) + " don't add up to " + std::to_string(sched.Statistics().ticks));
+
+		std::unique_ptr<Computer> c = sched.Remove(spinner);
+		if (!c || c->ReturnValue() != 7) fail("spinner didn't return 7");
+		if (sched.Finished(spinner) || sched.Statistics().sessions != 0) fail("sessions left after removing them all");
+
+		return failures;
+	}
+}
+
+int main()
+{
+	// the syscall codes used by the programs (see AddPredefines in driver.cpp)
+	DefineSymbol("sys_read", (u64)SyscallCode::sys_read);
+	DefineSymbol("sys_exit", (u64)SyscallCode::sys_exit);
+
+	Executable sum_exe, spin_exe;
+	if (!Build(SumSource, sum_exe) || !Build(SpinSource, spin_exe)) return 1;
+
+	int failures = 0;
+
+	for (unsigned threads : { 1, 2, 4 })
+		for (u64 seed = 0; seed < 10; ++seed)
+			failures += Run(sum_exe, spin_exe, threads, seed);
+
+	if (failures) { std::cerr << failures << " failed\n"; return 1; }
+	std::cout << "all sessions agree\n";
+	return 0;
+}
@@ -0,0 +1,187 @@
+// tests of the execution trace ring buffer (see Tracer).
+// random instruction and effective address records are written to a small trace and checked against the list of everything recorded:
+// the decoded trace must be exactly the most recent records, including after the ring has wrapped around many times,
+// and including address records that were split from their instruction by a block boundary.
+// saved traces must load back to the same blocks, and corrupted ones must be rejected.
+
+#include <iostream>
+#include <sstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../include/Tracer.h"
+#include "../include/Utility.h"
+#include "../include/csx_exceptions.h"
+
+using namespace CSX64;
+
+namespace
+{
+	// the number of blocks in the traces under test
+	const u64 BlockCount = 3;
+
+	// records random entries to the trace (and appends them to the list of everything recorded)
+	void Record(Tracer &t, std::vector<Tracer::Entry> &recorded, std::mt19937_64 &rng, std::size_t count)
+	{
+		u64 rip = rng() % 0x10000, address = rng();
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			// mostly sequential code, with the occasional jump (including far and backwards ones)
+			switch (rng() % 8)
+			{
+			case 0: rip += rng() % 2000 - 1000; break;
+			case 1: rip = rng(); break;
+			default: rip += 1 + rng() % 12; break;
+			}
+			Tracer::Entry e{ rip, (u8)rng(), {} };
+
+			// up to a few memory operands, each either near the previous one or anywhere
+			for (u64 n = rng() % 5; n > 0; --n)
+			{
+				address = rng() % 2 ? address + rng() % 64 - 32 : rng();
+				e.addresses.push_back(address);
+			}
+
+			t.Instruction(e.rip, e.op);
+			for (u64 a : e.addresses) t.Address(a);
+			recorded.push_back(std::move(e));
+		}
+	}
+
+	bool Equal(const Tracer::Entry &a, const Tracer::Entry &b)
+	{
+		return a.rip == b.rip && a.op == b.op && a.addresses == b.addresses;
+	}
+
+	// checks that the entries are exactly the last entries that were recorded
+	bool CheckTail(const std::vector<Tracer::Entry> &recorded, const std::vector<Tracer::Entry> &entries, const std::string &what)
+	{
+		if (entries.size() > recorded.size()) { std::cerr << what << ": decoded " << entries.size() << " entries but only " << recorded.size() << " were recorded\n"; return false; }
+
+		const std::size_t offset = recorded.size() - entries.size();
+		for (std::size_t i = 0; i < entries.size(); ++i)
+			if (!Equal(recorded[offset + i], entries[i])) { std::cerr << what << ": entry " << i << " of " << entries.size() << " doesn't match\n"; return false; }
+
+		return true;
+	}
+
+	// records a trace, then checks its decoded content and that it survives saving and loading.
+	// returns true if an address record was split from its instruction by a block boundary (in the blocks still present).
+	bool Check(std::mt19937_64 &rng, std::size_t count, int &failures, const std::string &what)
+	{
+		Tracer t(BlockCount * Tracer::BlockSize);
+		std::vector<Tracer::Entry> recorded;
+		Record(t, recorded, rng, count);
+
+		const Tracer::Blocks blocks = t.Snapshot();
+		const std::vector<Tracer::Entry> entries = Tracer::Decode(blocks);
+		if (!CheckTail(recorded, entries, what)) ++failures;
+
+		bool split = false;
+		u64 bytes = 0;
+		for (std::size_t i = 0; i < blocks.size(); ++i)
+		{
+			if (blocks[i].size() > Tracer::BlockSize) { std::cerr << what << ": block " << i << " is too long\n"; ++failures; }
+			if (i > 0 && !blocks[i].empty() && (blocks[i][0] & 3) == 2) split = true;
+			bytes += blocks[i].size();
+		}
+
+		// before wrapping around nothing is lost, and after it every block is present (so the tail is at least the size of all but one block)
+		if (blocks.size() > BlockCount) { std::cerr << what << ": " << blocks.size() << " blocks\n"; ++failures; }
+		if (blocks.size() < BlockCount && entries.size() != recorded.size()) { std::cerr << what << ": lost entries before wrapping around\n"; ++failures; }
+		if (blocks.size() == BlockCount && bytes < (BlockCount - 1) * (Tracer::BlockSize - Tracer::MaxRecordSize)) { std::cerr << what << ": only " << bytes << " bytes were kept\n"; ++failures; }
+
+		// save and load
+		std::stringstream buf;
+		t.Save(buf);
+		const Tracer::Blocks loaded = Tracer::Load(buf);
+		if (loaded != blocks) { std::cerr << what << ": loaded blocks don't match\n"; ++failures; }
+		else if (!CheckTail(recorded, Tracer::Decode(loaded), what + " (loaded)")) ++failures;
+
+		// clearing starts over
+		t.Clear();
+		if (!t.Entries().empty()) { std::cerr << what << ": entries after clear\n"; ++failures; }
+		recorded.clear();
+		Record(t, recorded, rng, 10);
+		if (!CheckTail(recorded, t.Entries(), what + " (cleared)") || t.Entries().size() != recorded.size()) ++failures;
+
+		return split;
+	}
+
+	// checks that loading or decoding a corrupted trace throws the expected exception type
+	template<typename E, typename F>
+	bool ExpectThrow(F f, const std::string &what)
+	{
+		try { f(); }
+		catch (const E&) { return true; }
+		catch (const std::exception &ex) { std::cerr << what << ": threw the wrong exception: " << ex.what() << '\n'; return false; }
+		std::cerr << what << ": didn't throw\n";
+		return false;
+	}
+
+	int Corruption()
+	{
+		int failures = 0;
+
+		std::mt19937_64 rng(1234);
+		Tracer t(BlockCount * Tracer::BlockSize);
+		std::vector<Tracer::Entry> recorded;
+		Record(t, recorded, rng, 5000);
+
+		std::stringstream buf;
+		t.Save(buf);
+		const std::string saved = buf.str();
+
+		auto load = [](const std::string &str) { return [str] { std::istringstream in(str); Tracer::Load(in); }; };
+
+		// truncated anywhere
+		for (std::size_t len : { (std::size_t)0, (std::size_t)5, (std::size_t)12, (std::size_t)20, (std::size_t)28, (std::size_t)100, saved.size() - 1 })
+			if (!ExpectThrow<FormatError>(load(saved.substr(0, len)), "truncated to " + std::to_string(len) + " bytes")) ++failures;
+
+		// not a trace
+		{
+			std::string bad = saved;
+			bad[5] = 'x';
+			if (!ExpectThrow<TypeError>(load(bad), "bad header")) ++failures;
+		}
+		// a block longer than the buffer's blocks (header, version, block count, then the first block's length)
+		{
+			std::string bad = saved;
+			std::ostringstream len;
+			BinWrite(len, Tracer::BlockSize + 1);
+			bad.replace(24, 8, len.str());
+			if (!ExpectThrow<FormatError>(load(bad), "block too long")) ++failures;
+		}
+
+		// records cut off part way through (a varint and an opcode), and an invalid record kind
+		for (const std::vector<u8> &b : { std::vector<u8>{ 0x85 }, std::vector<u8>{ 0x85, 0x80 }, std::vector<u8>{ 0x05 }, std::vector<u8>{ 0x04, 0x00 }, std::vector<u8>{ 0x07 } })
+			if (!ExpectThrow<FormatError>([&] { Tracer::Decode({ b }); }, "bad record " + std::to_string(b[0]))) ++failures;
+
+		return failures;
+	}
+}
+
+int main()
+{
+	int failures = 0;
+	bool split = false;
+
+	for (u64 seed = 0; seed < 200; ++seed)
+	{
+		std::mt19937_64 rng(seed);
+		const std::string what = "seed " + std::to_string(seed);
+
+		// within the first block, part way through the ring, and wrapped around many times
+		Check(rng, 1 + rng() % 100, failures, what + " (one block)");
+		Check(rng, 300 + rng() % 200, failures, what + " (partial)");
+		split |= Check(rng, 5000 + rng() % 20000, failures, what + " (wrapped)");
+	}
+	if (!split) { std::cerr << "no address records were split from their instruction\n"; ++failures; }
+
+	failures += Corruption();
+
+	if (failures) { std::cerr << failures << " failed\n"; return 1; }
+	std::cout << "all traces agree\n";
+	return 0;
+}